@@ -28,6 +28,8 @@
 #include "utils_sys.h"
 #include "comm_can.h"
 #include "hw.h"
+#include "input_filter.h"
+#include "mc_latency.h"
 #include <math.h>
 
 // Settings
@@ -65,6 +67,7 @@ static volatile int adc_detached = 0;
 static volatile bool buttons_detached = false;
 static volatile bool rev_override = false;
 static volatile bool cc_override = false;
+static input_filter filter;
 
 void app_adc_configure(adc_config *conf) {
 	if (!buttons_detached && (((conf->buttons >> 0) & 1) || CTRL_USES_BUTTON(conf->ctrl_type))) {
@@ -78,6 +81,10 @@ void app_adc_configure(adc_config *conf) {
 
 	config = *conf;
 	ms_without_power = 0.0;
+
+	input_filter_configure(&filter, config.hyst,
+			config.throttle_exp, config.throttle_exp_brake, config.throttle_exp_mode,
+			config.ramp_time_pos, config.ramp_time_neg);
 }
 
 void app_adc_start(bool use_rx_tx) {
@@ -153,6 +160,7 @@ static THD_FUNCTION(adc_thread, arg) {
 	(void)arg;
 
 	chRegSetThreadName("APP_ADC");
+	mc_latency_set_thread_source(MC_LATENCY_SRC_APP);
 	is_running = true;
 
 	for(;;) {
@@ -346,23 +354,10 @@ static THD_FUNCTION(adc_thread, arg) {
 			break;
 		}
 
-		// Apply deadband
-		utils_deadband(&pwr, config.hyst, 1.0);
-
-		// Apply throttle curve
-		pwr = utils_throttle_curve(pwr, config.throttle_exp, config.throttle_exp_brake, config.throttle_exp_mode);
-
-		// Apply ramping
+		// Apply deadband, throttle curve and ramping
 		static systime_t last_time = 0;
-		static float pwr_ramp = 0.0;
-		float ramp_time = fabsf(pwr) > fabsf(pwr_ramp) ? config.ramp_time_pos : config.ramp_time_neg;
-
-		if (ramp_time > 0.01) {
-			const float ramp_step = (float)ST2MS(chVTTimeElapsedSinceX(last_time)) / (ramp_time * 1000.0);
-			utils_step_towards(&pwr_ramp, pwr, ramp_step);
-			last_time = chVTGetSystemTimeX();
-			pwr = pwr_ramp;
-		}
+		pwr = input_filter_run(&filter, pwr, UTILS_AGE_S(last_time));
+		last_time = chVTGetSystemTimeX();
 
 		float current_rel = 0.0;
 		bool current_mode = false;
@@ -26,8 +26,10 @@
 #include "mc_interface.h"
 #include "timeout.h"
 #include "utils_math.h"
+#include "utils_sys.h"
 #include "comm_can.h"
 #include "hw.h"
+#include "input_filter.h"
 #include <math.h>
 
 // Settings
@@ -54,6 +56,7 @@ static volatile bool primary_output = false;
 static volatile bool stop_now = true;
 static volatile bool is_running = false;
 static volatile float torque_ratio = 0.0;
+static input_filter filter;
 
 /**
  * Configure and initialize PAS application
@@ -73,6 +76,10 @@ void app_pas_configure(pas_config *conf) {
 	min_pedal_period = 1.0 / ((config.pedal_rpm_end * 3.0 / 60.0));
 
 	(config.invert_pedal_direction) ? (direction_conf = -1.0) : (direction_conf = 1.0);
+
+	// Only the ramp is used
+	input_filter_configure(&filter, 0.0, 0.0, 0.0, THR_EXP_POLY,
+			config.ramp_time_pos, config.ramp_time_neg);
 }
 
 /**
@@ -262,17 +269,10 @@ static THD_FUNCTION(pas_thread, arg) {
 
 		// Apply ramping
 		static systime_t last_time = 0;
-		static float output_ramp = 0.0;
-		float ramp_time = fabsf(output) > fabsf(output_ramp) ? config.ramp_time_pos : config.ramp_time_neg;
-
-		if (ramp_time > 0.01) {
-			const float ramp_step = (float)ST2MS(chVTTimeElapsedSinceX(last_time)) / (ramp_time * 1000.0);
-			utils_step_towards(&output_ramp, output, ramp_step);
-			utils_truncate_number(&output_ramp, 0.0, config.current_scaling * sub_scaling);
-
-			last_time = chVTGetSystemTimeX();
-			output = output_ramp;
-		}
+		input_filter_ramp(&filter, output, UTILS_AGE_S(last_time));
+		utils_truncate_number(&filter.ramp, 0.0, config.current_scaling * sub_scaling);
+		output = filter.ramp;
+		last_time = chVTGetSystemTimeX();
 
 		if (output < 0.001) {
 			ms_without_power += (1000.0 * (float)sleep_time) / (float)CH_CFG_ST_FREQUENCY;
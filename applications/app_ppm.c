@@ -28,6 +28,11 @@
 #include "utils_math.h"
 #include "utils_sys.h"
 #include "comm_can.h"
+#include "commands.h"
+#include "terminal.h"
+#include "timer.h"
+#include "input_filter.h"
+#include "mc_latency.h"
 #include <math.h>
 
 // Settings
@@ -42,6 +47,7 @@ static volatile bool ppm_rx = false;
 
 // Private functions
 static void servodec_func(void);
+static void terminal_latency(int argc, const char **argv);
 
 // Private variables
 static volatile bool is_running = false;
@@ -52,6 +58,8 @@ static float input_val = 0.0;
 static volatile float direction_hyst = 0;
 static volatile bool ppm_detached = false;
 static volatile float ppm_override = 0.0;
+static input_filter filter;
+static input_latency latency;
 
 // Private functions
 
@@ -64,11 +72,25 @@ void app_ppm_configure(ppm_config *conf) {
 	}
 
 	direction_hyst = config.max_erpm_for_dir * 0.20;
+
+	input_filter_configure(&filter, config.hyst,
+			config.throttle_exp, config.throttle_exp_brake, config.throttle_exp_mode,
+			config.ramp_time_pos, config.ramp_time_neg);
 }
 
 void app_ppm_start(void) {
 	stop_now = false;
-	chThdCreateStatic(ppm_thread_wa, sizeof(ppm_thread_wa), NORMALPRIO, ppm_thread, NULL);
+	input_latency_reset(&latency);
+
+	// Above the other apps and communication so that new pulses are
+	// processed as soon as they are captured.
+	chThdCreateStatic(ppm_thread_wa, sizeof(ppm_thread_wa), NORMALPRIO + 1, ppm_thread, NULL);
+
+	terminal_register_command_callback(
+			"ppm_latency",
+			"Print and reset the time from PPM pulse capture to motor command.",
+			0,
+			terminal_latency);
 }
 
 void app_ppm_stop(void) {
@@ -111,6 +133,7 @@ static THD_FUNCTION(ppm_thread, arg) {
 
 	servodec_set_pulse_options(config.pulse_start, config.pulse_end, config.median_filter);
 	servodec_init(servodec_func);
+	mc_latency_set_thread_source(MC_LATENCY_SRC_APP);
 	is_running = true;
 
 	for(;;) {
@@ -121,11 +144,19 @@ static THD_FUNCTION(ppm_thread, arg) {
 			return;
 		}
 
+		bool new_input = ppm_rx;
 		if (ppm_rx) {
 			ppm_rx = false;
 			timeout_reset();
 		}
 
+		// Trace the latency of new pulses from when they were captured
+		if (new_input) {
+			mc_latency_begin(MC_LATENCY_SRC_APP, servodec_get_capture_time());
+		} else {
+			mc_latency_end();
+		}
+
 		const volatile mc_configuration *mcconf = mc_interface_get_configuration();
 		const float rpm_now = mc_interface_get_rpm();
 		float servo_val = servodec_get_servo(0);
@@ -185,30 +216,11 @@ static THD_FUNCTION(ppm_thread, arg) {
 			pulses_without_power = 0;
 		}
 
-		// Apply deadband
-		utils_deadband(&servo_val, config.hyst, 1.0);
-
-		// Apply throttle curve
-		servo_val = utils_throttle_curve(servo_val, config.throttle_exp, config.throttle_exp_brake, config.throttle_exp_mode);
-
-		// Apply ramping
+		// Apply deadband, throttle curve and ramping
 		static systime_t last_time = 0;
-		static float servo_val_ramp = 0.0;
-		float ramp_time = fabsf(servo_val) > fabsf(servo_val_ramp) ? config.ramp_time_pos : config.ramp_time_neg;
-
-		// TODO: Remember what this was about?
-//		if (fabsf(servo_val) > 0.001) {
-//			ramp_time = fminf(config.ramp_time_pos, config.ramp_time_neg);
-//		}
-
-		const float dt = (float)ST2MS(chVTTimeElapsedSinceX(last_time)) / 1000.0;
+		const float dt = UTILS_AGE_S(last_time);
 		last_time = chVTGetSystemTimeX();
-
-		if (ramp_time > 0.01) {
-			const float ramp_step = dt / ramp_time;
-			utils_step_towards(&servo_val_ramp, servo_val, ramp_step);
-			servo_val = servo_val_ramp;
-		}
+		servo_val = input_filter_run(&filter, servo_val, dt);
 
 		float current = 0;
 		bool current_mode = false;
@@ -558,5 +570,24 @@ static THD_FUNCTION(ppm_thread, arg) {
 			}
 		}
 
+		if (new_input && !ppm_detached) {
+			input_latency_add(&latency, timer_seconds_elapsed_since(servodec_get_capture_time()));
+		}
 	}
 }
+
+static void terminal_latency(int argc, const char **argv) {
+	(void)argc; (void)argv;
+
+	if (!is_running) {
+		commands_printf("PPM app not running\n");
+		return;
+	}
+
+	commands_printf("Pulses : %u", (unsigned int)latency.samples);
+	commands_printf("Last   : %.1f us", (double)(latency.last * 1e6));
+	commands_printf("Average: %.1f us", (double)(latency.avg * 1e6));
+	commands_printf("Max    : %.1f us\n", (double)(latency.max * 1e6));
+
+	input_latency_reset(&latency);
+}
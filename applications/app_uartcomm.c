@@ -23,6 +23,8 @@
 #include "hw.h"
 #include "packet.h"
 #include "commands.h"
+#include "mc_latency.h"
+#include "timer.h"
 
 // Settings
 
@@ -65,6 +67,7 @@ static stm32_gpio_t * RxGpioPort[UART_NUMBER];
 static uint8_t TxGpioPin[UART_NUMBER], RxGpioPin[UART_NUMBER], gpioAF[UART_NUMBER];
 static PACKET_STATE_t packet_state[UART_NUMBER];
 static bool pins_enabled[UART_NUMBER];
+static uint32_t rx_time = 0;
 
 // Private functions
 static void process_packet(unsigned char *data, unsigned int len, unsigned int port_number);
@@ -102,7 +105,9 @@ static void process_packet(unsigned char *data, unsigned int len, unsigned int p
 		return;
 	}
 
+	mc_latency_begin(MC_LATENCY_SRC_UART, rx_time);
 	commands_process_packet(data, len, send_functions[port_number]);
+	mc_latency_end();
 }
 
 void app_uartcomm_initialize(void) {
@@ -238,6 +243,8 @@ static THD_FUNCTION(packet_process_thread, arg) {
 				if (uart_is_running[port_number]) {
 					msg_t res = sdGetTimeout(serialPortDriverRx[port_number], TIME_IMMEDIATE);
 					if (res != MSG_TIMEOUT) {
+						// Arrival time of the packet this byte completes
+						rx_time = timer_time_now();
 						packet_process_byte(res, &packet_state[port_number]);
 						rx = true;
 					}
@@ -1,4 +1,5 @@
 BLACKMAGICSRC =	blackmagic/bm_if.c \
+				blackmagic/bm_pipe.c \
 				blackmagic/swdptap.c \
 				blackmagic/timing.c \
 				blackmagic/platform.c \
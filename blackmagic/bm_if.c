@@ -18,6 +18,7 @@
     */
 
 #include "bm_if.h"
+#include "bm_pipe.h"
 #include "platform.h"
 #include "general.h"
 #include "target.h"
@@ -74,6 +75,14 @@ static struct target_controller gdb_controller = {
 	.system = 0,
 };
 
+static int pipe_flash_write(uint32_t addr, const void *data, uint32_t len) {
+	if (!cur_target) {
+		return -1;
+	}
+
+	return target_flash_write(cur_target, addr, data, len);
+}
+
 static void display_target(int i, target *t, void *context) {
 	(void)context;
 	commands_printf("%2d   %c  %s", i, target_attached(t)?'*':' ', target_driver_name(t));
@@ -168,6 +177,7 @@ static void terminal_swdp_scan(int argc, const char **argv) {
 	(void)argc;
 	(void)argv;
 
+	bm_pipe_flush();
 	target_print_en = true;
 	bm_set_enabled(true);
 
@@ -191,6 +201,7 @@ static void terminal_attach(int argc, const char **argv) {
 		sscanf(argv[1], "%d", &addr);
 
 		if (addr >= 0) {
+			bm_pipe_flush();
 			bm_set_enabled(true);
 			target_print_en = true;
 			cur_target = target_attach_n(addr, &gdb_controller);
@@ -217,6 +228,7 @@ static void terminal_flash_erase(int argc, const char **argv) {
 
 		if (len >= 0) {
 			if (cur_target) {
+				bm_pipe_flush();
 				bm_set_enabled(true);
 				target_print_en = true;
 				target_reset(cur_target);
@@ -243,6 +255,7 @@ static void terminal_target_help(int argc, const char **argv) {
 	(void)argv;
 
 	if (cur_target) {
+		bm_pipe_flush();
 		bm_set_enabled(true);
 		target_print_en = true;
 		target_command_help(cur_target);
@@ -253,6 +266,7 @@ static void terminal_target_help(int argc, const char **argv) {
 
 static void terminal_target_cmd(int argc, const char **argv) {
 	if (cur_target) {
+		bm_pipe_flush();
 		target_print_en = true;
 
 		bm_set_enabled(true);
@@ -276,6 +290,7 @@ static void terminal_reset(int argc, const char **argv) {
 	(void)argv;
 
 	if (cur_target) {
+		bm_pipe_flush();
 		target_reset(cur_target);
 		commands_printf("Done.\n");
 	} else {
@@ -288,6 +303,7 @@ static void terminal_detach(int argc, const char **argv) {
 	(void)argv;
 
 	if (cur_target) {
+		bm_pipe_flush();
 		target_detach(cur_target);
 		cur_target = 0;
 		bm_set_enabled(false);
@@ -322,6 +338,8 @@ static void terminal_map_nrf5_pins(int argc, const char **argv) {
 #endif
 
 void bm_init(void) {
+	bm_pipe_init(pipe_flash_write);
+
 	terminal_register_command_callback(
 			"bm_swdp_scan",
 			"BlackMagic: Scan SWD",
@@ -422,6 +440,7 @@ void bm_set_enabled(bool enabled) {
 int bm_connect(void) {
 	int ret = -1;
 
+	bm_pipe_reset();
 	bm_set_enabled(true);
 	target_print_en = false;
 
@@ -458,6 +477,7 @@ int bm_erase_flash_all(void) {
 	int ret = -1;
 
 	if (cur_target) {
+		bm_pipe_reset();
 		target_print_en = false;
 
 		target_reset(cur_target);
@@ -505,7 +525,10 @@ int bm_erase_flash_all(void) {
 }
 
 /**
- * Write to flash memory on target.
+ * Write to flash memory on target. The data is queued and written in the
+ * background while the next chunk is received, so a failed write is
+ * reported by one of the following calls. bm_reboot reports failures of
+ * the last chunks.
  *
  * @param addr
  * Address to write to
@@ -514,9 +537,10 @@ int bm_erase_flash_all(void) {
  * The data to write
  *
  * @param len
- * Length of the data
+ * Length of the data, at most BM_PIPE_CHUNK_SIZE
  *
  * @return
+ * -3: Chunk too large
  * -2: Write failed
  * -1: Not connected
  *  1: Success
@@ -526,7 +550,31 @@ int bm_write_flash(uint32_t addr, const void *data, uint32_t len) {
 
 	if (cur_target) {
 		target_print_en = false;
-		ret = target_flash_write(cur_target, addr, data, len) ? -2 : 1;
+		ret = bm_pipe_write(addr, data, len);
+	}
+
+	return ret;
+}
+
+/**
+ * Same as bm_write_flash, but the data is compressed with LZO. It is
+ * decompressed while the previous chunk is written.
+ *
+ * @param decompressed_len
+ * Length of the data after decompression, at most BM_PIPE_CHUNK_SIZE
+ *
+ * @return
+ * -3: Chunk too large or decompression failed
+ * -2: Write failed
+ * -1: Not connected
+ *  1: Success
+ */
+int bm_write_flash_lzo(uint32_t addr, const void *data, uint32_t len, uint32_t decompressed_len) {
+	int ret = -1;
+
+	if (cur_target) {
+		target_print_en = false;
+		ret = bm_pipe_write_lzo(addr, data, len, decompressed_len);
 	}
 
 	return ret;
@@ -553,6 +601,7 @@ int bm_mem_write(uint32_t addr, const void *data, uint32_t len) {
 	int ret = -1;
 
 	if (cur_target) {
+		bm_pipe_flush();
 		target_print_en = false;
 		ret = target_mem_write(cur_target, addr, data, len) ? -2 : 1;
 	}
@@ -581,6 +630,7 @@ int bm_mem_read(uint32_t addr, void *data, uint32_t len) {
 	int ret = -1;
 
 	if (cur_target) {
+		bm_pipe_flush();
 		target_print_en = false;
 		target_flash_done(cur_target);
 		ret = target_mem_read(cur_target, data, addr, len) ? -2 : 1;
@@ -593,7 +643,7 @@ int bm_mem_read(uint32_t addr, void *data, uint32_t len) {
  * Reboot target.
  *
  * @return
- * -2: Flash done failed
+ * -2: Flash done or one of the queued flash writes failed
  * -1: Not connected
  *  1: Success
  */
@@ -601,8 +651,9 @@ int bm_reboot(void) {
 	int ret = -1;
 
 	if (cur_target) {
+		int pipe_res = bm_pipe_flush();
 		target_print_en = false;
-		ret = target_flash_done(cur_target) ? -2 : 1;
+		ret = (target_flash_done(cur_target) || pipe_res < 0) ? -2 : 1;
 		target_reset(cur_target);
 	}
 
@@ -614,6 +665,7 @@ int bm_reboot(void) {
  */
 void bm_halt_req(void) {
 	if (cur_target) {
+		bm_pipe_flush();
 		target_print_en = false;
 		target_halt_request(cur_target);
 	}
@@ -624,6 +676,7 @@ void bm_halt_req(void) {
  * significantly.
  */
 void bm_leave_nrf_debug_mode(void) {
+	bm_pipe_flush();
 	bm_set_enabled(true);
 
 	if (!target_list) {
@@ -643,6 +696,8 @@ void bm_leave_nrf_debug_mode(void) {
  * Disconnect from target and release SWD bus
  */
 void bm_disconnect(void) {
+	bm_pipe_flush();
+
 	if (cur_target) {
 		target_print_en = false;
 		target_flash_done(cur_target); // Ignore for now
@@ -672,6 +727,7 @@ void bm_disconnect(void) {
  */
 void bm_change_swd_pins(stm32_gpio_t *swdio_port, int swdio_pin,
 		stm32_gpio_t *swclk_port, int swclk_pin) {
+	bm_pipe_flush();
 	bm_set_enabled(false);
 	platform_swdio_port = swdio_port;
 	platform_swdio_pin = swdio_pin;
@@ -683,6 +739,7 @@ void bm_change_swd_pins(stm32_gpio_t *swdio_port, int swdio_pin,
  * Use default SWD pins
  */
 void bm_default_swd_pins(void) {
+	bm_pipe_flush();
 	bm_set_enabled(false);
 	platform_swdio_port = SWDIO_PORT_DEFAULT;
 	platform_swdio_pin = SWDIO_PIN_DEFAULT;
@@ -29,6 +29,7 @@ void bm_set_enabled(bool enabled);
 int bm_connect(void);
 int bm_erase_flash_all(void);
 int bm_write_flash(uint32_t addr, const void *data, uint32_t len);
+int bm_write_flash_lzo(uint32_t addr, const void *data, uint32_t len, uint32_t decompressed_len);
 int bm_mem_write(uint32_t addr, const void *data, uint32_t len);
 int bm_mem_read(uint32_t addr, void *data, uint32_t len);
 int bm_reboot(void);
@@ -0,0 +1,177 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/*
+ * Double-buffered flash write pipeline. Chunks are copied or decompressed
+ * into one buffer while a separate thread writes the other one to the
+ * target over SWD, so receiving and decompressing the next chunk overlaps
+ * with the slow bit-banged transfer of the previous one.
+ *
+ * A failed write is remembered and reported by all following calls until
+ * the pipeline is reset, as the caller has already moved on when it fails.
+ */
+
+#include "bm_pipe.h"
+#include "ch.h"
+#include "minilzo.h"
+#include <string.h>
+
+#define BUFFER_NUM		2
+
+typedef struct {
+	uint32_t addr;
+	uint32_t len;
+	uint8_t data[BM_PIPE_CHUNK_SIZE];
+} chunk_t;
+
+// Threads
+static THD_WORKING_AREA(write_thread_wa, 2048);
+static THD_FUNCTION(write_thread, arg);
+
+// Private variables
+static chunk_t m_chunks[BUFFER_NUM];
+static semaphore_t m_sem_free;
+static semaphore_t m_sem_full;
+static int m_head = 0;
+static int m_tail = 0;
+static volatile bool m_failed = false;
+static bm_pipe_write_func m_write_func = 0;
+
+void bm_pipe_init(bm_pipe_write_func func) {
+	m_write_func = func;
+	chSemObjectInit(&m_sem_free, BUFFER_NUM);
+	chSemObjectInit(&m_sem_full, 0);
+	chThdCreateStatic(write_thread_wa, sizeof(write_thread_wa), NORMALPRIO, write_thread, NULL);
+}
+
+/**
+ * Wait for the queued writes and forget earlier failures.
+ */
+void bm_pipe_reset(void) {
+	bm_pipe_flush();
+	m_failed = false;
+}
+
+static chunk_t *get_free_chunk(void) {
+	chSemWait(&m_sem_free);
+	return &m_chunks[m_head];
+}
+
+static void queue_chunk(void) {
+	m_head = (m_head + 1) % BUFFER_NUM;
+	chSemSignal(&m_sem_full);
+}
+
+/**
+ * Queue a chunk for writing. Waits while both buffers are in use.
+ *
+ * @return
+ * -3: Chunk too large
+ * -2: A previous write failed
+ *  1: Success
+ */
+int bm_pipe_write(uint32_t addr, const void *data, uint32_t len) {
+	if (len > BM_PIPE_CHUNK_SIZE) {
+		return -3;
+	}
+
+	if (m_failed) {
+		return -2;
+	}
+
+	chunk_t *c = get_free_chunk();
+	c->addr = addr;
+	c->len = len;
+	memcpy(c->data, data, len);
+	queue_chunk();
+
+	return 1;
+}
+
+/**
+ * Decompress a chunk compressed with LZO directly into a free buffer and
+ * queue it for writing.
+ *
+ * @return
+ * -3: Chunk too large or decompression failed
+ * -2: A previous write failed
+ *  1: Success
+ */
+int bm_pipe_write_lzo(uint32_t addr, const void *data, uint32_t len, uint32_t decompressed_len) {
+	if (decompressed_len > BM_PIPE_CHUNK_SIZE) {
+		return -3;
+	}
+
+	if (m_failed) {
+		return -2;
+	}
+
+	chunk_t *c = get_free_chunk();
+	lzo_uint out_len = decompressed_len;
+	int res = lzo1x_decompress_safe(data, len, c->data, &out_len, NULL);
+
+	if (res != LZO_E_OK || out_len != decompressed_len) {
+		// Give the buffer back
+		chSemSignal(&m_sem_free);
+		return -3;
+	}
+
+	c->addr = addr;
+	c->len = out_len;
+	queue_chunk();
+
+	return 1;
+}
+
+/**
+ * Wait until all queued chunks are written.
+ *
+ * @return
+ * -2: A write failed
+ *  1: Success
+ */
+int bm_pipe_flush(void) {
+	for (int i = 0;i < BUFFER_NUM;i++) {
+		chSemWait(&m_sem_free);
+	}
+
+	for (int i = 0;i < BUFFER_NUM;i++) {
+		chSemSignal(&m_sem_free);
+	}
+
+	return m_failed ? -2 : 1;
+}
+
+static THD_FUNCTION(write_thread, arg) {
+	(void)arg;
+
+	chRegSetThreadName("BM Write");
+
+	for (;;) {
+		chSemWait(&m_sem_full);
+
+		chunk_t *c = &m_chunks[m_tail];
+		if (!m_failed && m_write_func(c->addr, c->data, c->len) != 0) {
+			m_failed = true;
+		}
+
+		m_tail = (m_tail + 1) % BUFFER_NUM;
+		chSemSignal(&m_sem_free);
+	}
+}
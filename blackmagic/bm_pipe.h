@@ -0,0 +1,39 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef BLACKMAGIC_BM_PIPE_H_
+#define BLACKMAGIC_BM_PIPE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Largest chunk that can be queued, one packet payload
+#define BM_PIPE_CHUNK_SIZE		512
+
+// Writes a chunk to the target, returns 0 on success
+typedef int (*bm_pipe_write_func)(uint32_t addr, const void *data, uint32_t len);
+
+// Functions
+void bm_pipe_init(bm_pipe_write_func func);
+void bm_pipe_reset(void);
+int bm_pipe_write(uint32_t addr, const void *data, uint32_t len);
+int bm_pipe_write_lzo(uint32_t addr, const void *data, uint32_t len, uint32_t decompressed_len);
+int bm_pipe_flush(void);
+
+#endif /* BLACKMAGIC_BM_PIPE_H_ */
@@ -97,6 +97,9 @@ static void nrf51_add_flash(target *t,
 	f->start = addr;
 	f->length = length;
 	f->blocksize = erasesize;
+	/* Write whole pages, so that the stub is loaded and run once per page
+	 * instead of once per 1K */
+	f->buf_size = erasesize;
 	f->erase = nrf51_flash_erase;
 	f->write = nrf51_flash_write;
 	f->erased = 0xff;
@@ -250,6 +250,8 @@ int target_flash_write_buffered(struct target_flash *f,
 	if (f->buf == NULL) {
 		/* Allocate flash sector buffer */
 		f->buf = malloc(f->buf_size);
+		if (f->buf == NULL)
+			return -1;
 		f->buf_addr = -1;
 	}
 	while (len) {
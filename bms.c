@@ -30,33 +30,103 @@
 #include "utils_sys.h"
 #include "datatypes.h"
 #include "comm_can.h"
+#include "comm_can_rx.h"
 #include "commands.h"
 #include "comm_usb.h"
+#include "packet.h"
 #include "app.h"
 #include <string.h>
 #include <math.h>
 
 // Settings
 #define MAX_CAN_AGE_SEC				2.0
+#define MAX_PACKS					4
+#define MAX_CELLS					32
+#define MAX_TEMPS					50
+
+// Snapshots are opt-in, as older tools only understand COMM_BMS_FWD_CAN_RX
+#ifndef BMS_FWD_RATE_HZ
+#define BMS_FWD_RATE_HZ				0
+#endif
+
+// Escape byte in delta-encoded arrays, followed by the absolute value as int16
+#define DELTA_ESCAPE				-128
+
+/*
+ * Everything that was received from one BMS on the CAN-bus. Cell voltages
+ * and temperatures are stored in the fixed point format they have on the
+ * bus (mV and 0.01 degC).
+ */
+typedef struct {
+	int id; // -1 if unused
+	systime_t rx_time;
+	bool updated; // Received data since the last forwarded snapshot
+	bms_soc_soh_temp_stat stat;
+	float v_tot;
+	float v_charge;
+	float i_in;
+	float i_in_ic;
+	float ah_cnt;
+	float wh_cnt;
+	float temp_ic;
+	float temp_hum;
+	float hum;
+	uint8_t cell_num;
+	uint8_t temp_num;
+	uint32_t bal_state;
+	int16_t v_cell[MAX_CELLS];
+	int16_t temps[MAX_TEMPS];
+} bms_pack;
+
+// Threads
+static THD_WORKING_AREA(bms_thread_wa, 512);
+static THD_FUNCTION(bms_thread, arg);
 
 // Private variables
 static volatile bms_config m_conf;
 static volatile bms_values m_values;
-static volatile bms_soc_soh_temp_stat m_stat_temp_max;
-static volatile bms_soc_soh_temp_stat m_stat_soc_min;
-static volatile bms_soc_soh_temp_stat m_stat_soc_max;
+static bms_pack m_packs[MAX_PACKS];
+static mutex_t m_pack_mtx;
+
+// The limiting status messages of all BMSs, including the ones that do not fit in m_packs
+static bms_soc_soh_temp_stat m_stat_temp_max;
+static bms_soc_soh_temp_stat m_stat_soc_min;
+static bms_soc_soh_temp_stat m_stat_soc_max;
+static volatile int m_fwd_rate_hz = BMS_FWD_RATE_HZ;
+static bool m_thread_started = false;
+
+// Private functions
+static void decode_stat(uint8_t id, uint8_t *data8, bms_soc_soh_temp_stat *msg);
+static void pack_update(uint8_t id, CAN_PACKET_ID cmd, uint8_t *data8, int len);
+static void forward_frame(uint8_t id, CAN_PACKET_ID cmd, uint8_t *data8, int len);
+static void forward_snapshots(void);
 
 void bms_init(bms_config *conf) {
+	if (!m_thread_started) {
+		chMtxObjectInit(&m_pack_mtx);
+	}
+
 	m_conf = *conf;
 	memset((void*)&m_values, 0, sizeof(m_values));
-	memset((void*)&m_stat_temp_max, 0, sizeof(m_stat_temp_max));
-	memset((void*)&m_stat_soc_min, 0, sizeof(m_stat_soc_min));
-	memset((void*)&m_stat_soc_max, 0, sizeof(m_stat_soc_max));
-
 	m_values.can_id = -1;
+
+	chMtxLock(&m_pack_mtx);
+	memset(m_packs, 0, sizeof(m_packs));
+	for (int i = 0;i < MAX_PACKS;i++) {
+		m_packs[i].id = -1;
+	}
+	memset(&m_stat_temp_max, 0, sizeof(m_stat_temp_max));
+	memset(&m_stat_soc_min, 0, sizeof(m_stat_soc_min));
+	memset(&m_stat_soc_max, 0, sizeof(m_stat_soc_max));
 	m_stat_temp_max.id = -1;
 	m_stat_soc_min.id = -1;
 	m_stat_soc_max.id = -1;
+	chMtxUnlock(&m_pack_mtx);
+
+	if (!m_thread_started) {
+		m_thread_started = true;
+		chThdCreateStatic(bms_thread_wa, sizeof(bms_thread_wa), LOWPRIO, bms_thread, NULL);
+	}
 }
 
 bool bms_process_can_frame(uint32_t can_id, uint8_t *data8, int len, bool is_ext) {
@@ -67,6 +137,11 @@ bool bms_process_can_frame(uint32_t can_id, uint8_t *data8, int len, bool is_ext
 			uint8_t id = can_id & 0xFF;
 			CAN_PACKET_ID cmd = can_id >> 8;
 
+			// Only the packets that the CAN acceptance filters let through
+			if (!comm_can_rx_is_bms_packet(cmd)) {
+				return false;
+			}
+
 			switch (cmd) {
 			case CAN_PACKET_BMS_SOC_SOH_TEMP_STAT:
 			case CAN_PACKET_BMS_V_TOT:
@@ -76,50 +151,24 @@ bool bms_process_can_frame(uint32_t can_id, uint8_t *data8, int len, bool is_ext
 			case CAN_PACKET_BMS_BAL:
 			case CAN_PACKET_BMS_TEMPS:
 			case CAN_PACKET_BMS_HUM:
-			{
-				unsigned char fwd_data[11];
-				unsigned int fwd_len = 0;
-				fwd_data[fwd_len++] = COMM_BMS_FWD_CAN_RX;
-				fwd_data[fwd_len++] = id;
-				fwd_data[fwd_len++] = cmd;
-				memcpy(fwd_data + fwd_len, data8, len);
-				fwd_len += len;
-
-				switch (m_conf.fwd_can_mode) {
-				case BMS_FWD_CAN_MODE_DISABLED:
-					break;
-
-				case BMS_FWD_CAN_MODE_USB_ONLY:
-					comm_usb_send_packet(fwd_data, fwd_len);
-					break;
-
-				case BMS_FWD_CAN_MODE_ANY:
-					commands_send_packet(fwd_data, fwd_len);
-					break;
+				pack_update(id, cmd, data8, len);
+
+				// Without a snapshot rate every frame is forwarded as it arrives
+				if (m_fwd_rate_hz <= 0) {
+					forward_frame(id, cmd, data8, len);
 				}
+				break;
 
-				default:
-					break;
-			}
+			default:
+				break;
 			}
 
 			switch (cmd) {
 			case CAN_PACKET_BMS_SOC_SOH_TEMP_STAT: {
 				used_data = true;
 
-				int32_t ind = 0;
 				bms_soc_soh_temp_stat msg;
-				msg.id = id;
-				msg.rx_time = chVTGetSystemTimeX();
-				msg.v_cell_min = buffer_get_float16(data8, 1e3, &ind);
-				msg.v_cell_max = buffer_get_float16(data8, 1e3, &ind);
-				msg.soc = ((float)((uint8_t)data8[ind++])) / 255.0;
-				msg.soh = ((float)((uint8_t)data8[ind++])) / 255.0;
-				msg.t_cell_max = (float)((int8_t)data8[ind++]);
-				uint8_t stat = data8[ind++];
-				msg.is_charging = (stat >> 0) & 1;
-				msg.is_balancing = (stat >> 1) & 1;
-				msg.is_charge_allowed = (stat >> 2) & 1;
+				decode_stat(id, data8, &msg);
 
 				if (id == m_values.can_id || UTILS_AGE_S(m_values.update_time) > MAX_CAN_AGE_SEC) {
 					m_values.can_id = id;
@@ -128,33 +177,6 @@ bool bms_process_can_frame(uint32_t can_id, uint8_t *data8, int len, bool is_ext
 					m_values.soh = msg.soh;
 					m_values.temp_max_cell = msg.t_cell_max;
 				}
-
-				// In case there is more than one BMS, keep track of the limiting
-				// values for all of them.
-
-				if (m_stat_temp_max.id < 0 ||
-						UTILS_AGE_S(m_stat_temp_max.rx_time) > MAX_CAN_AGE_SEC ||
-						m_stat_temp_max.t_cell_max < msg.t_cell_max) {
-					m_stat_temp_max = msg;
-				} else if (m_stat_temp_max.id == msg.id) {
-					m_stat_temp_max = msg;
-				}
-
-				if (m_stat_soc_min.id < 0 ||
-						UTILS_AGE_S(m_stat_soc_min.rx_time) > MAX_CAN_AGE_SEC ||
-						m_stat_soc_min.soc > msg.soc) {
-					m_stat_soc_min = msg;
-				} else if (m_stat_soc_min.id == msg.id) {
-					m_stat_soc_min = msg;
-				}
-
-				if (m_stat_soc_max.id < 0 ||
-						UTILS_AGE_S(m_stat_soc_max.rx_time) > MAX_CAN_AGE_SEC ||
-						m_stat_soc_max.soc < msg.soc) {
-					m_stat_soc_max = msg;
-				} else if (m_stat_soc_max.id == msg.id) {
-					m_stat_soc_max = msg;
-				}
 			} break;
 
 			case CAN_PACKET_BMS_V_TOT: {
@@ -308,22 +330,14 @@ void bms_update_limits(float *i_in_min, float *i_in_max,
 	float i_in_min_bms = i_in_min_conf;
 	float i_in_max_bms = i_in_max_conf;
 
-	if (UTILS_AGE_S(m_stat_temp_max.rx_time) > MAX_CAN_AGE_SEC) {
-		m_stat_temp_max.id = -1;
-	}
-
-	if (UTILS_AGE_S(m_stat_soc_min.rx_time) > MAX_CAN_AGE_SEC) {
-		m_stat_soc_min.id = -1;
-	}
-
-	if (UTILS_AGE_S(m_stat_soc_max.rx_time) > MAX_CAN_AGE_SEC) {
-		m_stat_soc_max.id = -1;
-	}
+	// In case there is more than one BMS the limiting values of all of them are used
+	bms_stats stats;
+	bms_get_stats(&stats);
 
 	// Temperature
 	if ((m_conf.limit_mode >> 0) & 1) {
-		if (m_stat_temp_max.id >= 0 && UTILS_AGE_S(m_stat_temp_max.rx_time) < MAX_CAN_AGE_SEC) {
-			float temp = m_stat_temp_max.t_cell_max;
+		if (stats.pack_num > 0) {
+			float temp = stats.t_cell_max;
 
 			if (temp < (m_conf.t_limit_start + 0.1)) {
 				// OK
@@ -355,8 +369,8 @@ void bms_update_limits(float *i_in_min, float *i_in_max,
 
 	// SOC
 	if ((m_conf.limit_mode >> 1) & 1) {
-		if (m_stat_soc_min.id >= 0 && UTILS_AGE_S(m_stat_soc_min.rx_time) < MAX_CAN_AGE_SEC) {
-			float soc = m_stat_soc_min.soc;
+		if (stats.pack_num > 0) {
+			float soc = stats.soc_min;
 
 			if (soc > (m_conf.soc_limit_start - 0.001)) {
 				// OK
@@ -466,6 +480,105 @@ volatile bms_values *bms_get_values(void) {
 	return &m_values;
 }
 
+static bool stat_is_live(const bms_soc_soh_temp_stat *s) {
+	return s->id >= 0 && UTILS_AGE_S(s->rx_time) <= MAX_CAN_AGE_SEC;
+}
+
+/**
+ * Get the limiting values of all BMSs that have sent their status within the
+ * last MAX_CAN_AGE_SEC seconds. The status messages carry the per-pack
+ * extremes, so this only has to look at the packs and not at every cell.
+ * The highest temperature and the SOC range also cover the BMSs that do not
+ * fit in the pack table.
+ *
+ * @param stats
+ * Filled with the statistics. The cell voltages are -1 when no BMS reports
+ * them. pack_num counts at most MAX_PACKS packs.
+ */
+void bms_get_stats(bms_stats *stats) {
+	memset(stats, 0, sizeof(bms_stats));
+	stats->v_cell_min = -1.0;
+	stats->v_cell_max = -1.0;
+
+	chMtxLock(&m_pack_mtx);
+
+	for (int i = 0;i < MAX_PACKS;i++) {
+		bms_soc_soh_temp_stat s = m_packs[i].stat;
+
+		if (m_packs[i].id < 0 || !stat_is_live(&s)) {
+			continue;
+		}
+
+		if (stats->pack_num == 0 || s.t_cell_max > stats->t_cell_max) {
+			stats->t_cell_max = s.t_cell_max;
+		}
+
+		if (stats->pack_num == 0 || s.soc < stats->soc_min) {
+			stats->soc_min = s.soc;
+		}
+
+		if (stats->pack_num == 0 || s.soc > stats->soc_max) {
+			stats->soc_max = s.soc;
+		}
+
+		if (s.v_cell_min >= 0.0 && s.v_cell_max >= 0.0) {
+			if (stats->v_cell_min < 0.0 || s.v_cell_min < stats->v_cell_min) {
+				stats->v_cell_min = s.v_cell_min;
+			}
+
+			if (s.v_cell_max > stats->v_cell_max) {
+				stats->v_cell_max = s.v_cell_max;
+			}
+
+			if ((s.v_cell_max - s.v_cell_min) > stats->v_cell_imbalance) {
+				stats->v_cell_imbalance = s.v_cell_max - s.v_cell_min;
+			}
+		}
+
+		stats->pack_num++;
+	}
+
+	bool live_temp_max = stat_is_live(&m_stat_temp_max);
+	bool live_soc_min = stat_is_live(&m_stat_soc_min);
+	bool live_soc_max = stat_is_live(&m_stat_soc_max);
+
+	if (live_temp_max && (stats->pack_num == 0 || m_stat_temp_max.t_cell_max > stats->t_cell_max)) {
+		stats->t_cell_max = m_stat_temp_max.t_cell_max;
+	}
+
+	if (live_soc_min && (stats->pack_num == 0 || m_stat_soc_min.soc < stats->soc_min)) {
+		stats->soc_min = m_stat_soc_min.soc;
+	}
+
+	if (live_soc_max && (stats->pack_num == 0 || m_stat_soc_max.soc > stats->soc_max)) {
+		stats->soc_max = m_stat_soc_max.soc;
+	}
+
+	// A BMS is only left out of the table when it is full of live packs, but the
+	// limits must not be skipped if the table ends up empty anyway.
+	if (stats->pack_num == 0 && (live_temp_max || live_soc_min || live_soc_max)) {
+		stats->pack_num = 1;
+	}
+
+	chMtxUnlock(&m_pack_mtx);
+}
+
+/**
+ * Set how often the data received from the BMSs is forwarded when
+ * forwarding is enabled in the configuration.
+ *
+ * @param rate_hz
+ * Snapshots per second. 0 forwards every CAN frame as it arrives, as
+ * COMM_BMS_FWD_CAN_RX.
+ */
+void bms_set_fwd_rate(int rate_hz) {
+	m_fwd_rate_hz = rate_hz;
+}
+
+int bms_get_fwd_rate(void) {
+	return m_fwd_rate_hz;
+}
+
 void bms_send_status_can(void) {
 	int32_t send_index = 0;
 	uint8_t buffer[8];
@@ -582,3 +695,296 @@ void bms_send_status_can(void) {
 	buffer_append_float32_auto(buffer, m_values.wh_cnt_dis_total, &send_index);
 	comm_can_transmit_eid(id | ((uint32_t)CAN_PACKET_BMS_AH_WH_DIS_TOTAL << 8), buffer, send_index);
 }
+
+static void decode_stat(uint8_t id, uint8_t *data8, bms_soc_soh_temp_stat *msg) {
+	int32_t ind = 0;
+	msg->id = id;
+	msg->rx_time = chVTGetSystemTimeX();
+	msg->v_cell_min = buffer_get_float16(data8, 1e3, &ind);
+	msg->v_cell_max = buffer_get_float16(data8, 1e3, &ind);
+	msg->soc = ((float)((uint8_t)data8[ind++])) / 255.0;
+	msg->soh = ((float)((uint8_t)data8[ind++])) / 255.0;
+	msg->t_cell_max = (float)((int8_t)data8[ind++]);
+	uint8_t stat = data8[ind++];
+	msg->is_charging = (stat >> 0) & 1;
+	msg->is_balancing = (stat >> 1) & 1;
+	msg->is_charge_allowed = (stat >> 2) & 1;
+}
+
+/*
+ * Keep the status message with the highest temperature, the lowest SOC and
+ * the highest SOC of all BMSs.
+ */
+static void update_extremes(const bms_soc_soh_temp_stat *msg) {
+	if (!stat_is_live(&m_stat_temp_max) || m_stat_temp_max.id == msg->id ||
+			m_stat_temp_max.t_cell_max < msg->t_cell_max) {
+		m_stat_temp_max = *msg;
+	}
+
+	if (!stat_is_live(&m_stat_soc_min) || m_stat_soc_min.id == msg->id ||
+			m_stat_soc_min.soc > msg->soc) {
+		m_stat_soc_min = *msg;
+	}
+
+	if (!stat_is_live(&m_stat_soc_max) || m_stat_soc_max.id == msg->id ||
+			m_stat_soc_max.soc < msg->soc) {
+		m_stat_soc_max = *msg;
+	}
+}
+
+/*
+ * Find the table entry of a BMS, or take a free one for it. Only the slots
+ * of BMSs that have been silent for MAX_CAN_AGE_SEC are reused, so the
+ * packs already in the table are not pushed out by further BMSs. Returns
+ * null when all slots are used by live packs.
+ */
+static bms_pack *get_pack(uint8_t id) {
+	bms_pack *free_pack = 0;
+	bms_pack *oldest = 0;
+
+	for (int i = 0;i < MAX_PACKS;i++) {
+		bms_pack *p = &m_packs[i];
+
+		if (p->id == id) {
+			return p;
+		}
+
+		if (p->id < 0) {
+			if (!free_pack) {
+				free_pack = p;
+			}
+		} else if (UTILS_AGE_S(p->rx_time) > MAX_CAN_AGE_SEC &&
+				(!oldest || UTILS_AGE_S(p->rx_time) > UTILS_AGE_S(oldest->rx_time))) {
+			oldest = p;
+		}
+	}
+
+	bms_pack *p = free_pack ? free_pack : oldest;
+	if (!p) {
+		return 0;
+	}
+
+	memset(p, 0, sizeof(bms_pack));
+	p->id = id;
+	p->stat.id = -1;
+	return p;
+}
+
+/*
+ * Store a BMS frame in the table of the pack it came from.
+ */
+static void pack_update(uint8_t id, CAN_PACKET_ID cmd, uint8_t *data8, int len) {
+	chMtxLock(&m_pack_mtx);
+
+	bms_soc_soh_temp_stat stat;
+	if (cmd == CAN_PACKET_BMS_SOC_SOH_TEMP_STAT) {
+		decode_stat(id, data8, &stat);
+		update_extremes(&stat);
+	}
+
+	bms_pack *p = get_pack(id);
+	if (!p) {
+		chMtxUnlock(&m_pack_mtx);
+		return;
+	}
+
+	p->rx_time = chVTGetSystemTimeX();
+	p->updated = true;
+
+	int32_t ind = 0;
+
+	switch (cmd) {
+	case CAN_PACKET_BMS_SOC_SOH_TEMP_STAT:
+		p->stat = stat;
+		break;
+
+	case CAN_PACKET_BMS_V_TOT:
+		p->v_tot = buffer_get_float32_auto(data8, &ind);
+		p->v_charge = buffer_get_float32_auto(data8, &ind);
+		break;
+
+	case CAN_PACKET_BMS_I:
+		p->i_in = buffer_get_float32_auto(data8, &ind);
+		p->i_in_ic = buffer_get_float32_auto(data8, &ind);
+		break;
+
+	case CAN_PACKET_BMS_AH_WH:
+		p->ah_cnt = buffer_get_float32_auto(data8, &ind);
+		p->wh_cnt = buffer_get_float32_auto(data8, &ind);
+		break;
+
+	case CAN_PACKET_BMS_V_CELL: {
+		unsigned int ofs = data8[ind++];
+		p->cell_num = data8[ind++];
+
+		while (ind < len && ofs < MAX_CELLS) {
+			p->v_cell[ofs++] = buffer_get_int16(data8, &ind);
+		}
+	} break;
+
+	case CAN_PACKET_BMS_BAL: {
+		uint64_t bal_state_0 = buffer_get_uint32(data8, &ind) & 0x00FFFFFF;
+		uint64_t bal_state_1 = buffer_get_uint32(data8, &ind);
+		p->bal_state = (uint32_t)(bal_state_0 << 32 | bal_state_1);
+	} break;
+
+	case CAN_PACKET_BMS_TEMPS: {
+		unsigned int ofs = data8[ind++];
+		p->temp_num = data8[ind++];
+
+		while (ind < len && ofs < MAX_TEMPS) {
+			p->temps[ofs++] = buffer_get_int16(data8, &ind);
+		}
+	} break;
+
+	case CAN_PACKET_BMS_HUM:
+		p->temp_hum = buffer_get_float16(data8, 1e2, &ind);
+		p->hum = buffer_get_float16(data8, 1e2, &ind);
+		p->temp_ic = buffer_get_float16(data8, 1e2, &ind);
+		break;
+
+	default:
+		break;
+	}
+
+	chMtxUnlock(&m_pack_mtx);
+}
+
+static void send_fwd_packet(unsigned char *data, unsigned int len) {
+	switch (m_conf.fwd_can_mode) {
+	case BMS_FWD_CAN_MODE_DISABLED:
+		break;
+
+	case BMS_FWD_CAN_MODE_USB_ONLY:
+		comm_usb_send_packet(data, len);
+		break;
+
+	case BMS_FWD_CAN_MODE_ANY:
+		commands_send_packet(data, len);
+		break;
+	}
+}
+
+static void forward_frame(uint8_t id, CAN_PACKET_ID cmd, uint8_t *data8, int len) {
+	unsigned char fwd_data[11];
+	unsigned int fwd_len = 0;
+	fwd_data[fwd_len++] = COMM_BMS_FWD_CAN_RX;
+	fwd_data[fwd_len++] = id;
+	fwd_data[fwd_len++] = cmd;
+	memcpy(fwd_data + fwd_len, data8, len);
+	fwd_len += len;
+	send_fwd_packet(fwd_data, fwd_len);
+}
+
+/*
+ * Append an array where every value is stored as the difference to the
+ * previous one. Neighbouring cells and sensors are close to each other, so
+ * most values fit in one byte.
+ */
+static void append_delta_array(uint8_t *buffer, const int16_t *values, int num, int32_t *ind) {
+	int32_t last = 0;
+
+	for (int i = 0;i < num;i++) {
+		int32_t diff = values[i] - last;
+
+		if (diff > DELTA_ESCAPE && diff <= 127) {
+			buffer[(*ind)++] = (int8_t)diff;
+		} else {
+			buffer[(*ind)++] = (int8_t)DELTA_ESCAPE;
+			buffer_append_int16(buffer, values[i], ind);
+		}
+
+		last = values[i];
+	}
+}
+
+/*
+ * Forward one snapshot for every BMS that has sent something since the last
+ * snapshot. Format of COMM_BMS_FWD_SNAPSHOT:
+ *
+ * CAN ID (uint8)
+ * Snapshot counter of the BMS (uint8)
+ * v_tot, v_charge, i_in, i_in_ic, ah_cnt, wh_cnt (float32_auto)
+ * soc, soh (float16, 1e3)
+ * t_cell_max (int8, degC), state bitfield as in CAN_PACKET_BMS_SOC_SOH_TEMP_STAT (uint8)
+ * Cell count (uint8), cell voltages in mV (delta array)
+ * Balancing state, bit n for cell n (uint32)
+ * Temperature count (uint8), temperatures in 0.1 degC (delta array)
+ * temp_ic, temp_hum, hum (float16, 1e2)
+ *
+ * In a delta array every byte is the difference to the previous value (the
+ * first value is relative to 0). The byte -128 means that the value follows
+ * as int16 instead.
+ */
+static void forward_snapshots(void) {
+	static uint8_t buffer[PACKET_MAX_PL_LEN];
+	static uint8_t seq[MAX_PACKS];
+	int16_t temps[MAX_TEMPS];
+
+	for (int i = 0;i < MAX_PACKS;i++) {
+		chMtxLock(&m_pack_mtx);
+
+		bms_pack *p = &m_packs[i];
+		if (p->id < 0 || !p->updated) {
+			chMtxUnlock(&m_pack_mtx);
+			continue;
+		}
+
+		p->updated = false;
+
+		int cell_num = MIN(p->cell_num, MAX_CELLS);
+		int temp_num = MIN(p->temp_num, MAX_TEMPS);
+
+		int32_t ind = 0;
+		buffer[ind++] = COMM_BMS_FWD_SNAPSHOT;
+		buffer[ind++] = p->id;
+		buffer[ind++] = seq[i]++;
+		buffer_append_float32_auto(buffer, p->v_tot, &ind);
+		buffer_append_float32_auto(buffer, p->v_charge, &ind);
+		buffer_append_float32_auto(buffer, p->i_in, &ind);
+		buffer_append_float32_auto(buffer, p->i_in_ic, &ind);
+		buffer_append_float32_auto(buffer, p->ah_cnt, &ind);
+		buffer_append_float32_auto(buffer, p->wh_cnt, &ind);
+		buffer_append_float16(buffer, p->stat.soc, 1e3, &ind);
+		buffer_append_float16(buffer, p->stat.soh, 1e3, &ind);
+		buffer[ind++] = (int8_t)p->stat.t_cell_max;
+		buffer[ind++] = p->stat.is_charging << 0 |
+				p->stat.is_balancing << 1 |
+				p->stat.is_charge_allowed << 2;
+
+		buffer[ind++] = cell_num;
+		append_delta_array(buffer, p->v_cell, cell_num, &ind);
+		buffer_append_uint32(buffer, p->bal_state, &ind);
+
+		buffer[ind++] = temp_num;
+		for (int j = 0;j < temp_num;j++) {
+			temps[j] = p->temps[j] / 10;
+		}
+		append_delta_array(buffer, temps, temp_num, &ind);
+
+		buffer_append_float16(buffer, p->temp_ic, 1e2, &ind);
+		buffer_append_float16(buffer, p->temp_hum, 1e2, &ind);
+		buffer_append_float16(buffer, p->hum, 1e2, &ind);
+
+		chMtxUnlock(&m_pack_mtx);
+
+		send_fwd_packet(buffer, ind);
+	}
+}
+
+static THD_FUNCTION(bms_thread, arg) {
+	(void)arg;
+
+	chRegSetThreadName("BMS Fwd");
+
+	for (;;) {
+		int rate = m_fwd_rate_hz;
+
+		if (m_conf.type == BMS_TYPE_VESC &&
+				m_conf.fwd_can_mode != BMS_FWD_CAN_MODE_DISABLED && rate > 0) {
+			forward_snapshots();
+		}
+
+		chThdSleepMilliseconds(rate > 0 ? MAX(1000 / rate, 1) : 100);
+	}
+}
@@ -33,5 +33,8 @@ void bms_process_cmd(unsigned char *data, unsigned int len,
 		void(*reply_func)(unsigned char *data, unsigned int len));
 volatile bms_values *bms_get_values(void);
 void bms_send_status_can(void);
+void bms_get_stats(bms_stats *stats);
+void bms_set_fwd_rate(int rate_hz);
+int bms_get_fwd_rate(void);
 
 #endif /* BMS_H_ */
@@ -3,6 +3,8 @@ CSRC += \
 	comm/comm_usb_serial.c \
 	comm/comm_usb.c \
 	comm/comm_can.c \
+	comm/comm_can_rx.c \
+	comm/comm_can_bridge.c \
 	comm/packet.c \
 	comm/log.c
 
@@ -20,6 +20,7 @@
 #include <string.h>
 #include <math.h>
 #include "comm_can.h"
+#include "comm_can_bridge.h"
 #include "ch.h"
 #include "hal.h"
 #include "stm32f4xx_conf.h"
@@ -41,23 +42,18 @@
 #include "encoder_cfg.h"
 #include "servo_dec.h"
 #include "utils.h"
+#include "mc_latency.h"
+#include "timer.h"
 #ifdef USE_LISPBM
 #include "lispif.h"
 #endif
 
 // Settings
-#define RX_FRAMES_SIZE	50
 #define RX_BUFFER_NUM	3
 #define RX_BUFFER_SIZE	PACKET_MAX_PL_LEN
 
 #if CAN_ENABLE
 
-typedef struct {
-	CANRxFrame rx_frames[RX_FRAMES_SIZE];
-	int frame_read;
-	int frame_write;
-} rx_state;
-
 // Threads
 static THD_WORKING_AREA(cancom_read_thread_wa, 256);
 static THD_WORKING_AREA(cancom_process_thread_wa, 2048);
@@ -74,14 +70,22 @@ static THD_WORKING_AREA(cancom_status_internal_thread_wa, 512);
 #endif
 
 static mutex_t can_mtx;
-static mutex_t can_rx_mtx;
+static uint32_t m_rx_frame_time = 0;
+static CANRxFrame m_rx_frame;
 uint8_t rx_buffer[RX_BUFFER_NUM][RX_BUFFER_SIZE];
 int rx_buffer_offset[RX_BUFFER_NUM];
 unsigned int rx_buffer_last_id;
-static rx_state m_rx_state;
+static can_rx_ring m_rx_ring;
 #ifdef HW_CAN2_DEV
-static rx_state m_rx_state2;
+static can_rx_ring m_rx_ring2;
 #endif
+static can_rx_filter_key m_filter_key = {true, true, false, 0, 0};
+static int m_filter_num = 0;
+static can_bridge_batch m_bridge_batch;
+static uint32_t m_bridge_batch_start = 0;
+static uint32_t m_bridge_last_time = 0;
+static volatile bool m_bridge_batch_en = false;
+static volatile int m_bridge_flush_ms = CAN_BRIDGE_FLUSH_MS_DEFAULT;
 
 static thread_t *process_tp = 0;
 static thread_t *ping_tp = 0;
@@ -103,6 +107,7 @@ static io_board_digial_inputs io_board_digital_in[CAN_STATUS_MSGS_TO_STORE];
 static psw_status psw_stat[CAN_STATUS_MSGS_TO_STORE];
 static unsigned int detect_all_foc_res_index = 0;
 static int8_t detect_all_foc_res[50];
+static int16_t detect_all_foc_res_id[50];
 
 /*
  * 500KBaud, automatic wakeup, automatic recover
@@ -117,9 +122,14 @@ static CANConfig cancfg = {
 
 // Private functions
 static void set_timing(int brp, int ts1, int ts2);
+static void restart_can(void);
 #if CAN_ENABLE
 static void send_packet_wrapper(unsigned char *data, unsigned int len);
 static void decode_msg(uint32_t eid, uint8_t *data8, int len, bool is_replaced);
+static can_rx_filter_key get_filter_key(void);
+static void set_filters(void);
+static void bridge_fwd_frame(const CANRxFrame *rxmsg, uint32_t time);
+static void bridge_flush(void);
 #endif
 
 // Function pointers
@@ -143,10 +153,10 @@ void comm_can_init(void) {
 	}
 
 #if CAN_ENABLE
-	memset(&m_rx_state, 0, sizeof(m_rx_state));
+	comm_can_rx_ring_init(&m_rx_ring);
+	comm_can_bridge_reset(&m_bridge_batch);
 
 	chMtxObjectInit(&can_mtx);
-	chMtxObjectInit(&can_rx_mtx);
 
 	palSetPadMode(HW_CANRX_PORT, HW_CANRX_PIN,
 			PAL_MODE_ALTERNATE(HW_CAN_GPIO_AF) |
@@ -158,7 +168,7 @@ void comm_can_init(void) {
 			PAL_STM32_OSPEED_MID1);
 
 #ifdef HW_CAN2_DEV
-	memset(&m_rx_state2, 0, sizeof(m_rx_state2));
+	comm_can_rx_ring_init(&m_rx_ring2);
 
 	palSetPadMode(HW_CAN2_RX_PORT, HW_CAN2_RX_PIN,
 			PAL_MODE_ALTERNATE(HW_CAN2_GPIO_AF) |
@@ -737,12 +747,29 @@ void comm_can_conf_foc_erpms(uint8_t controller_id,
 
 int comm_can_detect_all_foc_res(unsigned int index) {
 	if (index < detect_all_foc_res_index) {
-		return detect_all_foc_res[detect_all_foc_res_index];
+		return detect_all_foc_res[index];
 	} else {
 		return -999;
 	}
 }
 
+/**
+ * ID of the VESC that sent a detection result.
+ *
+ * @param index
+ * Same index as for comm_can_detect_all_foc_res.
+ *
+ * @return
+ * The ID, or -1 if it is unknown as the sender runs an older firmware.
+ */
+int comm_can_detect_all_foc_res_id(unsigned int index) {
+	if (index < detect_all_foc_res_index) {
+		return detect_all_foc_res_id[index];
+	} else {
+		return -1;
+	}
+}
+
 int comm_can_detect_all_foc_res_size(void) {
 	return detect_all_foc_res_index;
 }
@@ -1116,7 +1143,9 @@ void comm_can_update_pid_pos_offset(int id, float angle_now, bool store) {
 
 /*
  * Get frame from RX buffer. Interface is the CAN-interface to read from. If
- * no frames are available NULL is returned.
+ * no frames are available NULL is returned. The frame is a copy that stays
+ * valid until the next call. Only one thread may take frames from the buffer,
+ * which is the CAN process thread outside of UAVCAN mode.
  *
  * Interface: 0: Any interface, 1: CAN1, 2: CAN2
  */
@@ -1124,28 +1153,18 @@ CANRxFrame *comm_can_get_rx_frame(int interface) {
 	CANRxFrame *res = NULL;
 
 #if CAN_ENABLE
-	chMtxLock(&can_rx_mtx);
 	if (!res && interface != 2) {
-		if (m_rx_state.frame_read != m_rx_state.frame_write) {
-			res = &m_rx_state.rx_frames[m_rx_state.frame_read++];
-
-			if (m_rx_state.frame_read == RX_FRAMES_SIZE) {
-				m_rx_state.frame_read = 0;
-			}
+		if (comm_can_rx_ring_pop(&m_rx_ring, &m_rx_frame, &m_rx_frame_time)) {
+			res = &m_rx_frame;
 		}
 	}
 #ifdef HW_CAN2_DEV
 	if (!res && interface != 1) {
-		if (m_rx_state2.frame_read != m_rx_state2.frame_write) {
-			res = &m_rx_state2.rx_frames[m_rx_state2.frame_read++];
-
-			if (m_rx_state2.frame_read == RX_FRAMES_SIZE) {
-				m_rx_state2.frame_read = 0;
-			}
+		if (comm_can_rx_ring_pop(&m_rx_ring2, &m_rx_frame, &m_rx_frame_time)) {
+			res = &m_rx_frame;
 		}
 	}
 #endif
-	chMtxUnlock(&can_rx_mtx);
 #else
 	(void)interface;
 #endif
@@ -1153,6 +1172,113 @@ CANRxFrame *comm_can_get_rx_frame(int interface) {
 	return res;
 }
 
+/*
+ * Copy up to max frames from the RX buffer of one interface to frames. Only
+ * one thread may take frames from the buffer, which is the UAVCAN thread in
+ * UAVCAN mode. There is no lock.
+ *
+ * Interface: 1: CAN1, 2: CAN2
+ *
+ * Returns the number of frames copied.
+ */
+int comm_can_get_rx_frames(int interface, CANRxFrame *frames, int max) {
+	int num = 0;
+
+#if CAN_ENABLE
+	can_rx_ring *ring = &m_rx_ring;
+#ifdef HW_CAN2_DEV
+	if (interface == 2) {
+		ring = &m_rx_ring2;
+	}
+#else
+	if (interface == 2) {
+		return 0;
+	}
+#endif
+
+	while (num < max && comm_can_rx_ring_pop(ring, &frames[num], 0)) {
+		num++;
+	}
+#else
+	(void)interface;
+	(void)frames;
+	(void)max;
+#endif
+
+	return num;
+}
+
+/*
+ * Get the receive counters of an interface.
+ *
+ * Interface: 1: CAN1, 2: CAN2
+ */
+void comm_can_get_rx_stats(int interface, can_rx_stats *stats) {
+	memset(stats, 0, sizeof(can_rx_stats));
+
+#if CAN_ENABLE
+	can_rx_ring *ring = &m_rx_ring;
+#ifdef HW_CAN2_DEV
+	if (interface == 2) {
+		ring = &m_rx_ring2;
+	}
+#else
+	if (interface == 2) {
+		return;
+	}
+#endif
+
+	stats->received = ring->received;
+	stats->dropped = ring->dropped;
+	stats->hw_overruns = ring->hw_overruns;
+	stats->filters = m_filter_num;
+#else
+	(void)interface;
+#endif
+}
+
+/**
+ * Configure how frames are forwarded in CAN_MODE_COMM_BRIDGE.
+ *
+ * @param enabled
+ * Pack frames into COMM_CAN_FWD_FRAMES batches instead of sending one
+ * COMM_CAN_FWD_FRAME packet per frame.
+ *
+ * @param flush_ms
+ * Longest time a frame waits in a batch before it is sent, 1 to 100 ms.
+ */
+void comm_can_set_fwd_batch(bool enabled, int flush_ms) {
+#if CAN_ENABLE
+	utils_truncate_number_int(&flush_ms, 1, 100);
+	m_bridge_flush_ms = flush_ms;
+	m_bridge_batch_en = enabled;
+
+	// Let the process thread send what is left when disabling
+	if (process_tp) {
+		chEvtSignal(process_tp, (eventmask_t)1);
+	}
+#else
+	(void)enabled;
+	(void)flush_ms;
+#endif
+}
+
+bool comm_can_get_fwd_batch(int *flush_ms) {
+#if CAN_ENABLE
+	if (flush_ms) {
+		*flush_ms = m_bridge_flush_ms;
+	}
+
+	return m_bridge_batch_en;
+#else
+	if (flush_ms) {
+		*flush_ms = 0;
+	}
+
+	return false;
+#endif
+}
+
 void comm_can_send_status1(uint8_t id, bool replace) {
 	int32_t send_index = 0;
 	uint8_t buffer[8];
@@ -1219,58 +1345,70 @@ static THD_FUNCTION(cancom_read_thread, arg) {
 	chRegSetThreadName("CAN read");
 
 	event_listener_t el;
+	event_listener_t el_err;
 	CANRxFrame rxmsg;
 
 	chEvtRegister(&HW_CAN_DEV.rxfull_event, &el, 0);
+	chEvtRegister(&HW_CAN_DEV.error_event, &el_err, 1);
 #ifdef HW_CAN2_DEV
 	event_listener_t el2;
+	event_listener_t el2_err;
 	chEvtRegister(&HW_CAN2_DEV.rxfull_event, &el2, 0);
+	chEvtRegister(&HW_CAN2_DEV.error_event, &el2_err, 1);
 #endif
 
 	while(!chThdShouldTerminateX()) {
 		// Feed watchdog
 		timeout_feed_WDT(THREAD_CANBUS);
-        
-		if (chEvtWaitAnyTimeout(ALL_EVENTS, MS2ST(10)) == 0) {
-			continue;
+
+		// Reprogram the acceptance filters when the set of consumed frames changes. That
+		// is done by the process thread, as building the filters does not fit on this stack.
+		can_rx_filter_key key = get_filter_key();
+		if (memcmp(&key, &m_filter_key, sizeof(can_rx_filter_key)) != 0 && process_tp) {
+			chEvtSignal(process_tp, (eventmask_t) 2);
 		}
 
-		msg_t result = canReceive(&HW_CAN_DEV, CAN_ANY_MAILBOX, &rxmsg, TIME_IMMEDIATE);
+		eventmask_t evt = chEvtWaitAnyTimeout(ALL_EVENTS, MS2ST(10));
+		if (evt == 0) {
+			continue;
+		}
 
-		while (result == MSG_OK) {
-			chMtxLock(&can_rx_mtx);
-			m_rx_state.rx_frames[m_rx_state.frame_write++] = rxmsg;
-			if (m_rx_state.frame_write == RX_FRAMES_SIZE) {
-				m_rx_state.frame_write = 0;
+		if (evt & EVENT_MASK(1)) {
+			if (chEvtGetAndClearFlags(&el_err) & CAN_OVERFLOW_ERROR) {
+				m_rx_ring.hw_overruns++;
+			}
+#ifdef HW_CAN2_DEV
+			if (chEvtGetAndClearFlags(&el2_err) & CAN_OVERFLOW_ERROR) {
+				m_rx_ring2.hw_overruns++;
 			}
-			chMtxUnlock(&can_rx_mtx);
+#endif
+		}
 
-			chEvtSignal(process_tp, (eventmask_t) 1);
+		// Drain the hardware FIFOs and wake up the process thread once for the whole burst
+		bool received = false;
 
-			result = canReceive(&HW_CAN_DEV, CAN_ANY_MAILBOX, &rxmsg, TIME_IMMEDIATE);
+		while (canReceive(&HW_CAN_DEV, CAN_ANY_MAILBOX, &rxmsg, TIME_IMMEDIATE) == MSG_OK) {
+			comm_can_rx_ring_push(&m_rx_ring, &rxmsg, timer_time_now());
+			received = true;
 		}
 
 #ifdef HW_CAN2_DEV
-		result = canReceive(&HW_CAN2_DEV, CAN_ANY_MAILBOX, &rxmsg, TIME_IMMEDIATE);
-
-		while (result == MSG_OK) {
-			chMtxLock(&can_rx_mtx);
-			m_rx_state2.rx_frames[m_rx_state2.frame_write++] = rxmsg;
-			if (m_rx_state2.frame_write == RX_FRAMES_SIZE) {
-				m_rx_state2.frame_write = 0;
-			}
-			chMtxUnlock(&can_rx_mtx);
+		while (canReceive(&HW_CAN2_DEV, CAN_ANY_MAILBOX, &rxmsg, TIME_IMMEDIATE) == MSG_OK) {
+			comm_can_rx_ring_push(&m_rx_ring2, &rxmsg, timer_time_now());
+			received = true;
+		}
+#endif
 
+		if (received) {
 			chEvtSignal(process_tp, (eventmask_t) 1);
-
-			result = canReceive(&HW_CAN2_DEV, CAN_ANY_MAILBOX, &rxmsg, TIME_IMMEDIATE);
 		}
-#endif
 	}
 
 	chEvtUnregister(&HW_CAN_DEV.rxfull_event, &el);
+	chEvtUnregister(&HW_CAN_DEV.error_event, &el_err);
 #ifdef HW_CAN2_DEV
 	chEvtUnregister(&HW_CAN2_DEV.rxfull_event, &el2);
+	chEvtUnregister(&HW_CAN2_DEV.error_event, &el2_err);
 #endif
 }
 
@@ -1281,8 +1419,29 @@ static THD_FUNCTION(cancom_process_thread, arg) {
 	process_tp = chThdGetSelfX();
 
 	for(;;) {
-		chEvtWaitAny((eventmask_t)1);
+		// Wake up periodically while frames wait in a batch to send it in time
+		eventmask_t evt;
+		if (m_bridge_batch.frames > 0) {
+			evt = chEvtWaitAnyTimeout((eventmask_t)3, MS2ST(1));
+		} else {
+			evt = chEvtWaitAny((eventmask_t)3);
+		}
 
+		if (evt & (eventmask_t)2) {
+			restart_can();
+		}
+
+		if (app_get_configuration()->can_mode != CAN_MODE_COMM_BRIDGE) {
+			bridge_flush();
+		}
+
+		// The RX ring has a single consumer. In UAVCAN mode that is the canard thread,
+		// so this thread must not take frames then. Both threads check the mode
+		// before every batch, so they only overlap for one batch when the mode is
+		// changed. A frame can then be lost or taken twice, but the ring itself
+		// cannot be corrupted, as the read thread only counts free slots from the
+		// tail. Frames are lost around a mode change anyway, as it restarts the
+		// interfaces to reprogram the filters.
 		if (app_get_configuration()->can_mode == CAN_MODE_UAVCAN) {
 			continue;
 		} else if (app_get_configuration()->can_mode == CAN_MODE_COMM_BRIDGE ||
@@ -1292,9 +1451,7 @@ static THD_FUNCTION(cancom_process_thread, arg) {
 				CANRxFrame rxmsg = *rxmsg_tmp;
 
 				if (app_get_configuration()->can_mode == CAN_MODE_COMM_BRIDGE) {
-					commands_fwd_can_frame(rxmsg.DLC, rxmsg.data8,
-							rxmsg.IDE == CAN_IDE_EXT ? rxmsg.EID : rxmsg.SID,
-									rxmsg.IDE == CAN_IDE_EXT);
+					bridge_fwd_frame(&rxmsg, m_rx_frame_time);
 				}
 
 				if (rxmsg.IDE == CAN_IDE_STD) {
@@ -1323,12 +1480,18 @@ static THD_FUNCTION(cancom_process_thread, arg) {
 #endif
 				}
 			}
+
+			if (m_bridge_batch.frames > 0 && (!m_bridge_batch_en ||
+					timer_seconds_elapsed_since(m_bridge_batch_start) * 1000.0 >= (float)m_bridge_flush_ms)) {
+				bridge_flush();
+			}
 			continue;
 		}
 
 		CANRxFrame *rxmsg_tmp;
 		while ((rxmsg_tmp = comm_can_get_rx_frame(0)) != 0) {
 			CANRxFrame rxmsg = *rxmsg_tmp;
+			mc_latency_begin(MC_LATENCY_SRC_CAN, m_rx_frame_time);
 
 			if (rxmsg.IDE == CAN_IDE_EXT) {
 				bool eid_cb_used = false;
@@ -1360,6 +1523,8 @@ static THD_FUNCTION(cancom_process_thread, arg) {
 				}
 #endif
 			}
+
+			mc_latency_end();
 		}
 	}
 }
@@ -1767,10 +1932,13 @@ static void decode_msg(uint32_t eid, uint8_t *data8, int len, bool is_replaced)
 				mempools_free_appconf(appconf);
 			}
 
-			int8_t buffer[1];
+			int8_t buffer[2];
 			buffer[0] = res;
+			// Reply with the ID the command was sent to, as the sender starts detection on
+			// both IDs of a dual controller and waits for a result from each.
+			buffer[1] = id == 255 ? id1 : id;
 			comm_can_transmit_eid_replace(data8[0] |
-					((uint32_t)CAN_PACKET_DETECT_APPLY_ALL_FOC_RES << 8), (uint8_t*)buffer, 1, true, 0);
+					((uint32_t)CAN_PACKET_DETECT_APPLY_ALL_FOC_RES << 8), (uint8_t*)buffer, 2, true, 0);
 		} break;
 
 		case CAN_PACKET_DETECT_APPLY_ALL_FOC_RES: {
@@ -1778,7 +1946,9 @@ static void decode_msg(uint32_t eid, uint8_t *data8, int len, bool is_replaced)
 				break;
 			}
 
-			detect_all_foc_res[detect_all_foc_res_index++] = (int8_t)data8[0];
+			detect_all_foc_res[detect_all_foc_res_index] = (int8_t)data8[0];
+			detect_all_foc_res_id[detect_all_foc_res_index] = len >= 2 ? data8[1] : -1;
+			detect_all_foc_res_index++;
 			detect_all_foc_res_index %= sizeof(detect_all_foc_res);
 		} break;
 
@@ -2137,8 +2307,136 @@ static void decode_msg(uint32_t eid, uint8_t *data8, int len, bool is_replaced)
 #endif
 }
 
+static void bridge_fwd_frame(const CANRxFrame *rxmsg, uint32_t time) {
+	bool is_ext = rxmsg->IDE == CAN_IDE_EXT;
+	uint32_t id = is_ext ? rxmsg->EID : rxmsg->SID;
+
+	if (!m_bridge_batch_en) {
+		commands_fwd_can_frame(rxmsg->DLC, (unsigned char*)rxmsg->data8, id, is_ext);
+		return;
+	}
+
+	float dt = timer_seconds_between(m_bridge_last_time, time) * 1e6;
+	uint32_t dt_us = dt > (float)CAN_BRIDGE_DT_MAX ? CAN_BRIDGE_DT_MAX : (uint32_t)dt;
+	m_bridge_last_time = time;
+
+	if (!comm_can_bridge_add(&m_bridge_batch, id, is_ext, rxmsg->data8, rxmsg->DLC, dt_us)) {
+		bridge_flush();
+		comm_can_bridge_add(&m_bridge_batch, id, is_ext, rxmsg->data8, rxmsg->DLC, dt_us);
+	}
+
+	if (m_bridge_batch.frames == 1) {
+		m_bridge_batch_start = time;
+	}
+}
+
+static void bridge_flush(void) {
+	if (m_bridge_batch.frames > 0) {
+		commands_fwd_can_frames(m_bridge_batch.data, m_bridge_batch.len);
+		comm_can_bridge_reset(&m_bridge_batch);
+	}
+}
+
+static can_rx_filter_key get_filter_key(void) {
+	const app_configuration *appconf = app_get_configuration();
+	can_rx_filter_key key = {true, true, false, 0, 0};
+
+	bool lisp_sid = false;
+	bool lisp_eid = false;
+#ifdef USE_LISPBM
+	lisp_sid = lispif_can_event_enabled(false);
+	lisp_eid = lispif_can_event_enabled(true);
 #endif
 
+	// Everything has to be received when some consumer takes arbitrary frames
+	if (appconf->can_mode != CAN_MODE_VESC || eid_callback || lisp_eid) {
+		return key;
+	}
+
+	key.accept_all = false;
+	key.accept_sid = sid_callback || lisp_sid;
+	key.bms = mc_interface_get_configuration()->bms.type == BMS_TYPE_VESC;
+	key.id1 = appconf->controller_id;
+#ifdef HW_HAS_DUAL_MOTORS
+	key.id2 = utils_second_motor_id();
+#else
+	key.id2 = key.id1;
+#endif
+
+	return key;
+}
+
+/*
+ * Program the acceptance filters for the frames decode_msg, the BMS and the
+ * standard frame consumers use. The frames that pass are still checked in
+ * software, so the filters only have to reject most of the irrelevant traffic.
+ * Both interfaces must be stopped.
+ */
+static void set_filters(void) {
+	can_rx_filter filters[CAN_RX_FILTER_MAX];
+	int num = comm_can_rx_filter_build(filters, &m_filter_key);
+
+	// The same filters are used for CAN1 and CAN2, with the CAN2 banks after the CAN1 banks
+	CANFilter cfs[CAN_RX_FILTER_MAX * 2];
+	for (int i = 0;i < num;i++) {
+		cfs[i].filter = i;
+		cfs[i].mode = 0;
+		cfs[i].scale = 1;
+		cfs[i].assignment = 0;
+		cfs[i].register1 = filters[i].id;
+		cfs[i].register2 = filters[i].mask;
+
+		cfs[num + i] = cfs[i];
+		cfs[num + i].filter = CAN_RX_FILTER_MAX + i;
+	}
+
+	canSTM32SetFilters(CAN_RX_FILTER_MAX, num * 2, cfs);
+	m_filter_num = num;
+}
+
+#endif
+
+/*
+ * Restart the CAN interfaces with the current timing and acceptance filters.
+ * The filters can only be changed while all interfaces are stopped.
+ */
+static void restart_can(void) {
+#if CAN_ENABLE
+	chMtxLock(&can_mtx);
+#endif
+
+#ifdef HW_CAN2_DEV
+	canStop(&CAND1);
+	canStop(&CAND2);
+#else
+	// CAND1 must be running for CAND2 to work
+	CANDriver *cand = &HW_CAN_DEV;
+	canStop(&HW_CAN_DEV);
+	if (cand == &CAND2) {
+		canStop(&CAND1);
+	}
+#endif
+
+#if CAN_ENABLE
+	m_filter_key = get_filter_key();
+	set_filters();
+#endif
+
+#ifdef HW_CAN2_DEV
+	canStart(&CAND1, &cancfg);
+	canStart(&CAND2, &cancfg);
+#else
+	if (cand == &CAND2) {
+		canStart(&CAND1, &cancfg);
+	}
+	canStart(&HW_CAN_DEV, &cancfg);
+#endif
+
+#if CAN_ENABLE
+	chMtxUnlock(&can_mtx);
+#endif
+}
+
 /**
  * Set the CAN timing. The CAN is clocked at 42 MHz, and the baud rate can be
  * calculated with
@@ -2165,13 +2463,5 @@ static void set_timing(int brp, int ts1, int ts2) {
 	cancfg.btr = CAN_BTR_SJW(3) | CAN_BTR_TS2(ts2) |
 		CAN_BTR_TS1(ts1) | CAN_BTR_BRP(brp);
 
-#ifdef HW_CAN2_DEV
-	canStop(&CAND1);
-	canStart(&CAND1, &cancfg);
-	canStop(&CAND2);
-	canStart(&CAND2, &cancfg);
-#else
-	canStop(&HW_CAN_DEV);
-	canStart(&HW_CAN_DEV, &cancfg);
-#endif
+	restart_can();
 }
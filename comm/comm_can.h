@@ -22,6 +22,7 @@
 
 #include "conf_general.h"
 #include "hal.h"
+#include "comm_can_rx.h"
 
 // Settings
 #define CAN_STATUS_MSGS_TO_STORE	10
@@ -54,6 +55,7 @@ void comm_can_conf_current_limits_in(uint8_t controller_id,
 void comm_can_conf_foc_erpms(uint8_t controller_id,
 		bool store, float foc_openloop_rpm, float foc_sl_erpm);
 int comm_can_detect_all_foc_res(unsigned int index);
+int comm_can_detect_all_foc_res_id(unsigned int index);
 int comm_can_detect_all_foc_res_size(void);
 void comm_can_detect_all_foc_res_clear(void);
 void comm_can_conf_battery_cut(uint8_t controller_id,
@@ -87,6 +89,10 @@ void comm_can_psw_switch(int id, bool is_on, bool plot);
 void comm_can_update_pid_pos_offset(int id, float angle_now, bool store);
 
 CANRxFrame *comm_can_get_rx_frame(int interface);
+int comm_can_get_rx_frames(int interface, CANRxFrame *frames, int max);
+void comm_can_get_rx_stats(int interface, can_rx_stats *stats);
+void comm_can_set_fwd_batch(bool enabled, int flush_ms);
+bool comm_can_get_fwd_batch(int *flush_ms);
 
 void comm_can_send_status1(uint8_t id, bool replace);
 void comm_can_send_status2(uint8_t id, bool replace);
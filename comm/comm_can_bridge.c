@@ -0,0 +1,127 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/*
+ * Packing of CAN frames for the batched CAN bridge. Forwarding every frame in
+ * its own packet costs a packet header, CRC and usually a USB transfer per
+ * frame, which limits how much of a busy bus can be bridged. Here frames are
+ * collected with compact headers until the batch is full or old enough, and
+ * the same format is used for bursts from the host to the bus.
+ */
+
+#include "comm_can_bridge.h"
+#include "buffer.h"
+#include <string.h>
+
+#define FLAG_EXT			0x80
+#define DLC_MASK			0x0F
+
+void comm_can_bridge_reset(can_bridge_batch *b) {
+	b->len = 0;
+	b->frames = 0;
+}
+
+/**
+ * Append a frame to a batch.
+ *
+ * @param id
+ * SID or EID of the frame.
+ *
+ * @param dt_us
+ * Microseconds since the previous frame. Larger values than
+ * CAN_BRIDGE_DT_MAX are saturated.
+ *
+ * @return
+ * false if the frame does not fit, then the batch should be sent and reset
+ * before adding the frame again.
+ */
+bool comm_can_bridge_add(can_bridge_batch *b, uint32_t id, bool is_ext,
+		const uint8_t *data, int len, uint32_t dt_us) {
+	if (len > 8) {
+		len = 8;
+	} else if (len < 0) {
+		len = 0;
+	}
+
+	int32_t ind = b->len;
+	if (ind + 3 + (is_ext ? 4 : 2) + len > CAN_BRIDGE_BATCH_SIZE) {
+		return false;
+	}
+
+	b->data[ind++] = (is_ext ? FLAG_EXT : 0) | len;
+	buffer_append_uint16(b->data, dt_us > CAN_BRIDGE_DT_MAX ? CAN_BRIDGE_DT_MAX : dt_us, &ind);
+
+	if (is_ext) {
+		buffer_append_uint32(b->data, id & 0x1FFFFFFF, &ind);
+	} else {
+		buffer_append_uint16(b->data, id & 0x7FF, &ind);
+	}
+
+	memcpy(b->data + ind, data, len);
+	ind += len;
+
+	b->len = ind;
+	b->frames++;
+
+	return true;
+}
+
+/**
+ * Unpack a batch and call func for every frame in it. The input is checked
+ * completely before the first call, so nothing is sent from a truncated or
+ * corrupt batch.
+ *
+ * @return
+ * The number of frames, or -1 if the batch is malformed.
+ */
+int comm_can_bridge_decode(const uint8_t *data, int len, can_bridge_frame_func func, void *arg) {
+	int frames = 0;
+
+	for (int pass = 0;pass < 2;pass++) {
+		int32_t ind = 0;
+		frames = 0;
+
+		while (ind < len) {
+			if (ind + 3 > len) {
+				return -1;
+			}
+
+			uint8_t head = data[ind++];
+			bool is_ext = head & FLAG_EXT;
+			int dlc = head & DLC_MASK;
+			uint32_t dt_us = buffer_get_uint16(data, &ind);
+
+			if (dlc > 8 || ind + (is_ext ? 4 : 2) + dlc > len) {
+				return -1;
+			}
+
+			uint32_t id = is_ext ? (buffer_get_uint32(data, &ind) & 0x1FFFFFFF) :
+					(buffer_get_uint16(data, &ind) & 0x7FF);
+
+			if (pass == 1 && func) {
+				func(id, is_ext, data + ind, dlc, dt_us, arg);
+			}
+
+			ind += dlc;
+			frames++;
+		}
+	}
+
+	return frames;
+}
@@ -0,0 +1,55 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef COMM_CAN_BRIDGE_H_
+#define COMM_CAN_BRIDGE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Settings
+#define CAN_BRIDGE_BATCH_SIZE		480 // Leaves room for the command byte in one packet
+#define CAN_BRIDGE_FLUSH_MS_DEFAULT	5
+#define CAN_BRIDGE_DT_MAX			0xFFFF
+
+/*
+ * Frames packed back to back, each with the header
+ *
+ * uint8  flags | dlc: bit 7 set for extended IDs, bits 0-3 data length
+ * uint16 Microseconds since the previous frame, saturated at CAN_BRIDGE_DT_MAX
+ * uint16 or uint32 ID, depending on the extended flag
+ *
+ * followed by the data. All fields are big endian.
+ */
+typedef struct {
+	uint8_t data[CAN_BRIDGE_BATCH_SIZE];
+	int len;
+	int frames;
+} can_bridge_batch;
+
+typedef void(*can_bridge_frame_func)(uint32_t id, bool is_ext,
+		const uint8_t *data, int len, uint32_t dt_us, void *arg);
+
+// Functions
+void comm_can_bridge_reset(can_bridge_batch *b);
+bool comm_can_bridge_add(can_bridge_batch *b, uint32_t id, bool is_ext,
+		const uint8_t *data, int len, uint32_t dt_us);
+int comm_can_bridge_decode(const uint8_t *data, int len, can_bridge_frame_func func, void *arg);
+
+#endif /* COMM_CAN_BRIDGE_H_ */
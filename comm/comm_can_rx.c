@@ -0,0 +1,278 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/*
+ * Receive side helpers for comm_can: a lock-free ring between the read thread
+ * and the consumer of the frames, and construction of the hardware acceptance
+ * filters. Nothing here touches the CAN peripheral, so it can be tested on a
+ * PC.
+ */
+
+#include "comm_can_rx.h"
+#include <string.h>
+
+// The consumer must see the frame before the new head, and the producer must
+// be done with the slot before it sees the new tail.
+#define MEMORY_BARRIER()	__sync_synchronize()
+
+// Packets that are decoded regardless of which node sent them
+static const CAN_PACKET_ID status_packets[] = {
+		CAN_PACKET_STATUS, CAN_PACKET_STATUS_2, CAN_PACKET_STATUS_3,
+		CAN_PACKET_STATUS_4, CAN_PACKET_STATUS_5, CAN_PACKET_STATUS_6,
+		CAN_PACKET_IO_BOARD_ADC_1_TO_4, CAN_PACKET_IO_BOARD_ADC_5_TO_8,
+		CAN_PACKET_IO_BOARD_DIGITAL_IN, CAN_PACKET_PSW_STAT,
+		CAN_PACKET_GNSS_TIME, CAN_PACKET_GNSS_LAT, CAN_PACKET_GNSS_LON,
+		CAN_PACKET_GNSS_ALT_SPEED_HDOP
+};
+
+// Packets from a VESC BMS. bms_process_can_frame only decodes the packets in
+// this table, so that the filters and the decoder cannot disagree.
+static const CAN_PACKET_ID bms_packets[] = {
+		CAN_PACKET_BMS_V_TOT, CAN_PACKET_BMS_I, CAN_PACKET_BMS_AH_WH,
+		CAN_PACKET_BMS_V_CELL, CAN_PACKET_BMS_BAL, CAN_PACKET_BMS_TEMPS,
+		CAN_PACKET_BMS_HUM, CAN_PACKET_BMS_SOC_SOH_TEMP_STAT,
+		CAN_PACKET_BMS_AH_WH_CHG_TOTAL, CAN_PACKET_BMS_AH_WH_DIS_TOTAL
+};
+
+#define STATUS_PACKET_NUM	(sizeof(status_packets) / sizeof(status_packets[0]))
+#define BMS_PACKET_NUM		(sizeof(bms_packets) / sizeof(bms_packets[0]))
+
+void comm_can_rx_ring_init(can_rx_ring *r) {
+	memset(r, 0, sizeof(*r));
+}
+
+/**
+ * Add a frame to the ring. Must only be called from the producer.
+ *
+ * @return
+ * false if the ring was full and the frame was dropped.
+ */
+bool comm_can_rx_ring_push(can_rx_ring *r, const CANRxFrame *frame, uint32_t time) {
+	uint32_t head = r->head;
+	r->received++;
+
+	if ((head - r->tail) >= CAN_RX_RING_SIZE) {
+		r->dropped++;
+		return false;
+	}
+
+	r->frames[head & (CAN_RX_RING_SIZE - 1)] = *frame;
+	r->times[head & (CAN_RX_RING_SIZE - 1)] = time;
+	MEMORY_BARRIER();
+	r->head = head + 1;
+
+	return true;
+}
+
+/**
+ * Take the oldest frame from the ring. Must only be called from the consumer.
+ *
+ * @param time
+ * Receive time of the frame, can be NULL.
+ *
+ * @return
+ * false if the ring was empty.
+ */
+bool comm_can_rx_ring_pop(can_rx_ring *r, CANRxFrame *frame, uint32_t *time) {
+	uint32_t tail = r->tail;
+
+	if (tail == r->head) {
+		return false;
+	}
+
+	MEMORY_BARRIER();
+	*frame = r->frames[tail & (CAN_RX_RING_SIZE - 1)];
+	if (time) {
+		*time = r->times[tail & (CAN_RX_RING_SIZE - 1)];
+	}
+	MEMORY_BARRIER();
+	r->tail = tail + 1;
+
+	return true;
+}
+
+int comm_can_rx_ring_count(const can_rx_ring *r) {
+	return (int)(r->head - r->tail);
+}
+
+/**
+ * The identifier of a frame in the layout of the 32 bit filter registers.
+ */
+uint32_t comm_can_rx_frame_reg(const CANRxFrame *frame) {
+	uint32_t reg = (uint32_t)frame->RTR << 1;
+
+	if (frame->IDE == CAN_IDE_EXT) {
+		reg |= ((uint32_t)frame->EID << 3) | (1 << 2);
+	} else {
+		reg |= (uint32_t)frame->SID << 21;
+	}
+
+	return reg;
+}
+
+/**
+ * Filter for extended frames where the bits set in eid_mask match eid.
+ */
+can_rx_filter comm_can_rx_filter_eid(uint32_t eid, uint32_t eid_mask) {
+	can_rx_filter f;
+	f.mask = ((eid_mask & 0x1FFFFFFF) << 3) | (1 << 2);
+	f.id = ((eid & eid_mask & 0x1FFFFFFF) << 3) | (1 << 2);
+	return f;
+}
+
+/**
+ * Filter for all standard frames.
+ */
+can_rx_filter comm_can_rx_filter_sid_all(void) {
+	can_rx_filter f;
+	f.mask = 1 << 2;
+	f.id = 0;
+	return f;
+}
+
+static int popcount(uint32_t x) {
+	int n = 0;
+	while (x) {
+		x &= x - 1;
+		n++;
+	}
+	return n;
+}
+
+/**
+ * Reduce a filter list to at most max banks. The pair of filters that keeps
+ * the most mask bits when combined is merged until the list fits, so the
+ * result accepts everything the original list did and as little more as
+ * possible.
+ *
+ * @return
+ * The new number of filters.
+ */
+int comm_can_rx_filter_merge(can_rx_filter *filters, int num, int max) {
+	while (num > max && num > 1) {
+		int best_i = 0;
+		int best_j = 1;
+		int best_bits = -1;
+		uint32_t best_mask = 0;
+
+		for (int i = 0;i < num;i++) {
+			for (int j = i + 1;j < num;j++) {
+				uint32_t mask = filters[i].mask & filters[j].mask &
+						~(filters[i].id ^ filters[j].id);
+				int bits = popcount(mask);
+				if (bits > best_bits) {
+					best_bits = bits;
+					best_mask = mask;
+					best_i = i;
+					best_j = j;
+				}
+			}
+		}
+
+		filters[best_i].mask = best_mask;
+		filters[best_i].id &= best_mask;
+		filters[best_j] = filters[num - 1];
+		num--;
+	}
+
+	return num;
+}
+
+/**
+ * Check if a frame passes the filters the way the hardware would. An empty
+ * list accepts everything.
+ */
+bool comm_can_rx_filter_match(const can_rx_filter *filters, int num, const CANRxFrame *frame) {
+	if (num == 0) {
+		return true;
+	}
+
+	uint32_t reg = comm_can_rx_frame_reg(frame);
+
+	for (int i = 0;i < num;i++) {
+		if ((reg & filters[i].mask) == (filters[i].id & filters[i].mask)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static bool packet_in(const CAN_PACKET_ID *packets, unsigned int num, CAN_PACKET_ID cmd) {
+	for (unsigned int i = 0;i < num;i++) {
+		if (packets[i] == cmd) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool comm_can_rx_is_status_packet(CAN_PACKET_ID cmd) {
+	return packet_in(status_packets, STATUS_PACKET_NUM, cmd);
+}
+
+bool comm_can_rx_is_bms_packet(CAN_PACKET_ID cmd) {
+	return packet_in(bms_packets, BMS_PACKET_NUM, cmd);
+}
+
+/**
+ * Build the acceptance filters for the frames decode_msg, the BMS and the
+ * standard frame consumers use, merged to fit the hardware banks.
+ *
+ * @param filters
+ * Room for CAN_RX_FILTER_MAX filters.
+ *
+ * @return
+ * The number of filters, 0 when everything has to be accepted.
+ */
+int comm_can_rx_filter_build(can_rx_filter *filters, const can_rx_filter_key *key) {
+	if (key->accept_all) {
+		return 0;
+	}
+
+	can_rx_filter all[STATUS_PACKET_NUM + BMS_PACKET_NUM + 4];
+	int num = 0;
+
+	// Packets addressed to this node or to all nodes
+	all[num++] = comm_can_rx_filter_eid(key->id1, 0xFF);
+	if (key->id2 != key->id1) {
+		all[num++] = comm_can_rx_filter_eid(key->id2, 0xFF);
+	}
+	all[num++] = comm_can_rx_filter_eid(255, 0xFF);
+
+	for (unsigned int i = 0;i < STATUS_PACKET_NUM;i++) {
+		all[num++] = comm_can_rx_filter_eid((uint32_t)status_packets[i] << 8, 0x1FFFFF00);
+	}
+
+	if (key->bms) {
+		for (unsigned int i = 0;i < BMS_PACKET_NUM;i++) {
+			all[num++] = comm_can_rx_filter_eid((uint32_t)bms_packets[i] << 8, 0x1FFFFF00);
+		}
+	}
+
+	if (key->accept_sid) {
+		all[num++] = comm_can_rx_filter_sid_all();
+	}
+
+	num = comm_can_rx_filter_merge(all, num, CAN_RX_FILTER_MAX);
+	memcpy(filters, all, sizeof(can_rx_filter) * num);
+
+	return num;
+}
@@ -0,0 +1,87 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef COMM_CAN_RX_H_
+#define COMM_CAN_RX_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "hal.h"
+#include "datatypes.h"
+
+// Settings
+#define CAN_RX_RING_SIZE		64 // Must be a power of two
+#define CAN_RX_FILTER_MAX		14 // Filter banks per interface
+
+/*
+ * Single producer single consumer frame ring. The read thread is the only
+ * writer of head and the consumer is the only writer of tail, so no lock is
+ * needed. A full ring drops the new frame and counts it.
+ */
+typedef struct {
+	CANRxFrame frames[CAN_RX_RING_SIZE];
+	uint32_t times[CAN_RX_RING_SIZE];
+	volatile uint32_t head;
+	volatile uint32_t tail;
+	volatile uint32_t received;
+	volatile uint32_t dropped;
+	volatile uint32_t hw_overruns;
+} can_rx_ring;
+
+/*
+ * bx-CAN 32 bit mask mode filter bank, in the layout of the filter registers.
+ * A frame is accepted when (frame_reg & mask) == (id & mask).
+ */
+typedef struct {
+	uint32_t id;
+	uint32_t mask;
+} can_rx_filter;
+
+// What the acceptance filters are built from
+typedef struct {
+	bool accept_all;
+	bool accept_sid;
+	bool bms;
+	uint8_t id1;
+	uint8_t id2;
+} can_rx_filter_key;
+
+typedef struct {
+	uint32_t received;
+	uint32_t dropped;
+	uint32_t hw_overruns;
+	int filters; // Hardware filter banks in use, 0 means that all frames are accepted
+} can_rx_stats;
+
+// Functions
+void comm_can_rx_ring_init(can_rx_ring *r);
+bool comm_can_rx_ring_push(can_rx_ring *r, const CANRxFrame *frame, uint32_t time);
+bool comm_can_rx_ring_pop(can_rx_ring *r, CANRxFrame *frame, uint32_t *time);
+int comm_can_rx_ring_count(const can_rx_ring *r);
+
+uint32_t comm_can_rx_frame_reg(const CANRxFrame *frame);
+can_rx_filter comm_can_rx_filter_eid(uint32_t eid, uint32_t eid_mask);
+can_rx_filter comm_can_rx_filter_sid_all(void);
+int comm_can_rx_filter_merge(can_rx_filter *filters, int num, int max);
+bool comm_can_rx_filter_match(const can_rx_filter *filters, int num, const CANRxFrame *frame);
+int comm_can_rx_filter_build(can_rx_filter *filters, const can_rx_filter_key *key);
+bool comm_can_rx_is_status_packet(CAN_PACKET_ID cmd);
+bool comm_can_rx_is_bms_packet(CAN_PACKET_ID cmd);
+
+#endif /* COMM_CAN_RX_H_ */
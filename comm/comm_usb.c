@@ -23,6 +23,8 @@
 #include "packet.h"
 #include "comm_usb_serial.h"
 #include "commands.h"
+#include "mc_latency.h"
+#include "timer.h"
 
 // Private variables
 #define SERIAL_RX_BUFFER_SIZE		2048
@@ -35,6 +37,7 @@ static mutex_t send_mutex;
 static thread_t *process_tp;
 static volatile unsigned int write_timeout_cnt = 0;
 static volatile bool was_timeout = false;
+static volatile uint32_t m_rx_time = 0;
 static PACKET_STATE_t packet_state;
 
 // Private functions
@@ -63,6 +66,7 @@ static THD_FUNCTION(serial_read_thread, arg) {
 		}
 
 		if (had_data) {
+			m_rx_time = timer_time_now();
 			chEvtSignal(process_tp, (eventmask_t) 1);
 			had_data = 0;
 		}
@@ -90,7 +94,9 @@ static THD_FUNCTION(serial_process_thread, arg) {
 }
 
 static void process_packet(unsigned char *data, unsigned int len) {
+	mc_latency_begin(MC_LATENCY_SRC_USB, m_rx_time);
 	commands_process_packet(data, len, comm_usb_send_packet);
+	mc_latency_end();
 }
 
 static void send_packet_raw(unsigned char *buffer, unsigned int len) {
@@ -33,6 +33,7 @@
 #include "timeout.h"
 #include "servo_dec.h"
 #include "comm_can.h"
+#include "comm_can_bridge.h"
 #include "flash_helper.h"
 #include "utils_math.h"
 #include "utils_sys.h"
@@ -51,6 +52,7 @@
 #include "bms.h"
 #include "qmlui.h"
 #include "crc.h"
+#include "mc_latency.h"
 #ifdef USE_LISPBM
 #include "lispif.h"
 #endif
@@ -184,6 +186,18 @@ static void send_func_dummy(unsigned char *data, unsigned int len) {
 	(void)data; (void)len;
 }
 
+// The host sends bursts as fast as it wants them on the bus, so the time
+// between frames is ignored.
+static void fwd_frames_transmit(uint32_t id, bool is_ext, const uint8_t *data, int len, uint32_t dt_us, void *arg) {
+	(void)dt_us; (void)arg;
+
+	if (is_ext) {
+		comm_can_transmit_eid(id, data, len);
+	} else {
+		comm_can_transmit_sid(id, data, len);
+	}
+}
+
 /**
  * Process a received buffer with commands and data.
  *
@@ -846,6 +860,27 @@ void commands_process_packet(unsigned char *data, unsigned int len,
 		gpdrive_set_buffer_int_scale(buffer_get_float32_auto(data, &ind));
 	} break;
 
+	case COMM_GPD_STREAM_START: {
+		timeout_reset();
+		if (len >= 9) {
+			int32_t ind = 0;
+			int upsample = buffer_get_uint16(data, &ind);
+			gpd_interpol interpol = data[ind++];
+			float scale = buffer_get_float32_auto(data, &ind);
+			int credit_block = buffer_get_uint16(data, &ind);
+			gpdrive_stream_start(upsample, interpol, scale, credit_block);
+		}
+	} break;
+
+	case COMM_GPD_STREAM_DATA: {
+		timeout_reset();
+		gpdrive_stream_add_samples(data, len);
+	} break;
+
+	case COMM_GPD_STREAM_STOP: {
+		gpdrive_stream_stop();
+	} break;
+
 	case COMM_GET_VALUES_SETUP:
 	case COMM_GET_VALUES_SETUP_SELECTIVE: {
 		setup_values val = mc_interface_get_setup_values();
@@ -1255,6 +1290,34 @@ void commands_process_packet(unsigned char *data, unsigned int len,
 		}
 	} break;
 
+	case COMM_CAN_FWD_FRAMES: {
+		comm_can_bridge_decode(data, len, fwd_frames_transmit, 0);
+	} break;
+
+	case COMM_CAN_FWD_BATCH_CONF: {
+		int32_t ind = 0;
+
+		if (len >= 1) {
+			bool enabled = data[ind++];
+			int flush_ms = CAN_BRIDGE_FLUSH_MS_DEFAULT;
+			if (len >= 3) {
+				flush_ms = buffer_get_uint16(data, &ind);
+			}
+
+			comm_can_set_fwd_batch(enabled, flush_ms);
+		}
+
+		int flush_ms = 0;
+		bool enabled = comm_can_get_fwd_batch(&flush_ms);
+
+		ind = 0;
+		uint8_t send_buffer[4];
+		send_buffer[ind++] = packet_id;
+		send_buffer[ind++] = enabled;
+		buffer_append_uint16(send_buffer, flush_ms, &ind);
+		reply_func(send_buffer, ind);
+	} break;
+
 	case COMM_SET_BATTERY_CUT: {
 		int32_t ind = 0;
 		float start = buffer_get_float32(data, 1e3, &ind);
@@ -1601,6 +1664,57 @@ void commands_process_packet(unsigned char *data, unsigned int len,
 		}
 	} break;
 
+	case COMM_GET_THERMAL_MODEL: {
+		mc_thermal m;
+		mc_interface_get_thermal_model(&m);
+
+		int32_t ind = 0;
+		uint8_t send_buffer[50];
+		send_buffer[ind++] = packet_id;
+		buffer_append_float32_auto(send_buffer, m.temp_w, &ind);
+		buffer_append_float32_auto(send_buffer, m.temp_s, &ind);
+		buffer_append_float32_auto(send_buffer, m.temp_h, &ind);
+		buffer_append_float32_auto(send_buffer, m.temp_amb, &ind);
+		buffer_append_float32_auto(send_buffer, m.power, &ind);
+		buffer_append_float32_auto(send_buffer, mc_interface_temp_motor_time_to_limit(), &ind);
+		buffer_append_float32_auto(send_buffer, m.scale_res, &ind);
+		buffer_append_float32_auto(send_buffer, m.scale_cap, &ind);
+		send_buffer[ind++] = mc_interface_get_thermal_derate();
+		reply_func(send_buffer, ind);
+	} break;
+
+	case COMM_GET_LATENCY_STATS: {
+		bool reset = false;
+
+		if (len > 0) {
+			reset = data[0];
+		}
+
+		uint8_t *send_buffer_global = mempools_get_packet_buffer();
+		int32_t ind = 0;
+		send_buffer_global[ind++] = packet_id;
+		send_buffer_global[ind++] = MC_LATENCY_SRC_NUM;
+		send_buffer_global[ind++] = MC_LATENCY_BINS;
+
+		for (int i = 0;i < MC_LATENCY_SRC_NUM;i++) {
+			mc_latency_hist h;
+			mc_latency_get_hist(i, &h);
+			buffer_append_uint32(send_buffer_global, h.count, &ind);
+			buffer_append_uint32(send_buffer_global, h.count ? (uint32_t)(h.sum_us / h.count) : 0, &ind);
+			buffer_append_uint32(send_buffer_global, h.max_us, &ind);
+			for (int j = 0;j < MC_LATENCY_BINS;j++) {
+				buffer_append_uint32(send_buffer_global, h.bins[j], &ind);
+			}
+		}
+
+		if (reset) {
+			mc_latency_reset();
+		}
+
+		reply_func(send_buffer_global, ind);
+		mempools_free_packet_buffer(send_buffer_global);
+	} break;
+
 	case COMM_GET_GNSS: {
 		int32_t ind = 0;
 		uint32_t mask = buffer_get_uint16(data, &ind);
@@ -1629,7 +1743,9 @@ void commands_process_packet(unsigned char *data, unsigned int len,
 	case COMM_LISP_SET_RUNNING:
 	case COMM_LISP_GET_STATS:
 	case COMM_LISP_REPL_CMD:
-	case COMM_LISP_STREAM_CODE: {
+	case COMM_LISP_STREAM_CODE:
+	case COMM_LISP_PROFILE:
+	case COMM_LISP_GC_TELEMETRY: {
 #ifdef USE_LISPBM
 		lispif_process_cmd(data - 1, len + 1, reply_func);
 #endif
@@ -1769,6 +1885,16 @@ void commands_fwd_can_frame(int len, unsigned char *data, uint32_t id, bool is_e
 	commands_send_packet(buffer, index);
 }
 
+/**
+ * Send a batch of CAN frames packed by comm_can_bridge_add.
+ */
+void commands_fwd_can_frames(const uint8_t *data, int len) {
+	uint8_t buffer[len + 1];
+	buffer[0] = COMM_CAN_FWD_FRAMES;
+	memcpy(buffer + 1, data, len);
+	commands_send_packet(buffer, len + 1);
+}
+
 disp_pos_mode commands_get_disp_pos_mode(void) {
 	return display_position_mode;
 }
@@ -1815,6 +1941,24 @@ void commands_send_gpd_buffer_notify(void) {
 	commands_send_packet(buffer, index);
 }
 
+/**
+ * Tell the host how many more samples it may stream. The host can send
+ * free - (samples sent - received) more samples, as the samples that are
+ * on their way were not in the buffer yet when this was sent.
+ */
+void commands_send_gpd_stream_credit(int free, uint32_t received, uint32_t played,
+		uint32_t underruns, uint32_t overruns) {
+	int32_t index = 0;
+	uint8_t buffer[19];
+	buffer[index++] = COMM_GPD_STREAM_CREDIT;
+	buffer_append_uint16(buffer, free, &index);
+	buffer_append_uint32(buffer, received, &index);
+	buffer_append_uint32(buffer, played, &index);
+	buffer_append_uint32(buffer, underruns, &index);
+	buffer_append_uint32(buffer, overruns, &index);
+	commands_send_packet(buffer, index);
+}
+
 void commands_send_mcconf(COMM_PACKET_ID packet_id, mc_configuration* mcconf, void(*reply_func)(unsigned char* data, unsigned int len)) {
 	uint8_t *send_buffer_global = mempools_get_packet_buffer();
 	send_buffer_global[0] = packet_id;
@@ -2293,18 +2437,18 @@ static THD_FUNCTION(blocking_thread, arg) {
 
 		case COMM_BM_WRITE_FLASH_LZO:
 		case COMM_BM_WRITE_FLASH: {
-			if (packet_id == COMM_BM_WRITE_FLASH_LZO) {
-				memcpy(send_buffer, data + 6, len - 6);
-				int32_t ind = 4;
-				lzo_uint decompressed_len = buffer_get_uint16(data, &ind);
-				lzo1x_decompress_safe(send_buffer, len - 6, data + 4, &decompressed_len, NULL);
-				len = decompressed_len + 4;
-			}
-
+			// The chunk is written in the background, so that the next one
+			// can be received while the previous one is sent over SWD.
 			int32_t ind = 0;
 			uint32_t addr = buffer_get_uint32(data, &ind);
 
-			int res = bm_write_flash(addr, data + ind, len - ind);
+			int res;
+			if (packet_id == COMM_BM_WRITE_FLASH_LZO) {
+				uint16_t decompressed_len = buffer_get_uint16(data, &ind);
+				res = bm_write_flash_lzo(addr, data + ind, len - ind, decompressed_len);
+			} else {
+				res = bm_write_flash(addr, data + ind, len - ind);
+			}
 
 			ind = 0;
 			send_buffer[ind++] = packet_id;
@@ -37,12 +37,15 @@ int commands_printf_lisp(const char* format, ...);
 void commands_send_rotor_pos(float rotor_pos);
 void commands_send_experiment_samples(float *samples, int len);
 void commands_fwd_can_frame(int len, unsigned char *data, uint32_t id, bool is_extended);
+void commands_fwd_can_frames(const uint8_t *data, int len);
 disp_pos_mode commands_get_disp_pos_mode(void);
 bool commands_set_app_data_handler(void(*func)(unsigned char *data, unsigned int len));
 void commands_set_hw_data_handler(void(*func)(unsigned char *data, unsigned int len));
 void commands_send_app_data(unsigned char *data, unsigned int len);
 void commands_send_hw_data(unsigned char *data, unsigned int len);
 void commands_send_gpd_buffer_notify(void);
+void commands_send_gpd_stream_credit(int free, uint32_t received, uint32_t played,
+		uint32_t underruns, uint32_t overruns);
 void commands_send_mcconf(COMM_PACKET_ID packet_id, mc_configuration* mcconf,
     void(*reply_func)(unsigned char* data, unsigned int len));
 void commands_send_appconf(COMM_PACKET_ID packet_id, app_configuration* appconf,
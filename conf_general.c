@@ -37,6 +37,7 @@
 #include "crc.h"
 #include "terminal.h"
 #include "firmware_metadata.h"
+#include "detect.h"
 
 #include <string.h>
 #include <math.h>
@@ -57,6 +58,9 @@ uint16_t VirtAddVarTab[NB_OF_VAR];
 bool conf_general_permanent_nrf_found = false;
 __attribute__((section(".ram4"))) volatile backup_data g_backup;
 
+// Private variables
+static detect_nodes m_detect_nodes;
+
 // Private functions
 static bool read_eeprom_var(eeprom_var *v, int address, uint16_t base);
 static bool store_eeprom_var(eeprom_var *v, int address, uint16_t base);
@@ -1128,13 +1132,31 @@ int conf_general_measure_flux_linkage_openloop(float current, float duty,
 		float iq_avg = 0.0;
 		float id_avg = 0.0;
 		float samples2 = 0.0;
+		float rad_s = RPM2RADPS_f(rpm_now);
+
+		// Stop averaging when the estimate has settled, but sample for at
+		// least 0.2 s to cover some electrical revolutions.
+		detect_avg linkage_avg;
+		detect_avg_init(&linkage_avg, 2000, 0.002);
 
 		for (int i = 0;i < 10000;i++) {
-			vq_avg += mcpwm_foc_get_vq();
-			vd_avg += mcpwm_foc_get_vd();
-			iq_avg += mcpwm_foc_get_iq();
-			id_avg += mcpwm_foc_get_id();
+			float vq = mcpwm_foc_get_vq();
+			float vd = mcpwm_foc_get_vd();
+			float iq = mcpwm_foc_get_iq();
+			float id = mcpwm_foc_get_id();
+			vq_avg += vq;
+			vd_avg += vd;
+			iq_avg += iq;
+			id_avg += id;
 			samples2 += 1.0;
+
+			float i_mag_now = NORM2_f(iq, id);
+			detect_avg_add(&linkage_avg,
+					(NORM2_f(vq, vd) - res * i_mag_now) / rad_s - i_mag_now * ind);
+			if (detect_avg_converged(&linkage_avg)) {
+				break;
+			}
+
 			chThdSleep(1);
 
 			fault = mc_interface_get_fault();
@@ -1148,7 +1170,6 @@ int conf_general_measure_flux_linkage_openloop(float current, float duty,
 		iq_avg /= samples2;
 		id_avg /= samples2;
 
-		float rad_s = RPM2RADPS_f(rpm_now);
 		float v_mag = NORM2_f(vq_avg, vd_avg);
 		float i_mag = NORM2_f(iq_avg, id_avg);
 		*linkage = (v_mag - res * i_mag) / rad_s - i_mag * ind;
@@ -2078,7 +2099,8 @@ int conf_general_detect_apply_all_foc_can(bool detect_can, float max_power_loss,
 	mempools_free_mcconf(mcconf_second);
 #endif
 
-	int can_devs = 0;
+	detect_nodes *nodes = &m_detect_nodes;
+	detect_nodes_init(nodes);
 	comm_can_detect_all_foc_res_clear();
 
 	if (detect_can) {
@@ -2096,8 +2118,9 @@ int conf_general_detect_apply_all_foc_can(bool detect_can, float max_power_loss,
 
 				comm_can_conf_current_limits_in(i, false, mcconf->l_in_current_min, mcconf->l_in_current_max);
 				comm_can_conf_foc_erpms(i, false, mcconf->foc_openloop_rpm, mcconf->foc_sl_erpm);
-				comm_can_detect_apply_all_foc(i, true, max_power_loss);
-				can_devs++;
+				if (detect_nodes_add(nodes, i)) {
+					comm_can_detect_apply_all_foc(i, true, max_power_loss);
+				}
 
 				// If some other controller has the same ID, change the local one.
 				if (i == id_new) {
@@ -2115,12 +2138,31 @@ int conf_general_detect_apply_all_foc_can(bool detect_can, float max_power_loss,
 		}
 	}
 
+	// The VESCs on the CAN-bus run their detection at the same time as this one
 	int res = conf_general_detect_apply_all_foc(max_power_loss, false, false);
 
-	// Wait for all VESCs on the CAN-bus to finish detection
+	if (nodes->num > 0) {
+		commands_printf("Local detection done: %d", res);
+	}
+
+	// Collect the results from the CAN-bus as they arrive and report progress. Stop
+	// waiting as soon as something has failed, as the outcome is known then. The
+	// other VESCs still finish and store their own detection.
 	int timeout = true;
+	int res_read = 0;
 	for (int i = 0;i < 18000;i++) {
-		if (comm_can_detect_all_foc_res_size() >= can_devs) {
+		while (res_read < comm_can_detect_all_foc_res_size()) {
+			int node_res = comm_can_detect_all_foc_res(res_read);
+			int ind = detect_nodes_report(nodes, comm_can_detect_all_foc_res_id(res_read), node_res);
+			res_read++;
+
+			if (ind >= 0) {
+				commands_printf("CAN %d detection done: %d (%d/%d)",
+						nodes->nodes[ind].id, node_res, nodes->done_num, nodes->num);
+			}
+		}
+
+		if (res < 0 || detect_nodes_finished(nodes)) {
 			timeout = false;
 			break;
 		}
@@ -2129,12 +2171,8 @@ int conf_general_detect_apply_all_foc_can(bool detect_can, float max_power_loss,
 
 	if (timeout) {
 		res = -50;
-	} else {
-		for (int i = 0;i < can_devs;i++) {
-			if (comm_can_detect_all_foc_res(i) < 0) {
-				res = -51;
-			}
-		}
+	} else if (nodes->failed_num > 0) {
+		res = -51;
 	}
 
 	// Store and send settings
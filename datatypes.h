@@ -105,6 +105,13 @@ typedef enum {
 	GPD_OUTPUT_MODE_CURRENT
 } gpd_output_mode;
 
+// Interpolation between streamed general purpose drive samples
+typedef enum {
+	GPD_INTERPOL_HOLD = 0,
+	GPD_INTERPOL_LINEAR,
+	GPD_INTERPOL_CUBIC
+} gpd_interpol;
+
 typedef enum {
 	MOTOR_TYPE_BLDC = 0,
 	MOTOR_TYPE_DC,
@@ -312,6 +319,16 @@ typedef struct {
 	bool is_charge_allowed;
 } bms_soc_soh_temp_stat;
 
+typedef struct {
+	int pack_num;
+	float v_cell_min;
+	float v_cell_max;
+	float v_cell_imbalance;
+	float t_cell_max;
+	float soc_min;
+	float soc_max;
+} bms_stats;
+
 typedef enum {
 	PID_RATE_25_HZ = 0,
 	PID_RATE_50_HZ,
@@ -1152,6 +1169,22 @@ typedef enum {
 	COMM_GET_GNSS,
 
 	COMM_LOG_DATA_F64,
+
+	COMM_LISP_PROFILE,
+	COMM_LISP_GC_TELEMETRY,
+	COMM_BMS_FWD_SNAPSHOT,
+
+	COMM_GPD_STREAM_START,
+	COMM_GPD_STREAM_DATA,
+	COMM_GPD_STREAM_STOP,
+	COMM_GPD_STREAM_CREDIT,
+
+	COMM_GET_LATENCY_STATS,
+
+	COMM_CAN_FWD_FRAMES,
+	COMM_CAN_FWD_BATCH_CONF,
+
+	COMM_GET_THERMAL_MODEL,
 } COMM_PACKET_ID;
 
 // CAN commands
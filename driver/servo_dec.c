@@ -23,6 +23,7 @@
 #include "hal.h"
 #include "hw.h"
 #include "utils_math.h"
+#include "timer.h"
 
 /*
  * Settings
@@ -32,6 +33,7 @@
 
 // Private variables
 static volatile systime_t last_update_time = 0;
+static volatile uint32_t last_capture_time = 0;
 static volatile float servo_pos[SERVO_NUM];
 static volatile float pulse_start = 1.0;
 static volatile float pulse_end = 2.0;
@@ -43,6 +45,7 @@ static volatile bool is_running = false;
 static void(*done_func)(void) = 0;
 
 static void icuwidthcb(ICUDriver *icup) {
+	uint32_t capture_time = timer_time_now();
 	float len_received = ((float)icuGetWidthX(icup) / ((float)TIMER_FREQ / 1000.0));
 #ifndef HW_VALIDATE_SERVO_INPUT
 	last_len_received[0] = len_received;
@@ -85,6 +88,7 @@ static void icuwidthcb(ICUDriver *icup) {
 		last_len_received[0] = len_received; // Stop noisy lengths from going to vesc tool
 #endif
 		last_update_time = chVTGetSystemTimeX();
+		last_capture_time = capture_time;
 
 		if (done_func) {
 			done_func();
@@ -203,6 +207,18 @@ float servodec_get_last_pulse_len(int servo_num) {
 	}
 }
 
+/**
+ * Get the time when the last valid pulse ended, which is when its value
+ * became available. Can be used with timer_seconds_elapsed_since to
+ * measure the latency of the input processing.
+ *
+ * @return
+ * The capture time in timer ticks.
+ */
+uint32_t servodec_get_capture_time(void) {
+	return last_capture_time;
+}
+
 bool servodec_is_running(void) {
 	return is_running;
 }
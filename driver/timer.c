@@ -49,6 +49,11 @@ float timer_seconds_elapsed_since(uint32_t time) {
 	return (float)diff / (float)TIMER_HZ;
 }
 
+float timer_seconds_between(uint32_t start, uint32_t end) {
+	uint32_t diff = end - start;
+	return (float)diff / (float)TIMER_HZ;
+}
+
 /**
  * Blocking sleep based on timer.
  *
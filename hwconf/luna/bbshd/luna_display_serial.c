@@ -241,6 +241,9 @@ static void set_assist_level(uint8_t assist_code) {
 	if(current_scale == 0.0) {
 		mcconf->l_current_max_scale = current_scale;
 	}
+
+	// The current limits are derived from the scale
+	mc_interface_update_derived();
 }
 
 static uint8_t checksum(uint8_t *buf, uint8_t len) {
@@ -313,6 +316,7 @@ static void serial_display_byte_process(unsigned char byte) {
 							mcconf->l_current_max = (float) serial_buffer.data[rd_ptr + 3];
 							//skipping assist table for now
 							mcconf->si_wheel_diameter = (float)serial_buffer.data[rd_ptr + 24] * 25.4 / 2.0;
+							mc_interface_update_derived();
 
 							//write settings to flash memory as motor_0
 							conf_general_store_mc_configuration((mc_configuration*)mcconf, false);
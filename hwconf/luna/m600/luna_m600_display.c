@@ -268,6 +268,9 @@ static void set_assist_level(uint8_t assist_code) {
 	if(current_scale == 0.0) {
 		mcconf->l_current_max_scale = current_scale;
 	}
+
+	// The current limits are derived from the scale
+	mc_interface_update_derived();
 }
 
 
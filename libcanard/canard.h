@@ -94,9 +94,12 @@ extern "C" {
 #define CANARD_ERROR_RX_SHORT_FRAME                    16
 #define CANARD_ERROR_RX_BAD_CRC                        17
 
-/// The size of a memory block in bytes.
+/// The size of a memory block in bytes. Blocks are larger when pointers are 64 bits, which
+/// makes it possible to run the library in host builds such as the unit tests.
 #if CANARD_ENABLE_CANFD
 #define CANARD_MEM_BLOCK_SIZE                       128U
+#elif UINTPTR_MAX > 0xFFFFFFFFu
+#define CANARD_MEM_BLOCK_SIZE                       48U
 #else
 #define CANARD_MEM_BLOCK_SIZE                       32U
 #endif
@@ -275,7 +278,7 @@ struct CanardRxState
 
     uint8_t buffer_head[];
 };
-CANARD_STATIC_ASSERT(offsetof(CanardRxState, buffer_head) <= 28, "Invalid memory layout");
+CANARD_STATIC_ASSERT(offsetof(CanardRxState, buffer_head) <= CANARD_MEM_BLOCK_SIZE - 4, "Invalid memory layout");
 CANARD_STATIC_ASSERT(CANARD_MULTIFRAME_RX_PAYLOAD_HEAD_SIZE >= 4, "Invalid memory layout");
 
 /**
@@ -581,9 +584,8 @@ CANARD_STATIC_ASSERT(((uint32_t)CANARD_MULTIFRAME_RX_PAYLOAD_HEAD_SIZE) < 128,
                      "Platforms where sizeof(void*) > 4 are not supported. "
                      "On AMD64 use 32-bit mode (e.g. GCC flag -m32).");
 #else
-CANARD_STATIC_ASSERT(((uint32_t)CANARD_MULTIFRAME_RX_PAYLOAD_HEAD_SIZE) < 32,
-                     "Platforms where sizeof(void*) > 4 are not supported. "
-                     "On AMD64 use 32-bit mode (e.g. GCC flag -m32).");
+CANARD_STATIC_ASSERT(((uint32_t)CANARD_MULTIFRAME_RX_PAYLOAD_HEAD_SIZE) < CANARD_MEM_BLOCK_SIZE,
+                     "Invalid memory layout");
 #endif
 
 #ifdef __cplusplus
@@ -1,5 +1,7 @@
 CANARDSRC =	libcanard/canard.c \
 			libcanard/canard_driver.c \
+			libcanard/canard_hash.c \
+			libcanard/canard_sched.c \
 			libcanard/dsdl/uavcan/equipment/esc/esc_Status.c \
 			libcanard/dsdl/uavcan/equipment/esc/esc_RawCommand.c \
 			libcanard/dsdl/uavcan/equipment/esc/esc_RPMCommand.c \
@@ -23,6 +23,8 @@
 
 #include "canard_driver.h"
 #include "canard.h"
+#include "canard_hash.h"
+#include "canard_sched.h"
 #include "uavcan/equipment/esc/Status.h"
 #include "uavcan/equipment/esc/RawCommand.h"
 #include "uavcan/equipment/esc/RPMCommand.h"
@@ -63,6 +65,32 @@
 #define PARAM_REFRESH_RATE_HZ                           10
 #define ESC_STATUS_TIMEOUT								500 //ms?
 #define RESERVED_FLASH_SPACE_SIZE                       393216
+#define RX_BATCH_SIZE									16
+#define PUBLISH_SLACK_MS								2
+
+/*
+ * Memory pool size per interface. Every pool block holds one queued TX frame
+ * or a part of a transfer that is being received. The pool has to fit a
+ * GetNodeInfo response together with one publish burst, and the RX state of
+ * the other ESCs and of the largest incoming transfers. The GetNodeInfo
+ * response has no certificate of authenticity and carries the node name.
+ */
+#define TX_FRAMES(size)		(((size) + 2 + 6) / 7) // 7 bytes per frame plus transfer CRC
+#define RX_BLOCKS(size)		(1 + ((size) + CANARD_BUFFER_BLOCK_DATA_SIZE - 1) / CANARD_BUFFER_BLOCK_DATA_SIZE)
+#define NODE_INFO_SIZE		(UAVCAN_PROTOCOL_GETNODEINFO_RESPONSE_MAX_SIZE - \
+							UAVCAN_PROTOCOL_HARDWAREVERSION_CERTIFICATE_OF_AUTHENTICITY_MAX_LENGTH - \
+							UAVCAN_PROTOCOL_GETNODEINFO_RESPONSE_NAME_MAX_LENGTH + \
+							sizeof(CAN_APP_NODE_NAME))
+
+#define POOL_BLOCKS_TX		(TX_FRAMES(NODE_INFO_SIZE) + \
+							TX_FRAMES(UAVCAN_PROTOCOL_NODESTATUS_MAX_SIZE) + \
+							TX_FRAMES(UAVCAN_EQUIPMENT_ESC_STATUS_MAX_SIZE) + \
+							TX_FRAMES(VESC_RTDATA_MAX_SIZE))
+#define POOL_BLOCKS_RX		(STATUS_MSGS_TO_STORE * RX_BLOCKS(UAVCAN_EQUIPMENT_ESC_STATUS_MAX_SIZE) + \
+							RX_BLOCKS(UAVCAN_EQUIPMENT_ESC_RAWCOMMAND_MAX_SIZE) + \
+							RX_BLOCKS(UAVCAN_PROTOCOL_PARAM_GETSET_REQUEST_MAX_SIZE) + \
+							RX_BLOCKS(UAVCAN_PROTOCOL_FILE_READ_RESPONSE_MAX_SIZE))
+#define POOL_BLOCKS			(POOL_BLOCKS_TX + POOL_BLOCKS_RX)
 
 /*
  * Node status variables
@@ -84,15 +112,43 @@ typedef struct {
 	systime_t rpmtime;
 } cmd_info_data;
 
+typedef struct {
+	uint32_t rx_frames;
+	uint32_t rx_errors;
+	uint32_t tx_frames;
+	uint32_t tx_no_mem;
+	uint32_t bursts;
+} if_stats_t;
+
+typedef struct {
+	uint16_t id;
+	bool is_service;
+	uint64_t signature;
+	void (*handler)(CanardInstance* ins, CanardRxTransfer* transfer);
+} transfer_handler_t;
+
+typedef enum {
+	PUBLISH_NODE_STATUS = 0,
+	PUBLISH_RATE_1,
+	PUBLISH_RATE_2,
+	PUBLISH_NUM
+} publish_slot;
+
 // Private variables
 static CanardInstance canard_ins;
-static uint8_t canard_memory_pool[1024];
+static CanardPoolAllocatorBlock canard_memory_pool[POOL_BLOCKS];
+static if_stats_t if_stats;
 static cmd_info_data can1_cmd = {0};
 #ifdef HW_CAN2_DEV
 static cmd_info_data can2_cmd = {0};
 static CanardInstance canard_ins_if2;
-static uint8_t canard_memory_pool_if2[1024];
+static CanardPoolAllocatorBlock canard_memory_pool_if2[POOL_BLOCKS];
+static if_stats_t if_stats_if2;
 #endif
+static canard_hash_t handler_hash;
+static canard_hash_t param_hash;
+static bool param_hash_complete;
+static canard_sched_slot_t publish_slots[PUBLISH_NUM];
 static uint8_t msg_buffer[512];
 static uint8_t node_health = UAVCAN_PROTOCOL_NODESTATUS_HEALTH_OK;
 static uint8_t node_mode = UAVCAN_PROTOCOL_NODESTATUS_MODE_OPERATIONAL;
@@ -106,8 +162,8 @@ static THD_FUNCTION(canard_thread, arg);
 
 // Private functions
 static void calculateTotalCurrent(void);
-static void sendEscStatus(CanardInstance *ins);
-static void sendRtData(CanardInstance *ins);
+static void sendEscStatus(void);
+static void sendRtData(void);
 static void readUniqueID(uint8_t* out_uid);
 static void onTransferReceived(CanardInstance* ins, CanardRxTransfer* transfer);
 static bool shouldAcceptTransfer(const CanardInstance* ins,
@@ -116,6 +172,8 @@ static bool shouldAcceptTransfer(const CanardInstance* ins,
 		CanardTransferType transfer_type,
 		uint8_t source_node_id);
 static void terminal_debug_on(int argc, const char **argv);
+static void terminal_status(int argc, const char **argv);
+static void init_lookup_tables(void);
 
 /*
 * Firmware Update Stuff
@@ -321,25 +379,29 @@ static param_t* getParamByIndex(uint16_t index)
 
 /*
  * Get parameter by name
- * Searches the parameter table for the given name and returns the parameter information 
+ * Looks up the name in the parameter hash table and returns the parameter information
  * if no parameter is found it returns null.
  */
 static param_t* getParamByName(char * name)
 {
-	for (uint16_t i = 0; i < (sizeof(parameters) / sizeof(parameters[0])); i++)
-	{
+	int ind = canard_hash_find(&param_hash, canard_hash_str(name));
+
+	if (ind >= 0 && strcmp(name, parameters[ind].name) == 0) {
 		if (debug_level == 2) {
-			commands_printf("name: %s paramname: %s", name, parameters[i].name);
+			commands_printf("found match: %s", name);
 		}
-		
-		if (strcmp(name, parameters[i].name) == 0)
-		{
-			if (debug_level == 2) {
-				commands_printf("found match!");
+		return &parameters[ind];
+	}
+
+	// Only names whose hash collides with another parameter are missing from the table
+	if (!param_hash_complete) {
+		for (uint16_t i = 0; i < ARRAY_SIZE(parameters); i++) {
+			if (strcmp(name, parameters[i].name) == 0) {
+				return &parameters[i];
 			}
-			return &parameters[i];
 		}
-	} 
+	}
+
 	return NULL;
 }
 
@@ -359,6 +421,8 @@ void canard_driver_init(void) {
 		stat_msgs[i].id = -1;
 	}
 
+	init_lookup_tables();
+
 	chThdCreateStatic(canard_thread_wa, sizeof(canard_thread_wa), NORMALPRIO, canard_thread, NULL);
 
 	terminal_register_command_callback(
@@ -366,6 +430,12 @@ void canard_driver_init(void) {
 		"Enable UAVCAN debug prints 0: off 1: errors 2: param getset 3: current calc 4: comms stuff)",
 		"[level]",
 		terminal_debug_on);
+
+	terminal_register_command_callback(
+		"uavcan_status",
+		"Print UAVCAN frame counters and memory pool usage",
+		0,
+		terminal_status);
 }
 
 uavcan_cmd_info canard_driver_last_rawcmd(int can_if) {
@@ -447,10 +517,34 @@ static void calculateTotalCurrent(void) {
 	// ToDo: Add a way to limit the ESC current based on the total system current consumed
 }
 
+/*
+ * Count TX queue overflows for the statistics
+ */
+static void count_tx_result(CanardInstance *ins, int16_t res) {
+	if (res == -CANARD_ERROR_OUT_OF_MEMORY) {
+		((if_stats_t*)canardGetUserReference(ins))->tx_no_mem++;
+	}
+}
+
+/*
+ * Broadcast a message on all interfaces. The message is only encoded once and every
+ * interface has its own transfer ID.
+ */
+static void broadcastAll(uint64_t signature, uint16_t id, uint8_t *transfer_id,
+		const void *payload, uint16_t len) {
+	count_tx_result(&canard_ins, canardBroadcast(&canard_ins, signature, id,
+			&transfer_id[0], CANARD_TRANSFER_PRIORITY_LOW, payload, len));
+
+#ifdef HW_CAN2_DEV
+	count_tx_result(&canard_ins_if2, canardBroadcast(&canard_ins_if2, signature, id,
+			&transfer_id[1], CANARD_TRANSFER_PRIORITY_LOW, payload, len));
+#endif
+}
+
 /*
 * Send Node Status Message
 */
-static void sendNodeStatus(CanardInstance *ins) {
+static void sendNodeStatus(void) {
 	node_mode = fw_update.node_id?UAVCAN_PROTOCOL_NODESTATUS_MODE_SOFTWARE_UPDATE:UAVCAN_PROTOCOL_NODESTATUS_MODE_OPERATIONAL;
 	
 	node_status.health = node_health;
@@ -459,12 +553,10 @@ static void sendNodeStatus(CanardInstance *ins) {
 	// status.sub_mode =
 	// status.vendor_specific_status_code is filled in the firmware update loop
 	uavcan_protocol_NodeStatus_encode(&node_status, msg_buffer);
-	static uint8_t transfer_id;
-	canardBroadcast(ins,
-		UAVCAN_PROTOCOL_NODESTATUS_SIGNATURE,
+	static uint8_t transfer_id[2];
+	broadcastAll(UAVCAN_PROTOCOL_NODESTATUS_SIGNATURE,
 		UAVCAN_PROTOCOL_NODESTATUS_ID,
-		&transfer_id,
-		CANARD_TRANSFER_PRIORITY_LOW,
+		transfer_id,
 		msg_buffer,
 		UAVCAN_PROTOCOL_NODESTATUS_MAX_SIZE);
 }
@@ -472,7 +564,7 @@ static void sendNodeStatus(CanardInstance *ins) {
 /*
  * Send ESC Status Message
  */
-static void sendEscStatus(CanardInstance *ins) {
+static void sendEscStatus(void) {
 	uavcan_equipment_esc_Status status;
 	memset(&status, 0, sizeof(status));
 
@@ -495,22 +587,20 @@ static void sendEscStatus(CanardInstance *ins) {
 
 	uavcan_equipment_esc_Status_encode(&status, msg_buffer);
 
-	static uint8_t transfer_id;
+	static uint8_t transfer_id[2];
 
 	if (debug_level > 11) {
 		commands_printf("UAVCAN sendESCStatus");
 	}
 
-	canardBroadcast(ins,
-		UAVCAN_EQUIPMENT_ESC_STATUS_SIGNATURE,
+	broadcastAll(UAVCAN_EQUIPMENT_ESC_STATUS_SIGNATURE,
 		UAVCAN_EQUIPMENT_ESC_STATUS_ID,
-		&transfer_id,
-		CANARD_TRANSFER_PRIORITY_LOW,
+		transfer_id,
 		msg_buffer,
 		UAVCAN_EQUIPMENT_ESC_STATUS_MAX_SIZE);
 }
 
-static void sendRtData(CanardInstance *ins) {
+static void sendRtData(void) {
 	vesc_RTData data;
 	memset(&data, 0, sizeof(data));
 
@@ -565,17 +655,15 @@ static void sendRtData(CanardInstance *ins) {
 
 	vesc_RTData_encode(&data, msg_buffer, false);
 
-	static uint8_t transfer_id;
+	static uint8_t transfer_id[2];
 
 	if (debug_level > 11) {
 		commands_printf("UAVCAN sendRtData");
 	}
 
-	canardBroadcast(ins,
-			VESC_RTDATA_SIGNATURE,
+	broadcastAll(VESC_RTDATA_SIGNATURE,
 			VESC_RTDATA_ID,
-			&transfer_id,
-			CANARD_TRANSFER_PRIORITY_LOW,
+			transfer_id,
 			msg_buffer,
 			VESC_RTDATA_MAX_SIZE);
 }
@@ -640,6 +728,7 @@ static void handle_get_node_info(CanardInstance* ins, CanardRxTransfer* transfer
 													CanardResponse,
 													msg_buffer,
 													total_size);
+	count_tx_result(ins, resp_res);
 	if (resp_res <= 0) {
 		if (debug_level > 1) {
 			commands_printf("Could not respond to GetNodeInfo: %d\n", resp_res);
@@ -927,6 +1016,7 @@ static void handle_param_getset(CanardInstance* ins, CanardRxTransfer* transfer)
 													&msg_buffer[0],
 													total_size);
 
+	count_tx_result(ins, resp_res);
 	if ((resp_res <= 0) && (debug_level > 1)) {
 		commands_printf("Could not respond to param_getset_req: %d\n", resp_res);
 	}												
@@ -1153,6 +1243,61 @@ static void handle_begin_firmware_update(CanardInstance* ins, CanardRxTransfer*
 	send_fw_read(ins);
 }
 
+static void handle_restart_node_request(CanardInstance* ins, CanardRxTransfer* transfer) {
+	(void)ins;
+	(void)transfer;
+
+	if (debug_level > 0) {
+		commands_printf("RestartNode\n");
+	}
+	handle_restart_node();
+}
+
+/*
+ * Transfers that are accepted by this node. Message and service IDs are
+ * separate namespaces, so the kind is part of the lookup key.
+ */
+static const transfer_handler_t transfer_handlers[] = {
+	{UAVCAN_PROTOCOL_GETNODEINFO_ID, true, UAVCAN_PROTOCOL_GETNODEINFO_SIGNATURE, handle_get_node_info},
+	{UAVCAN_EQUIPMENT_ESC_RAWCOMMAND_ID, false, UAVCAN_EQUIPMENT_ESC_RAWCOMMAND_SIGNATURE, handle_esc_raw_command},
+	{UAVCAN_EQUIPMENT_ESC_RPMCOMMAND_ID, false, UAVCAN_EQUIPMENT_ESC_RPMCOMMAND_SIGNATURE, handle_esc_rpm_command},
+	{UAVCAN_EQUIPMENT_ESC_STATUS_ID, false, UAVCAN_EQUIPMENT_ESC_STATUS_SIGNATURE, handle_esc_status},
+	{UAVCAN_PROTOCOL_RESTARTNODE_ID, true, UAVCAN_PROTOCOL_RESTARTNODE_SIGNATURE, handle_restart_node_request},
+	{UAVCAN_PROTOCOL_PARAM_GETSET_ID, true, UAVCAN_PROTOCOL_PARAM_GETSET_SIGNATURE, handle_param_getset},
+	{UAVCAN_PROTOCOL_FILE_BEGINFIRMWAREUPDATE_ID, true, UAVCAN_PROTOCOL_FILE_BEGINFIRMWAREUPDATE_SIGNATURE, handle_begin_firmware_update},
+	{UAVCAN_PROTOCOL_FILE_READ_ID, true, UAVCAN_PROTOCOL_FILE_READ_SIGNATURE, handle_file_read_response},
+};
+
+static uint32_t handler_key(uint16_t data_type_id, bool is_service) {
+	return (uint32_t)data_type_id | (is_service ? 0x10000 : 0);
+}
+
+static const transfer_handler_t *get_transfer_handler(uint16_t data_type_id, CanardTransferType transfer_type) {
+	int ind = canard_hash_find(&handler_hash,
+			handler_key(data_type_id, transfer_type != CanardTransferTypeBroadcast));
+	return ind >= 0 ? &transfer_handlers[ind] : NULL;
+}
+
+/*
+ * Fill the hash tables that are used to look up parameters by name and
+ * transfer handlers by data type.
+ */
+static void init_lookup_tables(void) {
+	canard_hash_init(&param_hash);
+	param_hash_complete = true;
+	for (uint16_t i = 0; i < ARRAY_SIZE(parameters); i++) {
+		if (!canard_hash_insert(&param_hash, canard_hash_str(parameters[i].name), i)) {
+			param_hash_complete = false;
+		}
+	}
+
+	canard_hash_init(&handler_hash);
+	for (uint16_t i = 0; i < ARRAY_SIZE(transfer_handlers); i++) {
+		canard_hash_insert(&handler_hash,
+				handler_key(transfer_handlers[i].id, transfer_handlers[i].is_service), i);
+	}
+}
+
 /**
 * This callback is invoked by the library when a new message or request or response is received.
 */
@@ -1174,42 +1319,10 @@ static void onTransferReceived(CanardInstance* ins, CanardRxTransfer* transfer)
 	//     return;
 	// }
 
-	switch (transfer->data_type_id) {
-		case UAVCAN_PROTOCOL_GETNODEINFO_ID:
-			handle_get_node_info(ins, transfer);
-			break;
-
-		case UAVCAN_EQUIPMENT_ESC_RAWCOMMAND_ID:
-			handle_esc_raw_command(ins, transfer);
-			break;
-
-		case UAVCAN_EQUIPMENT_ESC_RPMCOMMAND_ID:
-			handle_esc_rpm_command(ins, transfer);
-			break;
-
-		case UAVCAN_EQUIPMENT_ESC_STATUS_ID:
-			handle_esc_status(ins, transfer);
-			break;
-
-		case UAVCAN_PROTOCOL_RESTARTNODE_ID:
-			if (debug_level > 0) {
-				commands_printf("RestartNode\n");
-			}
-			handle_restart_node();
-			break;
-
-		case UAVCAN_PROTOCOL_PARAM_GETSET_ID:
-			handle_param_getset(ins, transfer);
-			break;
-
-		case UAVCAN_PROTOCOL_FILE_BEGINFIRMWAREUPDATE_ID:
-			handle_begin_firmware_update(ins, transfer);
-			break;
-
-		case UAVCAN_PROTOCOL_FILE_READ_ID:
-			handle_file_read_response(ins, transfer);
-			break;
-	   }
+	const transfer_handler_t *h = get_transfer_handler(transfer->data_type_id, transfer->transfer_type);
+	if (h) {
+		h->handler(ins, transfer);
+	}
 }
 
 /**
@@ -1247,41 +1360,10 @@ static bool shouldAcceptTransfer(const CanardInstance* ins,
 	//     return false;
 	// }
 
-	switch (data_type_id) {
-		case UAVCAN_PROTOCOL_GETNODEINFO_ID:
-			*out_data_type_signature = UAVCAN_PROTOCOL_GETNODEINFO_SIGNATURE;
-			return true;
-
-		case UAVCAN_EQUIPMENT_ESC_RAWCOMMAND_ID:
-			*out_data_type_signature = UAVCAN_EQUIPMENT_ESC_RAWCOMMAND_SIGNATURE;
-			return true;
-
-		case UAVCAN_EQUIPMENT_ESC_RPMCOMMAND_ID:
-			*out_data_type_signature = UAVCAN_EQUIPMENT_ESC_RPMCOMMAND_SIGNATURE;
-			return true;
-
-		case UAVCAN_EQUIPMENT_ESC_STATUS_ID:
-			*out_data_type_signature = UAVCAN_EQUIPMENT_ESC_STATUS_SIGNATURE;
-			return true;
-
-		case UAVCAN_PROTOCOL_RESTARTNODE_ID:
-			*out_data_type_signature = UAVCAN_PROTOCOL_RESTARTNODE_SIGNATURE;
-			return true;
-
-		case UAVCAN_PROTOCOL_PARAM_GETSET_ID:
-			*out_data_type_signature = UAVCAN_PROTOCOL_PARAM_GETSET_SIGNATURE;
-			return true;
-
-		case UAVCAN_PROTOCOL_FILE_READ_ID:
-			*out_data_type_signature = UAVCAN_PROTOCOL_FILE_READ_SIGNATURE;
-			return true;
-		
-		case UAVCAN_PROTOCOL_FILE_BEGINFIRMWAREUPDATE_ID:
-			*out_data_type_signature = UAVCAN_PROTOCOL_FILE_BEGINFIRMWAREUPDATE_SIGNATURE;
-			return true;
-
-		default:
-			break;
+	const transfer_handler_t *h = get_transfer_handler(data_type_id, transfer_type);
+	if (h) {
+		*out_data_type_signature = h->signature;
+		return true;
 	}
 
 	return false;
@@ -1303,15 +1385,101 @@ static void terminal_debug_on(int argc, const char **argv) {
 	}
 }
 
+static void print_if_status(CanardInstance *ins, int interface) {
+	CanardPoolAllocatorStatistics pool = canardGetPoolAllocatorStatistics(ins);
+	if_stats_t *stats = (if_stats_t*)canardGetUserReference(ins);
+
+	commands_printf("CAN%d", interface);
+	commands_printf("  Pool blocks  : %d used, %d peak, %d total",
+			pool.current_usage_blocks, pool.peak_usage_blocks, pool.capacity_blocks);
+	commands_printf("  RX frames    : %u (%u errors)", stats->rx_frames, stats->rx_errors);
+	commands_printf("  TX frames    : %u in %u bursts", stats->tx_frames, stats->bursts);
+	commands_printf("  TX no memory : %u", stats->tx_no_mem);
+}
+
+static void terminal_status(int argc, const char **argv) {
+	(void)argc;
+	(void)argv;
+
+	if (app_get_configuration()->can_mode != CAN_MODE_UAVCAN) {
+		commands_printf("UAVCAN is not running\n");
+		return;
+	}
+
+	print_if_status(&canard_ins, 1);
+#ifdef HW_CAN2_DEV
+	print_if_status(&canard_ins_if2, 2);
+#endif
+	commands_printf(" ");
+}
+
+/*
+ * Feed the frames that the CAN driver has received on an interface to libcanard. The
+ * frames are fetched in batches from the lock-free RX ring, which allows only one
+ * consumer. This thread only reads it in CAN_MODE_UAVCAN and the CAN process thread
+ * only outside of it, see cancom_process_thread.
+ */
+static void process_rx(CanardInstance *ins, int interface) {
+	static CANRxFrame frames[RX_BATCH_SIZE];
+	if_stats_t *stats = (if_stats_t*)canardGetUserReference(ins);
+	int num;
+
+	do {
+		num = comm_can_get_rx_frames(interface, frames, RX_BATCH_SIZE);
+		uint64_t timestamp = ST2US(chVTGetSystemTimeX());
+
+		for (int i = 0;i < num;i++) {
+			CANRxFrame *rxmsg = &frames[i];
+			CanardCANFrame rx_frame;
+
+			if (rxmsg->IDE == CAN_IDE_EXT) {
+				rx_frame.id = rxmsg->EID | CANARD_CAN_FRAME_EFF;
+			} else {
+				rx_frame.id = rxmsg->SID;
+			}
+
+			rx_frame.data_len = rxmsg->DLC;
+			memcpy(rx_frame.data, rxmsg->data8, rxmsg->DLC);
+
+			int16_t res = canardHandleRxFrame(ins, &rx_frame, timestamp);
+			stats->rx_frames++;
+
+			if (res < 0 && res != -CANARD_ERROR_RX_NOT_WANTED &&
+					res != -CANARD_ERROR_RX_WRONG_ADDRESS) {
+				stats->rx_errors++;
+			}
+		}
+	} while (num == RX_BATCH_SIZE);
+}
+
+/*
+ * Send everything in the TX queue back to back
+ */
+static void flush_tx(CanardInstance *ins, int interface) {
+	if_stats_t *stats = (if_stats_t*)canardGetUserReference(ins);
+
+	for (const CanardCANFrame* txf = NULL; (txf = canardPeekTxQueue(ins)) != NULL;) {
+		comm_can_transmit_eid_if(txf->id, txf->data, txf->data_len, interface);
+		canardPopTxQueue(ins);
+		stats->tx_frames++;
+	}
+}
+
+static uint32_t rate_to_period(uint32_t rate_hz) {
+	if (rate_hz == 0) {
+		return 0;
+	}
+
+	uint32_t period = CH_CFG_ST_FREQUENCY / rate_hz;
+	return period > 0 ? period : 1;
+}
+
 static THD_FUNCTION(canard_thread, arg) {
 	(void)arg;
 	chRegSetThreadName("UAVCAN");
 
 	getParamByName("controller_id")->defval = HW_DEFAULT_ID;
 
-	systime_t last_status_time = 0;
-	systime_t last_esc_status_time = 0;
-	systime_t last_esc_status_time_r2 = 0;
 	systime_t last_tot_current_calc_time = 0;
 	systime_t last_param_refresh = 0;
 	bool was_running = false;
@@ -1328,21 +1496,21 @@ static THD_FUNCTION(canard_thread, arg) {
 		if (!was_running) {
 			memset(&canard_ins, 0, sizeof(canard_ins));
 			memset(canard_memory_pool, 0, sizeof(canard_memory_pool));
+			memset(&if_stats, 0, sizeof(if_stats));
 
 			canardInit(&canard_ins, canard_memory_pool, sizeof(canard_memory_pool),
-					onTransferReceived, shouldAcceptTransfer, NULL);
+					onTransferReceived, shouldAcceptTransfer, &if_stats);
 
 #ifdef HW_CAN2_DEV
 			memset(&canard_ins_if2, 0, sizeof(canard_ins_if2));
 			memset(canard_memory_pool_if2, 0, sizeof(canard_memory_pool_if2));
+			memset(&if_stats_if2, 0, sizeof(if_stats_if2));
 
 			canardInit(&canard_ins_if2, canard_memory_pool_if2, sizeof(canard_memory_pool_if2),
-					onTransferReceived, shouldAcceptTransfer, NULL);
+					onTransferReceived, shouldAcceptTransfer, &if_stats_if2);
 #endif
 
-			last_status_time = chVTGetSystemTimeX();
-			last_esc_status_time = chVTGetSystemTimeX();
-			last_esc_status_time_r2 = chVTGetSystemTimeX();
+			memset(publish_slots, 0, sizeof(publish_slots));
 			last_tot_current_calc_time = chVTGetSystemTimeX();
 			last_param_refresh = chVTGetSystemTimeX();
 
@@ -1355,84 +1523,47 @@ static THD_FUNCTION(canard_thread, arg) {
 		canardSetLocalNodeID(&canard_ins_if2, conf->controller_id);
 #endif
 
-		CANRxFrame *rxmsg;
-		while ((rxmsg = comm_can_get_rx_frame(1)) != 0) {
-			CanardCANFrame rx_frame;
-
-			if (rxmsg->IDE == CAN_IDE_EXT) {
-				rx_frame.id = rxmsg->EID | CANARD_CAN_FRAME_EFF;
-			} else {
-				rx_frame.id = rxmsg->SID;
-			}
-
-			rx_frame.data_len = rxmsg->DLC;
-			memcpy(rx_frame.data, rxmsg->data8, rxmsg->DLC);
-
-			canardHandleRxFrame(&canard_ins, &rx_frame, ST2US(chVTGetSystemTimeX()));
-		}
-
-		for (const CanardCANFrame* txf = NULL; (txf = canardPeekTxQueue(&canard_ins)) != NULL;) {
-			comm_can_transmit_eid_if(txf->id, txf->data, txf->data_len, 1);
-			canardPopTxQueue(&canard_ins);
-		}
-
+		process_rx(&canard_ins, 1);
 #ifdef HW_CAN2_DEV
-		while ((rxmsg = comm_can_get_rx_frame(2)) != 0) {
-			CanardCANFrame rx_frame;
-
-			if (rxmsg->IDE == CAN_IDE_EXT) {
-				rx_frame.id = rxmsg->EID | CANARD_CAN_FRAME_EFF;
-			} else {
-				rx_frame.id = rxmsg->SID;
-			}
+		process_rx(&canard_ins_if2, 2);
+#endif
 
-			rx_frame.data_len = rxmsg->DLC;
-			memcpy(rx_frame.data, rxmsg->data8, rxmsg->DLC);
+		// All messages that are due are encoded together and sent as one burst below
+		systime_t now = chVTGetSystemTimeX();
+		canard_sched_set_period(&publish_slots[PUBLISH_NODE_STATUS], MS2ST(1000), now);
+		canard_sched_set_period(&publish_slots[PUBLISH_RATE_1], rate_to_period(conf->can_status_rate_1), now);
+		canard_sched_set_period(&publish_slots[PUBLISH_RATE_2], rate_to_period(conf->can_status_rate_2), now);
+		uint32_t publish = canard_sched_poll(publish_slots, PUBLISH_NUM, now, MS2ST(PUBLISH_SLACK_MS));
 
-			canardHandleRxFrame(&canard_ins_if2, &rx_frame, ST2US(chVTGetSystemTimeX()));
+		if (publish & (1 << PUBLISH_NODE_STATUS)) {
+			canardCleanupStaleTransfers(&canard_ins, ST2US(now));
+#ifdef HW_CAN2_DEV
+			canardCleanupStaleTransfers(&canard_ins_if2, ST2US(now));
+#endif
+			sendNodeStatus();
 		}
 
-		for (const CanardCANFrame* txf = NULL; (txf = canardPeekTxQueue(&canard_ins_if2)) != NULL;) {
-			comm_can_transmit_eid_if(txf->id, txf->data, txf->data_len, 2);
-			canardPopTxQueue(&canard_ins_if2);
+		if (publish & (1 << PUBLISH_RATE_1)) {
+			sendEscStatus();
 		}
-#endif
 
-		if (ST2MS(chVTTimeElapsedSinceX(last_status_time)) >= 1000) {
-			last_status_time = chVTGetSystemTimeX();
-			canardCleanupStaleTransfers(&canard_ins, ST2US(chVTGetSystemTimeX()));
-			sendNodeStatus(&canard_ins);
-#ifdef HW_CAN2_DEV
-			canardCleanupStaleTransfers(&canard_ins_if2, ST2US(chVTGetSystemTimeX()));
-			sendNodeStatus(&canard_ins_if2);
-#endif
+		if (((publish & (1 << PUBLISH_RATE_1)) && ((conf->can_status_msgs_r1 >> 0) & 1)) ||
+				((publish & (1 << PUBLISH_RATE_2)) && ((conf->can_status_msgs_r2 >> 0) & 1))) {
+			sendRtData();
 		}
 
-		if (conf->can_status_rate_1 > 0 && UTILS_AGE_S(last_esc_status_time) >= (1.0 / (float)conf->can_status_rate_1)) {
-			last_esc_status_time = chVTGetSystemTimeX();
-			sendEscStatus(&canard_ins);
-#ifdef HW_CAN2_DEV
-			sendEscStatus(&canard_ins_if2);
-#endif
-
-			if ((conf->can_status_msgs_r1 >> 0) & 1) {
-				sendRtData(&canard_ins);
+		if (publish) {
+			if_stats.bursts++;
 #ifdef HW_CAN2_DEV
-				sendRtData(&canard_ins_if2);
+			if_stats_if2.bursts++;
 #endif
-			}
 		}
 
-		if (conf->can_status_rate_2 > 0 && UTILS_AGE_S(last_esc_status_time_r2) >= (1.0 / (float)conf->can_status_rate_2)) {
-			last_esc_status_time_r2 = chVTGetSystemTimeX();
-
-			if ((conf->can_status_msgs_r2 >> 0) & 1) {
-				sendRtData(&canard_ins);
+		// Responses to the received transfers and the publish burst
+		flush_tx(&canard_ins, 1);
 #ifdef HW_CAN2_DEV
-				sendRtData(&canard_ins_if2);
+		flush_tx(&canard_ins_if2, 2);
 #endif
-			}
-		}
 
 		if (ST2MS(chVTTimeElapsedSinceX(last_tot_current_calc_time)) >= 1000 / CURRENT_CALC_FREQ_HZ) {
 			last_tot_current_calc_time = chVTGetSystemTimeX();
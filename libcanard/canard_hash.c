@@ -0,0 +1,98 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "canard_hash.h"
+
+static unsigned int slot_of(uint32_t key) {
+	// Fibonacci hashing, the high bits of the product are well mixed
+	return (key * 2654435761u) >> (32 - CANARD_HASH_BITS);
+}
+
+void canard_hash_init(canard_hash_t *h) {
+	for (int i = 0;i < CANARD_HASH_SLOTS;i++) {
+		h->key[i] = 0;
+		h->val[i] = CANARD_HASH_EMPTY;
+	}
+}
+
+/**
+ * Add a key to the table.
+ *
+ * @return
+ * false if the table is full or if the key already is in the table. In the
+ * latter case two entries hash to the same key and the caller has to fall
+ * back to a linear search for them.
+ */
+bool canard_hash_insert(canard_hash_t *h, uint32_t key, uint8_t val) {
+	if (val == CANARD_HASH_EMPTY) {
+		return false;
+	}
+
+	unsigned int slot = slot_of(key);
+	for (int i = 0;i < CANARD_HASH_SLOTS;i++) {
+		if (h->val[slot] == CANARD_HASH_EMPTY) {
+			h->key[slot] = key;
+			h->val[slot] = val;
+			return true;
+		}
+
+		if (h->key[slot] == key) {
+			return false;
+		}
+
+		slot = (slot + 1) & (CANARD_HASH_SLOTS - 1);
+	}
+
+	return false;
+}
+
+/**
+ * Look up a key.
+ *
+ * @return
+ * The value stored for key, or -1 if it is not in the table.
+ */
+int canard_hash_find(const canard_hash_t *h, uint32_t key) {
+	unsigned int slot = slot_of(key);
+	for (int i = 0;i < CANARD_HASH_SLOTS;i++) {
+		if (h->val[slot] == CANARD_HASH_EMPTY) {
+			return -1;
+		}
+
+		if (h->key[slot] == key) {
+			return h->val[slot];
+		}
+
+		slot = (slot + 1) & (CANARD_HASH_SLOTS - 1);
+	}
+
+	return -1;
+}
+
+/**
+ * 32-bit FNV-1a hash of a null-terminated string.
+ */
+uint32_t canard_hash_str(const char *str) {
+	uint32_t hash = 2166136261u;
+	while (*str) {
+		hash ^= (uint8_t)*str++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
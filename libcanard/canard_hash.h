@@ -0,0 +1,47 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef LIBCANARD_CANARD_HASH_H_
+#define LIBCANARD_CANARD_HASH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Settings
+#define CANARD_HASH_BITS		5
+#define CANARD_HASH_SLOTS		(1 << CANARD_HASH_BITS) // Keep at least twice the number of entries
+#define CANARD_HASH_EMPTY		0xFF
+
+/*
+ * Fixed size open addressing table from a 32-bit key to a table index. Used
+ * to look up transfer handlers by data type and parameters by name without
+ * scanning. The table is filled once at init and only read after that.
+ */
+typedef struct {
+	uint32_t key[CANARD_HASH_SLOTS];
+	uint8_t val[CANARD_HASH_SLOTS];
+} canard_hash_t;
+
+// Functions
+void canard_hash_init(canard_hash_t *h);
+bool canard_hash_insert(canard_hash_t *h, uint32_t key, uint8_t val);
+int canard_hash_find(const canard_hash_t *h, uint32_t key);
+uint32_t canard_hash_str(const char *str);
+
+#endif /* LIBCANARD_CANARD_HASH_H_ */
@@ -0,0 +1,78 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "canard_sched.h"
+
+static bool reached(uint32_t now, uint32_t time) {
+	return (int32_t)(now - time) >= 0;
+}
+
+static void advance(canard_sched_slot_t *slot, uint32_t now) {
+	// Keep the phase so that the rate does not drift with the loop time, but
+	// do not try to catch up when more than a period was missed.
+	slot->next += slot->period;
+	if (reached(now, slot->next)) {
+		slot->next = now + slot->period;
+	}
+}
+
+/**
+ * Set the period of a slot. The slot is restarted only when the period
+ * changes, so this can be called with the current configuration on every
+ * iteration.
+ */
+void canard_sched_set_period(canard_sched_slot_t *slot, uint32_t period, uint32_t now) {
+	if (slot->period != period) {
+		slot->period = period;
+		slot->next = now + period;
+	}
+}
+
+/**
+ * Check which slots should publish now.
+ *
+ * @param slack
+ * When at least one slot is due, slots that become due within slack ticks
+ * are taken as well, so that their messages go out in the same transmit
+ * burst instead of in a separate one shortly after.
+ *
+ * @return
+ * Bitmask with bit n set if slot n should publish.
+ */
+uint32_t canard_sched_poll(canard_sched_slot_t *slots, int num, uint32_t now, uint32_t slack) {
+	uint32_t mask = 0;
+
+	for (int i = 0;i < num;i++) {
+		if (slots[i].period > 0 && reached(now, slots[i].next)) {
+			mask |= 1u << i;
+			advance(&slots[i], now);
+		}
+	}
+
+	if (mask) {
+		for (int i = 0;i < num;i++) {
+			if (!(mask & (1u << i)) && slots[i].period > 0 && reached(now + slack, slots[i].next)) {
+				mask |= 1u << i;
+				advance(&slots[i], now);
+			}
+		}
+	}
+
+	return mask;
+}
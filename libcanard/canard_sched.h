@@ -0,0 +1,38 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef LIBCANARD_CANARD_SCHED_H_
+#define LIBCANARD_CANARD_SCHED_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Periodic publish slot. Times are in system ticks and wrap around.
+ */
+typedef struct {
+	uint32_t period; // 0 = disabled
+	uint32_t next;
+} canard_sched_slot_t;
+
+// Functions
+void canard_sched_set_period(canard_sched_slot_t *slot, uint32_t period, uint32_t now);
+uint32_t canard_sched_poll(canard_sched_slot_t *slots, int num, uint32_t now, uint32_t slack);
+
+#endif /* LIBCANARD_CANARD_SCHED_H_ */
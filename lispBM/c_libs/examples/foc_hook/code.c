@@ -0,0 +1,114 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "vesc_c_if.h"
+
+HEADER
+
+// Cogging compensation: a q-axis current offset indexed by the electrical
+// angle, added to the current reference at FOC rate.
+
+#define TABLE_SIZE		64
+#define PI_F			3.14159265f
+
+typedef struct {
+	float table[TABLE_SIZE];
+	int hook;
+} data;
+
+static void cogging_hook(const foc_hook_state *state, foc_hook_override *override) {
+	data *d = (data*)ARG;
+
+	float phase = state->phase;
+	if (phase < 0.0) {
+		phase += 2.0 * PI_F;
+	}
+
+	int ind = (int)(phase / (2.0 * PI_F) * (float)TABLE_SIZE);
+	if (ind < 0 || ind >= TABLE_SIZE) {
+		ind = 0;
+	}
+
+	override->iq = state->iq_target + d->table[ind];
+	override->iq_set = true;
+}
+
+// (ext-cogging-set index current)
+static lbm_value ext_cogging_set(lbm_value *args, lbm_uint argn) {
+	if (argn != 2 || !VESC_IF->lbm_is_number(args[0]) || !VESC_IF->lbm_is_number(args[1])) {
+		return VESC_IF->lbm_enc_sym_eerror;
+	}
+
+	int ind = VESC_IF->lbm_dec_as_i32(args[0]);
+	if (ind < 0 || ind >= TABLE_SIZE) {
+		return VESC_IF->lbm_enc_sym_eerror;
+	}
+
+	data *d = (data*)ARG;
+	d->table[ind] = VESC_IF->lbm_dec_as_float(args[1]);
+	return VESC_IF->lbm_enc_sym_true;
+}
+
+// (ext-cogging-stats) -> (calls overruns time-max enabled)
+static lbm_value ext_cogging_stats(lbm_value *args, lbm_uint argn) {
+	(void)args; (void)argn;
+
+	data *d = (data*)ARG;
+	foc_hook_stats stats;
+	if (!VESC_IF->foc_hook_get_stats(d->hook, &stats)) {
+		return VESC_IF->lbm_enc_sym_nil;
+	}
+
+	lbm_value res = stats.enabled ? VESC_IF->lbm_enc_sym_true : VESC_IF->lbm_enc_sym_nil;
+	res = VESC_IF->lbm_cons(res, VESC_IF->lbm_enc_sym_nil);
+	res = VESC_IF->lbm_cons(VESC_IF->lbm_enc_float(stats.time_max), res);
+	res = VESC_IF->lbm_cons(VESC_IF->lbm_enc_u32(stats.overruns), res);
+	res = VESC_IF->lbm_cons(VESC_IF->lbm_enc_u32(stats.calls), res);
+	return res;
+}
+
+static void stop(void *arg) {
+	data *d = (data*)arg;
+	VESC_IF->foc_hook_unregister(d->hook);
+	VESC_IF->free(d);
+}
+
+INIT_FUN(lib_info *info) {
+	INIT_START
+
+	data *d = VESC_IF->malloc(sizeof(data));
+	if (!d) {
+		return false;
+	}
+
+	for (int i = 0;i < TABLE_SIZE;i++) {
+		d->table[i] = 0.0;
+	}
+
+	info->stop_fun = stop;
+	info->arg = d;
+
+	// 5 us is a small fraction of the control period
+	d->hook = VESC_IF->foc_hook_register(FOC_HOOK_PRE_CURRENT, cogging_hook, 5e-6);
+
+	VESC_IF->lbm_add_extension("ext-cogging-set", ext_cogging_set);
+	VESC_IF->lbm_add_extension("ext-cogging-stats", ext_cogging_stats);
+
+	return true;
+}
@@ -0,0 +1,9 @@
+; Regression script for the host build of the examples, see Makefile.
+; Evaluates to t when the extensions registered by the libraries work.
+
+(define res-test (= (ext-test 14) 42))
+(define res-dec-cnt (eq (type-of (ext-dec-cnt 1000)) 'type-float))
+(define res-tak (eq (type-of (ext-tak 12 8 4)) 'type-float))
+(define res-cogging (ext-cogging-set 3 0.5))
+
+(and res-test res-dec-cnt res-tak res-cogging)
@@ -0,0 +1,362 @@
+/*
+	Copyright 2022 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Loads native libraries built for the host (see Makefile) into a lispBM
+ * instance and either evaluates lisp scripts against them or calls their
+ * extensions directly in a timed loop.
+ *
+ * lib_bench [-h heap] [-n iterations] [-s script.lisp]... [-b "ext arg ..."]... lib.so...
+ *
+ * -s  Evaluate a script after the libraries are loaded. The run fails if the
+ *     script times out or evaluates to an error.
+ * -b  Benchmark an extension. The arguments are evaluated once as lisp
+ *     expressions, then the extension is called n times with the evaluator
+ *     paused. Extensions that block the calling context can only be run
+ *     from scripts.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "lispbm.h"
+#include "extensions/array_extensions.h"
+#include "extensions/string_extensions.h"
+#include "extensions/math_extensions.h"
+#include "extensions/runtime_extensions.h"
+#include "vesc_if_host.h"
+
+#define GC_STACK_SIZE			256
+#define PRINT_STACK_SIZE		256
+#define EXTENSION_STORAGE_SIZE	256
+#define VARIABLE_STORAGE_SIZE	256
+#define SCRIPTS_MAX				16
+#define BENCH_MAX				16
+#define BENCH_ARGS_MAX			16
+#define EVAL_TIMEOUT_MS			60000
+#define STR_SIZE				1024
+
+static lbm_uint gc_stack_storage[GC_STACK_SIZE];
+static lbm_uint print_stack_storage[PRINT_STACK_SIZE];
+static extension_fptr extension_storage[EXTENSION_STORAGE_SIZE];
+static lbm_value variable_storage[VARIABLE_STORAGE_SIZE];
+static lbm_uint memory[LBM_MEMORY_SIZE_16K];
+static lbm_uint bitmap[LBM_MEMORY_BITMAP_SIZE_16K];
+
+static lbm_char_channel_t string_tok;
+static lbm_string_channel_state_t string_tok_state;
+
+static volatile lbm_cid wait_cid = -1;
+static volatile bool wait_done = false;
+static volatile lbm_value wait_res;
+
+static uint32_t timestamp_callback(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint32_t)((uint64_t)t.tv_sec * 1000000u + (uint64_t)t.tv_nsec / 1000u);
+}
+
+static void sleep_callback(uint32_t us) {
+	struct timespec s;
+	s.tv_sec = us / 1000000;
+	s.tv_nsec = (long)(us % 1000000) * 1000;
+	nanosleep(&s, NULL);
+}
+
+static double time_s(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
+
+static void done_callback(eval_context_t *ctx) {
+	if (ctx->id == wait_cid) {
+		wait_res = ctx->r;
+		wait_done = true;
+	}
+}
+
+static void *eval_thd_wrapper(void *v) {
+	(void)v;
+	lbm_run_eval();
+	return NULL;
+}
+
+static void pause_eval(void) {
+	lbm_pause_eval();
+	while (lbm_get_eval_state() != EVAL_CPS_STATE_PAUSED) {
+		sleep_callback(100);
+	}
+}
+
+/*
+ * Evaluate a program or a single expression and wait for the result.
+ * Returns false on timeout or on a reader error.
+ */
+static bool eval_str(char *code, bool program, lbm_value *res) {
+	pause_eval();
+	lbm_create_string_char_channel(&string_tok_state, &string_tok, code);
+
+	wait_done = false;
+	lbm_cid cid = program ? lbm_load_and_eval_program(&string_tok) :
+			lbm_load_and_eval_expression(&string_tok);
+	if (cid < 0) {
+		lbm_continue_eval();
+		return false;
+	}
+
+	wait_cid = cid;
+	lbm_continue_eval();
+
+	for (int i = 0;i < EVAL_TIMEOUT_MS && !wait_done;i++) {
+		sleep_callback(1000);
+	}
+
+	if (!wait_done) {
+		return false;
+	}
+
+	*res = wait_res;
+	return true;
+}
+
+static char *read_file(const char *path) {
+	FILE *f = fopen(path, "r");
+	if (!f) {
+		return NULL;
+	}
+
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	rewind(f);
+
+	char *buf = NULL;
+	if (size >= 0) {
+		buf = calloc(1, (size_t)size + 1);
+		if (buf && fread(buf, 1, (size_t)size, f) != (size_t)size) {
+			free(buf);
+			buf = NULL;
+		}
+	}
+
+	fclose(f);
+	return buf;
+}
+
+static bool run_script(const char *path) {
+	char *code = read_file(path);
+	if (!code) {
+		printf("%s: could not read file\n", path);
+		return false;
+	}
+
+	lbm_value res;
+	bool ok = eval_str(code, true, &res);
+	char output[STR_SIZE];
+
+	if (!ok) {
+		printf("%s: evaluation timed out or failed to start\n", path);
+	} else {
+		lbm_print_value(output, STR_SIZE, res);
+		printf("%s: %s\n", path, output);
+		ok = !lbm_is_error(res);
+	}
+
+	free(code);
+	return ok;
+}
+
+static int cmp_double(const void *a, const void *b) {
+	double fa = *(const double*)a;
+	double fb = *(const double*)b;
+	return (fa > fb) - (fa < fb);
+}
+
+static bool run_bench(const char *spec, int iterations) {
+	char name[STR_SIZE];
+	char code[STR_SIZE];
+
+	const char *args = strchr(spec, ' ');
+	size_t name_len = args ? (size_t)(args - spec) : strlen(spec);
+	if (name_len == 0 || name_len >= STR_SIZE) {
+		printf("%s: bad benchmark spec\n", spec);
+		return false;
+	}
+	memcpy(name, spec, name_len);
+	name[name_len] = 0;
+	snprintf(code, STR_SIZE, "(list %s)", args ? args : "");
+
+	lbm_uint sym;
+	extension_fptr ext = NULL;
+	if (lbm_get_symbol_by_name(name, &sym)) {
+		ext = lbm_get_extension(sym);
+	}
+	if (!ext) {
+		printf("%s: no such extension\n", name);
+		return false;
+	}
+
+	lbm_value arg_list;
+	if (!eval_str(code, false, &arg_list) || lbm_is_error(arg_list)) {
+		printf("%s: could not evaluate arguments\n", name);
+		return false;
+	}
+
+	// No other contexts are running, so with the evaluator paused the
+	// argument list cannot be collected while the extension runs.
+	pause_eval();
+
+	lbm_value argv[BENCH_ARGS_MAX];
+	lbm_uint argn = 0;
+	while (lbm_is_cons(arg_list) && argn < BENCH_ARGS_MAX) {
+		argv[argn++] = lbm_car(arg_list);
+		arg_list = lbm_cdr(arg_list);
+	}
+
+	double *times = malloc(sizeof(double) * (size_t)iterations);
+	if (!times) {
+		lbm_continue_eval();
+		return false;
+	}
+
+	// Run once as warm-up with library output enabled
+	lbm_value res = ext(argv, argn);
+	double total = 0.0;
+
+	vesc_if_host_set_quiet(true);
+	for (int i = 0;i < iterations;i++) {
+		double t0 = time_s();
+		res = ext(argv, argn);
+		times[i] = time_s() - t0;
+		total += times[i];
+	}
+	vesc_if_host_set_quiet(false);
+
+	qsort(times, (size_t)iterations, sizeof(double), cmp_double);
+
+	char output[STR_SIZE];
+	lbm_print_value(output, STR_SIZE, res);
+	printf("%s: n %d, min %.3f us, median %.3f us, mean %.3f us, max %.3f us, res %s\n",
+			spec, iterations,
+			times[0] * 1e6, times[iterations / 2] * 1e6,
+			total / iterations * 1e6, times[iterations - 1] * 1e6,
+			output);
+
+	free(times);
+	lbm_continue_eval();
+	return !lbm_is_error(res);
+}
+
+int main(int argc, char **argv) {
+	unsigned int heap_size = 8192;
+	int iterations = 100;
+	char *scripts[SCRIPTS_MAX];
+	int scripts_num = 0;
+	char *benches[BENCH_MAX];
+	int benches_num = 0;
+
+	int c;
+	while ((c = getopt(argc, argv, "h:n:s:b:")) != -1) {
+		switch (c) {
+		case 'h':
+			heap_size = (unsigned int)atoi(optarg);
+			break;
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		case 's':
+			if (scripts_num < SCRIPTS_MAX) {
+				scripts[scripts_num++] = optarg;
+			}
+			break;
+		case 'b':
+			if (benches_num < BENCH_MAX) {
+				benches[benches_num++] = optarg;
+			}
+			break;
+		default:
+			return 1;
+		}
+	}
+
+	if (optind >= argc || iterations < 1) {
+		printf("Usage: %s [-h heap] [-n iterations] [-s script.lisp]... [-b \"ext arg ...\"]... lib.so...\n", argv[0]);
+		return 1;
+	}
+
+	lbm_cons_t *heap_storage = malloc(sizeof(lbm_cons_t) * heap_size);
+	if (!heap_storage) {
+		return 1;
+	}
+
+	if (!lbm_init(heap_storage, heap_size,
+			gc_stack_storage, GC_STACK_SIZE,
+			memory, LBM_MEMORY_SIZE_16K,
+			bitmap, LBM_MEMORY_BITMAP_SIZE_16K,
+			print_stack_storage, PRINT_STACK_SIZE,
+			extension_storage, EXTENSION_STORAGE_SIZE)) {
+		printf("Failed to initialize LispBM\n");
+		return 1;
+	}
+
+	lbm_eval_init_events(20);
+	lbm_set_ctx_done_callback(done_callback);
+	lbm_set_timestamp_us_callback(timestamp_callback);
+	lbm_set_usleep_callback(sleep_callback);
+	lbm_set_printf_callback(printf);
+	lbm_variables_init(variable_storage, VARIABLE_STORAGE_SIZE);
+
+	lbm_array_extensions_init();
+	lbm_string_extensions_init();
+	lbm_math_extensions_init();
+	lbm_runtime_extensions_init(false);
+
+	vesc_if_host_init();
+
+	for (int i = optind;i < argc;i++) {
+		if (!vesc_if_host_load(argv[i])) {
+			return 1;
+		}
+	}
+
+	pthread_t lispbm_thd;
+	if (pthread_create(&lispbm_thd, NULL, eval_thd_wrapper, NULL)) {
+		printf("Error creating evaluation thread\n");
+		return 1;
+	}
+
+	bool ok = true;
+	for (int i = 0;i < scripts_num;i++) {
+		ok = run_script(scripts[i]) && ok;
+	}
+
+	for (int i = 0;i < benches_num;i++) {
+		ok = run_bench(benches[i], iterations) && ok;
+	}
+
+	pause_eval();
+	vesc_if_host_unload_all();
+
+	return ok ? 0 : 1;
+}
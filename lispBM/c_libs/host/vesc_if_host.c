@@ -0,0 +1,1050 @@
+/*
+	Copyright 2022 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <pthread.h>
+
+#include "lispbm.h"
+#include "lbm_flat_value.h"
+#include "vesc_c_if.h"
+#include "vesc_if_host.h"
+
+#define LIB_NUM_MAX			10
+#define EEPROM_VARS			128
+#define NVM_SIZE			(128 * 1024)
+#define SYSTIME_FREQ		10000
+
+typedef struct {
+	lib_info info;
+	void *handle;
+} host_lib;
+
+typedef struct {
+	void (*func)(void*);
+	void *arg;
+	pthread_t thd;
+	volatile bool terminate;
+} host_thd;
+
+static vesc_c_if cif;
+vesc_c_if *vesc_lib_host_if = &cif;
+
+static host_lib loaded_libs[LIB_NUM_MAX];
+static struct timespec start_time;
+static pthread_mutex_t sys_mutex;
+static __thread host_thd *current_thd = NULL;
+
+static eeprom_var eeprom[EEPROM_VARS];
+static uint8_t nvm[NVM_SIZE];
+static float cfg_float[CFG_PARAM_IMU_rot_yaw + 1];
+static int cfg_int[CFG_PARAM_IMU_rot_yaw + 1];
+static volatile gnss_data gnss;
+static void(*app_data_handler)(unsigned char *data, unsigned int len) = NULL;
+static volatile bool printf_quiet = false;
+
+// OS
+
+static uint64_t time_us(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)(t.tv_sec - start_time.tv_sec) * 1000000u +
+			(uint64_t)((t.tv_nsec - start_time.tv_nsec) / 1000);
+}
+
+static void lib_sleep_us(uint32_t us) {
+	struct timespec s;
+	s.tv_sec = us / 1000000;
+	s.tv_nsec = (long)(us % 1000000) * 1000;
+	nanosleep(&s, NULL);
+}
+
+static void lib_sleep_ms(uint32_t ms) {
+	lib_sleep_us(ms * 1000);
+}
+
+static float lib_system_time(void) {
+	return (float)time_us() / 1e6f;
+}
+
+static float lib_ts_to_age_s(systime_t ts) {
+	systime_t now = (systime_t)(time_us() / (1000000 / SYSTIME_FREQ));
+	return (float)(systime_t)(now - ts) / (float)SYSTIME_FREQ;
+}
+
+// Same behavior as commands_printf_lisp: the lisp console adds the line break
+static int lib_printf(const char *str, ...) {
+	if (printf_quiet) {
+		return 0;
+	}
+
+	va_list arg;
+	va_start(arg, str);
+	int len = vprintf(str, arg);
+	va_end(arg);
+
+	if (len > 0 && str[strlen(str) - 1] != '\n') {
+		putchar('\n');
+	}
+
+	fflush(stdout);
+	return len;
+}
+
+static void *lib_thd(void *arg) {
+	host_thd *t = (host_thd*)arg;
+	current_thd = t;
+	t->func(t->arg);
+	return NULL;
+}
+
+static lib_thread lib_spawn(void (*func)(void*), size_t stack_size, char *name, void *arg) {
+	(void)stack_size; (void)name;
+
+	host_thd *t = calloc(1, sizeof(host_thd));
+	if (!t) {
+		return NULL;
+	}
+
+	t->func = func;
+	t->arg = arg;
+
+	if (pthread_create(&t->thd, NULL, lib_thd, t) != 0) {
+		free(t);
+		return NULL;
+	}
+
+	return t;
+}
+
+static void lib_request_terminate(lib_thread thd) {
+	host_thd *t = (host_thd*)thd;
+	t->terminate = true;
+	pthread_join(t->thd, NULL);
+	free(t);
+}
+
+static bool lib_should_terminate(void) {
+	return current_thd != NULL && current_thd->terminate;
+}
+
+static void** lib_get_arg(uint32_t prog_addr) {
+	for (int i = 0;i < LIB_NUM_MAX;i++) {
+		if (loaded_libs[i].handle != NULL && loaded_libs[i].info.base_addr == prog_addr) {
+			return &loaded_libs[i].info.arg;
+		}
+	}
+
+	return NULL;
+}
+
+static lib_mutex lib_mutex_create(void) {
+	pthread_mutex_t *m = malloc(sizeof(pthread_mutex_t));
+	if (m) {
+		pthread_mutex_init(m, NULL);
+	}
+	return m;
+}
+
+static void lib_mutex_lock(lib_mutex m) {
+	pthread_mutex_lock((pthread_mutex_t*)m);
+}
+
+static void lib_mutex_unlock(lib_mutex m) {
+	pthread_mutex_unlock((pthread_mutex_t*)m);
+}
+
+static void lib_sys_lock(void) {
+	pthread_mutex_lock(&sys_mutex);
+}
+
+static void lib_sys_unlock(void) {
+	pthread_mutex_unlock(&sys_mutex);
+}
+
+static uint32_t lib_timer_time_now(void) {
+	return (uint32_t)time_us();
+}
+
+static float lib_timer_seconds_elapsed_since(uint32_t time) {
+	return (float)(uint32_t)(lib_timer_time_now() - time) / 1e6f;
+}
+
+static void lib_timer_sleep(float seconds) {
+	lib_sleep_us((uint32_t)(seconds * 1e6f));
+}
+
+// LBM
+
+static bool lib_eval_is_paused(void) {
+	return lbm_get_eval_state() == EVAL_CPS_STATE_PAUSED;
+}
+
+static bool lib_create_byte_array(lbm_value *value, lbm_uint num_elt) {
+	return lbm_heap_allocate_array(value, num_elt);
+}
+
+static lbm_value lib_enc_float(float f) {
+	return lbm_enc_float(f);
+}
+
+static float lib_dec_as_float(lbm_value val) {
+	return (float)lbm_dec_as_float(val);
+}
+
+static lbm_value lib_enc_i(lbm_int x) {
+	return lbm_enc_i(x);
+}
+
+static lbm_value lib_enc_u(lbm_uint x) {
+	return lbm_enc_u(x);
+}
+
+static lbm_value lib_enc_char(char x) {
+	return lbm_enc_char((uint8_t)x);
+}
+
+static char lib_dec_char(lbm_value x) {
+	return (char)lbm_dec_char(x);
+}
+
+static lbm_value lib_enc_sym(lbm_uint s) {
+	return lbm_enc_sym(s);
+}
+
+static lbm_uint lib_dec_sym(lbm_value x) {
+	return lbm_dec_sym(x);
+}
+
+static bool lib_is_cons(lbm_value x) {
+	return lbm_is_cons(x);
+}
+
+static bool lib_is_number(lbm_value x) {
+	return lbm_is_number(x);
+}
+
+static bool lib_is_char(lbm_value x) {
+	return lbm_is_char(x);
+}
+
+static bool lib_is_symbol(lbm_value x) {
+	return lbm_is_symbol(x);
+}
+
+static bool lib_is_symbol_nil(lbm_uint x) {
+	return lbm_is_symbol_nil(x);
+}
+
+static bool lib_is_symbol_true(lbm_uint x) {
+	return lbm_is_symbol_true(x);
+}
+
+static bool lib_symbol_to_io(lbm_uint sym, void **gpio, uint32_t *pin) {
+	(void)sym; (void)gpio; (void)pin;
+	return false;
+}
+
+// IO
+
+static void stub_pad_mode(void *gpio, uint32_t pin, uint32_t mode) {
+	(void)gpio; (void)pin; (void)mode;
+}
+
+static void stub_pad(void *gpio, uint32_t pin) {
+	(void)gpio; (void)pin;
+}
+
+static bool stub_io_set_mode(VESC_PIN pin, VESC_PIN_MODE mode) {
+	(void)pin; (void)mode;
+	return false;
+}
+
+static bool stub_io_write(VESC_PIN pin, int state) {
+	(void)pin; (void)state;
+	return false;
+}
+
+static bool stub_io_read(VESC_PIN pin) {
+	(void)pin;
+	return false;
+}
+
+static float stub_io_read_analog(VESC_PIN pin) {
+	(void)pin;
+	return 0.0;
+}
+
+static bool stub_io_get_st_pin(VESC_PIN vesc_pin, void **gpio, uint32_t *pin) {
+	(void)vesc_pin; (void)gpio; (void)pin;
+	return false;
+}
+
+// CAN
+
+static void stub_can_set_cb(bool (*p_func)(uint32_t id, uint8_t *data, uint8_t len)) {
+	(void)p_func;
+}
+
+static void stub_can_transmit(uint32_t id, const uint8_t *data, uint8_t len) {
+	(void)id; (void)data; (void)len;
+}
+
+static void stub_can_send_buffer(uint8_t controller_id, uint8_t *data, unsigned int len, uint8_t send) {
+	(void)controller_id; (void)data; (void)len; (void)send;
+}
+
+static void stub_can_set(uint8_t controller_id, float val) {
+	(void)controller_id; (void)val;
+}
+
+static void stub_can_set_off_delay(uint8_t controller_id, float val, float off_delay) {
+	(void)controller_id; (void)val; (void)off_delay;
+}
+
+static bool stub_can_ping(uint8_t controller_id, HW_TYPE *hw_type) {
+	(void)controller_id; (void)hw_type;
+	return false;
+}
+
+#define CAN_STATUS_STUB(name, type) \
+	static type *name(int i) { (void)i; return NULL; }
+
+CAN_STATUS_STUB(stub_can_status_1, can_status_msg)
+CAN_STATUS_STUB(stub_can_status_2, can_status_msg_2)
+CAN_STATUS_STUB(stub_can_status_3, can_status_msg_3)
+CAN_STATUS_STUB(stub_can_status_4, can_status_msg_4)
+CAN_STATUS_STUB(stub_can_status_5, can_status_msg_5)
+CAN_STATUS_STUB(stub_can_status_6, can_status_msg_6)
+
+// Motor control, IMU and other inert stubs
+
+static void stub_void(void) {
+}
+
+static bool stub_true(void) {
+	return true;
+}
+
+static bool stub_false(void) {
+	return false;
+}
+
+static int stub_int(void) {
+	return 0;
+}
+
+static float stub_float(void) {
+	return 0.0;
+}
+
+static void stub_set_int(int val) {
+	(void)val;
+}
+
+static void stub_set_float(float val) {
+	(void)val;
+}
+
+static void stub_set_float2(float val1, float val2) {
+	(void)val1; (void)val2;
+}
+
+static float stub_float_reset(bool reset) {
+	(void)reset;
+	return 0.0;
+}
+
+static int stub_int_reset(bool reset) {
+	(void)reset;
+	return 0;
+}
+
+static int stub_set_tachometer_value(int steps) {
+	(void)steps;
+	return 0;
+}
+
+static bool stub_wait_for_motor_release(float timeout) {
+	(void)timeout;
+	return true;
+}
+
+static void stub_set_pwm_callback(void (*p_func)(void)) {
+	(void)p_func;
+}
+
+static mc_fault_code stub_get_fault(void) {
+	return FAULT_CODE_NONE;
+}
+
+static const char* stub_fault_to_string(mc_fault_code fault) {
+	return fault == FAULT_CODE_NONE ? "FAULT_CODE_NONE" : "FAULT_CODE_UNKNOWN";
+}
+
+static void stub_update_pid_pos_offset(float angle_now, bool store) {
+	(void)angle_now; (void)store;
+}
+
+static float stub_get_battery_level(float *wh_left) {
+	if (wh_left) {
+		*wh_left = 0.0;
+	}
+	return 0.0;
+}
+
+static uint64_t stub_get_odometer(void) {
+	return 0;
+}
+
+static void stub_set_odometer(uint64_t new_odometer_meters) {
+	(void)new_odometer_meters;
+}
+
+static void stub_vec3(float *v) {
+	memset(v, 0, sizeof(float) * 3);
+}
+
+static void stub_quaternions(float *q) {
+	q[0] = 1.0; q[1] = 0.0; q[2] = 0.0; q[3] = 0.0;
+}
+
+static void stub_derotate(float *input, float *output) {
+	memcpy(output, input, sizeof(float) * 3);
+}
+
+static void stub_imu_get_calibration(float yaw, float *imu_cal) {
+	(void)yaw; (void)imu_cal;
+}
+
+static void stub_imu_set_read_callback(void (*func)(float *acc, float *gyro, float *mag, float dt)) {
+	(void)func;
+}
+
+static void stub_ahrs_init(ATTITUDE_INFO *att) {
+	memset(att, 0, sizeof(ATTITUDE_INFO));
+	att->q0 = 1.0;
+}
+
+static void stub_ahrs_initial(float *accelXYZ, float *magXYZ, ATTITUDE_INFO *att) {
+	(void)accelXYZ; (void)magXYZ; (void)att;
+}
+
+static void stub_ahrs_update(float *gyroXYZ, float *accelXYZ, float dt, ATTITUDE_INFO *att) {
+	(void)gyroXYZ; (void)accelXYZ; (void)dt; (void)att;
+}
+
+static float stub_ahrs_angle(ATTITUDE_INFO *att) {
+	(void)att;
+	return 0.0;
+}
+
+static void stub_encoder_callbacks(float (*read_deg)(void), bool (*has_fault)(void), char* (*print_info)(void)) {
+	(void)read_deg; (void)has_fault; (void)print_info;
+}
+
+static remote_state stub_get_remote_state(void) {
+	remote_state r;
+	memset(&r, 0, sizeof(r));
+	r.age_s = 1e6;
+	return r;
+}
+
+static float stub_get_ppm_age(void) {
+	return 1e6;
+}
+
+// There is no motor control interrupt on the host
+static int stub_foc_hook_register(foc_hook_point point, foc_hook_fun fun, float budget) {
+	(void)point; (void)fun; (void)budget;
+	return -1;
+}
+
+static bool stub_foc_hook_unregister(int handle) {
+	(void)handle;
+	return false;
+}
+
+static bool stub_foc_hook_get_stats(int handle, foc_hook_stats *stats) {
+	(void)handle; (void)stats;
+	return false;
+}
+
+// Shared memory is only provided by the firmware for now
+static lib_shm stub_shm_create(const char *name, const shm_field *fields, int field_num, bool use_seqlock) {
+	(void)name; (void)fields; (void)field_num; (void)use_seqlock;
+	return NULL;
+}
+
+static void* stub_shm_field_ptr(lib_shm shm, int field) {
+	(void)shm; (void)field;
+	return NULL;
+}
+
+static void stub_shm_write(lib_shm shm) {
+	(void)shm;
+}
+
+// Comm, UART and packets
+
+static void stub_process_packet(unsigned char *data, unsigned int len,
+		void(*reply_func)(unsigned char *data, unsigned int len)) {
+	(void)data; (void)len; (void)reply_func;
+}
+
+static void lib_send_app_data(unsigned char *data, unsigned int len) {
+	printf("app-data (%u):", len);
+	for (unsigned int i = 0;i < len;i++) {
+		printf(" %02x", data[i]);
+	}
+	printf("\n");
+}
+
+static bool lib_set_app_data_handler(void(*func)(unsigned char *data, unsigned int len)) {
+	app_data_handler = func;
+	return true;
+}
+
+static void stub_unregister_reply_func(void(*reply_func)(unsigned char *data, unsigned int len)) {
+	(void)reply_func;
+}
+
+static bool stub_uart_start(uint32_t baudrate, bool half_duplex) {
+	(void)baudrate; (void)half_duplex;
+	return false;
+}
+
+static bool stub_uart_write(uint8_t *data, uint32_t size) {
+	(void)data; (void)size;
+	return false;
+}
+
+static int32_t stub_uart_read(void) {
+	return -1;
+}
+
+static void stub_packet_init(void (*s_func)(unsigned char *, unsigned int),
+		void (*p_func)(unsigned char *, unsigned int), PACKET_STATE_t *state) {
+	memset(state, 0, sizeof(PACKET_STATE_t));
+	state->send_func = s_func;
+	state->process_func = p_func;
+}
+
+static void stub_packet_reset(PACKET_STATE_t *state) {
+	state->rx_read_ptr = 0;
+	state->rx_write_ptr = 0;
+	state->bytes_left = 0;
+}
+
+static void stub_packet_process_byte(uint8_t rx_data, PACKET_STATE_t *state) {
+	(void)rx_data; (void)state;
+}
+
+static void stub_packet_send_packet(unsigned char *data, unsigned int len, PACKET_STATE_t *state) {
+	(void)data; (void)len; (void)state;
+}
+
+static void stub_terminal_register(const char* command, const char *help, const char *arg_names,
+		void(*cbf)(int argc, const char **argv)) {
+	(void)command; (void)help; (void)arg_names; (void)cbf;
+}
+
+static void stub_terminal_unregister(void(*cbf)(int argc, const char **argv)) {
+	(void)cbf;
+}
+
+static void stub_plot_init(char *namex, char *namey) {
+	(void)namex; (void)namey;
+}
+
+static void stub_plot_add_graph(char *name) {
+	(void)name;
+}
+
+// Storage and configuration
+
+static bool lib_read_eeprom_var(eeprom_var *v, int address) {
+	if (address < 0 || address >= EEPROM_VARS) {
+		return false;
+	}
+	*v = eeprom[address];
+	return true;
+}
+
+static bool lib_store_eeprom_var(eeprom_var *v, int address) {
+	if (address < 0 || address >= EEPROM_VARS) {
+		return false;
+	}
+	eeprom[address] = *v;
+	return true;
+}
+
+static bool lib_read_nvm(uint8_t *v, unsigned int len, unsigned int address) {
+	if (address > NVM_SIZE || len > NVM_SIZE - address) {
+		return false;
+	}
+	memcpy(v, nvm + address, len);
+	return true;
+}
+
+static bool lib_write_nvm(uint8_t *v, unsigned int len, unsigned int address) {
+	if (address > NVM_SIZE || len > NVM_SIZE - address) {
+		return false;
+	}
+	memcpy(nvm + address, v, len);
+	return true;
+}
+
+static bool lib_wipe_nvm(void) {
+	memset(nvm, 0xFF, NVM_SIZE);
+	return true;
+}
+
+static void stub_conf_custom_add_config(
+		int (*get_cfg)(uint8_t *data, bool is_default),
+		bool (*set_cfg)(uint8_t *data),
+		int (*get_cfg_xml)(uint8_t **data)) {
+	(void)get_cfg; (void)set_cfg; (void)get_cfg_xml;
+}
+
+static float lib_get_cfg_float(CFG_PARAM p) {
+	return (unsigned int)p <= CFG_PARAM_IMU_rot_yaw ? cfg_float[p] : 0.0;
+}
+
+static int lib_get_cfg_int(CFG_PARAM p) {
+	return (unsigned int)p <= CFG_PARAM_IMU_rot_yaw ? cfg_int[p] : 0;
+}
+
+static bool lib_set_cfg_float(CFG_PARAM p, float value) {
+	if ((unsigned int)p > CFG_PARAM_IMU_rot_yaw) {
+		return false;
+	}
+	cfg_float[p] = value;
+	return true;
+}
+
+static bool lib_set_cfg_int(CFG_PARAM p, int value) {
+	if ((unsigned int)p > CFG_PARAM_IMU_rot_yaw) {
+		return false;
+	}
+	cfg_int[p] = value;
+	return true;
+}
+
+static volatile gnss_data* lib_mc_gnss(void) {
+	return &gnss;
+}
+
+void vesc_if_host_init(void) {
+	clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&sys_mutex, &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	memset(&cif, 0, sizeof(cif));
+	memset(nvm, 0xFF, NVM_SIZE);
+
+	// LBM
+	cif.lbm_add_extension = lbm_add_extension;
+	cif.lbm_block_ctx_from_extension = lbm_block_ctx_from_extension;
+	cif.lbm_unblock_ctx = lbm_unblock_ctx;
+	cif.lbm_get_current_cid = lbm_get_current_cid;
+	cif.lbm_set_error_reason = lbm_set_error_reason;
+	cif.lbm_pause_eval_with_gc = lbm_pause_eval_with_gc;
+	cif.lbm_continue_eval = lbm_continue_eval;
+	cif.lbm_send_message = lbm_send_message;
+	cif.lbm_eval_is_paused = lib_eval_is_paused;
+
+	cif.lbm_cons = lbm_cons;
+	cif.lbm_car = lbm_car;
+	cif.lbm_cdr = lbm_cdr;
+	cif.lbm_list_destructive_reverse = lbm_list_destructive_reverse;
+	cif.lbm_create_byte_array = lib_create_byte_array;
+
+	cif.lbm_add_symbol_const = lbm_add_symbol_const;
+	cif.lbm_get_symbol_by_name = lbm_get_symbol_by_name;
+
+	cif.lbm_enc_i = lib_enc_i;
+	cif.lbm_enc_u = lib_enc_u;
+	cif.lbm_enc_char = lib_enc_char;
+	cif.lbm_enc_float = lib_enc_float;
+	cif.lbm_enc_u32 = lbm_enc_u32;
+	cif.lbm_enc_i32 = lbm_enc_i32;
+	cif.lbm_enc_sym = lib_enc_sym;
+
+	cif.lbm_dec_as_float = lib_dec_as_float;
+	cif.lbm_dec_as_u32 = lbm_dec_as_u32;
+	cif.lbm_dec_as_i32 = lbm_dec_as_i32;
+	cif.lbm_dec_char = lib_dec_char;
+	cif.lbm_dec_str = lbm_dec_str;
+	cif.lbm_dec_sym = lib_dec_sym;
+
+	cif.lbm_is_byte_array = lbm_is_array_r;
+	cif.lbm_is_cons = lib_is_cons;
+	cif.lbm_is_number = lib_is_number;
+	cif.lbm_is_char = lib_is_char;
+	cif.lbm_is_symbol = lib_is_symbol;
+
+	cif.lbm_enc_sym_nil = ENC_SYM_NIL;
+	cif.lbm_enc_sym_true = ENC_SYM_TRUE;
+	cif.lbm_enc_sym_terror = ENC_SYM_TERROR;
+	cif.lbm_enc_sym_eerror = ENC_SYM_EERROR;
+	cif.lbm_enc_sym_merror = ENC_SYM_MERROR;
+
+	cif.lbm_is_symbol_nil = lib_is_symbol_nil;
+	cif.lbm_is_symbol_true = lib_is_symbol_true;
+
+	// Os
+	cif.sleep_ms = lib_sleep_ms;
+	cif.sleep_us = lib_sleep_us;
+	cif.system_time = lib_system_time;
+	cif.ts_to_age_s = lib_ts_to_age_s;
+	cif.printf = lib_printf;
+	cif.malloc = lbm_malloc_reserve;
+	cif.free = lbm_free;
+	cif.spawn = lib_spawn;
+	cif.request_terminate = lib_request_terminate;
+	cif.should_terminate = lib_should_terminate;
+	cif.get_arg = lib_get_arg;
+
+	// ST IO
+	cif.set_pad_mode = stub_pad_mode;
+	cif.set_pad = stub_pad;
+	cif.clear_pad = stub_pad;
+
+	// Abstract IO
+	cif.io_set_mode = stub_io_set_mode;
+	cif.io_write = stub_io_write;
+	cif.io_read = stub_io_read;
+	cif.io_read_analog = stub_io_read_analog;
+	cif.io_get_st_pin = stub_io_get_st_pin;
+
+	// CAN
+	cif.can_set_sid_cb = stub_can_set_cb;
+	cif.can_set_eid_cb = stub_can_set_cb;
+	cif.can_transmit_sid = stub_can_transmit;
+	cif.can_transmit_eid = stub_can_transmit;
+	cif.can_send_buffer = stub_can_send_buffer;
+	cif.can_set_duty = stub_can_set;
+	cif.can_set_current = stub_can_set;
+	cif.can_set_current_off_delay = stub_can_set_off_delay;
+	cif.can_set_current_brake = stub_can_set;
+	cif.can_set_rpm = stub_can_set;
+	cif.can_set_pos = stub_can_set;
+	cif.can_set_current_rel = stub_can_set;
+	cif.can_set_current_rel_off_delay = stub_can_set_off_delay;
+	cif.can_set_current_brake_rel = stub_can_set;
+	cif.can_ping = stub_can_ping;
+	cif.can_get_status_msg_index = stub_can_status_1;
+	cif.can_get_status_msg_id = stub_can_status_1;
+	cif.can_get_status_msg_2_index = stub_can_status_2;
+	cif.can_get_status_msg_2_id = stub_can_status_2;
+	cif.can_get_status_msg_3_index = stub_can_status_3;
+	cif.can_get_status_msg_3_id = stub_can_status_3;
+	cif.can_get_status_msg_4_index = stub_can_status_4;
+	cif.can_get_status_msg_4_id = stub_can_status_4;
+	cif.can_get_status_msg_5_index = stub_can_status_5;
+	cif.can_get_status_msg_5_id = stub_can_status_5;
+	cif.can_get_status_msg_6_index = stub_can_status_6;
+	cif.can_get_status_msg_6_id = stub_can_status_6;
+
+	// Motor Control
+	cif.mc_motor_now = stub_int;
+	cif.mc_select_motor_thread = stub_set_int;
+	cif.mc_get_motor_thread = stub_int;
+	cif.mc_dccal_done = stub_true;
+	cif.mc_set_pwm_callback = stub_set_pwm_callback;
+	cif.mc_get_fault = stub_get_fault;
+	cif.mc_fault_to_string = stub_fault_to_string;
+	cif.mc_set_duty = stub_set_float;
+	cif.mc_set_duty_noramp = stub_set_float;
+	cif.mc_set_pid_speed = stub_set_float;
+	cif.mc_set_pid_pos = stub_set_float;
+	cif.mc_set_current = stub_set_float;
+	cif.mc_set_brake_current = stub_set_float;
+	cif.mc_set_current_rel = stub_set_float;
+	cif.mc_set_brake_current_rel = stub_set_float;
+	cif.mc_set_handbrake = stub_set_float;
+	cif.mc_set_handbrake_rel = stub_set_float;
+	cif.mc_set_tachometer_value = stub_set_tachometer_value;
+	cif.mc_release_motor = stub_void;
+	cif.mc_wait_for_motor_release = stub_wait_for_motor_release;
+	cif.mc_get_duty_cycle_now = stub_float;
+	cif.mc_get_sampling_frequency_now = stub_float;
+	cif.mc_get_rpm = stub_float;
+	cif.mc_get_amp_hours = stub_float_reset;
+	cif.mc_get_amp_hours_charged = stub_float_reset;
+	cif.mc_get_watt_hours = stub_float_reset;
+	cif.mc_get_watt_hours_charged = stub_float_reset;
+	cif.mc_get_tot_current = stub_float;
+	cif.mc_get_tot_current_filtered = stub_float;
+	cif.mc_get_tot_current_directional = stub_float;
+	cif.mc_get_tot_current_directional_filtered = stub_float;
+	cif.mc_get_tot_current_in = stub_float;
+	cif.mc_get_tot_current_in_filtered = stub_float;
+	cif.mc_get_input_voltage_filtered = stub_float;
+	cif.mc_get_tachometer_value = stub_int_reset;
+	cif.mc_get_tachometer_abs_value = stub_int_reset;
+	cif.mc_get_pid_pos_set = stub_float;
+	cif.mc_get_pid_pos_now = stub_float;
+	cif.mc_update_pid_pos_offset = stub_update_pid_pos_offset;
+	cif.mc_temp_fet_filtered = stub_float;
+	cif.mc_temp_motor_filtered = stub_float;
+	cif.mc_get_battery_level = stub_get_battery_level;
+	cif.mc_get_speed = stub_float;
+	cif.mc_get_distance = stub_float;
+	cif.mc_get_distance_abs = stub_float;
+	cif.mc_get_odometer = stub_get_odometer;
+	cif.mc_set_odometer = stub_set_odometer;
+	cif.mc_set_current_off_delay = stub_set_float;
+	cif.mc_stat_speed_avg = stub_float;
+	cif.mc_stat_speed_max = stub_float;
+	cif.mc_stat_power_avg = stub_float;
+	cif.mc_stat_power_max = stub_float;
+	cif.mc_stat_current_avg = stub_float;
+	cif.mc_stat_current_max = stub_float;
+	cif.mc_stat_temp_mosfet_avg = stub_float;
+	cif.mc_stat_temp_mosfet_max = stub_float;
+	cif.mc_stat_temp_motor_avg = stub_float;
+	cif.mc_stat_temp_motor_max = stub_float;
+	cif.mc_stat_count_time = stub_float;
+	cif.mc_stat_reset = stub_void;
+
+	// Comm
+	cif.commands_process_packet = stub_process_packet;
+	cif.send_app_data = lib_send_app_data;
+	cif.set_app_data_handler = lib_set_app_data_handler;
+
+	// UART
+	cif.uart_start = stub_uart_start;
+	cif.uart_write = stub_uart_write;
+	cif.uart_read = stub_uart_read;
+
+	// Packets
+	cif.packet_init = stub_packet_init;
+	cif.packet_reset = stub_packet_reset;
+	cif.packet_process_byte = stub_packet_process_byte;
+	cif.packet_send_packet = stub_packet_send_packet;
+
+	// IMU
+	cif.imu_startup_done = stub_false;
+	cif.imu_get_roll = stub_float;
+	cif.imu_get_pitch = stub_float;
+	cif.imu_get_yaw = stub_float;
+	cif.imu_get_rpy = stub_vec3;
+	cif.imu_get_accel = stub_vec3;
+	cif.imu_get_gyro = stub_vec3;
+	cif.imu_get_mag = stub_vec3;
+	cif.imu_derotate = stub_derotate;
+	cif.imu_get_accel_derotated = stub_vec3;
+	cif.imu_get_gyro_derotated = stub_vec3;
+	cif.imu_get_quaternions = stub_quaternions;
+	cif.imu_get_calibration = stub_imu_get_calibration;
+	cif.imu_set_yaw = stub_set_float;
+
+	// Terminal
+	cif.terminal_register_command_callback = stub_terminal_register;
+	cif.terminal_unregister_callback = stub_terminal_unregister;
+
+	// EEPROM
+	cif.read_eeprom_var = lib_read_eeprom_var;
+	cif.store_eeprom_var = lib_store_eeprom_var;
+
+	// Timeout
+	cif.timeout_reset = stub_void;
+	cif.timeout_has_timeout = stub_false;
+	cif.timeout_secs_since_update = stub_float;
+
+	// Plot
+	cif.plot_init = stub_plot_init;
+	cif.plot_add_graph = stub_plot_add_graph;
+	cif.plot_set_graph = stub_set_int;
+	cif.plot_send_points = stub_set_float2;
+
+	// Custom config
+	cif.conf_custom_add_config = stub_conf_custom_add_config;
+	cif.conf_custom_clear_configs = stub_void;
+
+	// Settings
+	cif.get_cfg_float = lib_get_cfg_float;
+	cif.get_cfg_int = lib_get_cfg_int;
+	cif.set_cfg_float = lib_set_cfg_float;
+	cif.set_cfg_int = lib_set_cfg_int;
+	cif.store_cfg = stub_true;
+
+	// GNSS
+	cif.mc_gnss = lib_mc_gnss;
+
+	// Mutex
+	cif.mutex_create = lib_mutex_create;
+	cif.mutex_lock = lib_mutex_lock;
+	cif.mutex_unlock = lib_mutex_unlock;
+
+	// Get ST io-pin from lbm symbol
+	cif.lbm_symbol_to_io = lib_symbol_to_io;
+
+	// High resolution timer
+	cif.timer_time_now = lib_timer_time_now;
+	cif.timer_seconds_elapsed_since = lib_timer_seconds_elapsed_since;
+	cif.timer_sleep = lib_timer_sleep;
+
+	// System lock
+	cif.sys_lock = lib_sys_lock;
+	cif.sys_unlock = lib_sys_unlock;
+
+	// Unregister reply function
+	cif.commands_unregister_reply_func = stub_unregister_reply_func;
+
+	// IMU AHRS functions and read callback
+	cif.imu_set_read_callback = stub_imu_set_read_callback;
+	cif.ahrs_init_attitude_info = stub_ahrs_init;
+	cif.ahrs_update_initial_orientation = stub_ahrs_initial;
+	cif.ahrs_update_mahony_imu = stub_ahrs_update;
+	cif.ahrs_update_madgwick_imu = stub_ahrs_update;
+	cif.ahrs_get_roll = stub_ahrs_angle;
+	cif.ahrs_get_pitch = stub_ahrs_angle;
+	cif.ahrs_get_yaw = stub_ahrs_angle;
+
+	// Set custom encoder callbacks
+	cif.encoder_set_custom_callbacks = stub_encoder_callbacks;
+
+	// Store backup data
+	cif.store_backup_data = stub_true;
+
+	// Input Devices
+	cif.get_remote_state = stub_get_remote_state;
+	cif.get_ppm = stub_float;
+	cif.get_ppm_age = stub_get_ppm_age;
+	cif.app_is_output_disabled = stub_false;
+
+	// NVM
+	cif.read_nvm = lib_read_nvm;
+	cif.write_nvm = lib_write_nvm;
+	cif.wipe_nvm = lib_wipe_nvm;
+
+	// FOC
+	cif.foc_get_id = stub_float;
+	cif.foc_get_iq = stub_float;
+	cif.foc_get_vd = stub_float;
+	cif.foc_get_vq = stub_float;
+	cif.foc_set_openloop_current = stub_set_float2;
+	cif.foc_set_openloop_phase = stub_set_float2;
+	cif.foc_set_openloop_duty = stub_set_float2;
+	cif.foc_set_openloop_duty_phase = stub_set_float2;
+
+	// Flat values
+	cif.lbm_start_flatten = lbm_start_flatten;
+	cif.lbm_finish_flatten = lbm_finish_flatten;
+	cif.f_b = f_b;
+	cif.f_cons = f_cons;
+	cif.f_float = f_float;
+	cif.f_i = f_i;
+	cif.f_i32 = f_i32;
+	cif.f_i64 = f_i64;
+	cif.f_lbm_array = f_lbm_array;
+	cif.f_sym = f_sym;
+	cif.f_u32 = f_u32;
+	cif.f_u64 = f_u64;
+
+	// Unblock unboxed
+	cif.lbm_unblock_ctx_unboxed = lbm_unblock_ctx_unboxed;
+
+	// FOC-rate hooks
+	cif.foc_hook_register = stub_foc_hook_register;
+	cif.foc_hook_unregister = stub_foc_hook_unregister;
+	cif.foc_hook_get_stats = stub_foc_hook_get_stats;
+
+	// Shared memory
+	cif.shm_create = stub_shm_create;
+	cif.shm_field_ptr = stub_shm_field_ptr;
+	cif.shm_write_begin = stub_shm_write;
+	cif.shm_write_end = stub_shm_write;
+}
+
+bool vesc_if_host_load(const char *path) {
+	int slot = -1;
+	for (int i = 0;i < LIB_NUM_MAX;i++) {
+		if (loaded_libs[i].handle == NULL) {
+			slot = i;
+			break;
+		}
+	}
+
+	if (slot < 0) {
+		printf("%s: too many libraries loaded\n", path);
+		return false;
+	}
+
+	void *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+	if (!handle) {
+		printf("%s\n", dlerror());
+		return false;
+	}
+
+	bool (*init)(lib_info *info) = (bool(*)(lib_info*))dlsym(handle, "init");
+	volatile int *prog_ptr = (volatile int*)dlsym(handle, "prog_ptr");
+
+	if (!init || !prog_ptr) {
+		printf("%s: missing init or prog_ptr, was it built with HEADER and INIT_FUN?\n", path);
+		dlclose(handle);
+		return false;
+	}
+
+	host_lib *lib = &loaded_libs[slot];
+	memset(lib, 0, sizeof(host_lib));
+	lib->handle = handle;
+	lib->info.base_addr = (uint32_t)(uintptr_t)prog_ptr;
+
+	if (!init(&lib->info)) {
+		printf("%s: library init failed\n", path);
+		lib->handle = NULL;
+		dlclose(handle);
+		return false;
+	}
+
+	return true;
+}
+
+void vesc_if_host_unload_all(void) {
+	for (int i = 0;i < LIB_NUM_MAX;i++) {
+		host_lib *lib = &loaded_libs[i];
+		if (lib->handle == NULL) {
+			continue;
+		}
+
+		if (lib->info.stop_fun != NULL) {
+			lib->info.stop_fun(lib->info.arg);
+		}
+
+		dlclose(lib->handle);
+		memset(lib, 0, sizeof(host_lib));
+	}
+}
+
+void vesc_if_host_set_quiet(bool quiet) {
+	printf_quiet = quiet;
+}
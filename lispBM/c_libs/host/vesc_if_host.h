@@ -0,0 +1,40 @@
+/*
+	Copyright 2022 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VESC_IF_HOST_H_
+#define VESC_IF_HOST_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Host implementation of the VESC_IF function table. Native libraries built
+ * with -DVESC_LIB_HOST as shared objects are loaded with dlopen and see a
+ * table backed by the host lispBM instance. Hardware functions (IO, CAN,
+ * motor control, IMU, UART) are inert stubs that return zero or false.
+ *
+ * lispBM has to be initialized before a library is loaded.
+ */
+
+void vesc_if_host_init(void);
+bool vesc_if_host_load(const char *path);
+void vesc_if_host_unload_all(void);
+void vesc_if_host_set_quiet(bool quiet);
+
+#endif /* VESC_IF_HOST_H_ */
@@ -24,7 +24,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 
-#ifdef IS_VESC_LIB
+#if defined(IS_VESC_LIB) || defined(VESC_LIB_HOST)
 typedef uint32_t systime_t;
 
 typedef struct {
@@ -159,7 +159,19 @@ typedef struct {
 	systime_t last_update;
 } gnss_data;
 
+#endif
+
+#ifdef IS_VESC_LIB
 // LBM
+#if defined(VESC_LIB_HOST) && defined(LBM64)
+typedef uint64_t lbm_value;
+typedef uint64_t lbm_type;
+typedef int32_t  lbm_cid;
+
+typedef uint64_t lbm_uint;
+typedef int64_t  lbm_int;
+typedef double   lbm_float;
+#else
 typedef uint32_t lbm_value;
 typedef uint32_t lbm_type;
 typedef uint32_t lbm_cid;
@@ -167,6 +179,7 @@ typedef uint32_t lbm_cid;
 typedef uint32_t lbm_uint;
 typedef int32_t  lbm_int;
 typedef float    lbm_float;
+#endif
 
 typedef struct {
 	uint8_t *buf;
@@ -181,7 +194,9 @@ typedef struct {
 } lbm_array_header_t;
 
 typedef lbm_value (*extension_fptr)(lbm_value*,lbm_uint);
+#endif
 
+#if defined(IS_VESC_LIB) || defined(VESC_LIB_HOST)
 // For double precision literals
 #define D(x) 				((double)x##L)
 
@@ -202,6 +217,50 @@ typedef struct {
 	float ki;
 	float beta;
 } ATTITUDE_INFO;
+
+// FOC-rate hooks, see motor/foc_hooks.h
+typedef enum {
+	FOC_HOOK_PRE_CURRENT = 0,
+	FOC_HOOK_POST_CURRENT,
+	FOC_HOOK_POINT_NUM
+} foc_hook_point;
+
+typedef struct {
+	int motor;
+	float dt;
+	float phase;
+	float speed_rad_s;
+	float id;
+	float iq;
+	float id_filter;
+	float iq_filter;
+	float id_target;
+	float iq_target;
+	float vd;
+	float vq;
+	float mod_d;
+	float mod_q;
+	float v_bus;
+	float duty_now;
+} foc_hook_state;
+
+typedef struct {
+	bool id_set;
+	bool iq_set;
+	float id;
+	float iq;
+} foc_hook_override;
+
+typedef void (*foc_hook_fun)(const foc_hook_state *state, foc_hook_override *override);
+
+typedef struct {
+	uint32_t calls;
+	uint32_t overruns;
+	float time_last;
+	float time_max;
+	float budget;
+	bool enabled;
+} foc_hook_stats;
 #endif
 
 typedef bool (*load_extension_fptr)(char*,extension_fptr);
@@ -287,6 +346,25 @@ typedef struct {
 	float age_s; // Age of last update in seconds
 } remote_state;
 
+// Shared memory between native libraries and lisp
+typedef enum {
+	SHM_TYPE_I8 = 0,
+	SHM_TYPE_U8,
+	SHM_TYPE_I16,
+	SHM_TYPE_U16,
+	SHM_TYPE_I32,
+	SHM_TYPE_U32,
+	SHM_TYPE_FLOAT,
+} SHM_TYPE;
+
+typedef struct {
+	const char *name;
+	SHM_TYPE type;
+	uint32_t len; // Number of elements
+} shm_field;
+
+typedef void* lib_shm;
+
 /*
  * Function pointer struct. Always add new function pointers to the end in order to not
  * break compatibility with old binaries.
@@ -610,6 +688,26 @@ typedef struct {
 	// Unblock unboxed
 	bool (*lbm_unblock_ctx_unboxed)(lbm_cid cid, lbm_value unboxed);
 
+	// FOC-rate hooks. They run from the motor control interrupt with a snapshot
+	// of the motor state. Hooks at FOC_HOOK_PRE_CURRENT can override the current
+	// references through the override argument, which is NULL at other points.
+	// A hook that exceeds its budget (seconds) three calls in a row is disabled.
+	// Unregister the hooks in the stop function of the library.
+	int (*foc_hook_register)(foc_hook_point point, foc_hook_fun fun, float budget);
+	bool (*foc_hook_unregister)(int handle);
+	bool (*foc_hook_get_stats)(int handle, foc_hook_stats *stats);
+
+	// Shared memory regions. A region is a named struct of arrays that lisp can
+	// view without copying using shm-view and read consistently with shm-read.
+	// With use_seqlock set, wrap updates in shm_write_begin and shm_write_end.
+	// Regions live until lisp is restarted. Creating a region with the name
+	// and layout of an existing one returns that region, so that a reloaded
+	// library gets its data back.
+	lib_shm (*shm_create)(const char *name, const shm_field *fields, int field_num, bool use_seqlock);
+	void* (*shm_field_ptr)(lib_shm shm, int field);
+	void (*shm_write_begin)(lib_shm shm);
+	void (*shm_write_end)(lib_shm shm);
+
 } vesc_c_if;
 
 typedef struct {
@@ -619,10 +717,21 @@ typedef struct {
 } lib_info;
 
 // VESC-interface with function pointers
+#ifdef VESC_LIB_HOST
+// When building for the host (see host/) the interface is provided by the loader
+extern vesc_c_if *vesc_lib_host_if;
+#define VESC_IF		(vesc_lib_host_if)
+#else
 #define VESC_IF		((vesc_c_if*)(0x1000F800))
+#endif
 
 // Put this at the beginning of your source file
+#ifdef VESC_LIB_HOST
+// Exported so that the host loader can look it up with dlsym
+#define HEADER		volatile int __attribute__((__section__(".program_ptr"))) prog_ptr;
+#else
 #define HEADER		static volatile int __attribute__((__section__(".program_ptr"))) prog_ptr;
+#endif
 
 // Init function
 #define INIT_FUN	bool __attribute__((__section__(".init_fun"))) init
@@ -631,7 +740,11 @@ typedef struct {
 #define INIT_START	(void)prog_ptr;
 
 // Address of this program in memory
+#ifdef VESC_LIB_HOST
+#define PROG_ADDR	((uint32_t)(uintptr_t)&prog_ptr)
+#else
 #define PROG_ADDR	((uint32_t)&prog_ptr)
+#endif
 
 // The argument that was set in the init function (same as the one you get in stop_fun)
 #define ARG			(*VESC_IF->get_arg(PROG_ADDR))
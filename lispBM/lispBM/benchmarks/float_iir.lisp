@@ -0,0 +1,5 @@
+(define iir (lambda (n y)
+  (if (= n 0) y
+    (iir (- n 1) (+ (* 0.95 y) (* 0.05 (* 1.5 (- 2.0 y))))))))
+
+(iir 20000 0.0)
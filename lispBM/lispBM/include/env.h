@@ -41,6 +41,17 @@ lbm_value *lbm_get_env_ptr(void);
  * \return the global environment
  */
 lbm_value lbm_get_env(void);
+/** Get the version of the global environment. The version changes
+ *  whenever bindings may have been added to or removed from the global
+ *  environment, making any remembered binding cells invalid.
+ *
+ * \return Version of the global environment.
+ */
+lbm_uint lbm_get_env_version(void);
+/** Invalidate remembered global bindings after changing the
+ *  global environment other than through the functions in env.h.
+ */
+void lbm_env_version_inc(void);
 /** Copy the spine of an environment. The list structure is
  * recreated but the values themselves are not copied but rather
  * just referenced.
@@ -63,6 +74,13 @@ bool lbm_env_lookup_b(lbm_value *res, lbm_value sym, lbm_value env);
  * \return The value bound to key or lbm_enc_sym(SYM_NOT_FOUND).
  */
 lbm_value lbm_env_lookup(lbm_value sym, lbm_value env);
+/** Lookup the binding, the (key . value) pair, of a key in an environment.
+ *
+ * \param sym The key to look for in the environment
+ * \param env The environment to search for the key.
+ * \return The binding cell or nil if the key is not bound.
+ */
+lbm_value lbm_env_lookup_binding(lbm_value sym, lbm_value env);
 /** Create a new binding on the environment or replace an old binding.
  *
  * \param env Environment to modify.
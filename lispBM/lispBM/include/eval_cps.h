@@ -61,11 +61,42 @@ typedef struct eval_context_s{
   /* while reading */
   lbm_int row0;
   lbm_int row1;
+  /* while profiling */
+  lbm_value prof_fun;    /* Body of the closure currently executing */
+  lbm_value prof_caller; /* Body of the closure that called it */
+  /* Frames that can be rebound in place by tail calls */
+  lbm_value tail_env;    /* Parameter frame of the closure body being evaluated */
+  lbm_value tail_exp;    /* Body of that closure */
+  lbm_uint  tail_sp;     /* Stack pointer when the body was entered */
+  lbm_value let_env;     /* Let frame on top of tail_env, created in tail position */
+  lbm_value let_exp;     /* The let expression that created let_env */
+  lbm_uint  env_captures; /* Number of times an environment may have been captured */
   /* List structure */
   struct eval_context_s *prev;
   struct eval_context_s *next;
 } eval_context_t;
 
+/** What caused a garbage collection. */
+typedef enum {
+  LBM_GC_REASON_HEAP = 0,  /* A cons cell allocation failed. */
+  LBM_GC_REASON_MEMORY,    /* An lbm_memory allocation hit the reserve level. */
+  LBM_GC_REASON_OTHER,     /* Explicit gc, pause with gc or other allocations. */
+} lbm_gc_reason_t;
+
+/** Statistics of a single garbage collection, passed to the GC event callback. */
+typedef struct {
+  uint32_t timestamp;        /* Timestamp at start of GC in us. */
+  uint32_t duration;         /* Pause duration in us. */
+  lbm_uint marked;           /* Cells marked. */
+  lbm_uint recovered;        /* Cells recovered. */
+  lbm_uint recovered_arrays; /* Arrays recovered. */
+  lbm_uint heap_free;        /* Free cells after GC. */
+  lbm_uint mem_free;         /* Free lbm_memory words after GC. */
+  lbm_uint mem_longest_free; /* Longest free lbm_memory block after GC, in words. */
+  lbm_cid cid;               /* Context that was running, or -1. */
+  lbm_gc_reason_t reason;
+} lbm_gc_event_t;
+
 typedef enum {
   LBM_EVENT_FOR_HANDLER = 0,
   LBM_EVENT_UNBLOCK_CTX,
@@ -288,6 +319,13 @@ void lbm_set_timestamp_us_callback(uint32_t (*fptr)(void));
  * \param fptr Pointer to a "done" function.
  */
 void lbm_set_ctx_done_callback(void (*fptr)(eval_context_t *));
+/** Set a callback that is called by the evaluator after each garbage
+ *  collection. The callback runs on the evaluator thread while the
+ *  evaluator is stopped, so it should only copy the event.
+ *
+ * \param fptr Pointer to a GC event function or NULL to disable.
+ */
+void lbm_set_gc_event_callback(void (*fptr)(lbm_gc_event_t *));
 /** Set a "printf" callback function. This function will be called by
  * the evaluator to report error strings back to the user.
  *
@@ -0,0 +1,80 @@
+/*
+    Copyright 2023 Joel Svensson        svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RINGBUF_EXTENSIONS_H_
+#define RINGBUF_EXTENSIONS_H_
+
+#include "lbm_types.h"
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+  LBM_RINGBUF_I8 = 0,
+  LBM_RINGBUF_U8,
+  LBM_RINGBUF_I16,
+  LBM_RINGBUF_U16,
+  LBM_RINGBUF_I32,
+  LBM_RINGBUF_U32,
+  LBM_RINGBUF_F32
+} lbm_ringbuf_type_t;
+
+static inline lbm_uint lbm_ringbuf_type_size(lbm_ringbuf_type_t type) {
+  switch (type) {
+  case LBM_RINGBUF_I8: case LBM_RINGBUF_U8: return 1;
+  case LBM_RINGBUF_I16: case LBM_RINGBUF_U16: return 2;
+  default: return 4;
+  }
+}
+
+bool lbm_ringbuf_extensions_init(void);
+
+/** Check if a value is a ring buffer created by rb-create.
+ * \param v Value to check.
+ * \return true if v is a ring buffer.
+ */
+bool lbm_is_ringbuf(lbm_value v);
+/** Get the number of columns and the number of rows currently stored.
+ * \param rb Ring buffer.
+ * \param ncols Set to the number of columns.
+ * \return Number of rows stored.
+ */
+lbm_uint lbm_ringbuf_len(lbm_value rb, lbm_uint *ncols);
+/** Get the stored rows of one column as a contiguous array, oldest
+ *  first, without copying. The data is in native byte order and is
+ *  valid until the next push to or clear of the ring buffer.
+ * \param rb Ring buffer.
+ * \param col Column index.
+ * \param type Set to the element type of the column.
+ * \param num Set to the number of elements.
+ * \return Pointer to the oldest element or NULL if col is out of range.
+ */
+void *lbm_ringbuf_column(lbm_value rb, lbm_uint col, lbm_ringbuf_type_t *type, lbm_uint *num);
+/** Read one element as a float.
+ * \param rb Ring buffer.
+ * \param col Column index.
+ * \param row Row index, 0 is the oldest row.
+ * \return The element or 0 if the index is out of range.
+ */
+float lbm_ringbuf_get(lbm_value rb, lbm_uint col, lbm_uint row);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -205,8 +205,27 @@ Aux bits could be used for storing vector size. Up to 30bits should be available
 #define LBM_PTR_TO_CONSTANT_MASK         ~LBM_PTR_TO_CONSTANT_BIT
 #define LBM_PTR_TO_CONSTANT_SHIFT        26
 
+#ifdef LBM_SHORT_FLOAT
+/* Short floats live in the symbol value space with the top bit set.
+   The 27 remaining value bits hold the sign, the exponent and the 18
+   most significant mantissa bits of an IEEE-754 single, so floats are
+   unboxed at reduced precision.
+
+   1XXX XXXX XXXX XXXX XXXX XXXX XXXX 0000
+
+   Symbol ids are far below 2^27 and never set the top bit.
+ */
+#define LBM_SHORT_FLOAT_BIT              0x80000000u
+#define LBM_SHORT_FLOAT_MASK             0x8000000Du
+#define LBM_SHORT_FLOAT_VAL_MASK         0x7FFFFFF0u
+#endif
+
 #else /* 64 bit Version */
 
+#ifdef LBM_SHORT_FLOAT
+#error "LBM_SHORT_FLOAT is only supported on 32 bit builds, floats are always unboxed with LBM64"
+#endif
+
 #define LBM_ADDRESS_SHIFT                2
 #define LBM_VAL_SHIFT                    8
 
@@ -235,6 +254,12 @@ typedef struct {
   lbm_value cdr;
 } lbm_cons_t;
 
+/** Number of bins in the GC pause time histogram. Bin 0 counts pauses
+ *  of 0us and bin i > 0 counts pauses in [2^(i-1), 2^i) us. The last
+ *  bin also counts all longer pauses.
+ */
+#define LBM_GC_PAUSE_HIST_BINS 16
+
 /**
  *  Heap state
  */
@@ -260,6 +285,9 @@ typedef struct {
   lbm_uint gc_time_acc;
   lbm_uint gc_min_duration;
   lbm_uint gc_max_duration;
+  lbm_uint gc_pause_hist[LBM_GC_PAUSE_HIST_BINS];
+
+  bool alloc_failed;           // A cell allocation has failed since the last GC.
 } lbm_heap_state_t;
 
 extern lbm_heap_state_t lbm_heap_state;
@@ -297,6 +325,12 @@ int lbm_heap_init(lbm_cons_t *addr, lbm_uint num_cells,
  * \param dur Duration as reported by the timestamp callback.
  */
 void lbm_heap_new_gc_time(lbm_uint dur);
+/** Check if a cell allocation has failed since the last call and
+ *  clear the indication.
+ *
+ * \return true if a cell allocation has failed.
+ */
+bool lbm_heap_take_alloc_failed(void);
 /** Add a new free_list length to the heap_stats.
  *  Calculates a new freelist length and updates
  *  the GC statistics.
@@ -617,11 +651,17 @@ lbm_uint lbm_flash_memory_usage(void);
  * \return The type information.
  */
 static inline lbm_type lbm_type_of(lbm_value x) {
+#ifdef LBM_SHORT_FLOAT
+  if ((x & LBM_SHORT_FLOAT_MASK) == LBM_SHORT_FLOAT_BIT) return LBM_TYPE_FLOAT;
+#endif
   return (x & LBM_PTR_MASK) ? (x & LBM_PTR_TYPE_MASK) : (x & LBM_VAL_TYPE_MASK);
 }
 
 // type-of check that is safe in functional code
 static inline lbm_type lbm_type_of_functional(lbm_value x) {
+#ifdef LBM_SHORT_FLOAT
+  if ((x & LBM_SHORT_FLOAT_MASK) == LBM_SHORT_FLOAT_BIT) return LBM_TYPE_FLOAT;
+#endif
   return (x & LBM_PTR_MASK) ?
     (x & (LBM_PTR_TO_CONSTANT_MASK & LBM_PTR_TYPE_MASK)) :
      (x & LBM_VAL_TYPE_MASK);
@@ -676,6 +716,8 @@ extern lbm_value lbm_enc_i32(int32_t x);
 extern lbm_value lbm_enc_u32(uint32_t x);
 
 /** Encode a float into an lbm_value.
+ *  With LBM_SHORT_FLOAT the float is rounded to 18 mantissa bits and
+ *  stored unboxed, otherwise it is boxed on 32 bit platforms.
  * \param x float value to encode.
  * \return result encoded value.
  */
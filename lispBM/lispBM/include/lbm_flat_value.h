@@ -54,7 +54,10 @@ bool f_i64(lbm_flat_value_t *v, int64_t w);
 bool f_u64(lbm_flat_value_t *v, uint64_t w);
 bool f_lbm_array(lbm_flat_value_t *v, uint32_t num_bytes, uint8_t *data);
 
-/** Unflatten a flat value stored in an lbm_memory array onto the heap
+/** Unflatten a flat value stored in an lbm_memory array onto the heap.
+ *  The buffer of the flat value is consumed. It is either freed or,
+ *  if the value contains a byte array, reused as the storage of the
+ *  first byte array.
  *  
  *  \param v Flat value to unflatten. 
  *  \param res Pointer to where the result lbm_value should be stored. 
@@ -0,0 +1,126 @@
+/** \file lbm_prof.h */
+/*
+    Copyright 2023 Joel Svensson    svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LBM_PROF_H_
+#define LBM_PROF_H_
+
+#include "lbm_types.h"
+#include "eval_cps.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** One entry of the sampled profile. Samples are attributed to the
+ *  closure that was executing in the running context and to the
+ *  closure that called it. Closures are identified by the global
+ *  symbol they are bound to. SYM_NIL means top level code that is
+ *  not inside any closure and SYM_CLOSURE means an anonymous
+ *  closure.
+ *
+ *  Summing count over fun gives the flat profile. The (caller, fun)
+ *  pairs are the edges of the call graph.
+ */
+typedef struct {
+  lbm_cid  cid;
+  lbm_uint fun;
+  lbm_uint caller;
+  lbm_uint count;
+} lbm_prof_t;
+
+/** Time spent in an extension while profiling was running. */
+typedef struct {
+  lbm_uint sym;
+  lbm_uint calls;
+  lbm_uint time_us;
+  lbm_uint max_us;
+} lbm_prof_ext_t;
+
+/** Set by lbm_prof_tick and cleared when the evaluator has taken the sample. */
+extern volatile bool lbm_prof_sample_pending;
+
+/** Initialize the profiler with storage for the samples and the extension statistics.
+ *
+ * \param data Array to store samples in.
+ * \param num_data Number of elements in data.
+ * \param ext_data Array to store extension statistics in.
+ * \param num_ext_data Number of elements in ext_data.
+ * \return true on success.
+ */
+bool lbm_prof_init(lbm_prof_t *data, lbm_uint num_data,
+                   lbm_prof_ext_t *ext_data, lbm_uint num_ext_data);
+/** Clear all collected samples and statistics. */
+void lbm_prof_reset(void);
+/** Start collecting samples. Profiling is stopped after lbm_prof_init. */
+void lbm_prof_start(void);
+/** Stop collecting samples. Collected data is kept until lbm_prof_reset. */
+void lbm_prof_stop(void);
+/** Check if the profiler is running.
+ * \return true if the profiler is collecting samples.
+ */
+bool lbm_prof_is_running(void);
+/** Request a sample. Call this periodically from a timer, it only
+ *  sets a flag and is safe to call from an interrupt. The sample is
+ *  taken by the evaluator before its next step. Ticks that arrive
+ *  while no context is running are counted as idle.
+ */
+void lbm_prof_tick(void);
+
+/* Used by the evaluator */
+
+/** Record a sample of the running context.
+ * \param ctx The running context.
+ */
+void lbm_prof_sample(eval_context_t *ctx);
+/** Account for time spent in garbage collection.
+ * \param us Duration of the collection in microseconds.
+ */
+void lbm_prof_gc(lbm_uint us);
+/** Account for the duration of an extension call.
+ * \param sym Symbol id of the extension.
+ * \param us Duration of the call in microseconds.
+ */
+void lbm_prof_ext(lbm_uint sym, lbm_uint us);
+
+/* Results */
+
+/** Get the sample table.
+ * \param num Set to the number of used entries.
+ * \return Pointer to the sample table.
+ */
+lbm_prof_t *lbm_prof_get_data(lbm_uint *num);
+/** Get the extension statistics table.
+ * \param num Set to the number of used entries.
+ * \return Pointer to the extension statistics table.
+ */
+lbm_prof_ext_t *lbm_prof_get_ext_data(lbm_uint *num);
+/** \return Number of ticks since the profiler was reset. */
+lbm_uint lbm_prof_get_num_ticks(void);
+/** \return Number of ticks that were taken while the garbage collector was running. */
+lbm_uint lbm_prof_get_num_gc_samples(void);
+/** \return Number of samples that did not fit in the sample table. */
+lbm_uint lbm_prof_get_num_dropped(void);
+/** \return Total time spent in garbage collection in microseconds. */
+lbm_uint lbm_prof_get_gc_time_us(void);
+/** \return Number of ticks where no context was running. */
+lbm_uint lbm_prof_get_num_idle(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -39,6 +39,7 @@ extern "C" {
 /** A lispBM value.
  *  Can represent a character, 28 bit signed or unsigned integer.
  *  A value can also represent a pointer to a heap cell or to boxed 32 bit values such as a float.
+ *  Building with LBM_SHORT_FLOAT stores floats unboxed at reduced precision instead.
  */
 typedef uint32_t lbm_value;
 /** A lispBM type. */
@@ -33,6 +33,7 @@
 #include "lbm_variables.h"
 #include "lbm_custom_type.h"
 #include "lbm_channel.h"
+#include "lbm_prof.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -18,13 +18,15 @@ LISPBM_SRC = $(LISPBM)/src/env.c \
              $(LISPBM)/src/lbm_channel.c \
              $(LISPBM)/src/lbm_flat_value.c\
              $(LISPBM)/src/lbm_flags.c\
+             $(LISPBM)/src/lbm_prof.c\
              $(LISPBM)/src/extensions/array_extensions.c \
              $(LISPBM)/src/extensions/string_extensions.c \
              $(LISPBM)/src/extensions/math_extensions.c \
              $(LISPBM)/src/extensions/runtime_extensions.c \
              $(LISPBM)/src/extensions/matvec_extensions.c \
              $(LISPBM)/src/extensions/random_extensions.c \
-             $(LISPBM)/src/extensions/loop_extensions.c
+             $(LISPBM)/src/extensions/loop_extensions.c \
+             $(LISPBM)/src/extensions/ringbuf_extensions.c
 
 
 LISPBM_INC = -I$(LISPBM)/include \
@@ -32,6 +32,7 @@
 #include "extensions/string_extensions.h"
 #include "extensions/math_extensions.h"
 #include "extensions/runtime_extensions.h"
+#include "extensions/ringbuf_extensions.h"
 
 #include "lbm_custom_type.h"
 #include "lbm_channel.h"
@@ -45,12 +46,16 @@
 #define WAIT_TIMEOUT 2500
 #define STR_SIZE 1024
 #define CONSTANT_MEMORY_SIZE 32*1024
+#define PROF_DATA_NUM 128
+#define PROF_EXT_DATA_NUM 64
 
 lbm_uint gc_stack_storage[GC_STACK_SIZE];
 lbm_uint print_stack_storage[PRINT_STACK_SIZE];
 extension_fptr extension_storage[EXTENSION_STORAGE_SIZE];
 lbm_value variable_storage[VARIABLE_STORAGE_SIZE];
 lbm_uint constants_memory[CONSTANT_MEMORY_SIZE];
+lbm_prof_t prof_data[PROF_DATA_NUM];
+lbm_prof_ext_t prof_ext_data[PROF_EXT_DATA_NUM];
 
 bool const_heap_write(lbm_uint ix, lbm_uint w) {
   if (ix >= CONSTANT_MEMORY_SIZE) return false;
@@ -546,6 +551,110 @@ void sym_it(const char *str) {
   printf("%s\n", str);
 }
 
+static const char *gc_reason_str[] = {"heap", "memory", "other"};
+
+void gc_event_callback(lbm_gc_event_t *e) {
+  erase();
+  printf("GC ctx %"PRI_INT" (%s): %u us, marked %"PRI_UINT", recovered %"PRI_UINT" cells %"PRI_UINT" arrays, "
+         "free %"PRI_UINT" cells %"PRI_UINT" words (longest %"PRI_UINT")\n",
+         e->cid, gc_reason_str[e->reason], e->duration, e->marked, e->recovered, e->recovered_arrays,
+         e->heap_free, e->mem_free, e->mem_longest_free);
+  new_prompt();
+}
+
+static bool prof_thd_running = false;
+static volatile uint32_t prof_period_us = 1000;
+
+// Ticks are ignored by the profiler while it is stopped, so the
+// thread is started on the first :prof start and then left running.
+void *prof_thd(void *v) {
+  (void)v;
+  while (true) {
+    sleep_callback(prof_period_us);
+    lbm_prof_tick();
+  }
+  return NULL;
+}
+
+const char *prof_name(lbm_uint sym) {
+  if (sym == SYM_NIL) return "<top level>";
+  if (sym == SYM_CLOSURE) return "<anonymous>";
+  const char *name = lbm_get_name_by_symbol(sym);
+  return name ? name : "<unknown>";
+}
+
+typedef struct {
+  lbm_uint fun;
+  lbm_uint count;
+} prof_flat_t;
+
+int prof_flat_cmp(const void *a, const void *b) {
+  lbm_uint ca = ((const prof_flat_t*)a)->count;
+  lbm_uint cb = ((const prof_flat_t*)b)->count;
+  return (ca < cb) - (ca > cb);
+}
+
+int prof_data_cmp(const void *a, const void *b) {
+  lbm_uint ca = ((const lbm_prof_t*)a)->count;
+  lbm_uint cb = ((const lbm_prof_t*)b)->count;
+  return (ca < cb) - (ca > cb);
+}
+
+void prof_report(void) {
+  lbm_uint num;
+  lbm_prof_t *data = lbm_prof_get_data(&num);
+  lbm_uint num_ext;
+  lbm_prof_ext_t *ext = lbm_prof_get_ext_data(&num_ext);
+  lbm_uint ticks = lbm_prof_get_num_ticks();
+
+  if (ticks == 0) {
+    printf("No samples\n");
+    return;
+  }
+
+  prof_flat_t flat[PROF_DATA_NUM];
+  lbm_uint num_flat = 0;
+  for (lbm_uint i = 0; i < num; i ++) {
+    lbm_uint j = 0;
+    while (j < num_flat && flat[j].fun != data[i].fun) j ++;
+    if (j == num_flat) {
+      flat[j].fun = data[i].fun;
+      flat[j].count = 0;
+      num_flat ++;
+    }
+    flat[j].count += data[i].count;
+  }
+  qsort(flat, num_flat, sizeof(prof_flat_t), prof_flat_cmp);
+  qsort(data, num, sizeof(lbm_prof_t), prof_data_cmp);
+
+  printf("--(Flat profile)--------------------------------------------\n");
+  printf("%8s %8s  %s\n", "samples", "%", "function");
+  for (lbm_uint i = 0; i < num_flat; i ++) {
+    printf("%8"PRI_UINT" %7.2f%%  %s\n", flat[i].count,
+           100.0 * (double)flat[i].count / (double)ticks, prof_name(flat[i].fun));
+  }
+  printf("--(Call graph)----------------------------------------------\n");
+  printf("%8s %6s  %s\n", "samples", "ctx", "caller -> function");
+  for (lbm_uint i = 0; i < num; i ++) {
+    printf("%8"PRI_UINT" %6"PRI_INT"  %s -> %s\n", data[i].count, data[i].cid,
+           prof_name(data[i].caller), prof_name(data[i].fun));
+  }
+  printf("--(Extensions)----------------------------------------------\n");
+  printf("%8s %10s %8s  %s\n", "calls", "total us", "max us", "extension");
+  for (lbm_uint i = 0; i < num_ext; i ++) {
+    printf("%8"PRI_UINT" %10"PRI_UINT" %8"PRI_UINT"  %s\n", ext[i].calls,
+           ext[i].time_us, ext[i].max_us, prof_name(ext[i].sym));
+  }
+  printf("------------------------------------------------------------\n");
+  printf("Ticks: %"PRI_UINT"\n", ticks);
+  printf("GC: %"PRI_UINT" samples, %"PRI_UINT" us\n",
+         lbm_prof_get_num_gc_samples(), lbm_prof_get_gc_time_us());
+  printf("Idle: %"PRI_UINT" samples\n", lbm_prof_get_num_idle());
+  if (lbm_prof_get_num_dropped() > 0) {
+    printf("Dropped: %"PRI_UINT" samples\n", lbm_prof_get_num_dropped());
+  }
+}
+
 static lbm_uint memory[LBM_MEMORY_SIZE_8K];
 static lbm_uint bitmap[LBM_MEMORY_BITMAP_SIZE_8K];
 
@@ -609,6 +718,7 @@ int main(int argc, char **argv) {
   lbm_set_reader_done_callback(read_done_callback);
 
   lbm_variables_init(variable_storage, VARIABLE_STORAGE_SIZE);
+  lbm_prof_init(prof_data, PROF_DATA_NUM, prof_ext_data, PROF_EXT_DATA_NUM);
 
   if (lbm_array_extensions_init()) {
     printf("Array extensions loaded\n");
@@ -628,6 +738,12 @@ int main(int argc, char **argv) {
     printf("Loading math extensions failed\n");
   }
 
+  if (lbm_ringbuf_extensions_init()) {
+    printf("Ringbuf extensions loaded\n");
+  } else {
+    printf("Loading ringbuf extensions failed\n");
+  }
+
   if (lbm_runtime_extensions_init(false)) {
     printf("Runtime extensions loaded\n");
   } else {
@@ -698,6 +814,11 @@ int main(int argc, char **argv) {
       printf("Recovered: %"PRI_INT"\n", heap_state.gc_recovered);
       printf("Recovered arrays: %"PRI_UINT"\n", heap_state.gc_recovered_arrays);
       printf("Marked: %"PRI_INT"\n", heap_state.gc_marked);
+      printf("GC pause histogram (us):\n");
+      for (int i = 0; i < LBM_GC_PAUSE_HIST_BINS; i ++) {
+        if (heap_state.gc_pause_hist[i] == 0) continue;
+        printf("  < %-8u %"PRI_UINT"\n", 1u << i, heap_state.gc_pause_hist[i]);
+      }
       printf("--(Symbol and Array memory)---------------------------------\n");
       printf("Memory size: %"PRI_UINT" Words\n", lbm_memory_num_words());
       printf("Memory free: %"PRI_UINT" Words\n", lbm_memory_num_free());
@@ -817,6 +938,12 @@ int main(int argc, char **argv) {
           printf("Loading math extensions failed\n");
         }
 
+        if (lbm_ringbuf_extensions_init()) {
+          printf("Ringbuf extensions loaded\n");
+        } else {
+          printf("Loading ringbuf extensions failed\n");
+        }
+
         res = lbm_add_extension("block", ext_block);
         if (res)
           printf("Extension added.\n");
@@ -859,6 +986,12 @@ int main(int argc, char **argv) {
         printf("Loading math extensions failed\n");
       }
 
+      if (lbm_ringbuf_extensions_init()) {
+        printf("Ringbuf extensions loaded\n");
+      } else {
+        printf("Loading ringbuf extensions failed\n");
+      }
+
       lbm_add_extension("print", ext_print);
       free(str);
     } else if (strncmp(str, ":send", 5) == 0) {
@@ -905,6 +1038,41 @@ int main(int argc, char **argv) {
       } else {
         printf("symbol does not exist\n");
       }
+    } else if (strncmp(str, ":gctrace", 8) == 0) {
+      static bool gc_trace = false;
+      gc_trace = !gc_trace;
+      lbm_set_gc_event_callback(gc_trace ? gc_event_callback : NULL);
+      printf("GC trace %s\n", gc_trace ? "enabled" : "disabled");
+      free(str);
+    } else if (strncmp(str, ":prof start", 11) == 0) {
+      int period = atoi(str + 11);
+      if (period > 0) {
+        prof_period_us = (uint32_t)period;
+      }
+      if (!prof_thd_running) {
+        pthread_t prof_thread;
+        if (pthread_create(&prof_thread, NULL, prof_thd, NULL)) {
+          printf("Error creating profiler thread\n");
+        } else {
+          pthread_detach(prof_thread);
+          prof_thd_running = true;
+        }
+      }
+      if (prof_thd_running) {
+        lbm_prof_start();
+        printf("Profiler started, sampling every %u us\n", prof_period_us);
+      }
+      free(str);
+    } else if (strncmp(str, ":prof stop", 10) == 0) {
+      lbm_prof_stop();
+      printf("Profiler stopped\n");
+      free(str);
+    } else if (strncmp(str, ":prof reset", 11) == 0) {
+      lbm_prof_reset();
+      free(str);
+    } else if (strncmp(str, ":prof report", 12) == 0) {
+      prof_report();
+      free(str);
     } else if (strncmp(str, ":undef", 6) == 0) {
       lbm_pause_eval_with_gc(50);
       while(lbm_get_eval_state() != EVAL_CPS_STATE_PAUSED) {
@@ -23,12 +23,22 @@
 #include "print.h"
 
 lbm_value env_global;
+static lbm_uint env_global_version = 0;
 
 int lbm_init_env(void) {
   env_global = ENC_SYM_NIL;
+  env_global_version ++;
   return 1;
 }
 
+lbm_uint lbm_get_env_version(void) {
+  return env_global_version;
+}
+
+void lbm_env_version_inc(void) {
+  env_global_version ++;
+}
+
 lbm_value *lbm_get_env_ptr(void) {
   return &env_global;
 }
@@ -77,6 +87,19 @@ bool lbm_env_lookup_b(lbm_value *res, lbm_value sym, lbm_value env) {
   return false;
 }
 
+lbm_value lbm_env_lookup_binding(lbm_value sym, lbm_value env) {
+  lbm_value curr = env;
+
+  while (lbm_is_ptr(curr)) {
+    lbm_value c = lbm_ref_cell(curr)->car;
+    if ((lbm_ref_cell(c)->car) == sym) {
+      return c;
+    }
+    curr = lbm_ref_cell(curr)->cdr;
+  }
+  return ENC_SYM_NIL;
+}
+
 lbm_value lbm_env_lookup(lbm_value sym, lbm_value env) {
   lbm_value curr = env;
 
@@ -99,6 +122,8 @@ lbm_value lbm_env_set(lbm_value env, lbm_value key, lbm_value val) {
   lbm_value new_env;
   lbm_value keyval;
 
+  if (env == env_global) env_global_version ++;
+
   while(lbm_type_of(curr) == LBM_TYPE_CONS) {
     if (lbm_car(lbm_car(curr)) == key) {
       lbm_set_cdr(lbm_car(curr),val);
@@ -119,6 +144,8 @@ lbm_value lbm_env_set(lbm_value env, lbm_value key, lbm_value val) {
 
 lbm_value lbm_env_set_functional(lbm_value env, lbm_value key, lbm_value val) {
 
+  if (env == env_global) env_global_version ++;
+
   lbm_value keyval = lbm_cons(key, val);
   if (lbm_type_of(keyval) == LBM_TYPE_SYMBOL) {
     return keyval;
@@ -156,6 +183,8 @@ lbm_value lbm_env_modify_binding(lbm_value env, lbm_value key, lbm_value val) {
 lbm_value lbm_env_drop_binding(lbm_value env, lbm_value key) {
 
   lbm_value curr = env;
+
+  if (env == env_global) env_global_version ++;
   // If key is first in env
   if (lbm_car(lbm_car(curr)) == key) {
     return lbm_cdr(curr);
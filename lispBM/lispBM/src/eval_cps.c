@@ -33,6 +33,7 @@
 #include "platform_mutex.h"
 #include "lbm_flat_value.h"
 #include "lbm_flags.h"
+#include "lbm_prof.h"
 
 #ifdef VISUALIZE_HEAP
 #include "heap_vis.h"
@@ -82,7 +83,11 @@
 #define MOVE_LIST_TO_FLASH    CONTINUATION(37)
 #define CLOSE_LIST_IN_FLASH   CONTINUATION(38)
 #define READ_GRAB_ROW0        CONTINUATION(39)
-#define NUM_CONTINUATIONS     40
+#define BYTECODE_RESUME       CONTINUATION(40)
+#define BYTECODE_CONTINUE     CONTINUATION(41)
+#define PROF_RETURN           CONTINUATION(42)
+#define TAIL_ARGS             CONTINUATION(43)
+#define NUM_CONTINUATIONS     44
 
 #define FM_NEED_GC       -1
 #define FM_NO_MATCH      -2
@@ -199,6 +204,7 @@ static void usleep_nonsense(uint32_t us) {
 static void (*usleep_callback)(uint32_t) = usleep_nonsense;
 static uint32_t (*timestamp_us_callback)(void) = NULL;
 static void (*ctx_done_callback)(eval_context_t *) = NULL;
+static void (*gc_event_callback)(lbm_gc_event_t *) = NULL;
 static int (*printf_callback)(const char *, ...) = NULL;
 static bool (*dynamic_load_callback)(const char *, const char **) = NULL;
 static void (*reader_done_callback)(lbm_cid cid) = NULL;
@@ -215,6 +221,10 @@ void lbm_set_ctx_done_callback(void (*fptr)(eval_context_t *)) {
   ctx_done_callback = fptr;
 }
 
+void lbm_set_gc_event_callback(void (*fptr)(lbm_gc_event_t *)) {
+  gc_event_callback = fptr;
+}
+
 void lbm_set_printf_callback(int (*fptr)(const char*, ...)){
   printf_callback = fptr;
 }
@@ -910,6 +920,16 @@ static lbm_cid lbm_create_ctx_parent(lbm_value program, lbm_value env, lbm_uint
   ctx->row0 = -1;
   ctx->row1 = -1;
 
+  ctx->prof_fun = ENC_SYM_NIL;
+  ctx->prof_caller = ENC_SYM_NIL;
+
+  ctx->tail_env = ENC_SYM_NIL;
+  ctx->tail_exp = ENC_SYM_NIL;
+  ctx->tail_sp = 0;
+  ctx->let_env = ENC_SYM_NIL;
+  ctx->let_exp = ENC_SYM_NIL;
+  ctx->env_captures = 0;
+
   ctx->id = cid;
   ctx->parent = parent;
 
@@ -1167,11 +1187,17 @@ static int find_match(lbm_value plist, lbm_value *earr, lbm_uint num, lbm_value
 static void mark_context(eval_context_t *ctx, void *arg1, void *arg2) {
   (void) arg1;
   (void) arg2;
-  lbm_gc_mark_phase(4,
+  lbm_gc_mark_phase(10,
                     ctx->curr_env,
                     ctx->curr_exp,
                     ctx->program,
-                    ctx->r);
+                    ctx->r,
+                    ctx->prof_fun,
+                    ctx->prof_caller,
+                    ctx->tail_env,
+                    ctx->tail_exp,
+                    ctx->let_env,
+                    ctx->let_exp);
   lbm_gc_mark_aux(ctx->mailbox, ctx->num_mail);
   lbm_gc_mark_aux(ctx->K.data, ctx->K.sp);
 }
@@ -1185,6 +1211,14 @@ static int gc(void) {
     tstart = timestamp_us_callback();
   }
 
+  lbm_gc_reason_t reason = LBM_GC_REASON_OTHER;
+  if (lbm_heap_take_alloc_failed()) {
+    reason = LBM_GC_REASON_HEAP;
+  } else if (gc_requested) {
+    reason = LBM_GC_REASON_MEMORY;
+  }
+  lbm_uint recovered_arrays = lbm_heap_state.gc_recovered_arrays;
+
   gc_requested = false;
   lbm_gc_state_inc();
 
@@ -1206,11 +1240,17 @@ static int gc(void) {
   queue_iterator_nm(&blocked, mark_context, NULL, NULL);
 
   if (ctx_running) {
-    lbm_gc_mark_phase(4,
+    lbm_gc_mark_phase(10,
                       ctx_running->curr_env,
                       ctx_running->curr_exp,
                       ctx_running->program,
-                      ctx_running->r);
+                      ctx_running->r,
+                      ctx_running->prof_fun,
+                      ctx_running->prof_caller,
+                      ctx_running->tail_env,
+                      ctx_running->tail_exp,
+                      ctx_running->let_env,
+                      ctx_running->let_exp);
     lbm_gc_mark_aux(ctx_running->mailbox, ctx_running->num_mail);
     lbm_gc_mark_aux(ctx_running->K.data, ctx_running->K.sp);
   }
@@ -1232,9 +1272,25 @@ static int gc(void) {
   }
 
   lbm_heap_new_gc_time(dur);
+  lbm_prof_gc(dur);
 
   lbm_heap_new_freelist_length();
 
+  if (gc_event_callback) {
+    lbm_gc_event_t e;
+    e.timestamp = (uint32_t)tstart;
+    e.duration = (uint32_t)dur;
+    e.marked = lbm_heap_state.gc_marked;
+    e.recovered = lbm_heap_state.gc_recovered;
+    e.recovered_arrays = lbm_heap_state.gc_recovered_arrays - recovered_arrays;
+    e.heap_free = lbm_heap_state.gc_last_free;
+    e.mem_free = lbm_memory_num_free();
+    e.mem_longest_free = lbm_memory_longest_free();
+    e.cid = ctx_running ? ctx_running->id : -1;
+    e.reason = reason;
+    gc_event_callback(&e);
+  }
+
   return r;
 }
 
@@ -1242,20 +1298,64 @@ int lbm_perform_gc(void) {
   return gc();
 }
 
+/****************************************************/
+/* Call site cache                                  */
+
+/* Global bindings found when resolving a symbol are remembered in a
+ * small direct mapped table keyed by the site of the lookup, the call
+ * form for applications and 0 for plain variable references. An entry
+ * holds the binding cell of the global environment, so values changed by
+ * set, setq or a redefinition are seen through it. Entries are valid
+ * only as long as the global environment version is unchanged.
+ */
+#ifndef LBM_CALL_SITE_CACHE_SIZE
+#define LBM_CALL_SITE_CACHE_SIZE 32 // power of two
+#endif
+
+typedef struct {
+  lbm_uint  site;
+  lbm_value sym;
+  lbm_value binding;
+  lbm_uint  version;
+} call_site_entry_t;
+
+static call_site_entry_t call_site_cache[LBM_CALL_SITE_CACHE_SIZE];
+
+static bool global_lookup_cached(lbm_uint site, lbm_value sym, lbm_value *value) {
+  lbm_uint ix = ((site >> LBM_ADDRESS_SHIFT) ^ (sym >> LBM_VAL_SHIFT)) & (LBM_CALL_SITE_CACHE_SIZE - 1);
+  call_site_entry_t *e = &call_site_cache[ix];
+  lbm_uint version = lbm_get_env_version();
+
+  if (e->site == site && e->sym == sym && e->version == version) {
+    *value = lbm_ref_cell(e->binding)->cdr;
+    return true;
+  }
+  lbm_value binding = lbm_env_lookup_binding(sym, *lbm_get_env_ptr());
+  if (lbm_is_cons(binding)) {
+    e->site = site;
+    e->sym = sym;
+    e->binding = binding;
+    e->version = version;
+    *value = lbm_ref_cell(binding)->cdr;
+    return true;
+  }
+  return false;
+}
+
 /****************************************************/
 /* Evaluation functions                             */
 
-static bool eval_symbol(eval_context_t *ctx, lbm_value *value) {
-  lbm_uint s = lbm_dec_sym(ctx->curr_exp);
+static bool lookup_symbol(eval_context_t *ctx, lbm_value sym, lbm_uint site, lbm_value *value) {
+  lbm_uint s = lbm_dec_sym(sym);
   if (s < SPECIAL_SYMBOLS_END) {
-    *value = ctx->curr_exp;
+    *value = sym;
     return true;
   }
 
   if (s >= EXTENSION_SYMBOLS_START &&
       s <  EXTENSION_SYMBOLS_END) {
-    if (lbm_get_extension(lbm_dec_sym(ctx->curr_exp)) != NULL) {
-      *value = ctx->curr_exp;
+    if (lbm_get_extension(s) != NULL) {
+      *value = sym;
       return true;
     }
     return false;
@@ -1267,13 +1367,17 @@ static bool eval_symbol(eval_context_t *ctx, lbm_value *value) {
     return true;
   }
 
-  if (lbm_env_lookup_b(value, ctx->curr_exp, ctx->curr_env)) {
+  if (lbm_env_lookup_b(value, sym, ctx->curr_env)) {
     return true;
   } else {
-    return lbm_env_lookup_b(value, ctx->curr_exp, *lbm_get_env_ptr());
+    return global_lookup_cached(site, sym, value);
   }
 }
 
+static bool eval_symbol(eval_context_t *ctx, lbm_value *value) {
+  return lookup_symbol(ctx, ctx->curr_exp, 0, value);
+}
+
 static void dynamic_load(eval_context_t *ctx) {
   const char *sym_str = lbm_get_name_by_symbol(lbm_dec_sym(ctx->curr_exp));
   const char *code_str = NULL;
@@ -1311,6 +1415,53 @@ static void eval_quote(eval_context_t *ctx) {
   ctx->app_cont = true;
 }
 
+/****************************************************/
+/* Tail call frame reuse                            */
+
+/* When a closure body is entered with at least one parameter, the
+   parameter frame (the first cells of the new environment) is
+   recorded together with the stack pointer. A call to the same
+   closure made at that stack pointer, from that frame or from a let
+   frame on top of it, is a self tail call: nothing on the stack can
+   refer to the frame, so the arguments are written into the existing
+   bindings instead of allocating a new frame. The same holds for a
+   let in tail position of the body, which reuses the let frame of
+   the previous iteration.
+
+   A frame can also be referenced from a closure or a captured
+   continuation. Whenever an environment may be captured the recorded
+   frames are forgotten and the capture count is increased. */
+static void env_captured(eval_context_t *ctx) {
+  ctx->tail_env = ENC_SYM_NIL;
+  ctx->let_env = ENC_SYM_NIL;
+  ctx->env_captures ++;
+}
+
+static void tail_enter(eval_context_t *ctx, lbm_value env, lbm_value exp) {
+  if (env != ctx->tail_env) ctx->let_env = ENC_SYM_NIL;
+  ctx->tail_env = env;
+  ctx->tail_exp = exp;
+  ctx->tail_sp = ctx->K.sp;
+}
+
+static bool tail_frame_reusable(eval_context_t *ctx, lbm_value arg_env, lbm_value exp,
+                                lbm_value params, lbm_value clo_env, lbm_value args) {
+  if (!lbm_is_cons(ctx->tail_env) ||
+      exp != ctx->tail_exp ||
+      ctx->K.sp - 2 != ctx->tail_sp ||
+      (arg_env != ctx->tail_env && arg_env != ctx->let_env)) {
+    return false;
+  }
+  lbm_value curr = ctx->tail_env;
+  while (lbm_is_cons(params)) {
+    if (!lbm_is_cons(args) || !lbm_is_cons(curr)) return false;
+    curr = lbm_cdr(curr);
+    params = lbm_cdr(params);
+    args = lbm_cdr(args);
+  }
+  return lbm_is_symbol_nil(args) && curr == clo_env;
+}
+
 static void eval_selfevaluating(eval_context_t *ctx) {
   ctx->r = ctx->curr_exp;
   ctx->app_cont = true;
@@ -1355,6 +1506,7 @@ static void eval_atomic(eval_context_t *ctx) {
 
 static void eval_callcc(eval_context_t *ctx) {
 
+  env_captured(ctx);
   lbm_value cont_array;
   if (!lbm_heap_allocate_array(&cont_array, ctx->K.sp * sizeof(lbm_uint))) {
     gc();
@@ -1416,6 +1568,8 @@ static void eval_define(eval_context_t *ctx) {
 static void eval_lambda(eval_context_t *ctx) {
   lbm_value closure;
 
+  env_captured(ctx);
+
   WITH_GC(closure, lbm_heap_allocate_list_init(4,
                                                ENC_SYM_CLOSURE,
                                                lbm_cadr(ctx->curr_exp),
@@ -1539,6 +1693,22 @@ static void eval_let(eval_context_t *ctx) {
     return;
   }
 
+  // A let in tail position of a closure body that is rebound by self
+  // tail calls, see tail_frame_reusable.
+  bool tail = (lbm_is_cons(orig_env) &&
+               orig_env == ctx->tail_env &&
+               ctx->K.sp == ctx->tail_sp);
+
+  if (tail && ctx->let_exp == ctx->curr_exp && lbm_is_cons(ctx->let_env)) {
+    new_env = ctx->let_env;
+    lbm_value env_curr = new_env;
+    while (lbm_is_cons(curr)) {
+      lbm_set_cdr(lbm_car(env_curr), ENC_SYM_NIL);
+      env_curr = lbm_cdr(env_curr);
+      curr = lbm_cdr(curr);
+    }
+  }
+
   // Implements letrec by "preallocating" the key parts
   while (lbm_is_cons(curr)) {
     lbm_value new_env_tmp = new_env;
@@ -1565,6 +1735,22 @@ static void eval_let(eval_context_t *ctx) {
     curr = lbm_cdr(curr);
   }
 
+  if (tail && new_env != ctx->let_env) {
+    // Only frames with one cell per binding can be reused.
+    bool simple = true;
+    for (curr = binds; lbm_is_cons(curr); curr = lbm_cdr(curr)) {
+      lbm_value key = lbm_caar(curr);
+      if (!lbm_is_symbol(key) || key == ENC_SYM_NIL || key == ENC_SYM_DONTCARE) {
+        simple = false;
+        break;
+      }
+    }
+    if (simple) {
+      ctx->let_env = new_env;
+      ctx->let_exp = ctx->curr_exp;
+    }
+  }
+
   lbm_value key0 = lbm_caar(binds);
   lbm_value val0_exp = lbm_cadr(lbm_car(binds));
 
@@ -2118,6 +2304,611 @@ static void apply_reverse(lbm_value *args, lbm_uint nargs, eval_context_t *ctx)
   }
 }
 
+/****************************************************/
+/* Bytecode compiler and interpreter               */
+
+/* (compile f) lowers a closure into a stack bytecode that is executed
+ * directly on the context stack, instead of walking the expression
+ * with one continuation per sub-expression. A compiled closure has the
+ * shape (closure params body env code consts). The tree walker ignores
+ * the two trailing elements, so a compiled closure can still be used
+ * anywhere a closure can. Closures containing forms the compiler does
+ * not handle are returned unchanged.
+ *
+ * Frame layout on K, fp is the index of the first argument:
+ *   K[fp - 1]             the closure
+ *   K[fp .. fp + n - 1]   arguments
+ *   K[fp + n]             return pc, 0 returns to the evaluator
+ *   K[fp + n + 1]         return fp
+ *   K[fp + n + 2 ..]      let bound locals and operands
+ *
+ * code[0] is the number of parameters and code[1] the frame size.
+ */
+
+#define BC_IMM     0  // push the next code word
+#define BC_CONST   1  // push constant number arg
+#define BC_LOAD    2  // push K[fp + arg]
+#define BC_SYM     3  // push the value of the symbol in the next code word
+#define BC_POP     4
+#define BC_SLIDE   5  // drop arg values from below the top of stack
+#define BC_JMP     6
+#define BC_JNIL    7  // pop and jump if nil
+#define BC_JNIL_K  8  // jump if top of stack is nil, keep it
+#define BC_JT_K    9  // jump if top of stack is not nil, keep it
+#define BC_FUND    10 // apply fundamental (arg & 0xFF) to (arg >> 8) values
+#define BC_CALL    11 // apply function below arg values
+#define BC_TCALL   12 // as BC_CALL, reusing the frame for compiled functions
+#define BC_RET     13
+
+#define BC_OP(w)           ((w) & 0xFF)
+#define BC_ARG(w)          ((w) >> 8)
+#define BC_INSTR(op, arg)  ((lbm_uint)(op) | ((lbm_uint)(arg) << 8))
+
+#define BC_CODE_START      2
+#define BC_HEADER_SIZE     2
+#define BC_STACK_MARGIN    3  // room for a resume point on top of a frame
+#define BC_QUANTUM         64 // instructions executed per evaluation step
+#define BC_MAX_LOCALS      32
+#define BC_MAX_NESTING     32
+#define BC_MAX_ARGS        0xFFFF
+
+static void application(eval_context_t *ctx, lbm_value *fun_args, lbm_uint arg_count);
+
+static lbm_value bc_closure_env(lbm_value fun) {
+  return lbm_car(lbm_cdr(lbm_cddr(fun)));
+}
+
+static lbm_uint *bc_code(lbm_value fun) {
+  if (!lbm_is_cons(fun) || lbm_car(fun) != ENC_SYM_CLOSURE) return NULL;
+  lbm_value ext = lbm_cddr(lbm_cddr(fun));
+  if (!lbm_is_cons(ext)) return NULL;
+  lbm_value code = lbm_car(ext);
+  if (!lbm_is_array_r(code)) return NULL;
+  return (lbm_uint*)((lbm_array_header_t*)lbm_car(code))->data;
+}
+
+typedef struct {
+  lbm_uint *code;      // NULL while sizing
+  lbm_uint  pc;
+  lbm_value consts;    // next unfilled cell of the constants list
+  lbm_uint  num_consts;
+  lbm_value env;
+  lbm_value local_sym[BC_MAX_LOCALS];
+  lbm_uint  local_slot[BC_MAX_LOCALS];
+  lbm_uint  num_locals;
+  lbm_uint  depth;
+  lbm_uint  max_depth;
+  lbm_uint  nesting;
+  bool      ok;
+} bc_compiler_t;
+
+static void bc_emit(bc_compiler_t *c, lbm_uint w) {
+  if (c->code) c->code[c->pc] = w;
+  c->pc ++;
+}
+
+// Point the jump at address at to the current pc.
+static void bc_patch(bc_compiler_t *c, lbm_uint at) {
+  if (c->code) c->code[at] = BC_INSTR(BC_OP(c->code[at]), c->pc);
+}
+
+static void bc_grow(bc_compiler_t *c, lbm_uint n) {
+  c->depth += n;
+  if (c->depth > c->max_depth) c->max_depth = c->depth;
+}
+
+static void bc_shrink(bc_compiler_t *c, lbm_uint n) {
+  c->depth -= n;
+}
+
+static void bc_add_local(bc_compiler_t *c, lbm_value sym, lbm_uint slot) {
+  if (c->num_locals == BC_MAX_LOCALS) {
+    c->ok = false;
+    return;
+  }
+  c->local_sym[c->num_locals] = sym;
+  c->local_slot[c->num_locals] = slot;
+  c->num_locals ++;
+}
+
+static void bc_emit_value(bc_compiler_t *c, lbm_value v) {
+  if (lbm_is_ptr(v)) {
+    if (c->code) {
+      lbm_set_car(c->consts, v);
+      c->consts = lbm_cdr(c->consts);
+    }
+    bc_emit(c, BC_INSTR(BC_CONST, c->num_consts));
+    c->num_consts ++;
+  } else {
+    bc_emit(c, BC_INSTR(BC_IMM, 0));
+    bc_emit(c, v);
+  }
+  bc_grow(c, 1);
+}
+
+static bool bc_mentions(lbm_value e, lbm_value sym, lbm_uint nesting) {
+  if (nesting > BC_MAX_NESTING) return true;
+  while (lbm_is_cons(e)) {
+    if (bc_mentions(lbm_car(e), sym, nesting + 1)) return true;
+    e = lbm_cdr(e);
+  }
+  return e == sym;
+}
+
+// Symbols are resolved in the same order as eval_symbol.
+static void bc_compile_symbol(bc_compiler_t *c, lbm_value e) {
+  lbm_uint s = lbm_dec_sym(e);
+  if (s < SPECIAL_SYMBOLS_END ||
+      (s >= EXTENSION_SYMBOLS_START &&
+       s <  EXTENSION_SYMBOLS_END &&
+       lbm_get_extension(s) != NULL)) {
+    bc_emit_value(c, e);
+    return;
+  }
+  if (s < VARIABLE_SYMBOLS_START || s >= VARIABLE_SYMBOLS_END) {
+    for (lbm_uint i = c->num_locals; i > 0; i --) {
+      if (c->local_sym[i-1] == e) {
+        bc_emit(c, BC_INSTR(BC_LOAD, c->local_slot[i-1]));
+        bc_grow(c, 1);
+        return;
+      }
+    }
+  }
+  bc_emit(c, BC_INSTR(BC_SYM, 0));
+  bc_emit(c, e);
+  bc_grow(c, 1);
+}
+
+static void bc_compile_exp(bc_compiler_t *c, lbm_value e, bool tail);
+
+static void bc_compile_cond(bc_compiler_t *c, lbm_value clauses, bool tail) {
+  if (!lbm_is_cons(clauses)) {
+    bc_emit_value(c, ENC_SYM_NIL);
+    return;
+  }
+  lbm_value clause = lbm_car(clauses);
+  if (lbm_list_length(clause) != 2) {
+    c->ok = false;
+    return;
+  }
+  bc_compile_exp(c, lbm_car(clause), false);
+  lbm_uint jnil = c->pc;
+  bc_emit(c, BC_INSTR(BC_JNIL, 0));
+  bc_shrink(c, 1);
+  bc_compile_exp(c, lbm_cadr(clause), tail);
+  lbm_uint jmp = c->pc;
+  bc_emit(c, BC_INSTR(BC_JMP, 0));
+  bc_shrink(c, 1);
+  bc_patch(c, jnil);
+  c->nesting ++;
+  if (c->nesting > BC_MAX_NESTING) {
+    c->ok = false;
+    return;
+  }
+  bc_compile_cond(c, lbm_cdr(clauses), tail);
+  c->nesting --;
+  bc_patch(c, jmp);
+}
+
+// and/or: the value deciding the outcome is left on the stack.
+static void bc_compile_and_or(bc_compiler_t *c, lbm_uint jump_op, lbm_value exps, bool tail) {
+  bool last = !lbm_is_cons(lbm_cdr(exps));
+  bc_compile_exp(c, lbm_car(exps), tail && last);
+  if (last) return;
+  lbm_uint j = c->pc;
+  bc_emit(c, BC_INSTR(jump_op, 0));
+  bc_emit(c, BC_INSTR(BC_POP, 0));
+  bc_shrink(c, 1);
+  c->nesting ++;
+  if (c->nesting > BC_MAX_NESTING) {
+    c->ok = false;
+    return;
+  }
+  bc_compile_and_or(c, jump_op, lbm_cdr(exps), tail);
+  c->nesting --;
+  bc_patch(c, j);
+}
+
+static void bc_compile_let(bc_compiler_t *c, lbm_value binds, lbm_value body, bool tail) {
+  lbm_uint num_locals = c->num_locals;
+  lbm_uint n = 0;
+  for (lbm_value curr = binds; lbm_is_cons(curr); curr = lbm_cdr(curr)) {
+    lbm_value key = lbm_caar(curr);
+    lbm_value val = lbm_cadr(lbm_car(curr));
+    if (!lbm_is_symbol(key)) {
+      c->ok = false;
+      return;
+    }
+    // let is letrec, a value referring to its own or a later key
+    // would see a binding location, not a value.
+    for (lbm_value later = curr; lbm_is_cons(later); later = lbm_cdr(later)) {
+      lbm_value k = lbm_caar(later);
+      if (lbm_dec_sym(k) >= SPECIAL_SYMBOLS_END && bc_mentions(val, k, 0)) {
+        c->ok = false;
+        return;
+      }
+    }
+    bc_compile_exp(c, val, false);
+    bc_add_local(c, key, c->depth - 1);
+    n ++;
+  }
+  bc_compile_exp(c, body, tail);
+  c->num_locals = num_locals;
+  if (n > 0) {
+    bc_emit(c, BC_INSTR(BC_SLIDE, n));
+    bc_shrink(c, n);
+  }
+}
+
+static void bc_compile_application(bc_compiler_t *c, lbm_value head, lbm_value args, bool tail) {
+  lbm_uint n = 0;
+  if (lbm_is_symbol(head)) {
+    lbm_uint s = lbm_dec_sym(head);
+    if (s - SPECIAL_FORMS_START <= SPECIAL_FORMS_END - SPECIAL_FORMS_START ||
+        head == ENC_SYM_EVAL ||
+        head == ENC_SYM_EVAL_PROGRAM ||
+        head == ENC_SYM_READ_AND_EVAL_PROGRAM) {
+      // Remaining special forms, and functions that evaluate code in
+      // the environment of the caller, are left to the tree walker.
+      c->ok = false;
+      return;
+    }
+    lbm_uint fund = s - FUNDAMENTALS_START;
+    if (fund <= FUNDAMENTALS_END - FUNDAMENTALS_START) {
+      for (; lbm_is_cons(args); args = lbm_cdr(args)) {
+        bc_compile_exp(c, lbm_car(args), false);
+        n ++;
+      }
+      if (!lbm_is_symbol_nil(args) || n > BC_MAX_ARGS) {
+        c->ok = false;
+        return;
+      }
+      bc_emit(c, BC_INSTR(BC_FUND, fund | (n << 8)));
+      bc_shrink(c, n);
+      bc_grow(c, 1);
+      return;
+    }
+    lbm_value v;
+    if ((lbm_env_lookup_b(&v, head, c->env) ||
+         lbm_env_lookup_b(&v, head, *lbm_get_env_ptr())) &&
+        lbm_is_cons(v) && lbm_car(v) == ENC_SYM_MACRO) {
+      c->ok = false;
+      return;
+    }
+  }
+  bc_compile_exp(c, head, false);
+  for (; lbm_is_cons(args); args = lbm_cdr(args)) {
+    bc_compile_exp(c, lbm_car(args), false);
+    n ++;
+  }
+  if (!lbm_is_symbol_nil(args) || n > BC_MAX_ARGS) {
+    c->ok = false;
+    return;
+  }
+  bc_emit(c, BC_INSTR(tail ? BC_TCALL : BC_CALL, n));
+  bc_shrink(c, n + 1);
+  bc_grow(c, 1);
+}
+
+static void bc_compile_exp(bc_compiler_t *c, lbm_value e, bool tail) {
+  if (!c->ok) return;
+  c->nesting ++;
+  if (c->nesting > BC_MAX_NESTING) {
+    c->ok = false;
+    return;
+  }
+
+  if (lbm_is_symbol(e)) {
+    bc_compile_symbol(c, e);
+  } else if (!lbm_is_cons(e)) {
+    bc_emit_value(c, e);
+  } else {
+    lbm_value head = lbm_car(e);
+    lbm_value rest = lbm_cdr(e);
+    switch (head) {
+    case ENC_SYM_QUOTE:
+      bc_emit_value(c, lbm_car(rest));
+      break;
+    case ENC_SYM_IF: {
+      bc_compile_exp(c, lbm_car(rest), false);
+      lbm_uint jnil = c->pc;
+      bc_emit(c, BC_INSTR(BC_JNIL, 0));
+      bc_shrink(c, 1);
+      bc_compile_exp(c, lbm_cadr(rest), tail);
+      lbm_uint jmp = c->pc;
+      bc_emit(c, BC_INSTR(BC_JMP, 0));
+      bc_shrink(c, 1);
+      bc_patch(c, jnil);
+      bc_compile_exp(c, lbm_car(lbm_cddr(rest)), tail);
+      bc_patch(c, jmp);
+    } break;
+    case ENC_SYM_COND:
+      bc_compile_cond(c, rest, tail);
+      break;
+    case ENC_SYM_PROGN:
+      if (!lbm_is_cons(rest)) {
+        bc_emit_value(c, ENC_SYM_NIL);
+      }
+      for (; lbm_is_cons(rest); rest = lbm_cdr(rest)) {
+        bool last = !lbm_is_cons(lbm_cdr(rest));
+        bc_compile_exp(c, lbm_car(rest), tail && last);
+        if (!last) {
+          bc_emit(c, BC_INSTR(BC_POP, 0));
+          bc_shrink(c, 1);
+        }
+      }
+      break;
+    case ENC_SYM_AND:
+    case ENC_SYM_OR:
+      if (!lbm_is_cons(rest)) {
+        bc_emit_value(c, head == ENC_SYM_AND ? ENC_SYM_TRUE : ENC_SYM_NIL);
+      } else {
+        bc_compile_and_or(c, head == ENC_SYM_AND ? BC_JNIL_K : BC_JT_K, rest, tail);
+      }
+      break;
+    case ENC_SYM_LET:
+      bc_compile_let(c, lbm_car(rest), lbm_cadr(rest), tail);
+      break;
+    default:
+      bc_compile_application(c, head, rest, tail);
+      break;
+    }
+  }
+  c->nesting --;
+}
+
+// With code == NULL only the sizes are computed.
+static bool bc_compile(bc_compiler_t *c, lbm_value params, lbm_value body, lbm_value env,
+                       lbm_uint *code, lbm_value consts) {
+  c->code = code;
+  c->pc = BC_CODE_START;
+  c->consts = consts;
+  c->num_consts = 0;
+  c->env = env;
+  c->num_locals = 0;
+  c->nesting = 0;
+  c->ok = true;
+
+  lbm_uint n = 0;
+  for (; lbm_is_cons(params); params = lbm_cdr(params)) {
+    if (!lbm_is_symbol(lbm_car(params))) return false;
+    bc_add_local(c, lbm_car(params), n);
+    n ++;
+  }
+  if (!lbm_is_symbol_nil(params)) return false;
+
+  c->depth = n + BC_HEADER_SIZE;
+  c->max_depth = c->depth;
+  bc_compile_exp(c, body, true);
+  bc_emit(c, BC_INSTR(BC_RET, 0));
+  if (code) {
+    code[0] = n;
+    code[1] = c->max_depth;
+  }
+  return c->ok;
+}
+
+static void apply_compile(lbm_value *args, lbm_uint nargs, eval_context_t *ctx) {
+  if (nargs != 1 || !lbm_is_cons(args[0]) || lbm_car(args[0]) != ENC_SYM_CLOSURE) {
+    lbm_set_error_reason("Compile requires a closure argument");
+    error_ctx(ENC_SYM_EERROR);
+    return;
+  }
+  lbm_value fun = args[0];
+  lbm_value params = lbm_cadr(fun);
+  lbm_value body = lbm_car(lbm_cddr(fun));
+  lbm_value env = bc_closure_env(fun);
+  lbm_value res = fun;
+
+  bc_compiler_t c;
+  if (!bc_code(fun) && bc_compile(&c, params, body, env, NULL, ENC_SYM_NIL)) {
+    lbm_uint size = c.pc * sizeof(lbm_uint);
+    lbm_value consts;
+    WITH_GC(consts, lbm_heap_allocate_list((unsigned int)c.num_consts));
+    lbm_value code;
+    if (!lbm_heap_allocate_array(&code, size)) {
+      lbm_gc_mark_phase(1, consts);
+      gc();
+      if (!lbm_heap_allocate_array(&code, size)) {
+        error_ctx(ENC_SYM_MERROR);
+        return;
+      }
+    }
+    lbm_array_header_t *arr = (lbm_array_header_t*)lbm_car(code);
+    bc_compile(&c, params, body, env, (lbm_uint*)arr->data, consts);
+    WITH_GC_RMBR(res, lbm_heap_allocate_list_init(6,
+                                                  ENC_SYM_CLOSURE,
+                                                  params,
+                                                  body,
+                                                  env,
+                                                  code,
+                                                  consts), 2, code, consts);
+  }
+  lbm_stack_drop(&ctx->K, nargs + 1);
+  ctx->r = res;
+  ctx->app_cont = true;
+}
+
+static bool bc_lookup(lbm_value sym, lbm_value env, lbm_uint site, lbm_value *value) {
+  lbm_uint s = lbm_dec_sym(sym);
+  if (s >= VARIABLE_SYMBOLS_START &&
+      s < VARIABLE_SYMBOLS_END) {
+    *value = lbm_get_var(s);
+    return true;
+  }
+  return (lbm_env_lookup_b(value, sym, env) ||
+          global_lookup_cached(site, sym, value));
+}
+
+// Leave a resume point on the stack at index at, shifting up what is above it.
+static void bc_push_resume(lbm_stack_t *s, lbm_uint at, lbm_uint pc, lbm_uint fp, lbm_value k) {
+  memmove(&s->data[at + 3], &s->data[at], (s->sp - at) * sizeof(lbm_uint));
+  s->data[at]     = lbm_enc_u(pc);
+  s->data[at + 1] = lbm_enc_u(fp);
+  s->data[at + 2] = k;
+  s->sp += 3;
+}
+
+static lbm_value bc_apply_fundamental(lbm_uint fund, lbm_value *args, lbm_uint n, eval_context_t *ctx) {
+  lbm_value res = fundamental_table[fund](args, n, ctx);
+  if (lbm_is_symbol_merror(res)) {
+    gc();
+    res = fundamental_table[fund](args, n, ctx);
+  }
+  return res;
+}
+
+static void bytecode_run(eval_context_t *ctx, lbm_uint fp, lbm_uint pc) {
+  lbm_stack_t *s = &ctx->K;
+  lbm_uint *code = bc_code(s->data[fp - 1]);
+
+  for (unsigned int steps = 0; steps < BC_QUANTUM; steps ++) {
+    lbm_uint w = code[pc++];
+    switch (BC_OP(w)) {
+    case BC_IMM:
+      s->data[s->sp++] = code[pc++];
+      break;
+    case BC_CONST: {
+      lbm_value cs = lbm_car(lbm_cdr(lbm_cddr(lbm_cddr(s->data[fp - 1]))));
+      for (lbm_uint i = BC_ARG(w); i > 0; i --) cs = lbm_cdr(cs);
+      s->data[s->sp++] = lbm_car(cs);
+    } break;
+    case BC_LOAD:
+      s->data[s->sp] = s->data[fp + BC_ARG(w)];
+      s->sp ++;
+      break;
+    case BC_SYM: {
+      lbm_value sym = code[pc++];
+      lbm_value env = bc_closure_env(s->data[fp - 1]);
+      lbm_value v;
+      if (bc_lookup(sym, env, (lbm_uint)&code[pc], &v)) {
+        s->data[s->sp++] = v;
+      } else {
+        // Let the evaluator resolve or dynamically load the symbol.
+        bc_push_resume(s, s->sp, pc, fp, BYTECODE_RESUME);
+        ctx->curr_exp = sym;
+        ctx->curr_env = env;
+        ctx->app_cont = false;
+        return;
+      }
+    } break;
+    case BC_POP:
+      s->sp --;
+      break;
+    case BC_SLIDE: {
+      lbm_value v = s->data[s->sp - 1];
+      s->sp -= BC_ARG(w);
+      s->data[s->sp - 1] = v;
+    } break;
+    case BC_JMP:
+      pc = BC_ARG(w);
+      break;
+    case BC_JNIL:
+      s->sp --;
+      if (lbm_is_symbol_nil(s->data[s->sp])) pc = BC_ARG(w);
+      break;
+    case BC_JNIL_K:
+      if (lbm_is_symbol_nil(s->data[s->sp - 1])) pc = BC_ARG(w);
+      break;
+    case BC_JT_K:
+      if (!lbm_is_symbol_nil(s->data[s->sp - 1])) pc = BC_ARG(w);
+      break;
+    case BC_FUND: {
+      lbm_uint n = BC_ARG(w) >> 8;
+      lbm_value res = bc_apply_fundamental(BC_ARG(w) & 0xFF, &s->data[s->sp - n], n, ctx);
+      if (lbm_is_error(res)) {
+        error_ctx(res);
+        return;
+      }
+      s->sp -= n;
+      s->data[s->sp++] = res;
+    } break;
+    case BC_CALL: /* fall through */
+    case BC_TCALL: {
+      lbm_uint n = BC_ARG(w);
+      lbm_uint base = s->sp - n - 1;
+      lbm_value fun = s->data[base];
+      lbm_uint *fcode = bc_code(fun);
+      if (fcode && fcode[0] == n) {
+        lbm_uint new_fp = base + 1;
+        lbm_value ret_pc = lbm_enc_u(pc);
+        lbm_value ret_fp = lbm_enc_u(fp);
+        if (BC_OP(w) == BC_TCALL) {
+          new_fp = fp;
+          ret_pc = s->data[fp + code[0]];
+          ret_fp = s->data[fp + code[0] + 1];
+        }
+        if (new_fp + fcode[1] + BC_STACK_MARGIN >= s->size) {
+          error_ctx(ENC_SYM_STACK_ERROR);
+          return;
+        }
+        if (new_fp != base + 1) {
+          memmove(&s->data[new_fp - 1], &s->data[base], (n + 1) * sizeof(lbm_uint));
+        }
+        s->sp = new_fp + n;
+        s->data[s->sp++] = ret_pc;
+        s->data[s->sp++] = ret_fp;
+        if (new_fp + fcode[1] > s->max_sp) s->max_sp = new_fp + fcode[1];
+        fp = new_fp;
+        code = fcode;
+        pc = BC_CODE_START;
+      } else if (lbm_is_symbol(fun) &&
+                 lbm_dec_sym(fun) - FUNDAMENTALS_START <= FUNDAMENTALS_END - FUNDAMENTALS_START) {
+        lbm_value res = bc_apply_fundamental(lbm_dec_sym(fun) - FUNDAMENTALS_START, &s->data[base + 1], n, ctx);
+        if (lbm_is_error(res)) {
+          error_ctx(res);
+          return;
+        }
+        s->sp = base;
+        s->data[s->sp++] = res;
+      } else {
+        // Everything else is applied by the evaluator, which returns
+        // the result to the resume point.
+        bc_push_resume(s, base, pc, fp, BYTECODE_RESUME);
+        ctx->curr_env = bc_closure_env(s->data[fp - 1]);
+        application(ctx, &s->data[base + 3], n);
+        return;
+      }
+    } break;
+    case BC_RET: {
+      lbm_value v = s->data[s->sp - 1];
+      lbm_uint ret_pc = lbm_dec_u(s->data[fp + code[0]]);
+      lbm_uint ret_fp = lbm_dec_u(s->data[fp + code[0] + 1]);
+      s->sp = fp - 1;
+      if (ret_pc == 0) {
+        ctx->r = v;
+        ctx->app_cont = true;
+        return;
+      }
+      fp = ret_fp;
+      pc = ret_pc;
+      code = bc_code(s->data[fp - 1]);
+      s->data[s->sp++] = v;
+    } break;
+    default:
+      error_ctx(ENC_SYM_FATAL_ERROR);
+      return;
+    }
+  }
+  // Quantum used up, give other contexts a chance to run.
+  bc_push_resume(s, s->sp, pc, fp, BYTECODE_CONTINUE);
+  ctx->app_cont = true;
+}
+
+// Enter a compiled closure whose arguments are on top of the stack.
+static void bytecode_enter(eval_context_t *ctx, lbm_value *fun_args, lbm_uint *code) {
+  lbm_stack_t *s = &ctx->K;
+  lbm_uint fp = (lbm_uint)(fun_args - s->data) + 1;
+  if (fp + code[1] + BC_STACK_MARGIN >= s->size) {
+    error_ctx(ENC_SYM_STACK_ERROR);
+    return;
+  }
+  s->data[s->sp++] = lbm_enc_u(0);
+  s->data[s->sp++] = lbm_enc_u(0);
+  if (fp + code[1] > s->max_sp) s->max_sp = fp + code[1];
+  bytecode_run(ctx, fp, BC_CODE_START);
+}
+
 /***************************************************/
 /* Application lookup table                        */
 
@@ -2139,12 +2930,81 @@ static const apply_fun fun_table[] =
    apply_error,
    apply_map,
    apply_reverse,
+   apply_compile,
   };
 
 /***************************************************/
 /* Application of function that takes arguments    */
 /* passed over the stack.                          */
 
+// Record the closure body being entered for the profiler. A call in
+// tail position reuses the PROF_RETURN frame of the enclosing call so
+// that tail recursion stays in constant stack while profiling.
+static void prof_enter(eval_context_t *ctx, lbm_value body) {
+  lbm_stack_t *s = &ctx->K;
+  if (s->sp == 0 || s->data[s->sp-1] != PROF_RETURN) {
+    CHECK_STACK(lbm_push_3(s, ctx->prof_caller, ctx->prof_fun, PROF_RETURN));
+    ctx->prof_caller = ctx->prof_fun;
+  }
+  ctx->prof_fun = body;
+}
+
+// Apply a closure to already evaluated arguments by binding them in
+// the closure environment, as cont_closure_application_args does.
+static void apply_closure_values(eval_context_t *ctx, lbm_value *fun_args, lbm_uint arg_count) {
+  lbm_value fun = fun_args[0];
+  lbm_value params  = lbm_cadr(fun);
+  lbm_value exp     = lbm_car(lbm_cddr(fun));
+  lbm_value clo_env = bc_closure_env(fun);
+  lbm_value nil_arg = ENC_SYM_NIL;
+  lbm_value *args = &fun_args[1];
+  lbm_uint num_args = arg_count;
+
+  if (arg_count == 0) {
+    // Application of a closure to 0 arguments is the same as applying it to nil.
+    args = &nil_arg;
+    num_args = lbm_is_cons(params) ? 1 : 0;
+  }
+  lbm_uint i = 0;
+  for (; i < num_args && lbm_is_cons(params); i ++) {
+    lbm_value ls;
+    WITH_GC_RMBR(ls, lbm_heap_allocate_list(2), 1, clo_env);
+    lbm_value entry = ls;
+    lbm_value aug_env = lbm_cdr(ls);
+    lbm_cons_t *c1 = lbm_ref_cell(entry);
+    c1->car = lbm_car(params);
+    c1->cdr = args[i];
+    lbm_cons_t *c2 = lbm_ref_cell(aug_env);
+    c2->car = entry;
+    c2->cdr = clo_env;
+    clo_env = aug_env;
+    params = lbm_cdr(params);
+  }
+  if (i < num_args) {
+    lbm_set_error_reason((char*)lbm_error_str_num_args);
+    error_ctx(ENC_SYM_EERROR);
+    return;
+  }
+  if (lbm_is_cons(params)) {
+    lbm_value closure;
+    WITH_GC_RMBR(closure, lbm_heap_allocate_list_init(4,
+                                                      ENC_SYM_CLOSURE,
+                                                      params,
+                                                      exp,
+                                                      clo_env),
+                 1, clo_env);
+    lbm_stack_drop(&ctx->K, arg_count + 1);
+    ctx->app_cont = true;
+    ctx->r = closure;
+  } else {
+    lbm_stack_drop(&ctx->K, arg_count + 1);
+    ctx->curr_exp = exp;
+    ctx->curr_env = clo_env;
+    ctx->app_cont = false;
+    if (lbm_prof_is_running()) prof_enter(ctx, exp);
+  }
+}
+
 
 static void application(eval_context_t *ctx, lbm_value *fun_args, lbm_uint arg_count) {
   lbm_value fun = fun_args[0];
@@ -2167,6 +3027,7 @@ static void application(eval_context_t *ctx, lbm_value *fun_args, lbm_uint arg_c
     }
     // zero argument continuation application is fine! (defaults to a nil arg)
     lbm_stack_clear(&ctx->K);
+    env_captured(ctx);
 
     lbm_array_header_t *arr = (lbm_array_header_t*)lbm_car(c);
 
@@ -2175,6 +3036,13 @@ static void application(eval_context_t *ctx, lbm_value *fun_args, lbm_uint arg_c
 
     ctx->r = arg;
     ctx->app_cont = true;
+  } else if (lbm_is_cons(fun) && lbm_car(fun) == ENC_SYM_CLOSURE) {
+    lbm_uint *code = bc_code(fun);
+    if (code && code[0] == arg_count) {
+      bytecode_enter(ctx, fun_args, code);
+    } else {
+      apply_closure_values(ctx, fun_args, arg_count);
+    }
   } else if (lbm_type_of(fun) == LBM_TYPE_SYMBOL) {
     /* eval_cps specific operations */
     lbm_uint fun_val = lbm_dec_sym(fun);
@@ -2202,7 +3070,11 @@ static void application(eval_context_t *ctx, lbm_value *fun_args, lbm_uint arg_c
       }
 
       lbm_value ext_res;
+      uint32_t t_start = 0;
+      bool prof = lbm_prof_is_running() && timestamp_us_callback;
+      if (prof) t_start = timestamp_us_callback();
       WITH_GC(ext_res, f(&fun_args[1], arg_count));
+      if (prof) lbm_prof_ext(fun_val, (uint32_t)(timestamp_us_callback() - t_start));
       if (lbm_is_error(ext_res)) { //Error other than merror
         error_ctx(ext_res);
         return;
@@ -2270,12 +3142,15 @@ static void cont_closure_application_args(eval_context_t *ctx) {
     ctx->curr_env = clo_env;
     ctx->curr_exp = exp;
     ctx->app_cont = false;
+    if (lbm_prof_is_running()) prof_enter(ctx, exp);
+    if (lbm_is_cons(params)) tail_enter(ctx, clo_env, exp);
   } else if (!a_nil && p_nil) {
     // Application with extra arguments
     lbm_set_error_reason((char*)lbm_error_str_num_args);
     error_ctx(ENC_SYM_EERROR);
   } else {
     // Ran out of arguments, but there are still parameters.
+    env_captured(ctx);
     lbm_value new_env = lbm_list_append(arg_env,clo_env);
     lbm_value closure;
     WITH_GC_RMBR(closure, lbm_heap_allocate_list_init(4,
@@ -2351,6 +3226,80 @@ static void cont_or(eval_context_t *ctx) {
   }
 }
 
+// Arguments of a self tail call. The evaluated arguments are kept on
+// the stack below the frame until all of them are evaluated, as the
+// arguments may refer to the bindings that are about to be replaced.
+static void cont_tail_args(eval_context_t *ctx) {
+  lbm_value *sptr = NULL;
+  if (!get_stack_ptr(ctx, 6, &sptr))
+    return;
+
+  lbm_value exp     = sptr[0];
+  lbm_value frame   = sptr[1];
+  lbm_value arg_env = sptr[2];
+  lbm_value caps    = sptr[3];
+  lbm_uint  nvals   = lbm_dec_u(sptr[4]);
+  lbm_value rest    = sptr[5];
+
+  if (lbm_is_cons(rest)) {
+    lbm_value *reserved = NULL;
+    if (!stack_reserve(ctx, 2, &reserved))
+      return;
+    sptr[0] = ctx->r;
+    sptr[1] = exp;
+    sptr[2] = frame;
+    sptr[3] = arg_env;
+    sptr[4] = caps;
+    sptr[5] = lbm_enc_u(nvals + 1);
+    sptr[6] = lbm_cdr(rest);
+    sptr[7] = TAIL_ARGS;
+    ctx->curr_exp = lbm_car(rest);
+    ctx->curr_env = arg_env;
+    return;
+  }
+
+  lbm_stack_drop(&ctx->K, 6);
+  // The last argument is in r and the others are on the stack. The
+  // frame holds the bindings in reverse parameter order.
+  lbm_uint n = nvals + 1;
+  lbm_value *vals = &ctx->K.data[ctx->K.sp - nvals];
+  lbm_value env = frame;
+
+  if (caps == lbm_enc_u(ctx->env_captures)) {
+    lbm_value curr = frame;
+    for (lbm_uint i = 0; i < n; i ++) {
+      lbm_set_cdr(lbm_car(curr), i == 0 ? ctx->r : vals[n - 1 - i]);
+      curr = lbm_cdr(curr);
+    }
+  } else {
+    // The frame may have been captured while evaluating the
+    // arguments, build a new one.
+    lbm_value cells;
+    WITH_GC_RMBR(cells, lbm_heap_allocate_list((unsigned int)(2 * n)), 2, frame, exp);
+    env = cells;
+    lbm_value curr = frame;
+    lbm_value c = cells;
+    for (lbm_uint i = 0; i < n; i ++) {
+      lbm_value spine = c;
+      lbm_value binding = lbm_cdr(c);
+      c = lbm_cdr(binding);
+      lbm_cons_t *b = lbm_ref_cell(binding);
+      b->car = lbm_caar(curr);
+      b->cdr = i == 0 ? ctx->r : vals[n - 1 - i];
+      curr = lbm_cdr(curr);
+      lbm_cons_t *sc = lbm_ref_cell(spine);
+      sc->car = binding;
+      sc->cdr = i == n - 1 ? curr : c;
+    }
+  }
+  lbm_stack_drop(&ctx->K, nvals);
+  ctx->curr_env = env;
+  ctx->curr_exp = exp;
+  ctx->app_cont = false;
+  if (lbm_prof_is_running()) prof_enter(ctx, exp);
+  tail_enter(ctx, env, exp);
+}
+
 static int fill_binding_location(lbm_value key, lbm_value value, lbm_value env) {
   if (lbm_type_of(key) == LBM_TYPE_SYMBOL) {
     if (key == ENC_SYM_DONTCARE) return FB_OK;
@@ -3279,6 +4228,14 @@ static void cont_application_start(eval_context_t *ctx) {
       ctx->app_cont = false;
     } break;
     case ENC_SYM_CLOSURE: {
+      if (bc_code(ctx->r)) {
+        // Compiled closures get their arguments over the stack.
+        sptr[1] = lbm_enc_u(0);
+        CHECK_STACK(lbm_push(&ctx->K,
+                             args));
+        cont_application_args(ctx);
+        break;
+      }
       lbm_value cdr_fun = lbm_cdr(ctx->r);
       lbm_value cddr_fun = lbm_cdr(cdr_fun);
       lbm_value cdddr_fun = lbm_cdr(cddr_fun);
@@ -3286,6 +4243,23 @@ static void cont_application_start(eval_context_t *ctx) {
       lbm_value exp     = lbm_car(cddr_fun);
       lbm_value clo_env = lbm_car(cdddr_fun);
       lbm_value arg_env = (lbm_value)sptr[0];
+      if (lbm_is_cons(params) &&
+          tail_frame_reusable(ctx, arg_env, exp, params, clo_env, args)) {
+        lbm_value *reserved = NULL;
+        if (!stack_reserve(ctx, 5, &reserved))
+          return;
+        sptr[0] = exp;
+        sptr[1] = ctx->tail_env;
+        reserved[0] = arg_env;
+        reserved[1] = lbm_enc_u(ctx->env_captures);
+        reserved[2] = lbm_enc_u(0);
+        reserved[3] = lbm_cdr(args);
+        reserved[4] = TAIL_ARGS;
+        ctx->curr_exp = lbm_car(args);
+        ctx->curr_env = arg_env;
+        ctx->app_cont = false;
+        break;
+      }
       sptr[1] = exp;
       lbm_value *reserved = NULL;
       if (!stack_reserve(ctx, 4, &reserved))
@@ -3587,6 +4561,31 @@ static void cont_read_grab_row0(eval_context_t *ctx) {
   ctx->app_cont = true;
 }
 
+// Result of a call handed to the evaluator from bytecode.
+static void cont_bytecode_resume(eval_context_t *ctx) {
+  lbm_uint fp;
+  lbm_uint pc;
+  lbm_pop_2(&ctx->K, &fp, &pc);
+  CHECK_STACK(lbm_push(&ctx->K, ctx->r));
+  bytecode_run(ctx, lbm_dec_u(fp), lbm_dec_u(pc));
+}
+
+static void cont_bytecode_continue(eval_context_t *ctx) {
+  lbm_uint fp;
+  lbm_uint pc;
+  lbm_pop_2(&ctx->K, &fp, &pc);
+  bytecode_run(ctx, lbm_dec_u(fp), lbm_dec_u(pc));
+}
+
+static void cont_prof_return(eval_context_t *ctx) {
+  lbm_value fun;
+  lbm_value caller;
+  lbm_pop_2(&ctx->K, &fun, &caller);
+  ctx->prof_fun = fun;
+  ctx->prof_caller = caller;
+  ctx->app_cont = true;
+}
+
 
 /*********************************************************/
 /* Continuations table                                   */
@@ -3633,6 +4632,10 @@ static const cont_fun continuations[NUM_CONTINUATIONS] =
     cont_move_list_to_flash,
     cont_close_list_in_flash,
     cont_read_grab_row0,
+    cont_bytecode_resume,
+    cont_bytecode_continue,
+    cont_prof_return,
+    cont_tail_args,
   };
 
 /*********************************************************/
@@ -3673,6 +4676,10 @@ static void evaluation_step(void){
   heap_vis_gen_image();
 #endif
 
+  if (lbm_prof_sample_pending) {
+    lbm_prof_sample(ctx);
+  }
+
   if (ctx->app_cont) {
     lbm_value k;
     lbm_pop(&ctx->K, &k);
@@ -3725,6 +4732,16 @@ static void evaluation_step(void){
     reserved[1] = lbm_ref_cell(ctx->curr_exp)->cdr;
     reserved[2] = APPLICATION_START;
 
+    // A symbol in function position is resolved through the call site
+    // cache, keyed by the application form. This also skips the separate
+    // step that would evaluate the symbol, so such an application takes
+    // one evaluation step fewer. Every context still gets the same step
+    // quota per time slice, so scheduling stays fair between contexts.
+    if (lbm_type_of(head) == LBM_TYPE_SYMBOL &&
+        lookup_symbol(ctx, head, ctx->curr_exp, &ctx->r)) {
+      ctx->app_cont = true;
+      return;
+    }
     ctx->curr_exp = head; // evaluate the function
     return;
   }
@@ -3927,6 +4944,8 @@ int lbm_eval_init() {
   mutex_unlock(&qmutex);
 
   *lbm_get_env_ptr() = ENC_SYM_NIL;
+  lbm_env_version_inc();
+  memset(call_site_cache, 0, sizeof(call_site_cache));
   eval_running = true;
 
   return res;
@@ -0,0 +1,411 @@
+/*
+    Copyright 2023 Joel Svensson        svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "extensions.h"
+#include "lbm_custom_type.h"
+#include "extensions/ringbuf_extensions.h"
+
+#include <stdint.h>
+
+static const char *ringbuf_desc = "Ring-Buffer";
+
+static lbm_uint sym_i8;
+static lbm_uint sym_u8;
+static lbm_uint sym_i16;
+static lbm_uint sym_u16;
+static lbm_uint sym_i32;
+static lbm_uint sym_u32;
+static lbm_uint sym_f32;
+static lbm_uint sym_min;
+static lbm_uint sym_max;
+static lbm_uint sym_mean;
+static lbm_uint sym_var;
+
+/* **************************************************
+ * Every column stores each element twice, at index i and at index
+ * i + capacity. The stored rows of a column are then always the
+ * contiguous range [start, start + len), which lets the data be
+ * handed out without copying.
+ *
+ * Mean and variance are updated on every push (Welford, with
+ * removal of the evicted element). Min and max are updated on push
+ * and only rescanned when the current extreme is evicted. To keep
+ * rounding errors from accumulating, all statistics are recomputed
+ * from the data once every capacity pushes.
+ */
+
+typedef struct {
+  lbm_ringbuf_type_t type;
+  lbm_uint offset;
+  float mean;
+  float m2;
+  float min;
+  float max;
+  bool minmax_valid;
+} rb_col_t;
+
+typedef struct {
+  lbm_uint cap;
+  lbm_uint ncols;
+  lbm_uint start;
+  lbm_uint len;
+  uint8_t *data;
+  rb_col_t cols[1];
+} ringbuf_t;
+
+static bool ringbuf_destructor(lbm_uint value) {
+  lbm_free((void*)value);
+  return true;
+}
+
+static inline uint8_t *elem_ptr(ringbuf_t *rb, lbm_uint col, lbm_uint i) {
+  rb_col_t *c = &rb->cols[col];
+  return rb->data + c->offset + i * lbm_ringbuf_type_size(c->type);
+}
+
+static float elem_read(ringbuf_t *rb, lbm_uint col, lbm_uint i) {
+  uint8_t *p = elem_ptr(rb, col, i);
+  switch (rb->cols[col].type) {
+  case LBM_RINGBUF_I8: return (float)*(int8_t*)p;
+  case LBM_RINGBUF_U8: return (float)*p;
+  case LBM_RINGBUF_I16: return (float)*(int16_t*)p;
+  case LBM_RINGBUF_U16: return (float)*(uint16_t*)p;
+  case LBM_RINGBUF_I32: return (float)*(int32_t*)p;
+  case LBM_RINGBUF_U32: return (float)*(uint32_t*)p;
+  default: return *(float*)p;
+  }
+}
+
+static void elem_write(ringbuf_t *rb, lbm_uint col, lbm_uint i, lbm_value v) {
+  uint8_t *p = elem_ptr(rb, col, i);
+  switch (rb->cols[col].type) {
+  case LBM_RINGBUF_I8: *(int8_t*)p = (int8_t)lbm_dec_as_i32(v); break;
+  case LBM_RINGBUF_U8: *p = (uint8_t)lbm_dec_as_u32(v); break;
+  case LBM_RINGBUF_I16: *(int16_t*)p = (int16_t)lbm_dec_as_i32(v); break;
+  case LBM_RINGBUF_U16: *(uint16_t*)p = (uint16_t)lbm_dec_as_u32(v); break;
+  case LBM_RINGBUF_I32: *(int32_t*)p = lbm_dec_as_i32(v); break;
+  case LBM_RINGBUF_U32: *(uint32_t*)p = lbm_dec_as_u32(v); break;
+  default: *(float*)p = lbm_dec_as_float(v); break;
+  }
+}
+
+static lbm_value elem_enc(ringbuf_t *rb, lbm_uint col, lbm_uint i) {
+  uint8_t *p = elem_ptr(rb, col, i);
+  switch (rb->cols[col].type) {
+  case LBM_RINGBUF_I8: return lbm_enc_i(*(int8_t*)p);
+  case LBM_RINGBUF_U8: return lbm_enc_i(*p);
+  case LBM_RINGBUF_I16: return lbm_enc_i(*(int16_t*)p);
+  case LBM_RINGBUF_U16: return lbm_enc_i(*(uint16_t*)p);
+  case LBM_RINGBUF_I32: return lbm_enc_i32(*(int32_t*)p);
+  case LBM_RINGBUF_U32: return lbm_enc_u32(*(uint32_t*)p);
+  default: return lbm_enc_float(*(float*)p);
+  }
+}
+
+static void col_rescan_minmax(ringbuf_t *rb, lbm_uint col) {
+  rb_col_t *c = &rb->cols[col];
+  float min = elem_read(rb, col, rb->start);
+  float max = min;
+  for (lbm_uint i = 1; i < rb->len; i ++) {
+    float x = elem_read(rb, col, rb->start + i);
+    if (x < min) min = x;
+    if (x > max) max = x;
+  }
+  c->min = min;
+  c->max = max;
+  c->minmax_valid = true;
+}
+
+static void col_resync(ringbuf_t *rb, lbm_uint col) {
+  rb_col_t *c = &rb->cols[col];
+  float sum = 0.0f;
+  for (lbm_uint i = 0; i < rb->len; i ++) {
+    sum += elem_read(rb, col, rb->start + i);
+  }
+  c->mean = sum / (float)rb->len;
+  float m2 = 0.0f;
+  for (lbm_uint i = 0; i < rb->len; i ++) {
+    float d = elem_read(rb, col, rb->start + i) - c->mean;
+    m2 += d * d;
+  }
+  c->m2 = m2;
+  col_rescan_minmax(rb, col);
+}
+
+static void ringbuf_clear(ringbuf_t *rb) {
+  rb->start = 0;
+  rb->len = 0;
+  for (lbm_uint i = 0; i < rb->ncols; i ++) {
+    rb->cols[i].mean = 0.0f;
+    rb->cols[i].m2 = 0.0f;
+    rb->cols[i].minmax_valid = false;
+  }
+}
+
+static void ringbuf_push(ringbuf_t *rb, lbm_value *vals) {
+  lbm_uint w;
+  bool evict = rb->len == rb->cap;
+  if (evict) {
+    w = rb->start;
+    rb->start ++;
+    if (rb->start == rb->cap) rb->start = 0;
+  } else {
+    w = rb->start + rb->len;
+    if (w >= rb->cap) w -= rb->cap;
+    rb->len ++;
+  }
+
+  float n = (float)rb->len;
+  for (lbm_uint col = 0; col < rb->ncols; col ++) {
+    rb_col_t *c = &rb->cols[col];
+    float old = evict ? elem_read(rb, col, w) : 0.0f;
+    elem_write(rb, col, w, vals[col]);
+    elem_write(rb, col, w + rb->cap, vals[col]);
+    float x = elem_read(rb, col, w);
+
+    if (evict) {
+      float mean_old = c->mean;
+      c->mean += (x - old) / n;
+      c->m2 += (x - old) * ((x - c->mean) + (old - mean_old));
+      if (c->m2 < 0.0f) c->m2 = 0.0f;
+      if (c->minmax_valid && (old <= c->min || old >= c->max)) {
+        c->minmax_valid = false;
+      }
+    } else {
+      float d = x - c->mean;
+      c->mean += d / n;
+      c->m2 += d * (x - c->mean);
+      if (rb->len == 1) {
+        c->min = x;
+        c->max = x;
+        c->minmax_valid = true;
+      }
+    }
+    if (c->minmax_valid) {
+      if (x < c->min) c->min = x;
+      if (x > c->max) c->max = x;
+    }
+
+    if (evict && w == rb->cap - 1) {
+      col_resync(rb, col);
+    }
+  }
+}
+
+bool lbm_is_ringbuf(lbm_value v) {
+  return ((lbm_uint)lbm_get_custom_descriptor(v) == (lbm_uint)ringbuf_desc);
+}
+
+lbm_uint lbm_ringbuf_len(lbm_value rb, lbm_uint *ncols) {
+  ringbuf_t *r = (ringbuf_t*)lbm_get_custom_value(rb);
+  *ncols = r->ncols;
+  return r->len;
+}
+
+void *lbm_ringbuf_column(lbm_value rb, lbm_uint col, lbm_ringbuf_type_t *type, lbm_uint *num) {
+  ringbuf_t *r = (ringbuf_t*)lbm_get_custom_value(rb);
+  if (col >= r->ncols) return NULL;
+  *type = r->cols[col].type;
+  *num = r->len;
+  return elem_ptr(r, col, r->start);
+}
+
+float lbm_ringbuf_get(lbm_value rb, lbm_uint col, lbm_uint row) {
+  ringbuf_t *r = (ringbuf_t*)lbm_get_custom_value(rb);
+  if (col >= r->ncols || row >= r->len) return 0.0f;
+  return elem_read(r, col, r->start + row);
+}
+
+static bool decode_type(lbm_value v, lbm_ringbuf_type_t *type) {
+  if (!lbm_is_symbol(v)) return false;
+  lbm_uint s = lbm_dec_sym(v);
+  if (s == sym_i8) *type = LBM_RINGBUF_I8;
+  else if (s == sym_u8) *type = LBM_RINGBUF_U8;
+  else if (s == sym_i16) *type = LBM_RINGBUF_I16;
+  else if (s == sym_u16) *type = LBM_RINGBUF_U16;
+  else if (s == sym_i32) *type = LBM_RINGBUF_I32;
+  else if (s == sym_u32) *type = LBM_RINGBUF_U32;
+  else if (s == sym_f32) *type = LBM_RINGBUF_F32;
+  else return false;
+  return true;
+}
+
+// Get the column index argument, or -1 if it is not valid.
+static int col_arg(ringbuf_t *rb, lbm_value v) {
+  if (!lbm_is_number(v)) return -1;
+  int32_t col = lbm_dec_as_i32(v);
+  if (col < 0 || (lbm_uint)col >= rb->ncols) return -1;
+  return (int)col;
+}
+
+/* **************************************************
+ * Extension implementations
+ */
+
+static lbm_value ext_rb_create(lbm_value *args, lbm_uint argn) {
+  if (argn < 2 || !lbm_is_number(args[0])) return ENC_SYM_TERROR;
+
+  int32_t cap = lbm_dec_as_i32(args[0]);
+  if (cap <= 0) return ENC_SYM_EERROR;
+
+  lbm_uint ncols = argn - 1;
+  lbm_uint data_bytes = 0;
+  for (lbm_uint i = 0; i < ncols; i ++) {
+    lbm_ringbuf_type_t type;
+    if (!decode_type(args[i + 1], &type)) return ENC_SYM_TERROR;
+    // Keep every column 4 byte aligned
+    data_bytes += (2 * (lbm_uint)cap * lbm_ringbuf_type_size(type) + 3) & ~(lbm_uint)3;
+  }
+
+  lbm_uint header_bytes = sizeof(ringbuf_t) + (ncols - 1) * sizeof(rb_col_t);
+  header_bytes = (header_bytes + 7) & ~(lbm_uint)7;
+
+  ringbuf_t *rb = lbm_malloc(header_bytes + data_bytes);
+  if (!rb) return ENC_SYM_MERROR;
+
+  rb->cap = (lbm_uint)cap;
+  rb->ncols = ncols;
+  rb->data = (uint8_t*)rb + header_bytes;
+  lbm_uint offset = 0;
+  for (lbm_uint i = 0; i < ncols; i ++) {
+    decode_type(args[i + 1], &rb->cols[i].type);
+    rb->cols[i].offset = offset;
+    offset += (2 * rb->cap * lbm_ringbuf_type_size(rb->cols[i].type) + 3) & ~(lbm_uint)3;
+  }
+  ringbuf_clear(rb);
+
+  lbm_value res;
+  if (!lbm_custom_type_create((lbm_uint)rb,
+                              ringbuf_destructor,
+                              ringbuf_desc,
+                              &res)) {
+    lbm_free(rb);
+    return ENC_SYM_MERROR;
+  }
+  return res;
+}
+
+static lbm_value ext_rb_push(lbm_value *args, lbm_uint argn) {
+  if (argn < 1 || !lbm_is_ringbuf(args[0])) return ENC_SYM_TERROR;
+  ringbuf_t *rb = (ringbuf_t*)lbm_get_custom_value(args[0]);
+  if (argn != rb->ncols + 1) return ENC_SYM_EERROR;
+  for (lbm_uint i = 1; i < argn; i ++) {
+    if (!lbm_is_number(args[i])) return ENC_SYM_TERROR;
+  }
+  ringbuf_push(rb, &args[1]);
+  return ENC_SYM_TRUE;
+}
+
+static lbm_value ext_rb_get(lbm_value *args, lbm_uint argn) {
+  if (argn != 3 || !lbm_is_ringbuf(args[0]) || !lbm_is_number(args[2])) {
+    return ENC_SYM_TERROR;
+  }
+  ringbuf_t *rb = (ringbuf_t*)lbm_get_custom_value(args[0]);
+  int col = col_arg(rb, args[1]);
+  if (col < 0) return ENC_SYM_EERROR;
+
+  // Negative indexes count from the newest row
+  int32_t row = lbm_dec_as_i32(args[2]);
+  if (row < 0) row += (int32_t)rb->len;
+  if (row < 0 || (lbm_uint)row >= rb->len) return ENC_SYM_EERROR;
+
+  return elem_enc(rb, (lbm_uint)col, rb->start + (lbm_uint)row);
+}
+
+static lbm_value ext_rb_len(lbm_value *args, lbm_uint argn) {
+  if (argn != 1 || !lbm_is_ringbuf(args[0])) return ENC_SYM_TERROR;
+  ringbuf_t *rb = (ringbuf_t*)lbm_get_custom_value(args[0]);
+  return lbm_enc_i((lbm_int)rb->len);
+}
+
+static lbm_value ext_rb_clear(lbm_value *args, lbm_uint argn) {
+  if (argn != 1 || !lbm_is_ringbuf(args[0])) return ENC_SYM_TERROR;
+  ringbuf_clear((ringbuf_t*)lbm_get_custom_value(args[0]));
+  return ENC_SYM_TRUE;
+}
+
+static lbm_value ext_rb_stat(lbm_value *args, lbm_uint argn) {
+  if (argn != 3 || !lbm_is_ringbuf(args[0]) || !lbm_is_symbol(args[2])) {
+    return ENC_SYM_TERROR;
+  }
+  ringbuf_t *rb = (ringbuf_t*)lbm_get_custom_value(args[0]);
+  int col = col_arg(rb, args[1]);
+  if (col < 0) return ENC_SYM_EERROR;
+  if (rb->len == 0) return ENC_SYM_NIL;
+
+  rb_col_t *c = &rb->cols[col];
+  lbm_uint s = lbm_dec_sym(args[2]);
+  if (s == sym_min || s == sym_max) {
+    if (!c->minmax_valid) col_rescan_minmax(rb, (lbm_uint)col);
+    return lbm_enc_float(s == sym_min ? c->min : c->max);
+  } else if (s == sym_mean) {
+    return lbm_enc_float(c->mean);
+  } else if (s == sym_var) {
+    return lbm_enc_float(c->m2 / (float)rb->len);
+  }
+  return ENC_SYM_EERROR;
+}
+
+static lbm_value ext_rb_to_list(lbm_value *args, lbm_uint argn) {
+  if (argn != 2 || !lbm_is_ringbuf(args[0])) return ENC_SYM_TERROR;
+  ringbuf_t *rb = (ringbuf_t*)lbm_get_custom_value(args[0]);
+  int col = col_arg(rb, args[1]);
+  if (col < 0) return ENC_SYM_EERROR;
+
+  lbm_value result = lbm_heap_allocate_list((unsigned int)rb->len);
+  lbm_value curr = result;
+  for (lbm_uint i = 0; i < rb->len && lbm_is_cons(curr); i ++) {
+    lbm_value v = elem_enc(rb, (lbm_uint)col, rb->start + i);
+    if (lbm_is_error(v)) return v;
+    lbm_set_car(curr, v);
+    curr = lbm_cdr(curr);
+  }
+  return result;
+}
+
+// The type and statistic names are common words, reuse them if they
+// are already symbols.
+static int add_symbol(char *name, lbm_uint *id) {
+  if (lbm_get_symbol_by_name(name, id)) return 1;
+  return lbm_add_symbol_const(name, id);
+}
+
+bool lbm_ringbuf_extensions_init(void) {
+
+  int res = true;
+  res = res && add_symbol("i8", &sym_i8);
+  res = res && add_symbol("u8", &sym_u8);
+  res = res && add_symbol("i16", &sym_i16);
+  res = res && add_symbol("u16", &sym_u16);
+  res = res && add_symbol("i32", &sym_i32);
+  res = res && add_symbol("u32", &sym_u32);
+  res = res && add_symbol("f32", &sym_f32);
+  res = res && add_symbol("min", &sym_min);
+  res = res && add_symbol("max", &sym_max);
+  res = res && add_symbol("mean", &sym_mean);
+  res = res && add_symbol("var", &sym_var);
+
+  res = res && lbm_add_extension("rb-create", ext_rb_create);
+  res = res && lbm_add_extension("rb-push", ext_rb_push);
+  res = res && lbm_add_extension("rb-get", ext_rb_get);
+  res = res && lbm_add_extension("rb-len", ext_rb_len);
+  res = res && lbm_add_extension("rb-clear", ext_rb_clear);
+  res = res && lbm_add_extension("rb-stat", ext_rb_stat);
+  res = res && lbm_add_extension("rb-to-list", ext_rb_to_list);
+
+  return res;
+}
@@ -35,6 +35,7 @@ static lbm_uint sym_num_last_free;
 static lbm_uint sym_gc_time_acc;
 static lbm_uint sym_gc_time_min;
 static lbm_uint sym_gc_time_max;
+static lbm_uint sym_gc_pause_hist;
 
 lbm_value ext_eval_set_quota(lbm_value *args, lbm_uint argn) {
   LBM_CHECK_ARGN_NUMBER(1);
@@ -116,6 +117,13 @@ lbm_value ext_lbm_heap_state(lbm_value *args, lbm_uint argn) {
       res = lbm_enc_u(hs.gc_min_duration);
     } else if (s == sym_gc_time_max) {
       res = lbm_enc_u(hs.gc_max_duration);
+    } else if (s == sym_gc_pause_hist) {
+      res = lbm_heap_allocate_list(LBM_GC_PAUSE_HIST_BINS);
+      lbm_value curr = res;
+      for (int i = 0; i < LBM_GC_PAUSE_HIST_BINS && lbm_is_cons(curr); i ++) {
+        lbm_set_car(curr, lbm_enc_u(hs.gc_pause_hist[i]));
+        curr = lbm_cdr(curr);
+      }
     } else {
       res = ENC_SYM_NIL;
     }
@@ -139,6 +147,7 @@ bool lbm_runtime_extensions_init(bool minimal) {
     lbm_add_symbol_const("get-gc-time-acc", &sym_gc_time_acc);
     lbm_add_symbol_const("get-gc-min-dur", &sym_gc_time_min);
     lbm_add_symbol_const("get-gc-max-dur", &sym_gc_time_max);
+    lbm_add_symbol_const("get-gc-pause-hist", &sym_gc_pause_hist);
   }
 
   bool res = true;
@@ -28,46 +28,63 @@
 #include <stdio.h>
 #include <math.h>
 
-static lbm_uint add2(lbm_uint a, lbm_uint b) {
+/* Find the type that all arguments of an n-ary numerical operation
+ * are promoted to, starting from type t. Returns LBM_TYPE_SYMBOL if
+ * any of the arguments is not a number.
+ */
+static lbm_uint promote_types(lbm_value *args, lbm_uint nargs, lbm_uint t) {
+  for (lbm_uint i = 0; i < nargs; i ++) {
+    if (!lbm_is_number(args[i])) {
+      return LBM_TYPE_SYMBOL;
+    }
+    lbm_uint ti = lbm_type_of_functional(args[i]);
+    if (ti > t) t = ti;
+  }
+  return t;
+}
 
-  lbm_uint retval = ENC_SYM_TERROR;
+/* Fold args[start..nargs) into an accumulator of C type ctype and
+ * encode only the final value. Boxed number types thus cost a single
+ * allocation per operation rather than one per intermediate result.
+ */
+#define FOLD_ARGS(res, ctype, dec, enc, init, op, args, start, nargs) do { \
+    ctype acc_ = (init);                                                \
+    for (lbm_uint i_ = (start); i_ < (nargs); i_ ++) {                  \
+      acc_ = acc_ op dec((args)[i_]);                                   \
+    }                                                                   \
+    (res) = enc(acc_);                                                  \
+  } while (0)
 
-  if (!(lbm_is_number(a) && lbm_is_number(b))) {
-    return retval;
-  }
+static lbm_value add_n(lbm_uint t, lbm_value *args, lbm_uint nargs) {
+
+  lbm_value retval = ENC_SYM_TERROR;
 
-  lbm_uint t = (lbm_type_of_functional(a) < lbm_type_of_functional(b)) ? lbm_type_of_functional(b) : lbm_type_of_functional(a);
   switch (t) {
-  case LBM_TYPE_I: retval = lbm_enc_i(lbm_dec_as_i32(a) + lbm_dec_as_i32(b)); break;
-  case LBM_TYPE_U: retval = lbm_enc_u(lbm_dec_as_u32(a) + lbm_dec_as_u32(b)); break;
-  case LBM_TYPE_U32: retval = lbm_enc_u32(lbm_dec_as_u32(a) + lbm_dec_as_u32(b)); break;
-  case LBM_TYPE_I32: retval = lbm_enc_i32(lbm_dec_as_i32(a) + lbm_dec_as_i32(b)); break;
-  case LBM_TYPE_FLOAT: retval = lbm_enc_float(lbm_dec_as_float(a) + lbm_dec_as_float(b)); break;
-  case LBM_TYPE_U64: retval = lbm_enc_u64(lbm_dec_as_u64(a) + lbm_dec_as_u64(b)); break;
-  case LBM_TYPE_I64: retval = lbm_enc_i64(lbm_dec_as_i64(a) + lbm_dec_as_i64(b)); break;
-  case LBM_TYPE_DOUBLE: retval = lbm_enc_double(lbm_dec_as_double(a) + lbm_dec_as_double(b)); break;
+  case LBM_TYPE_I: FOLD_ARGS(retval, int32_t, lbm_dec_as_i32, lbm_enc_i, 0, +, args, 0, nargs); break;
+  case LBM_TYPE_U: FOLD_ARGS(retval, uint32_t, lbm_dec_as_u32, lbm_enc_u, 0, +, args, 0, nargs); break;
+  case LBM_TYPE_U32: FOLD_ARGS(retval, uint32_t, lbm_dec_as_u32, lbm_enc_u32, 0, +, args, 0, nargs); break;
+  case LBM_TYPE_I32: FOLD_ARGS(retval, int32_t, lbm_dec_as_i32, lbm_enc_i32, 0, +, args, 0, nargs); break;
+  case LBM_TYPE_FLOAT: FOLD_ARGS(retval, float, lbm_dec_as_float, lbm_enc_float, 0, +, args, 0, nargs); break;
+  case LBM_TYPE_U64: FOLD_ARGS(retval, uint64_t, lbm_dec_as_u64, lbm_enc_u64, 0, +, args, 0, nargs); break;
+  case LBM_TYPE_I64: FOLD_ARGS(retval, int64_t, lbm_dec_as_i64, lbm_enc_i64, 0, +, args, 0, nargs); break;
+  case LBM_TYPE_DOUBLE: FOLD_ARGS(retval, double, lbm_dec_as_double, lbm_enc_double, 0, +, args, 0, nargs); break;
   }
   return retval;
 }
 
-static lbm_uint mul2(lbm_uint a, lbm_uint b) {
+static lbm_value mul_n(lbm_uint t, lbm_value *args, lbm_uint nargs) {
 
-  lbm_uint retval = ENC_SYM_TERROR;
+  lbm_value retval = ENC_SYM_TERROR;
 
-  if (!(lbm_is_number(a) && lbm_is_number(b))) {
-    return retval;
-  }
-
-  lbm_uint t = (lbm_type_of_functional(a) < lbm_type_of_functional(b)) ? lbm_type_of_functional(b) : lbm_type_of_functional(a);
   switch (t) {
-  case LBM_TYPE_I: retval = lbm_enc_i(lbm_dec_as_i32(a) * lbm_dec_as_i32(b)); break;
-  case LBM_TYPE_U: retval = lbm_enc_u(lbm_dec_as_u32(a) * lbm_dec_as_u32(b)); break;
-  case LBM_TYPE_U32: retval = lbm_enc_u32(lbm_dec_as_u32(a) * lbm_dec_as_u32(b)); break;
-  case LBM_TYPE_I32: retval = lbm_enc_i32(lbm_dec_as_i32(a) * lbm_dec_as_i32(b)); break;
-  case LBM_TYPE_FLOAT: retval = lbm_enc_float(lbm_dec_as_float(a) * lbm_dec_as_float(b)); break;
-  case LBM_TYPE_U64: retval = lbm_enc_u64(lbm_dec_as_u64(a) * lbm_dec_as_u64(b)); break;
-  case LBM_TYPE_I64: retval = lbm_enc_i64(lbm_dec_as_i64(a) * lbm_dec_as_i64(b)); break;
-  case LBM_TYPE_DOUBLE: retval = lbm_enc_double(lbm_dec_as_double(a) * lbm_dec_as_double(b)); break;
+  case LBM_TYPE_I: FOLD_ARGS(retval, int32_t, lbm_dec_as_i32, lbm_enc_i, 1, *, args, 0, nargs); break;
+  case LBM_TYPE_U: FOLD_ARGS(retval, uint32_t, lbm_dec_as_u32, lbm_enc_u, 1, *, args, 0, nargs); break;
+  case LBM_TYPE_U32: FOLD_ARGS(retval, uint32_t, lbm_dec_as_u32, lbm_enc_u32, 1, *, args, 0, nargs); break;
+  case LBM_TYPE_I32: FOLD_ARGS(retval, int32_t, lbm_dec_as_i32, lbm_enc_i32, 1, *, args, 0, nargs); break;
+  case LBM_TYPE_FLOAT: FOLD_ARGS(retval, float, lbm_dec_as_float, lbm_enc_float, 1, *, args, 0, nargs); break;
+  case LBM_TYPE_U64: FOLD_ARGS(retval, uint64_t, lbm_dec_as_u64, lbm_enc_u64, 1, *, args, 0, nargs); break;
+  case LBM_TYPE_I64: FOLD_ARGS(retval, int64_t, lbm_dec_as_i64, lbm_enc_i64, 1, *, args, 0, nargs); break;
+  case LBM_TYPE_DOUBLE: FOLD_ARGS(retval, double, lbm_dec_as_double, lbm_enc_double, 1, *, args, 0, nargs); break;
   }
   return retval;
 }
@@ -135,24 +152,20 @@ static lbm_uint negate(lbm_uint a) {
   return retval;
 }
 
-static lbm_uint sub2(lbm_uint a, lbm_uint b) {
+/* Subtract args[1..nargs) from args[0]. nargs must be at least 1. */
+static lbm_value sub_n(lbm_uint t, lbm_value *args, lbm_uint nargs) {
 
-  lbm_uint retval = ENC_SYM_TERROR;
+  lbm_value retval = ENC_SYM_TERROR;
 
-  if (!(lbm_is_number(a) && lbm_is_number(b))) {
-    return retval;
-  }
-
-  lbm_uint t = (lbm_type_of_functional(a) < lbm_type_of_functional(b)) ? lbm_type_of_functional(b) : lbm_type_of_functional(a);
   switch (t) {
-  case LBM_TYPE_I: retval = lbm_enc_i(lbm_dec_as_i32(a) - lbm_dec_as_i32(b)); break;
-  case LBM_TYPE_U: retval = lbm_enc_u(lbm_dec_as_u32(a) - lbm_dec_as_u32(b)); break;
-  case LBM_TYPE_U32: retval = lbm_enc_u32(lbm_dec_as_u32(a) - lbm_dec_as_u32(b)); break;
-  case LBM_TYPE_I32: retval = lbm_enc_i32(lbm_dec_as_i32(a) - lbm_dec_as_i32(b)); break;
-  case LBM_TYPE_FLOAT: retval = lbm_enc_float(lbm_dec_as_float(a) - lbm_dec_as_float(b)); break;
-  case LBM_TYPE_U64: retval = lbm_enc_u64(lbm_dec_as_u64(a) - lbm_dec_as_u64(b)); break;
-  case LBM_TYPE_I64: retval = lbm_enc_i64(lbm_dec_as_i64(a) - lbm_dec_as_i64(b)); break;
-  case LBM_TYPE_DOUBLE: retval = lbm_enc_double(lbm_dec_as_double(a) - lbm_dec_as_double(b)); break;
+  case LBM_TYPE_I: FOLD_ARGS(retval, int32_t, lbm_dec_as_i32, lbm_enc_i, lbm_dec_as_i32(args[0]), -, args, 1, nargs); break;
+  case LBM_TYPE_U: FOLD_ARGS(retval, uint32_t, lbm_dec_as_u32, lbm_enc_u, lbm_dec_as_u32(args[0]), -, args, 1, nargs); break;
+  case LBM_TYPE_U32: FOLD_ARGS(retval, uint32_t, lbm_dec_as_u32, lbm_enc_u32, lbm_dec_as_u32(args[0]), -, args, 1, nargs); break;
+  case LBM_TYPE_I32: FOLD_ARGS(retval, int32_t, lbm_dec_as_i32, lbm_enc_i32, lbm_dec_as_i32(args[0]), -, args, 1, nargs); break;
+  case LBM_TYPE_FLOAT: FOLD_ARGS(retval, float, lbm_dec_as_float, lbm_enc_float, lbm_dec_as_float(args[0]), -, args, 1, nargs); break;
+  case LBM_TYPE_U64: FOLD_ARGS(retval, uint64_t, lbm_dec_as_u64, lbm_enc_u64, lbm_dec_as_u64(args[0]), -, args, 1, nargs); break;
+  case LBM_TYPE_I64: FOLD_ARGS(retval, int64_t, lbm_dec_as_i64, lbm_enc_i64, lbm_dec_as_i64(args[0]), -, args, 1, nargs); break;
+  case LBM_TYPE_DOUBLE: FOLD_ARGS(retval, double, lbm_dec_as_double, lbm_enc_double, lbm_dec_as_double(args[0]), -, args, 1, nargs); break;
   }
   return retval;
 }
@@ -209,16 +222,11 @@ bool struct_eq(lbm_value a, lbm_value b) {
   return res;
 }
 
-/* returns -1 if a < b; 0 if a = b; 1 if a > b */
-static int compare(lbm_uint a, lbm_uint b) {
+/* returns -1 if a < b; 0 if a = b; 1 if a > b when both are taken as type t */
+static int compare_as(lbm_uint t, lbm_value a, lbm_value b) {
 
   int retval = 0;
 
-  if (!(lbm_is_number(a) && lbm_is_number(b))) {
-    return retval; // result is nonsense if arguments are not numbers.
-  }
-
-  lbm_uint t = (lbm_type_of_functional(a) < lbm_type_of_functional(b)) ? lbm_type_of_functional(b) : lbm_type_of_functional(a);
   switch (t) {
   case LBM_TYPE_I: retval = CMP(lbm_dec_as_i32(a), lbm_dec_as_i32(b)); break;
   case LBM_TYPE_U: retval = CMP(lbm_dec_as_u32(a), lbm_dec_as_u32(b)); break;
@@ -232,6 +240,29 @@ static int compare(lbm_uint a, lbm_uint b) {
   return retval;
 }
 
+/* Compare args[0] against each of the remaining arguments. Each pair is
+ * promoted on its own, so (> 3 -1 1u32) compares 3 and -1 as i and
+ * only 3 and 1 as u32. Results in true if every comparison result is
+ * within [lo, hi].
+ */
+static lbm_value compare_args(lbm_value *args, lbm_uint nargs, int lo, int hi) {
+  if (nargs < 1) {
+    return ENC_SYM_EERROR;
+  }
+  if (promote_types(args, nargs, LBM_TYPE_SYMBOL) == LBM_TYPE_SYMBOL) {
+    return ENC_SYM_TERROR;
+  }
+  lbm_uint t0 = lbm_type_of_functional(args[0]);
+  for (lbm_uint i = 1; i < nargs; i ++) {
+    lbm_uint t = lbm_type_of_functional(args[i]);
+    int c = compare_as(t > t0 ? t : t0, args[0], args[i]);
+    if (c < lo || c > hi) {
+      return ENC_SYM_NIL;
+    }
+  }
+  return ENC_SYM_TRUE;
+}
+
 /* (array-create type size) */
 static void array_create(lbm_value *args, lbm_uint nargs, lbm_value *result) {
   *result = ENC_SYM_EERROR;
@@ -292,14 +323,7 @@ static lbm_value cossa_lookup(lbm_value key, lbm_value assoc) {
 
 static lbm_value fundamental_add(lbm_value *args, lbm_uint nargs, eval_context_t *ctx) {
   (void) ctx;
-  lbm_uint sum = lbm_enc_u(0);
-  for (lbm_uint i = 0; i < nargs; i ++) {
-    sum = add2(sum, args[i]);
-    if (lbm_type_of(sum) == LBM_TYPE_SYMBOL) {
-      break;
-    }
-  }
-  return sum;
+  return add_n(promote_types(args, nargs, LBM_TYPE_U), args, nargs);
 }
 
 static lbm_value fundamental_sub(lbm_value *args, lbm_uint nargs, eval_context_t *ctx) {
@@ -316,17 +340,8 @@ static lbm_value fundamental_sub(lbm_value *args, lbm_uint nargs, eval_context_t
       res = negate(args[0]);
       break;
 
-  case 2:
-      res = sub2(args[0], args[1]);
-      break;
-
   default:
-      res = args[0];
-      for (lbm_uint i = 1; i < nargs; i ++) {
-          res = sub2(res, args[i]);
-          if (lbm_type_of(res) == LBM_TYPE_SYMBOL)
-              break;
-      }
+      res = sub_n(promote_types(args, nargs, LBM_TYPE_SYMBOL), args, nargs);
       break;
   }
   return res;
@@ -334,15 +349,7 @@ static lbm_value fundamental_sub(lbm_value *args, lbm_uint nargs, eval_context_t
 
 static lbm_value fundamental_mul(lbm_value *args, lbm_uint nargs, eval_context_t *ctx) {
   (void) ctx;
-
-  lbm_uint prod = lbm_enc_u(1);
-  for (lbm_uint i = 0; i < nargs; i ++) {
-    prod = mul2(prod, args[i]);
-    if (lbm_type_of(prod) == LBM_TYPE_SYMBOL) {
-      break;
-    }
-  }
-  return prod;
+  return mul_n(promote_types(args, nargs, LBM_TYPE_U), args, nargs);
 }
 
 static lbm_value fundamental_div(lbm_value *args, lbm_uint nargs, eval_context_t *ctx) {
@@ -407,32 +414,7 @@ static lbm_value fundamental_not_eq(lbm_value *args, lbm_uint nargs, eval_contex
 
 static lbm_value fundamental_numeq(lbm_value *args, lbm_uint nargs, eval_context_t *ctx) {
   (void) ctx;
-
-  lbm_uint a = args[0];
-  lbm_uint b;
-  bool r = true;
-  bool ok = true;
-
-  if (!lbm_is_number(a)) {
-    return ENC_SYM_TERROR;
-  }
-  for (lbm_uint i = 1; i < nargs; i ++) {
-    b = args[i];
-    if (!lbm_is_number(b)) {
-      ok = false;
-      break;
-    }
-    r = r && (compare(a, b) == 0);
-    if (!r) break;
-  }
-  if (ok) {
-    if (r) {
-      return ENC_SYM_TRUE;
-    } else {
-      return ENC_SYM_NIL;
-    }
-  }
-  return ENC_SYM_TERROR;
+  return compare_args(args, nargs, 0, 0);
 }
 
 static lbm_value fundamental_num_not_eq(lbm_value *args, lbm_uint nargs, eval_context_t *ctx) {
@@ -448,118 +430,22 @@ static lbm_value fundamental_num_not_eq(lbm_value *args, lbm_uint nargs, eval_co
 
 static lbm_value fundamental_lt(lbm_value *args, lbm_uint nargs, eval_context_t *ctx) {
   (void) ctx;
-
-  lbm_uint a = args[0];
-  lbm_uint b;
-  bool r = true;
-  bool ok = true;
-
-  if (!lbm_is_number(a)) {
-    return ENC_SYM_TERROR;
-  }
-  for (lbm_uint i = 1; i < nargs; i ++) {
-    b = args[i];
-    if (!lbm_is_number(b)) {
-      ok = false;
-      break;
-    }
-    r = r && (compare(a, b) == -1);
-  }
-  if (ok) {
-    if (r) {
-      return ENC_SYM_TRUE;
-    } else {
-      return ENC_SYM_NIL;
-    }
-  }
-  return ENC_SYM_TERROR;
+  return compare_args(args, nargs, -1, -1);
 }
 
 static lbm_value fundamental_gt(lbm_value *args, lbm_uint nargs, eval_context_t *ctx) {
   (void) ctx;
-
-  lbm_uint a = args[0];
-  lbm_uint b;
-  bool r = true;
-  bool ok = true;
-
-  if (!lbm_is_number(a)) {
-    return ENC_SYM_TERROR;
-  }
-  for (lbm_uint i = 1; i < nargs; i ++) {
-    b = args[i];
-    if (!lbm_is_number(b)) {
-      ok = false;
-      break;
-    }
-    r = r && (compare(a, b) == 1);
-  }
-  if (ok) {
-    if (r) {
-      return ENC_SYM_TRUE;
-    } else {
-      return ENC_SYM_NIL;
-    }
-  }
-  return ENC_SYM_TERROR;
+  return compare_args(args, nargs, 1, 1);
 }
 
 static lbm_value fundamental_leq(lbm_value *args, lbm_uint nargs, eval_context_t *ctx) {
   (void) ctx;
-
-  lbm_uint a = args[0];
-  lbm_uint b;
-  bool r = true;
-  bool ok = true;
-
-  if (!lbm_is_number(a)) {
-    return ENC_SYM_TERROR;
-  }
-  for (lbm_uint i = 1; i < nargs; i ++) {
-    b = args[i];
-    if (!lbm_is_number(b)) {
-      ok = false;
-      break;
-    }
-    r = r && (compare(a, b) <= 0);
-  }
-  if (ok) {
-    if (r) {
-      return ENC_SYM_TRUE;
-    } else {
-      return ENC_SYM_NIL;
-    }
-  }
-  return ENC_SYM_TERROR;
+  return compare_args(args, nargs, -1, 0);
 }
 
 static lbm_value fundamental_geq(lbm_value *args, lbm_uint nargs, eval_context_t *ctx) {
   (void) ctx;
-
-  lbm_uint a = args[0];
-  lbm_uint b;
-  bool r = true;
-  bool ok = true;
-
-  if (!lbm_is_number(a)) {
-    return ENC_SYM_TERROR;
-  }
-  for (lbm_uint i = 1; i < nargs; i ++) {
-    b = args[i];
-    if (!lbm_is_number(b)) {
-      ok = false;
-      break;
-    }
-    r = r && (compare(a, b) >= 0);
-  }
-  if (ok) {
-    if (r) {
-      return ENC_SYM_TRUE;
-    } else {
-      return ENC_SYM_NIL;
-    }
-  }
-  return ENC_SYM_TERROR;
+  return compare_args(args, nargs, 0, 1);
 }
 
 static lbm_value fundamental_not(lbm_value *args, lbm_uint nargs, eval_context_t *ctx) {
@@ -21,6 +21,7 @@
 #include <stdint.h>
 #include <stdarg.h>
 #include <inttypes.h>
+#include <string.h>
 #include <lbm_memory.h>
 #include <lbm_custom_type.h>
 
@@ -80,7 +81,16 @@ lbm_value lbm_enc_u32(uint32_t x) {
 }
 
 lbm_value lbm_enc_float(float x) {
-#ifndef LBM64
+#if defined(LBM_SHORT_FLOAT)
+  uint32_t t;
+  memcpy(&t, &x, sizeof(float));
+  if ((t & 0x7F800000u) != 0x7F800000u) {
+    t += 0x10u; // Round to nearest on the dropped mantissa bits.
+  } else if (t & 0x007FFFFFu) {
+    t |= 0x00400000u; // Keep NaN from turning into infinity.
+  }
+  return LBM_SHORT_FLOAT_BIT | ((t >> 1) & LBM_SHORT_FLOAT_VAL_MASK);
+#elif !defined(LBM64)
   lbm_uint t;
   memcpy(&t, &x, sizeof(lbm_float));
   lbm_value f = lbm_cons(t, lbm_enc_sym(SYM_RAW_F_TYPE));
@@ -155,6 +165,13 @@ lbm_value lbm_enc_double(double x) {
 float lbm_dec_float(lbm_value x) {
 #ifndef LBM64
   float f_tmp;
+#ifdef LBM_SHORT_FLOAT
+  if (!lbm_is_ptr(x)) {
+    uint32_t t = (x & LBM_SHORT_FLOAT_VAL_MASK) << 1;
+    memcpy(&f_tmp, &t, sizeof(float));
+    return f_tmp;
+  }
+#endif
   lbm_uint tmp = lbm_car(x);
   memcpy(&f_tmp, &tmp, sizeof(float));
   return f_tmp;
@@ -462,6 +479,9 @@ static void heap_init_state(lbm_cons_t *addr, lbm_uint num_cells,
   lbm_heap_state.gc_time_acc = 0;
   lbm_heap_state.gc_max_duration = 0;
   lbm_heap_state.gc_min_duration = UINT32_MAX;
+  memset(lbm_heap_state.gc_pause_hist, 0, sizeof(lbm_heap_state.gc_pause_hist));
+
+  lbm_heap_state.alloc_failed = false;
 }
 
 void lbm_heap_new_gc_time(lbm_uint dur) {
@@ -470,6 +490,19 @@ void lbm_heap_new_gc_time(lbm_uint dur) {
     lbm_heap_state.gc_max_duration = dur;
   if (dur < lbm_heap_state.gc_min_duration)
     lbm_heap_state.gc_min_duration = dur;
+
+  unsigned int bin = 0;
+  while (dur > 0 && bin < LBM_GC_PAUSE_HIST_BINS - 1) {
+    dur >>= 1;
+    bin ++;
+  }
+  lbm_heap_state.gc_pause_hist[bin] ++;
+}
+
+bool lbm_heap_take_alloc_failed(void) {
+  bool r = lbm_heap_state.alloc_failed;
+  lbm_heap_state.alloc_failed = false;
+  return r;
 }
 
 void lbm_heap_new_freelist_length(void) {
@@ -520,6 +553,7 @@ lbm_value lbm_heap_allocate_cell(lbm_type ptr_type) {
   else if ((lbm_type_of(lbm_heap_state.freelist) == LBM_TYPE_SYMBOL) &&
            (lbm_dec_sym(lbm_heap_state.freelist) == SYM_NIL)) {
     // all is as it should be (but no free cells)
+    lbm_heap_state.alloc_failed = true;
     return ENC_SYM_MERROR;
   }
   else {
@@ -529,7 +563,10 @@ lbm_value lbm_heap_allocate_cell(lbm_type ptr_type) {
 
 lbm_value lbm_heap_allocate_list(unsigned int n) {
   if (n == 0) return ENC_SYM_NIL;
-  if (lbm_heap_num_free() < n) return ENC_SYM_MERROR;
+  if (lbm_heap_num_free() < n) {
+    lbm_heap_state.alloc_failed = true;
+    return ENC_SYM_MERROR;
+  }
 
   lbm_value res = lbm_heap_state.freelist;
   if (lbm_type_of(res) == LBM_TYPE_CONS) {
@@ -556,6 +593,7 @@ lbm_value lbm_heap_allocate_list_init_va(unsigned int n, va_list valist) {
     return ENC_SYM_NIL;
   }
   if (lbm_heap_num_free() < n) {
+    lbm_heap_state.alloc_failed = true;
     return ENC_SYM_MERROR;
   }
 
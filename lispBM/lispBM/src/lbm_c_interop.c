@@ -249,6 +249,7 @@ int lbm_undefine(char *symbol) {
     prev = curr;
     curr = lbm_cdr(curr);
   }
+  lbm_env_version_inc();
   return res;
 
 }
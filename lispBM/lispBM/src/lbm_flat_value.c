@@ -208,27 +208,72 @@ static bool extract_dword(lbm_flat_value_t *v, uint64_t *r) {
 #define UNFLATTEN_GC_RETRY      -1
 #define UNFLATTEN_OK             0
 
-/* Recursive and potentially stack hungry for large flat values */
-static int lbm_unflatten_value_internal(lbm_flat_value_t *v, lbm_value *res) {
+/* The first byte array of a flat value is not copied. While
+   unflattening it is an array whose data points into the flat value
+   buffer, and when unflattening succeeds the array takes over the
+   buffer: the data is moved to the start of the buffer and the
+   buffer is shrunk to fit. The most common events (CAN frames, UART
+   and app data) carry a single byte array, which then needs no
+   allocation of its own. Any further arrays are copied. */
+typedef struct {
+  lbm_flat_value_t *v;
+  lbm_array_header_t *view;
+} unflatten_t;
+
+/* The view must not be left pointing into the buffer when the buffer
+   is freed or when the partial result is garbage collected. */
+static void drop_view(unflatten_t *u) {
+  if (u->view) {
+    u->view->data = NULL;
+    u->view->size = 0;
+    u->view = NULL;
+  }
+}
+
+static void adopt_buffer(unflatten_t *u) {
+  lbm_uint n = u->view->size;
+  memmove(u->v->buf, u->view->data, n);
+  u->view->data = (lbm_uint*)u->v->buf;
+  lbm_uint words = (n + sizeof(lbm_uint) - 1) / sizeof(lbm_uint);
+  lbm_memory_shrink((lbm_uint*)u->v->buf, words);
+  u->view = NULL;
+}
+
+/* Recursive in the nesting depth of the flat value. The spine of a
+   list is decoded in a loop. */
+static int lbm_unflatten_value_internal(unflatten_t *u, lbm_value *res) {
+  lbm_flat_value_t *v = u->v;
   if (v->buf_size == v->buf_pos) return UNFLATTEN_MALFORMED;
   uint8_t curr = v->buf[v->buf_pos++];
 
   switch(curr) {
   case S_CONS: {
-    lbm_value a;
-    lbm_value b;
-    int r = lbm_unflatten_value_internal(v, &a);
-    if (r == UNFLATTEN_OK) {
-      r = lbm_unflatten_value_internal(v, &b);
-      if (r == UNFLATTEN_OK) {
-        lbm_value c;
-        c = lbm_cons(a,b);
-        if (lbm_is_symbol_merror(c)) return UNFLATTEN_GC_RETRY;
-        *res = c;
-        r = UNFLATTEN_OK;
+    lbm_value first = ENC_SYM_NIL;
+    lbm_value last = ENC_SYM_NIL;
+    while (true) {
+      lbm_value a;
+      int r = lbm_unflatten_value_internal(u, &a);
+      if (r != UNFLATTEN_OK) return r;
+      lbm_value c = lbm_cons(a, ENC_SYM_NIL);
+      if (lbm_is_symbol_merror(c)) return UNFLATTEN_GC_RETRY;
+      if (lbm_is_cons(last)) {
+        lbm_set_cdr(last, c);
+      } else {
+        first = c;
+      }
+      last = c;
+      if (v->buf_pos < v->buf_size && v->buf[v->buf_pos] == S_CONS) {
+        v->buf_pos++;
+      } else {
+        lbm_value b;
+        r = lbm_unflatten_value_internal(u, &b);
+        if (r != UNFLATTEN_OK) return r;
+        lbm_set_cdr(last, b);
+        break;
       }
     }
-    return r;
+    *res = first;
+    return UNFLATTEN_OK;
   }
   case S_SYM_VALUE: {
     lbm_uint tmp;
@@ -337,14 +382,20 @@ static int lbm_unflatten_value_internal(lbm_flat_value_t *v, lbm_value *res) {
   case S_LBM_ARRAY: {
     uint32_t num_elt;
     if (extract_word(v, &num_elt)) {
-      if (lbm_heap_allocate_array(res, num_elt)) {
+      if (v->buf_size - v->buf_pos < num_elt) return UNFLATTEN_MALFORMED;
+      if (u->view == NULL && num_elt > 0 &&
+          lbm_memory_ptr_inside((lbm_uint*)v->buf)) {
+        if (!lbm_lift_array(res, (char*)(v->buf + v->buf_pos), num_elt)) {
+          return UNFLATTEN_GC_RETRY;
+        }
+        u->view = (lbm_array_header_t*)lbm_car(*res);
+      } else if (lbm_heap_allocate_array(res, num_elt)) {
         lbm_array_header_t *arr = (lbm_array_header_t*)lbm_car(*res);
-        lbm_uint num_bytes = num_elt;
-        memcpy(arr->data, v->buf + v->buf_pos, num_bytes);
-        v->buf_pos += num_bytes;
+        memcpy(arr->data, v->buf + v->buf_pos, num_elt);
       } else {
         return UNFLATTEN_GC_RETRY;
       }
+      v->buf_pos += num_elt;
       return UNFLATTEN_OK;
     }
     return UNFLATTEN_MALFORMED;
@@ -356,11 +407,15 @@ static int lbm_unflatten_value_internal(lbm_flat_value_t *v, lbm_value *res) {
 
 bool lbm_unflatten_value(lbm_flat_value_t *v, lbm_value *res) {
   bool b = false;
-  int r = lbm_unflatten_value_internal(v,res);
+  unflatten_t u;
+  u.v = v;
+  u.view = NULL;
+  int r = lbm_unflatten_value_internal(&u,res);
   if (r == UNFLATTEN_GC_RETRY) {
+    drop_view(&u);
     lbm_perform_gc();
     v->buf_pos = 0;
-    r = lbm_unflatten_value_internal(v,res);
+    r = lbm_unflatten_value_internal(&u,res);
   }
   if (r == UNFLATTEN_MALFORMED) {
     *res = ENC_SYM_EERROR;
@@ -369,6 +424,11 @@ bool lbm_unflatten_value(lbm_flat_value_t *v, lbm_value *res) {
   } else {
     b = true;
   }
-  lbm_free(v->buf);
+  if (b && u.view) {
+    adopt_buffer(&u);
+  } else {
+    drop_view(&u);
+    lbm_free(v->buf);
+  }
   return b;
 }
@@ -0,0 +1,212 @@
+/*
+    Copyright 2023 Joel Svensson    svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "lbm_prof.h"
+#include "heap.h"
+#include "env.h"
+#include "symrepr.h"
+
+volatile bool lbm_prof_sample_pending = false;
+
+static lbm_prof_t *prof_data = NULL;
+static lbm_uint prof_data_size = 0;
+static lbm_uint prof_data_num = 0;
+static lbm_prof_ext_t *prof_ext = NULL;
+static lbm_uint prof_ext_size = 0;
+static lbm_uint prof_ext_num = 0;
+
+static volatile bool prof_running = false;
+static volatile lbm_uint prof_ticks = 0;
+static lbm_uint prof_samples = 0;
+static lbm_uint prof_gc_samples = 0;
+static lbm_uint prof_dropped = 0;
+static lbm_uint prof_gc_time = 0;
+
+bool lbm_prof_init(lbm_prof_t *data, lbm_uint num_data,
+                   lbm_prof_ext_t *ext_data, lbm_uint num_ext_data) {
+  if (data == NULL || num_data == 0 ||
+      ext_data == NULL || num_ext_data == 0)
+    return false;
+
+  prof_running = false;
+  prof_data = data;
+  prof_data_size = num_data;
+  prof_ext = ext_data;
+  prof_ext_size = num_ext_data;
+  lbm_prof_reset();
+  return true;
+}
+
+void lbm_prof_reset(void) {
+  lbm_prof_sample_pending = false;
+  prof_data_num = 0;
+  prof_ext_num = 0;
+  prof_ticks = 0;
+  prof_samples = 0;
+  prof_gc_samples = 0;
+  prof_dropped = 0;
+  prof_gc_time = 0;
+}
+
+void lbm_prof_start(void) {
+  if (prof_data) {
+    lbm_prof_sample_pending = false;
+    prof_running = true;
+  }
+}
+
+void lbm_prof_stop(void) {
+  prof_running = false;
+  lbm_prof_sample_pending = false;
+}
+
+bool lbm_prof_is_running(void) {
+  return prof_running;
+}
+
+void lbm_prof_tick(void) {
+  if (prof_running) {
+    prof_ticks++;
+    lbm_prof_sample_pending = true;
+  }
+}
+
+// Closures are recorded by their body, which is shared by all copies
+// of the closure. The name is the first global binding to a closure
+// with the same body. Both names of a sample are resolved in a single
+// pass over the environment, stopping once both are found.
+static lbm_uint body_name(lbm_value body) {
+  return lbm_is_symbol_nil(body) ? SYM_NIL : SYM_CLOSURE;
+}
+
+static void fun_names(lbm_value fun_body, lbm_value caller_body,
+                      lbm_uint *fun, lbm_uint *caller) {
+  *fun = body_name(fun_body);
+  *caller = body_name(caller_body);
+  bool fun_found = *fun == SYM_NIL;
+  bool caller_found = *caller == SYM_NIL;
+
+  lbm_value curr = *lbm_get_env_ptr();
+  while (lbm_is_cons(curr) && !(fun_found && caller_found)) {
+    lbm_value binding = lbm_car(curr);
+    lbm_value val = lbm_cdr(binding);
+    if (lbm_is_cons(val) &&
+        lbm_car(val) == ENC_SYM_CLOSURE) {
+      lbm_value body = lbm_car(lbm_cddr(val));
+      if (!fun_found && body == fun_body) {
+        *fun = lbm_dec_sym(lbm_car(binding));
+        fun_found = true;
+      }
+      if (!caller_found && body == caller_body) {
+        *caller = lbm_dec_sym(lbm_car(binding));
+        caller_found = true;
+      }
+    }
+    curr = lbm_cdr(curr);
+  }
+}
+
+void lbm_prof_sample(eval_context_t *ctx) {
+  lbm_prof_sample_pending = false;
+  if (!prof_running) return;
+
+  prof_samples++;
+  lbm_uint fun;
+  lbm_uint caller;
+  fun_names(ctx->prof_fun, ctx->prof_caller, &fun, &caller);
+
+  for (lbm_uint i = 0; i < prof_data_num; i ++) {
+    if (prof_data[i].cid == ctx->id &&
+        prof_data[i].fun == fun &&
+        prof_data[i].caller == caller) {
+      prof_data[i].count++;
+      return;
+    }
+  }
+  if (prof_data_num < prof_data_size) {
+    prof_data[prof_data_num].cid = ctx->id;
+    prof_data[prof_data_num].fun = fun;
+    prof_data[prof_data_num].caller = caller;
+    prof_data[prof_data_num].count = 1;
+    prof_data_num++;
+  } else {
+    prof_dropped++;
+  }
+}
+
+void lbm_prof_gc(lbm_uint us) {
+  if (!prof_running) return;
+  prof_gc_time += us;
+  if (lbm_prof_sample_pending) {
+    lbm_prof_sample_pending = false;
+    prof_gc_samples++;
+  }
+}
+
+void lbm_prof_ext(lbm_uint sym, lbm_uint us) {
+  if (!prof_running) return;
+
+  lbm_prof_ext_t *e = NULL;
+  for (lbm_uint i = 0; i < prof_ext_num; i ++) {
+    if (prof_ext[i].sym == sym) {
+      e = &prof_ext[i];
+      break;
+    }
+  }
+  if (e == NULL) {
+    if (prof_ext_num == prof_ext_size) return;
+    e = &prof_ext[prof_ext_num++];
+    e->sym = sym;
+    e->calls = 0;
+    e->time_us = 0;
+    e->max_us = 0;
+  }
+  e->calls++;
+  e->time_us += us;
+  if (us > e->max_us) e->max_us = us;
+}
+
+lbm_prof_t *lbm_prof_get_data(lbm_uint *num) {
+  *num = prof_data_num;
+  return prof_data;
+}
+
+lbm_prof_ext_t *lbm_prof_get_ext_data(lbm_uint *num) {
+  *num = prof_ext_num;
+  return prof_ext;
+}
+
+lbm_uint lbm_prof_get_num_ticks(void) {
+  return prof_ticks;
+}
+
+lbm_uint lbm_prof_get_num_gc_samples(void) {
+  return prof_gc_samples;
+}
+
+lbm_uint lbm_prof_get_num_dropped(void) {
+  return prof_dropped;
+}
+
+lbm_uint lbm_prof_get_gc_time_us(void) {
+  return prof_gc_time;
+}
+
+lbm_uint lbm_prof_get_num_idle(void) {
+  lbm_uint taken = prof_samples + prof_gc_samples;
+  return prof_ticks > taken ? prof_ticks - taken : 0;
+}
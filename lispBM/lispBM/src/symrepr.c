@@ -66,6 +66,7 @@ special_sym const special_symbols[] =  {
   {"exit-error"   , SYM_EXIT_ERROR},
   {"map"          , SYM_MAP},
   {"reverse"      , SYM_REVERSE},
+  {"compile"      , SYM_COMPILE},
   {"gc"           , SYM_PERFORM_GC},
 
   // pattern matching
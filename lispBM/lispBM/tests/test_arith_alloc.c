@@ -0,0 +1,95 @@
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "heap.h"
+#include "symrepr.h"
+#include "lbm_memory.h"
+#include "fundamental.h"
+
+#define GC_STACK_SIZE 256
+#define HEAP_SIZE 1024
+
+lbm_uint gc_stack_storage[GC_STACK_SIZE];
+lbm_cons_t heap_storage[HEAP_SIZE];
+lbm_uint memory[LBM_MEMORY_SIZE_1K];
+lbm_uint bitmap[LBM_MEMORY_BITMAP_SIZE_1K];
+
+#define FUN(sym) fundamental_table[(sym) - FUNDAMENTALS_START]
+
+/* Number of heap cells needed to hold one boxed value of the same type as v. */
+static lbm_uint cells_of(lbm_value v) {
+  lbm_uint before = lbm_heap_num_allocated();
+  lbm_value r = FUN(SYM_ADD)(&v, 1, NULL);
+  (void)r;
+  return lbm_heap_num_allocated() - before;
+}
+
+/* Evaluate a fundamental on args and report the number of heap cells
+   allocated. A fold over native C types allocates at most the cells
+   of the final result. */
+static int check(const char *name, lbm_uint sym, lbm_value *args, lbm_uint nargs) {
+  lbm_uint before = lbm_heap_num_allocated();
+  lbm_value r = FUN(sym)(args, nargs, NULL);
+  lbm_uint used = lbm_heap_num_allocated() - before;
+
+  if (lbm_is_symbol(r) && lbm_is_error(r)) {
+    printf("%-28s error result\n", name);
+    return 0;
+  }
+  lbm_uint expected = lbm_is_number(r) ? cells_of(r) : 0;
+  printf("%-28s %u cells (expected %u)\n", name, (unsigned int)used, (unsigned int)expected);
+  return used == expected;
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+
+  int res = 1;
+
+  if (!lbm_symrepr_init() ||
+      !lbm_heap_init(heap_storage, HEAP_SIZE, gc_stack_storage, GC_STACK_SIZE) ||
+      !lbm_memory_init(memory, LBM_MEMORY_SIZE_1K, bitmap, LBM_MEMORY_BITMAP_SIZE_1K)) {
+    printf("Error initializing\n");
+    return 0;
+  }
+
+  lbm_value f[4] = {lbm_enc_float(1.0f), lbm_enc_float(2.0f),
+                    lbm_enc_float(3.0f), lbm_enc_float(4.0f)};
+  lbm_value i32[4] = {lbm_enc_i32(1), lbm_enc_i32(2),
+                      lbm_enc_i32(3), lbm_enc_i32(4)};
+  lbm_value u32[4] = {lbm_enc_u32(4), lbm_enc_u32(3),
+                      lbm_enc_u32(2), lbm_enc_u32(1)};
+  lbm_value d[4] = {lbm_enc_double(1.0), lbm_enc_double(2.0),
+                    lbm_enc_double(3.0), lbm_enc_double(4.0)};
+  lbm_value mix[4] = {lbm_enc_i(1), lbm_enc_u32(2),
+                      lbm_enc_float(3.0f), lbm_enc_i(4)};
+
+  res &= check("(+ f f f f)", SYM_ADD, f, 4);
+  res &= check("(- f f f f)", SYM_SUB, f, 4);
+  res &= check("(* f f f f)", SYM_MUL, f, 4);
+  res &= check("(+ i32 i32 i32 i32)", SYM_ADD, i32, 4);
+  res &= check("(* i32 i32 i32 i32)", SYM_MUL, i32, 4);
+  res &= check("(- u32 u32 u32 u32)", SYM_SUB, u32, 4);
+  res &= check("(+ d d d d)", SYM_ADD, d, 4);
+  res &= check("(* d d d d)", SYM_MUL, d, 4);
+  res &= check("(+ i u32 f i)", SYM_ADD, mix, 4);
+  res &= check("(< i32 i32 i32 i32)", SYM_LT, i32, 4);
+  res &= check("(>= f f f f)", SYM_GEQ, f, 4);
+
+  lbm_value r = FUN(SYM_ADD)(mix, 4, NULL);
+  res &= (lbm_type_of_functional(r) == LBM_TYPE_FLOAT && lbm_dec_float(r) == 10.0f);
+  r = FUN(SYM_SUB)(u32, 4, NULL);
+  res &= (lbm_type_of_functional(r) == LBM_TYPE_U32 && lbm_dec_u32(r) == (uint32_t)-2);
+  r = FUN(SYM_MUL)(d, 4, NULL);
+  res &= (lbm_type_of_functional(r) == LBM_TYPE_DOUBLE && lbm_dec_double(r) == 24.0);
+  res &= (FUN(SYM_LT)(i32, 4, NULL) == ENC_SYM_TRUE);
+  res &= (FUN(SYM_GT)(i32, 4, NULL) == ENC_SYM_NIL);
+  lbm_value bad[2] = {lbm_enc_i(1), ENC_SYM_NIL};
+  res &= (FUN(SYM_ADD)(bad, 2, NULL) == ENC_SYM_TERROR);
+  res &= (FUN(SYM_NUMEQ)(bad, 2, NULL) == ENC_SYM_TERROR);
+
+  printf("Arithmetic allocation test: %s\n", res ? "OK" : "NOK!");
+  return res;
+}
@@ -0,0 +1,20 @@
+;; Redefinitions and shadowing must be seen at call sites that
+;; have already resolved a global function.
+(define f (lambda (x) (+ x 1)))
+(define g (lambda (x) (f x)))
+(define a (g 1))
+
+(define f (lambda (x) (+ x 10)))
+(define b (g 1))
+
+(setq f (lambda (x) (+ x 100)))
+(define c (g 1))
+
+(define h (lambda (f) (f 1)))
+(define d (h (lambda (x) (- x 1))))
+
+(undefine 'f)
+(define f (lambda (x) 0))
+(define e (g 1))
+
+(check (and (= a 2) (= b 11) (= c 101) (= d 0) (= e 0)))
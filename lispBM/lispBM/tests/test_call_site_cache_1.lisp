@@ -0,0 +1,14 @@
+;; Global variables read in a loop follow updates.
+(define k 1)
+(define sum-k (lambda (n acc)
+  (if (= n 0) acc
+    (progn
+      (if (= n 50) (define k 2) nil)
+      (sum-k (- n 1) (+ acc k))))))
+
+(define cf (compile (lambda (x) (+ x k))))
+(define r1 (cf 1))
+(define k 5)
+(define r2 (cf 1))
+
+(check (and (= r1 2) (= r2 6) (= (sum-k 100 0) 350)))
@@ -0,0 +1,4 @@
+(check (and (eq t (> 3 -1 1u32))
+            (eq t (< -1 2 5i64))
+            (eq nil (< -1 2 5u32))
+            (eq t (>= 3 -1 3u32))))
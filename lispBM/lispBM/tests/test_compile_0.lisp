@@ -0,0 +1,6 @@
+(define fib (compile (lambda (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))))
+
+(check (and (= (fib 0) 0)
+            (= (fib 1) 1)
+            (= (fib 15) 610)
+            (eq (length fib) 6)))
@@ -0,0 +1,25 @@
+(define tak-body '(lambda (x y z)
+  (if (not (< y x))
+      z
+    (tak
+     (tak (- x 1) y z)
+     (tak (- y 1) z x)
+     (tak (- z 1) x y)))))
+
+(define q2-body '(lambda (x y)
+  (if (or (< x 1) (< y 1)) 1
+    (+ (q2 (- x (q2 (- x 1) y)) y)
+       (q2 x (- y (q2 x (- y 1))))))))
+
+(define tak (eval tak-body))
+(define q2 (eval q2-body))
+(define tak-r (tak 12 8 4))
+(define q2-r (q2 4 5))
+
+(define tak (compile (eval tak-body)))
+(define q2 (compile (eval q2-body)))
+
+(check (and (= (tak 12 8 4) tak-r)
+            (= (q2 4 5) q2-r)
+            (eq (length tak) 6)
+            (eq (length q2) 6)))
@@ -0,0 +1,15 @@
+;; Tail calls in compiled code run in constant stack.
+(define loop (compile (lambda (n acc)
+  (if (= n 0) acc (loop (- n 1) (+ acc 1))))))
+
+(define f (compile (lambda (x)
+  (let ((a (* x 2))
+        (b (+ a 1)))
+    (cond ((< b 10) 'small)
+          ((< b 100) (list a b))
+          (t (and x b)))))))
+
+(check (and (= (loop 100000 0) 100000)
+            (eq (f 1) 'small)
+            (eq (f 10) '(20 21))
+            (= (f 100) 201)))
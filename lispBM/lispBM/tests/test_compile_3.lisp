@@ -0,0 +1,15 @@
+;; Calls from compiled code to closures, extensions and apply functions
+;; are handed over to the evaluator.
+(define add1 (lambda (x) (+ x 1)))
+(define g (compile (lambda (xs k) (progn (map add1 xs) (reverse (map (lambda (y) y) xs)) (add1 k)))))
+(define h (compile (lambda (xs) (map add1 xs))))
+(define apply-twice (compile (lambda (f x) (f (f x)))))
+(define outer 100)
+(define add-outer (compile (lambda (x) (+ x outer))))
+
+(check (and (= (g '(1 2 3) 1) 2)
+            (eq (h '(1 2 3)) '(2 3 4))
+            (= (apply-twice add1 1) 3)
+            (= (apply-twice add-outer 1) 201)
+            (= (apply-twice + 1) 1)
+            (= (add-outer 1) 101)))
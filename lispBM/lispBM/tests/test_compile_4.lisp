@@ -0,0 +1,12 @@
+;; Closures with forms the compiler does not handle are returned unchanged.
+(define f (lambda (x) (progn (define y x) (setq y (+ y 1)) y)))
+(define cf (compile f))
+
+(define mk (compile (lambda (a) (lambda (b) (+ a b)))))
+(define partial (compile (lambda (a b) (+ a b))))
+
+(check (and (eq (length cf) 4)
+            (= (cf 1) 2)
+            (= ((mk 1) 2) 3)
+            (= ((partial 1) 2) 3)
+            (= (partial 1 2) 3)))
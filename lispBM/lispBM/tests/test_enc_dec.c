@@ -1,6 +1,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <math.h>
 
 #include "heap.h"
 
@@ -46,6 +47,25 @@ int main(int argc, char **argv) {
   printf("DEC/ENC %d: %s \n", n++, res ? "ok" : "NOK!");
   res &= (lbm_dec_sym(lbm_enc_sym(268435455)) == 268435455);
   printf("DEC/ENC %d: %s \n", n++, res ? "ok" : "NOK!");
-  
+
+#ifdef LBM_SHORT_FLOAT
+  res &= (lbm_type_of(lbm_enc_float(1.5f)) == LBM_TYPE_FLOAT);
+  printf("DEC/ENC %d: %s \n", n++, res ? "ok" : "NOK!");
+  res &= (!lbm_is_ptr(lbm_enc_float(1.5f)));
+  printf("DEC/ENC %d: %s \n", n++, res ? "ok" : "NOK!");
+  res &= (lbm_dec_float(lbm_enc_float(0.0f)) == 0.0f);
+  printf("DEC/ENC %d: %s \n", n++, res ? "ok" : "NOK!");
+  res &= (lbm_dec_float(lbm_enc_float(-1.5f)) == -1.5f);
+  printf("DEC/ENC %d: %s \n", n++, res ? "ok" : "NOK!");
+  res &= (fabsf(lbm_dec_float(lbm_enc_float(3.14159265f)) - 3.14159265f) < 3.14159265f / 262144.0f);
+  printf("DEC/ENC %d: %s \n", n++, res ? "ok" : "NOK!");
+  res &= (isinf(lbm_dec_float(lbm_enc_float(INFINITY))));
+  printf("DEC/ENC %d: %s \n", n++, res ? "ok" : "NOK!");
+  res &= (isnan(lbm_dec_float(lbm_enc_float(NAN))));
+  printf("DEC/ENC %d: %s \n", n++, res ? "ok" : "NOK!");
+  res &= (lbm_type_of(lbm_enc_sym(SYM_NIL)) == LBM_TYPE_SYMBOL);
+  printf("DEC/ENC %d: %s \n", n++, res ? "ok" : "NOK!");
+#endif
+
   return res;
 }
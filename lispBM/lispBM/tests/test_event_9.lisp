@@ -0,0 +1,36 @@
+(event-register-handler (self))
+
+;; Arrays received in events own their memory and are writable
+(defun get-arr ()
+  (progn
+    (spawn (fn () (event-array 'apa)))
+    (recv (((? x) . (? arr)) arr))))
+
+(def a (get-arr))
+(bufset-i8 a 0 72)
+
+(def b (get-arr))
+
+(defun recv-many (n)
+  (if (= n 0)
+      t
+    (progn
+      (get-arr)
+      (recv-many (- n 1)))))
+
+;; Measure within one expression, as the incremental reader allocates
+;; between top level expressions. One warm-up round takes the one-off
+;; allocations before the baseline.
+(defun no-leak ()
+  (progn
+    (get-arr)
+    (gc)
+    (let ((free-before (mem-num-free)))
+      (progn
+        (recv-many 50)
+        (gc)
+        (= (mem-num-free) free-before)))))
+
+(check (and (eq a "Hello world")
+            (eq b "hello world")
+            (no-leak)))
@@ -0,0 +1,11 @@
+;; Every collection is counted in one bin of the pause histogram.
+(define sum (lambda (ls) (if (eq ls nil) 0 (+ (car ls) (sum (cdr ls))))))
+
+(gc)
+(gc)
+(define hist (lbm-heap-state 'get-gc-pause-hist))
+(define n (sum hist))
+
+(check (and (= (length hist) 16)
+            (>= n 2)
+            (<= n (lbm-heap-state 'get-gc-num))))
@@ -33,6 +33,7 @@
 #include "extensions/matvec_extensions.h"
 #include "extensions/random_extensions.h"
 #include "extensions/loop_extensions.h"
+#include "extensions/ringbuf_extensions.h"
 #include "lbm_channel.h"
 #include "lbm_flat_value.h"
 
@@ -585,6 +586,13 @@ int main(int argc, char **argv) {
     return 0;
   }
 
+  if (lbm_ringbuf_extensions_init()) {
+    printf("Ringbuf extensions initialized.\n");
+  } else {
+    printf("Ringbuf extensions failed.\n");
+    return 0;
+  }
+
   res = lbm_add_extension("ext-even", ext_even);
   if (res)
     printf("Extension added.\n");
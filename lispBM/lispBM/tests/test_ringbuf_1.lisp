@@ -0,0 +1,30 @@
+
+(def rb (rb-create 4 'f32 'i16))
+
+(rb-push rb 1.0 10)
+(rb-push rb 2.0 -20)
+(rb-push rb 3.0 30)
+
+(def a (and (= (rb-len rb) 3)
+            (= (rb-get rb 0 0) 1.0)
+            (= (rb-get rb 1 -1) 30)
+            (= (rb-stat rb 0 'min) 1.0)
+            (= (rb-stat rb 1 'min) -20.0)
+            (= (rb-stat rb 0 'mean) 2.0)))
+
+;; Fill and wrap, the oldest rows are dropped
+(rb-push rb 4.0 40)
+(rb-push rb 5.0 50)
+(rb-push rb 6.0 60)
+
+(def b (and (= (rb-len rb) 4)
+            (eq (rb-to-list rb 0) '(3.0 4.0 5.0 6.0))
+            (eq (rb-to-list rb 1) '(30 40 50 60))
+            (= (rb-stat rb 0 'min) 3.0)
+            (= (rb-stat rb 0 'max) 6.0)
+            (= (rb-stat rb 0 'mean) 4.5)
+            (= (rb-stat rb 0 'var) 1.25)))
+
+(rb-clear rb)
+
+(check (and a b (= (rb-len rb) 0) (eq (rb-stat rb 0 'mean) nil)))
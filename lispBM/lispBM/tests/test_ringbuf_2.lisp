@@ -0,0 +1,17 @@
+
+(def rb (rb-create 8 'i32))
+
+(defun fill (i n)
+  (if (< i n)
+      (progn (rb-push rb i) (fill (+ i 1) n))
+    t))
+
+;; Many wraps, statistics follow the last 8 values
+(fill 0 1000)
+
+(check (and (= (rb-len rb) 8)
+            (= (rb-get rb 0 0) 992)
+            (= (rb-stat rb 0 'min) 992.0)
+            (= (rb-stat rb 0 'max) 999.0)
+            (= (rb-stat rb 0 'mean) 995.5)
+            (= (rb-stat rb 0 'var) 5.25)))
@@ -0,0 +1,32 @@
+
+;; Closures created in the arguments of a self tail call keep their bindings
+(defun collect (i acc)
+  (if (= i 0) acc
+    (collect (- i 1) (cons (lambda () i) acc))))
+
+;; Closures created in a let in tail position keep their bindings
+(defun collect-let (i acc)
+  (if (= i 0) acc
+    (let ((j (* i 10)))
+      (collect-let (- i 1) (cons (lambda () j) acc)))))
+
+;; Arguments refer to the bindings that are replaced
+(defun swap (n a b)
+  (if (= n 0) (list a b)
+    (swap (- n 1) b a)))
+
+(defun inner (x) (+ x 1))
+(defun outer (i acc)
+  (if (= i 0) acc
+    (outer (- i 1) (+ acc (inner i)))))
+
+(defun cc (i acc)
+  (if (= i 0) acc
+    (cc (- i 1) (+ acc (call-cc (lambda (k) (k i)))))))
+
+(check (and (eq (map (lambda (f) (f)) (collect 3 nil)) '(1 2 3))
+            (eq (map (lambda (f) (f)) (collect-let 3 nil)) '(10 20 30))
+            (eq (swap 3 1 2) '(2 1))
+            (eq (swap 4 1 2) '(1 2))
+            (= (outer 10 0) 65)
+            (= (cc 3 0) 6)))
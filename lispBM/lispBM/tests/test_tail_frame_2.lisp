@@ -0,0 +1,19 @@
+
+;; Self tail calls and lets in tail position do not allocate
+(defun lp (i acc)
+  (if (= i 0) acc
+    (let ((y (* i 2)) (z (+ i 1)))
+      (lp (- i 1) (+ acc y z)))))
+
+(defun dec-cnt (x)
+  (if (= x 0) 0 (dec-cnt (- x 1))))
+
+(lp 10 0)
+(dec-cnt 10)
+(gc)
+(define g0 (lbm-heap-state 'get-gc-num))
+(define r (lp 5000 0))
+(dec-cnt 5000)
+(define g1 (lbm-heap-state 'get-gc-num))
+
+(check (and (= r 37512500) (= g0 g1)))
@@ -18,12 +18,15 @@ LISPBMSRC = $(LISPBM)/src/env.c \
             $(LISPBM)/src/lbm_variables.c \
             $(LISPBM)/src/lbm_custom_type.c \
             $(LISPBM)/src/lbm_flags.c \
+            $(LISPBM)/src/lbm_prof.c \
             $(LISPBM)/src/lbm_flat_value.c \
             $(LISPBM)/src/extensions/array_extensions.c \
             $(LISPBM)/src/extensions/math_extensions.c \
             $(LISPBM)/src/extensions/string_extensions.c \
+            $(LISPBM)/src/extensions/ringbuf_extensions.c \
 			lispBM/lispif.c \
 			lispBM/lispif_vesc_extensions.c \
+			lispBM/lispif_dsp_extensions.c \
 			lispBM/lispif_vesc_dynamic_loader.c \
 			lispBM/lispif_c_lib.c
 
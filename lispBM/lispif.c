@@ -24,8 +24,10 @@
 #include "flash_helper.h"
 #include "buffer.h"
 #include "timeout.h"
+#include "mc_latency.h"
 #include "lispbm.h"
 #include "mempools.h"
+#include "packet.h"
 #include "stm32f4xx_conf.h"
 
 #define HEAP_SIZE				(2048 + 256 + 160)
@@ -35,6 +37,10 @@
 #define PRINT_STACK_SIZE		128
 #define EXTENSION_STORAGE_SIZE	260
 #define VARIABLE_STORAGE_SIZE	50
+#define PROF_DATA_NUM			32
+#define PROF_EXT_DATA_NUM		16
+#define PROF_NAME_MAX_LEN		40 // Longer symbol names are truncated in the profile reply
+#define GC_EVENT_NUM			16
 
 __attribute__((section(".ram4"))) static lbm_cons_t heap[HEAP_SIZE] __attribute__ ((aligned (8)));
 static uint32_t memory_array[LISP_MEM_SIZE];
@@ -43,6 +49,9 @@ static uint32_t gc_stack_storage[GC_STACK_SIZE];
 __attribute__((section(".ram4"))) static uint32_t print_stack_storage[PRINT_STACK_SIZE];
 __attribute__((section(".ram4"))) static extension_fptr extension_storage[EXTENSION_STORAGE_SIZE];
 __attribute__((section(".ram4"))) static lbm_value variable_storage[VARIABLE_STORAGE_SIZE];
+__attribute__((section(".ram4"))) static lbm_prof_t prof_data[PROF_DATA_NUM];
+__attribute__((section(".ram4"))) static lbm_prof_ext_t prof_ext_data[PROF_EXT_DATA_NUM];
+__attribute__((section(".ram4"))) static lbm_gc_event_t gc_events[GC_EVENT_NUM];
 
 static lbm_string_channel_state_t string_tok_state;
 static lbm_char_channel_t string_tok;
@@ -61,6 +70,15 @@ static mutex_t lbm_mutex;
 static int repl_cid = -1;
 static int restart_cnt = 0;
 
+static virtual_timer_t prof_vt;
+static systime_t prof_period = MS2ST(1);
+
+// GC events are written by the evaluator thread and read by the
+// command handler, one producer and one consumer.
+static volatile unsigned int gc_event_head = 0;
+static volatile unsigned int gc_event_tail = 0;
+static volatile uint32_t gc_event_dropped = 0;
+
 // Private functions
 static uint32_t timestamp_callback(void);
 static void sleep_callback(uint32_t us);
@@ -114,6 +132,56 @@ static void sym_it(const char *str) {
 	commands_printf_lisp("%s", str);
 }
 
+static void prof_vt_cb(void *arg) {
+	(void)arg;
+
+	lbm_prof_tick();
+
+	if (lbm_prof_is_running()) {
+		chSysLockFromISR();
+		chVTSetI(&prof_vt, prof_period, prof_vt_cb, NULL);
+		chSysUnlockFromISR();
+	}
+}
+
+static const char *prof_name(lbm_uint sym) {
+	if (sym == SYM_NIL) {
+		return "<top level>";
+	} else if (sym == SYM_CLOSURE) {
+		return "<anonymous>";
+	}
+
+	const char *name = lbm_get_name_by_symbol(sym);
+	return name ? name : "<unknown>";
+}
+
+static void gc_event_callback(lbm_gc_event_t *e) {
+	unsigned int next = (gc_event_head + 1) % GC_EVENT_NUM;
+	if (next == gc_event_tail) {
+		gc_event_dropped++;
+		return;
+	}
+	gc_events[gc_event_head] = *e;
+	gc_event_head = next;
+}
+
+// Bytes a name takes in the profile reply, including the terminator. Longer
+// names are truncated.
+static int32_t prof_name_size(lbm_uint sym) {
+	size_t len = strlen(prof_name(sym));
+	if (len > PROF_NAME_MAX_LEN) {
+		len = PROF_NAME_MAX_LEN;
+	}
+	return (int32_t)len + 1;
+}
+
+static void prof_append_name(uint8_t *buffer, lbm_uint sym, int32_t *ind) {
+	int32_t size = prof_name_size(sym);
+	memcpy(buffer + *ind, prof_name(sym), size - 1);
+	buffer[*ind + size - 1] = '\0';
+	*ind += size;
+}
+
 void lispif_process_cmd(unsigned char *data, unsigned int len,
 		void(*reply_func)(unsigned char *data, unsigned int len)) {
 	COMM_PACKET_ID packet_id;
@@ -217,6 +285,144 @@ void lispif_process_cmd(unsigned char *data, unsigned int len,
 		mempools_free_packet_buffer(send_buffer_global);
 	} break;
 
+	case COMM_LISP_PROFILE: {
+		int32_t ind = 0;
+		uint8_t op = data[ind++];
+
+		if (op == 0) {
+			// Stop
+			lbm_prof_stop();
+			chVTReset(&prof_vt);
+		} else if (op == 1) {
+			// Start, optionally with the sample rate in Hz
+			if (len >= 3) {
+				uint16_t rate = buffer_get_uint16(data, &ind);
+				if (rate > 0 && rate <= CH_CFG_ST_FREQUENCY) {
+					prof_period = CH_CFG_ST_FREQUENCY / rate;
+				}
+			}
+
+			if (lisp_thd_running) {
+				lbm_prof_start();
+				chVTSet(&prof_vt, prof_period, prof_vt_cb, NULL);
+			}
+		} else if (op == 2) {
+			// Reset
+			lbm_prof_reset();
+		}
+
+		uint8_t *send_buffer_global = mempools_get_packet_buffer();
+		int32_t send_ind = 0;
+
+		send_buffer_global[send_ind++] = packet_id;
+		send_buffer_global[send_ind++] = op;
+		send_buffer_global[send_ind++] = lbm_prof_is_running();
+
+		if (op == 3) {
+			// Get. Each sample is attributed to a (caller, function) pair,
+			// the flat profile is the sum over the function.
+			lbm_uint num;
+			lbm_prof_t *data_prof = lbm_prof_get_data(&num);
+			lbm_uint num_ext;
+			lbm_prof_ext_t *data_ext = lbm_prof_get_ext_data(&num_ext);
+
+			buffer_append_uint32(send_buffer_global, lbm_prof_get_num_ticks(), &send_ind);
+			buffer_append_uint32(send_buffer_global, lbm_prof_get_num_gc_samples(), &send_ind);
+			buffer_append_uint32(send_buffer_global, lbm_prof_get_gc_time_us(), &send_ind);
+			buffer_append_uint32(send_buffer_global, lbm_prof_get_num_idle(), &send_ind);
+			buffer_append_uint32(send_buffer_global, lbm_prof_get_num_dropped(), &send_ind);
+
+			int32_t num_ind = send_ind;
+			send_ind += 2;
+			uint16_t num_sent = 0;
+			for (lbm_uint i = 0; i < num && send_ind < 300; i++) {
+				// Leave room for the count of the extension records
+				int32_t size = 8 + prof_name_size(data_prof[i].fun) + prof_name_size(data_prof[i].caller);
+				if (send_ind + size > PACKET_MAX_PL_LEN - 2) {
+					break;
+				}
+
+				buffer_append_int32(send_buffer_global, data_prof[i].cid, &send_ind);
+				buffer_append_uint32(send_buffer_global, data_prof[i].count, &send_ind);
+				prof_append_name(send_buffer_global, data_prof[i].fun, &send_ind);
+				prof_append_name(send_buffer_global, data_prof[i].caller, &send_ind);
+				num_sent++;
+			}
+			buffer_append_uint16(send_buffer_global, num_sent, &num_ind);
+
+			num_ind = send_ind;
+			send_ind += 2;
+			num_sent = 0;
+			for (lbm_uint i = 0; i < num_ext && send_ind < 420; i++) {
+				int32_t size = 12 + prof_name_size(data_ext[i].sym);
+				if (send_ind + size > PACKET_MAX_PL_LEN) {
+					break;
+				}
+
+				buffer_append_uint32(send_buffer_global, data_ext[i].calls, &send_ind);
+				buffer_append_uint32(send_buffer_global, data_ext[i].time_us, &send_ind);
+				buffer_append_uint32(send_buffer_global, data_ext[i].max_us, &send_ind);
+				prof_append_name(send_buffer_global, data_ext[i].sym, &send_ind);
+				num_sent++;
+			}
+			buffer_append_uint16(send_buffer_global, num_sent, &num_ind);
+		}
+
+		reply_func(send_buffer_global, send_ind);
+		mempools_free_packet_buffer(send_buffer_global);
+	} break;
+
+	case COMM_LISP_GC_TELEMETRY: {
+		uint8_t op = data[0];
+
+		if (op == 0) {
+			// Disable
+			lbm_set_gc_event_callback(NULL);
+		} else if (op == 1) {
+			// Enable
+			gc_event_tail = gc_event_head;
+			gc_event_dropped = 0;
+			lbm_set_gc_event_callback(gc_event_callback);
+		}
+
+		uint8_t *send_buffer_global = mempools_get_packet_buffer();
+		int32_t ind = 0;
+
+		send_buffer_global[ind++] = packet_id;
+		send_buffer_global[ind++] = op;
+
+		if (op == 2) {
+			// Get the pause histogram and drain the queued events
+			send_buffer_global[ind++] = LBM_GC_PAUSE_HIST_BINS;
+			for (int i = 0; i < LBM_GC_PAUSE_HIST_BINS; i++) {
+				buffer_append_uint32(send_buffer_global, lbm_heap_state.gc_pause_hist[i], &ind);
+			}
+			buffer_append_uint32(send_buffer_global, gc_event_dropped, &ind);
+
+			int32_t num_ind = ind++;
+			uint8_t num = 0;
+			while (gc_event_tail != gc_event_head && ind < 400) {
+				lbm_gc_event_t *e = &gc_events[gc_event_tail];
+				buffer_append_uint32(send_buffer_global, e->timestamp, &ind);
+				buffer_append_uint32(send_buffer_global, e->duration, &ind);
+				buffer_append_uint16(send_buffer_global, e->marked, &ind);
+				buffer_append_uint16(send_buffer_global, e->recovered, &ind);
+				buffer_append_uint16(send_buffer_global, e->recovered_arrays, &ind);
+				buffer_append_uint16(send_buffer_global, e->heap_free, &ind);
+				buffer_append_uint32(send_buffer_global, e->mem_free, &ind);
+				buffer_append_uint32(send_buffer_global, e->mem_longest_free, &ind);
+				buffer_append_int32(send_buffer_global, e->cid, &ind);
+				send_buffer_global[ind++] = e->reason;
+				gc_event_tail = (gc_event_tail + 1) % GC_EVENT_NUM;
+				num++;
+			}
+			send_buffer_global[num_ind] = num;
+		}
+
+		reply_func(send_buffer_global, ind);
+		mempools_free_packet_buffer(send_buffer_global);
+	} break;
+
 	case COMM_LISP_REPL_CMD: {
 		if (!lisp_thd_running) {
 			lispif_restart(true, false);
@@ -272,6 +478,9 @@ void lispif_process_cmd(unsigned char *data, unsigned int len,
 				commands_printf_lisp("Recovered: %d\n", lbm_heap_state.gc_recovered);
 				commands_printf_lisp("Recovered arrays: %u\n", lbm_heap_state.gc_recovered_arrays);
 				commands_printf_lisp("Marked: %d\n", lbm_heap_state.gc_marked);
+				commands_printf_lisp("GC pause us (min/max/acc): %u/%u/%u\n",
+						lbm_heap_state.gc_min_duration, lbm_heap_state.gc_max_duration,
+						lbm_heap_state.gc_time_acc);
 				commands_printf_lisp("--(Symbol and Array memory)--\n");
 				commands_printf_lisp("Memory size: %u Words\n", lbm_memory_num_words());
 				commands_printf_lisp("Memory free: %u Words\n", lbm_memory_num_free());
@@ -536,6 +745,9 @@ bool lispif_restart(bool print, bool load_code) {
 
 	lispif_stop_lib();
 
+	lbm_prof_stop();
+	chVTReset(&prof_vt);
+
 	char *code_data = (char*)flash_helper_code_data(CODE_IND_LISP);
 	int32_t code_len = flash_helper_code_size(CODE_IND_LISP);
 
@@ -551,6 +763,7 @@ bool lispif_restart(bool print, bool load_code) {
 					extension_storage, EXTENSION_STORAGE_SIZE);
 			lbm_variables_init(variable_storage, VARIABLE_STORAGE_SIZE);
 			lbm_eval_init_events(20);
+			lbm_prof_init(prof_data, PROF_DATA_NUM, prof_ext_data, PROF_EXT_DATA_NUM);
 
 			lbm_set_timestamp_us_callback(timestamp_callback);
 			lbm_set_usleep_callback(sleep_callback);
@@ -574,6 +787,7 @@ bool lispif_restart(bool print, bool load_code) {
 					extension_storage, EXTENSION_STORAGE_SIZE);
 			lbm_variables_init(variable_storage, VARIABLE_STORAGE_SIZE);
 			lbm_eval_init_events(20);
+			lbm_prof_reset();
 		}
 
 		lbm_pause_eval();
@@ -667,5 +881,6 @@ static THD_FUNCTION(eval_thread, arg) {
 	(void)arg;
 	eval_tp = chThdGetSelfX();
 	chRegSetThreadName("Lisp Eval");
+	mc_latency_set_thread_source(MC_LATENCY_SRC_LISP);
 	lbm_run_eval();
 }
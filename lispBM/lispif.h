@@ -40,11 +40,13 @@ float lispif_get_ppm(void);
 void lispif_process_cmd(unsigned char *data, unsigned int len,
 		void(*reply_func)(unsigned char *data, unsigned int len));
 void lispif_process_can(uint32_t can_id, uint8_t *data8, int len, bool is_ext);
+bool lispif_can_event_enabled(bool is_ext);
 void lispif_process_custom_app_data(unsigned char *data, unsigned int len);
 void lispif_process_shutdown(void);
 void lispif_set_ext_load_callback(void (*p_func)(void));
 
 void lispif_load_vesc_extensions(void);
+void lispif_load_dsp_extensions(void);
 bool lispif_vesc_dynamic_loader(const char *str, const char **code);
 
 #endif /* LISPBM_LISPIF_H_ */
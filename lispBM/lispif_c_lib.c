@@ -43,6 +43,9 @@
 #include "servo_simple.h"
 #include "flash_helper.h"
 #include "mcpwm_foc.h"
+#include "foc_hooks.h"
+
+#include <string.h>
 
 // Function prototypes otherwise missing
 void packet_init(void (*s_func)(unsigned char *data, unsigned int len),
@@ -503,6 +506,7 @@ static bool lib_set_cfg_float(CFG_PARAM p, float value) {
 
 	if (changed_mc > 0) {
 		commands_apply_mcconf_hw_limits(mcconf);
+		mc_interface_update_derived();
 	}
 
 	if (changed_app > 0) {
@@ -586,6 +590,264 @@ static float lib_get_ppm_age(void) {
 	return (float)servodec_get_time_since_update() / 1000.0;
 }
 
+// Shared memory
+
+#define SHM_NUM_MAX			8
+#define SHM_FIELDS_MAX		16
+#define SHM_NAME_LEN		16
+#define SHM_READ_TRIES		100
+
+typedef struct {
+	char name[SHM_NAME_LEN];
+	SHM_TYPE type;
+	uint32_t len;
+	uint32_t offset;
+} shm_field_info;
+
+typedef struct {
+	volatile uint32_t seq;
+	bool use_seqlock;
+	char name[SHM_NAME_LEN];
+	int field_num;
+	shm_field_info fields[SHM_FIELDS_MAX];
+	uint32_t data_size;
+	uint8_t *data;
+} shm_region;
+
+static shm_region *shm_regions[SHM_NUM_MAX] = {0};
+
+static uint32_t shm_type_size(SHM_TYPE type) {
+	switch (type) {
+	case SHM_TYPE_I8: case SHM_TYPE_U8: return 1;
+	case SHM_TYPE_I16: case SHM_TYPE_U16: return 2;
+	case SHM_TYPE_I32: case SHM_TYPE_U32: case SHM_TYPE_FLOAT: return 4;
+	default: return 0;
+	}
+}
+
+static shm_region *shm_find(const char *name) {
+	for (int i = 0;i < SHM_NUM_MAX;i++) {
+		if (shm_regions[i] && strncmp(shm_regions[i]->name, name, SHM_NAME_LEN) == 0) {
+			return shm_regions[i];
+		}
+	}
+	return NULL;
+}
+
+static bool shm_layout_equal(shm_region *shm, const shm_field *fields, int field_num, bool use_seqlock) {
+	if (shm->field_num != field_num || shm->use_seqlock != use_seqlock) {
+		return false;
+	}
+
+	for (int i = 0;i < field_num;i++) {
+		if (strncmp(shm->fields[i].name, fields[i].name, SHM_NAME_LEN) != 0 ||
+				shm->fields[i].type != fields[i].type ||
+				shm->fields[i].len != fields[i].len) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static lib_shm lib_shm_create(const char *name, const shm_field *fields, int field_num, bool use_seqlock) {
+	if (!name || strlen(name) >= SHM_NAME_LEN || field_num <= 0 || field_num > SHM_FIELDS_MAX) {
+		return NULL;
+	}
+
+	shm_region *old = shm_find(name);
+	if (old) {
+		return shm_layout_equal(old, fields, field_num, use_seqlock) ? old : NULL;
+	}
+
+	int slot = -1;
+	for (int i = 0;i < SHM_NUM_MAX;i++) {
+		if (!shm_regions[i]) {
+			slot = i;
+			break;
+		}
+	}
+
+	if (slot < 0) {
+		return NULL;
+	}
+
+	// Every field starts at a 4-byte boundary so that lisp can use bufget-f32 etc. on it
+	uint32_t data_size = 0;
+	for (int i = 0;i < field_num;i++) {
+		uint32_t size = shm_type_size(fields[i].type);
+		if (size == 0 || !fields[i].name || strlen(fields[i].name) >= SHM_NAME_LEN ||
+				fields[i].len == 0 || fields[i].len > (1 << 20)) {
+			return NULL;
+		}
+		data_size += (size * fields[i].len + 3) & ~3;
+	}
+
+	// The data comes after the header in the same allocation. Array views that lisp
+	// creates point into it, and as they never point to the start of the allocation
+	// the garbage collector will not free the region when a view is collected.
+	shm_region *shm = lbm_malloc_reserve(sizeof(shm_region) + data_size);
+	if (!shm) {
+		return NULL;
+	}
+
+	memset(shm, 0, sizeof(shm_region) + data_size);
+	strcpy(shm->name, name);
+	shm->use_seqlock = use_seqlock;
+	shm->field_num = field_num;
+	shm->data_size = data_size;
+	shm->data = (uint8_t*)shm + sizeof(shm_region);
+
+	uint32_t offset = 0;
+	for (int i = 0;i < field_num;i++) {
+		strcpy(shm->fields[i].name, fields[i].name);
+		shm->fields[i].type = fields[i].type;
+		shm->fields[i].len = fields[i].len;
+		shm->fields[i].offset = offset;
+		offset += (shm_type_size(fields[i].type) * fields[i].len + 3) & ~3;
+	}
+
+	shm_regions[slot] = shm;
+	return shm;
+}
+
+static void* lib_shm_field_ptr(lib_shm shm, int field) {
+	shm_region *r = (shm_region*)shm;
+	if (!r || field < 0 || field >= r->field_num) {
+		return NULL;
+	}
+	return r->data + r->fields[field].offset;
+}
+
+static void lib_shm_write_begin(lib_shm shm) {
+	shm_region *r = (shm_region*)shm;
+	r->seq++;
+	__DMB();
+}
+
+static void lib_shm_write_end(lib_shm shm) {
+	shm_region *r = (shm_region*)shm;
+	__DMB();
+	r->seq++;
+}
+
+// The regions are forgotten rather than freed, as lisp can still hold views into
+// them. Their memory is reclaimed when the lbm memory is reinitialized on restart.
+static void shm_clear(void) {
+	for (int i = 0;i < SHM_NUM_MAX;i++) {
+		shm_regions[i] = NULL;
+	}
+}
+
+static shm_field_info *shm_get_field(shm_region *shm, lbm_value arg) {
+	if (lbm_is_number(arg)) {
+		int ind = lbm_dec_as_i32(arg);
+		if (ind >= 0 && ind < shm->field_num) {
+			return &shm->fields[ind];
+		}
+	} else if (lbm_is_array_r(arg)) {
+		char *name = lbm_dec_str(arg);
+		for (int i = 0;i < shm->field_num;i++) {
+			if (name && strncmp(shm->fields[i].name, name, SHM_NAME_LEN) == 0) {
+				return &shm->fields[i];
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static shm_region *shm_get_region(lbm_value arg) {
+	if (!lbm_is_array_r(arg)) {
+		return NULL;
+	}
+
+	char *name = lbm_dec_str(arg);
+	return name ? shm_find(name) : NULL;
+}
+
+// (shm-view name field) -> byte array that shares memory with the field
+lbm_value ext_shm_view(lbm_value *args, lbm_uint argn) {
+	if (argn != 2) {
+		return ENC_SYM_TERROR;
+	}
+
+	shm_region *shm = shm_get_region(args[0]);
+	if (!shm) {
+		lbm_set_error_reason("Shared memory region not found");
+		return ENC_SYM_EERROR;
+	}
+
+	shm_field_info *f = shm_get_field(shm, args[1]);
+	if (!f) {
+		lbm_set_error_reason("Shared memory field not found");
+		return ENC_SYM_EERROR;
+	}
+
+	lbm_value res;
+	if (!lbm_lift_array(&res, (char*)(shm->data + f->offset), f->len * shm_type_size(f->type))) {
+		return ENC_SYM_MERROR;
+	}
+
+	return res;
+}
+
+// (shm-seq name) -> sequence number, odd while a write is in progress
+lbm_value ext_shm_seq(lbm_value *args, lbm_uint argn) {
+	if (argn != 1) {
+		return ENC_SYM_TERROR;
+	}
+
+	shm_region *shm = shm_get_region(args[0]);
+	if (!shm) {
+		return ENC_SYM_EERROR;
+	}
+
+	return lbm_enc_u32(shm->seq);
+}
+
+// (shm-read name field dest) -> bytes copied into dest, or nil if no
+// consistent snapshot could be taken because the writer was busy.
+lbm_value ext_shm_read(lbm_value *args, lbm_uint argn) {
+	if (argn != 3 || !lbm_is_array_rw(args[2])) {
+		return ENC_SYM_TERROR;
+	}
+
+	shm_region *shm = shm_get_region(args[0]);
+	shm_field_info *f = shm ? shm_get_field(shm, args[1]) : NULL;
+	if (!f) {
+		return ENC_SYM_EERROR;
+	}
+
+	lbm_array_header_t *dest = (lbm_array_header_t*)lbm_car(args[2]);
+	uint32_t len = f->len * shm_type_size(f->type);
+	if (len > dest->size) {
+		len = dest->size;
+	}
+
+	uint8_t *src = shm->data + f->offset;
+
+	if (!shm->use_seqlock) {
+		memcpy(dest->data, src, len);
+		return lbm_enc_i(len);
+	}
+
+	for (int i = 0;i < SHM_READ_TRIES;i++) {
+		uint32_t seq = shm->seq;
+		if (seq & 1) {
+			continue;
+		}
+		__DMB();
+		memcpy(dest->data, src, len);
+		__DMB();
+		if (shm->seq == seq) {
+			return lbm_enc_i(len);
+		}
+	}
+
+	return ENC_SYM_NIL;
+}
+
 lbm_value ext_load_native_lib(lbm_value *args, lbm_uint argn) {
 	lbm_value res = lbm_enc_sym(SYM_EERROR);
 
@@ -903,6 +1165,17 @@ lbm_value ext_load_native_lib(lbm_value *args, lbm_uint argn) {
 		// Unblock unboxed
 		cif.cif.lbm_unblock_ctx_unboxed = lbm_unblock_ctx_unboxed;
 
+		// FOC-rate hooks
+		cif.cif.foc_hook_register = foc_hooks_register;
+		cif.cif.foc_hook_unregister = foc_hooks_unregister;
+		cif.cif.foc_hook_get_stats = foc_hooks_get_stats;
+
+		// Shared memory
+		cif.cif.shm_create = lib_shm_create;
+		cif.cif.shm_field_ptr = lib_shm_field_ptr;
+		cif.cif.shm_write_begin = lib_shm_write_begin;
+		cif.cif.shm_write_end = lib_shm_write_end;
+
 		lib_init_done = true;
 	}
 
@@ -957,6 +1230,10 @@ lbm_value ext_unload_native_lib(lbm_value *args, lbm_uint argn) {
 		if (loaded_libs[i].stop_fun != NULL && loaded_libs[i].base_addr == addr) {
 			loaded_libs[i].stop_fun(loaded_libs[i].arg);
 			loaded_libs[i].stop_fun = NULL;
+
+			// The FOC interrupt must not call into the code after lisp frees it
+			foc_hooks_remove_range(addr, addr + array->size);
+
 			res = lbm_enc_sym(SYM_TRUE);
 			ok = true;
 		}
@@ -970,6 +1247,9 @@ lbm_value ext_unload_native_lib(lbm_value *args, lbm_uint argn) {
 }
 
 void lispif_stop_lib(void) {
+	// Hooks that the libraries did not remove point into code that is about to go away
+	foc_hooks_clear();
+
 	for (int i = 0;i < LIB_NUM_MAX;i++) {
 		if (loaded_libs[i].stop_fun != NULL) {
 			loaded_libs[i].stop_fun(loaded_libs[i].arg);
@@ -984,6 +1264,8 @@ void lispif_stop_lib(void) {
 	}
 
 	lib_running_threads_cnt = 0;
+
+	shm_clear();
 }
 
 float lispif_get_ppm(void) {
@@ -0,0 +1,417 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lispif.h"
+#include "lispbm.h"
+#include "lbm_constants.h"
+#include "digital_filter.h"
+#include "utils_math.h"
+
+#include <math.h>
+#include <string.h>
+
+// DSP kernels that work in place on byte arrays holding native
+// (little-endian) f32 or i16 samples. Read them from lisp with
+// (bufget-f32 arr (* i 4) 'little-endian).
+
+#define DSP_MEDIAN_MAX_WINDOW	31
+#define DSP_FIR_MAX_BITS		6
+
+static bool get_f32_array(lbm_value v, bool rw, float **data, int *len) {
+	if (rw ? !lbm_is_array_rw(v) : !lbm_is_array_r(v)) {
+		return false;
+	}
+
+	lbm_array_header_t *array = (lbm_array_header_t*)lbm_car(v);
+	*data = (float*)array->data;
+	*len = array->size / sizeof(float);
+	return true;
+}
+
+static bool get_i16_array(lbm_value v, bool rw, int16_t **data, int *len) {
+	if (rw ? !lbm_is_array_rw(v) : !lbm_is_array_r(v)) {
+		return false;
+	}
+
+	lbm_array_header_t *array = (lbm_array_header_t*)lbm_car(v);
+	*data = (int16_t*)array->data;
+	*len = array->size / sizeof(int16_t);
+	return true;
+}
+
+static bool get_biquad(lbm_value v, Biquad **bq) {
+	if (!lbm_is_array_rw(v)) {
+		return false;
+	}
+
+	lbm_array_header_t *array = (lbm_array_header_t*)lbm_car(v);
+	if (array->size != sizeof(Biquad)) {
+		return false;
+	}
+
+	*bq = (Biquad*)array->data;
+	return true;
+}
+
+// (dsp-biquad-create fc optHighpass)
+static lbm_value ext_dsp_biquad_create(lbm_value *args, lbm_uint argn) {
+	if ((argn != 1 && argn != 2) || !lbm_is_number(args[0])) {
+		lbm_set_error_reason((char*)lbm_error_str_incorrect_arg);
+		return ENC_SYM_EERROR;
+	}
+
+	float fc = lbm_dec_as_float(args[0]);
+	if (fc <= 0.0 || fc >= 0.5) {
+		return ENC_SYM_EERROR;
+	}
+
+	bool highpass = argn == 2 && !lbm_is_symbol_nil(args[1]);
+
+	lbm_value res;
+	if (!lbm_create_array(&res, sizeof(Biquad))) {
+		return ENC_SYM_MERROR;
+	}
+
+	Biquad *bq = (Biquad*)((lbm_array_header_t*)lbm_car(res))->data;
+	biquad_config(bq, highpass ? BQ_HIGHPASS : BQ_LOWPASS, fc);
+	biquad_reset(bq);
+	return res;
+}
+
+// (dsp-biquad-run bq arr)
+static lbm_value ext_dsp_biquad_run(lbm_value *args, lbm_uint argn) {
+	LBM_CHECK_ARGN(2);
+
+	Biquad *bq;
+	float *data;
+	int len;
+	if (!get_biquad(args[0], &bq) || !get_f32_array(args[1], true, &data, &len)) {
+		lbm_set_error_reason((char*)lbm_error_str_incorrect_arg);
+		return ENC_SYM_EERROR;
+	}
+
+	for (int i = 0;i < len;i++) {
+		data[i] = biquad_process(bq, data[i]);
+	}
+
+	return ENC_SYM_TRUE;
+}
+
+// (dsp-biquad-reset bq)
+static lbm_value ext_dsp_biquad_reset(lbm_value *args, lbm_uint argn) {
+	LBM_CHECK_ARGN(1);
+
+	Biquad *bq;
+	if (!get_biquad(args[0], &bq)) {
+		lbm_set_error_reason((char*)lbm_error_str_incorrect_arg);
+		return ENC_SYM_EERROR;
+	}
+
+	biquad_reset(bq);
+	return ENC_SYM_TRUE;
+}
+
+// (dsp-fir-lowpass-create f-break bits)
+static lbm_value ext_dsp_fir_lowpass_create(lbm_value *args, lbm_uint argn) {
+	LBM_CHECK_ARGN_NUMBER(2);
+
+	float f_break = lbm_dec_as_float(args[0]);
+	int bits = lbm_dec_as_i32(args[1]);
+
+	// filter_create_fir_lowpass keeps 2^bits floats on the stack
+	if (bits < 1 || bits > DSP_FIR_MAX_BITS) {
+		return ENC_SYM_EERROR;
+	}
+
+	lbm_value res;
+	if (!lbm_create_array(&res, sizeof(float) << bits)) {
+		return ENC_SYM_MERROR;
+	}
+
+	float *taps = (float*)((lbm_array_header_t*)lbm_car(res))->data;
+	filter_create_fir_lowpass(taps, f_break, bits, 1);
+	return res;
+}
+
+// (dsp-fir arr taps)
+// Causal FIR filter, samples before the start of arr are taken as 0.
+static lbm_value ext_dsp_fir(lbm_value *args, lbm_uint argn) {
+	LBM_CHECK_ARGN(2);
+
+	float *data, *taps;
+	int len, taps_len;
+	if (!get_f32_array(args[0], true, &data, &len) ||
+			!get_f32_array(args[1], false, &taps, &taps_len)) {
+		lbm_set_error_reason((char*)lbm_error_str_incorrect_arg);
+		return ENC_SYM_EERROR;
+	}
+
+	// Going backwards keeps the older samples unmodified
+	for (int i = len - 1;i >= 0;i--) {
+		float acc = 0.0;
+		int n = i + 1 < taps_len ? i + 1 : taps_len;
+		for (int k = 0;k < n;k++) {
+			acc += taps[k] * data[i - k];
+		}
+		data[i] = acc;
+	}
+
+	return ENC_SYM_TRUE;
+}
+
+// (dsp-moving-avg arr n)
+// Trailing moving average, the first n - 1 outputs average the samples available.
+static lbm_value ext_dsp_moving_avg(lbm_value *args, lbm_uint argn) {
+	LBM_CHECK_ARGN(2);
+
+	float *data;
+	int len;
+	if (!get_f32_array(args[0], true, &data, &len) || !lbm_is_number(args[1])) {
+		lbm_set_error_reason((char*)lbm_error_str_incorrect_arg);
+		return ENC_SYM_EERROR;
+	}
+
+	int n = lbm_dec_as_i32(args[1]);
+	if (n < 1) {
+		return ENC_SYM_EERROR;
+	}
+
+	if (len == 0) {
+		return ENC_SYM_TRUE;
+	}
+
+	int win = n < len ? n : len;
+	float sum = 0.0;
+	for (int k = 0;k < win;k++) {
+		sum += data[len - 1 - k];
+	}
+
+	for (int i = len - 1;i >= 0;i--) {
+		float x = data[i];
+		data[i] = sum / (float)win;
+		sum -= x;
+		if (i - n >= 0) {
+			sum += data[i - n];
+		} else {
+			win--;
+		}
+	}
+
+	return ENC_SYM_TRUE;
+}
+
+// (dsp-median arr n)
+static lbm_value ext_dsp_median(lbm_value *args, lbm_uint argn) {
+	LBM_CHECK_ARGN(2);
+
+	float *data;
+	int len;
+	if (!get_f32_array(args[0], true, &data, &len) || !lbm_is_number(args[1])) {
+		lbm_set_error_reason((char*)lbm_error_str_incorrect_arg);
+		return ENC_SYM_EERROR;
+	}
+
+	int n = lbm_dec_as_i32(args[1]);
+	if (n < 1 || n > DSP_MEDIAN_MAX_WINDOW) {
+		return ENC_SYM_EERROR;
+	}
+
+	float win[DSP_MEDIAN_MAX_WINDOW];
+	for (int i = len - 1;i >= 0;i--) {
+		int cnt = i + 1 < n ? i + 1 : n;
+
+		// Insertion sort of the window
+		for (int k = 0;k < cnt;k++) {
+			float x = data[i - k];
+			int j = k;
+			while (j > 0 && win[j - 1] > x) {
+				win[j] = win[j - 1];
+				j--;
+			}
+			win[j] = x;
+		}
+
+		data[i] = win[cnt / 2];
+	}
+
+	return ENC_SYM_TRUE;
+}
+
+// (dsp-fft re im optInverse)
+static lbm_value ext_dsp_fft(lbm_value *args, lbm_uint argn) {
+	if (argn != 2 && argn != 3) {
+		lbm_set_error_reason((char*)lbm_error_str_num_args);
+		return ENC_SYM_EERROR;
+	}
+
+	float *re, *im;
+	int len, len_im;
+	if (!get_f32_array(args[0], true, &re, &len) ||
+			!get_f32_array(args[1], true, &im, &len_im)) {
+		lbm_set_error_reason((char*)lbm_error_str_incorrect_arg);
+		return ENC_SYM_EERROR;
+	}
+
+	if (len != len_im || len < 2 || (len & (len - 1)) != 0) {
+		return ENC_SYM_EERROR;
+	}
+
+	int m = 0;
+	while ((1 << m) < len) {
+		m++;
+	}
+
+	bool inverse = argn == 3 && !lbm_is_symbol_nil(args[2]);
+	filter_fft(inverse ? 1 : 0, m, re, im);
+	return ENC_SYM_TRUE;
+}
+
+// (dsp-dot arr1 arr2)
+static lbm_value ext_dsp_dot(lbm_value *args, lbm_uint argn) {
+	LBM_CHECK_ARGN(2);
+
+	float *a, *b;
+	int len_a, len_b;
+	if (!get_f32_array(args[0], false, &a, &len_a) ||
+			!get_f32_array(args[1], false, &b, &len_b)) {
+		lbm_set_error_reason((char*)lbm_error_str_incorrect_arg);
+		return ENC_SYM_EERROR;
+	}
+
+	int len = len_a < len_b ? len_a : len_b;
+	float acc = 0.0;
+	for (int i = 0;i < len;i++) {
+		acc += a[i] * b[i];
+	}
+
+	return lbm_enc_float(acc);
+}
+
+// (dsp-scale arr gain optOffset)
+static lbm_value ext_dsp_scale(lbm_value *args, lbm_uint argn) {
+	if ((argn != 2 && argn != 3) || !lbm_is_number(args[1]) ||
+			(argn == 3 && !lbm_is_number(args[2]))) {
+		lbm_set_error_reason((char*)lbm_error_str_incorrect_arg);
+		return ENC_SYM_EERROR;
+	}
+
+	float *data;
+	int len;
+	if (!get_f32_array(args[0], true, &data, &len)) {
+		lbm_set_error_reason((char*)lbm_error_str_incorrect_arg);
+		return ENC_SYM_EERROR;
+	}
+
+	float gain = lbm_dec_as_float(args[1]);
+	float offset = argn == 3 ? lbm_dec_as_float(args[2]) : 0.0;
+	for (int i = 0;i < len;i++) {
+		data[i] = data[i] * gain + offset;
+	}
+
+	return ENC_SYM_TRUE;
+}
+
+// (dsp-clamp arr min max)
+static lbm_value ext_dsp_clamp(lbm_value *args, lbm_uint argn) {
+	LBM_CHECK_ARGN(3);
+
+	float *data;
+	int len;
+	if (!get_f32_array(args[0], true, &data, &len) ||
+			!lbm_is_number(args[1]) || !lbm_is_number(args[2])) {
+		lbm_set_error_reason((char*)lbm_error_str_incorrect_arg);
+		return ENC_SYM_EERROR;
+	}
+
+	float min = lbm_dec_as_float(args[1]);
+	float max = lbm_dec_as_float(args[2]);
+	for (int i = 0;i < len;i++) {
+		utils_truncate_number(&data[i], min, max);
+	}
+
+	return ENC_SYM_TRUE;
+}
+
+// (dsp-i16-to-f32 src dst optScale)
+static lbm_value ext_dsp_i16_to_f32(lbm_value *args, lbm_uint argn) {
+	if ((argn != 2 && argn != 3) || (argn == 3 && !lbm_is_number(args[2]))) {
+		lbm_set_error_reason((char*)lbm_error_str_incorrect_arg);
+		return ENC_SYM_EERROR;
+	}
+
+	int16_t *src;
+	float *dst;
+	int len_src, len_dst;
+	if (!get_i16_array(args[0], false, &src, &len_src) ||
+			!get_f32_array(args[1], true, &dst, &len_dst)) {
+		lbm_set_error_reason((char*)lbm_error_str_incorrect_arg);
+		return ENC_SYM_EERROR;
+	}
+
+	float scale = argn == 3 ? lbm_dec_as_float(args[2]) : 1.0;
+	int len = len_src < len_dst ? len_src : len_dst;
+	for (int i = 0;i < len;i++) {
+		dst[i] = (float)src[i] * scale;
+	}
+
+	return lbm_enc_i(len);
+}
+
+// (dsp-f32-to-i16 src dst optScale)
+static lbm_value ext_dsp_f32_to_i16(lbm_value *args, lbm_uint argn) {
+	if ((argn != 2 && argn != 3) || (argn == 3 && !lbm_is_number(args[2]))) {
+		lbm_set_error_reason((char*)lbm_error_str_incorrect_arg);
+		return ENC_SYM_EERROR;
+	}
+
+	float *src;
+	int16_t *dst;
+	int len_src, len_dst;
+	if (!get_f32_array(args[0], false, &src, &len_src) ||
+			!get_i16_array(args[1], true, &dst, &len_dst)) {
+		lbm_set_error_reason((char*)lbm_error_str_incorrect_arg);
+		return ENC_SYM_EERROR;
+	}
+
+	float scale = argn == 3 ? lbm_dec_as_float(args[2]) : 1.0;
+	int len = len_src < len_dst ? len_src : len_dst;
+	for (int i = 0;i < len;i++) {
+		float x = src[i] * scale;
+		utils_truncate_number(&x, -32768.0, 32767.0);
+		dst[i] = (int16_t)lrintf(x);
+	}
+
+	return lbm_enc_i(len);
+}
+
+void lispif_load_dsp_extensions(void) {
+	lbm_add_extension("dsp-biquad-create", ext_dsp_biquad_create);
+	lbm_add_extension("dsp-biquad-run", ext_dsp_biquad_run);
+	lbm_add_extension("dsp-biquad-reset", ext_dsp_biquad_reset);
+	lbm_add_extension("dsp-fir-lowpass-create", ext_dsp_fir_lowpass_create);
+	lbm_add_extension("dsp-fir", ext_dsp_fir);
+	lbm_add_extension("dsp-moving-avg", ext_dsp_moving_avg);
+	lbm_add_extension("dsp-median", ext_dsp_median);
+	lbm_add_extension("dsp-fft", ext_dsp_fft);
+	lbm_add_extension("dsp-dot", ext_dsp_dot);
+	lbm_add_extension("dsp-scale", ext_dsp_scale);
+	lbm_add_extension("dsp-clamp", ext_dsp_clamp);
+	lbm_add_extension("dsp-i16-to-f32", ext_dsp_i16_to_f32);
+	lbm_add_extension("dsp-f32-to-i16", ext_dsp_f32_to_i16);
+}
@@ -23,6 +23,7 @@
 #include "extensions/array_extensions.h"
 #include "extensions/math_extensions.h"
 #include "extensions/string_extensions.h"
+#include "extensions/ringbuf_extensions.h"
 #include "lbm_constants.h"
 
 #include "commands.h"
@@ -39,6 +40,7 @@
 #include "mcpwm_foc.h"
 #include "imu.h"
 #include "mempools.h"
+#include "packet.h"
 #include "app.h"
 #include "spi_bb.h"
 #include "i2c.h"
@@ -80,6 +82,13 @@ typedef struct {
 	lbm_uint ah_cnt_dis_total;
 	lbm_uint wh_cnt_dis_total;
 	lbm_uint msg_age;
+	lbm_uint stat_packs;
+	lbm_uint stat_v_cell_min;
+	lbm_uint stat_v_cell_max;
+	lbm_uint stat_v_cell_imbalance;
+	lbm_uint stat_temp_cell_max;
+	lbm_uint stat_soc_min;
+	lbm_uint stat_soc_max;
 
 	// GPIO
 	lbm_uint pin_mode_out;
@@ -242,6 +251,20 @@ static bool compare_symbol(lbm_uint sym, lbm_uint *comp) {
 			get_add_symbol("bms-wh-cnt-dis-total", comp);
 		} else if (comp == &syms_vesc.msg_age) {
 			get_add_symbol("bms-msg-age", comp);
+		} else if (comp == &syms_vesc.stat_packs) {
+			get_add_symbol("bms-stat-packs", comp);
+		} else if (comp == &syms_vesc.stat_v_cell_min) {
+			get_add_symbol("bms-stat-v-cell-min", comp);
+		} else if (comp == &syms_vesc.stat_v_cell_max) {
+			get_add_symbol("bms-stat-v-cell-max", comp);
+		} else if (comp == &syms_vesc.stat_v_cell_imbalance) {
+			get_add_symbol("bms-stat-v-cell-imbalance", comp);
+		} else if (comp == &syms_vesc.stat_temp_cell_max) {
+			get_add_symbol("bms-stat-temp-cell-max", comp);
+		} else if (comp == &syms_vesc.stat_soc_min) {
+			get_add_symbol("bms-stat-soc-min", comp);
+		} else if (comp == &syms_vesc.stat_soc_max) {
+			get_add_symbol("bms-stat-soc-max", comp);
 		}
 
 		else if (comp == &syms_vesc.pin_mode_out) {
@@ -626,6 +649,26 @@ static lbm_value get_set_bms_val(bool set, lbm_value *args, lbm_uint argn) {
 		res = get_or_set_float(set, &val->wh_cnt_dis_total, &set_arg);
 	} else if (compare_symbol(name, &syms_vesc.msg_age)) {
 		res = lbm_enc_float(UTILS_AGE_S(val->update_time));
+	} else if (!set) {
+		// Read-only statistics over all BMSs on the CAN-bus
+		bms_stats stats;
+		bms_get_stats(&stats);
+
+		if (compare_symbol(name, &syms_vesc.stat_packs)) {
+			res = lbm_enc_i(stats.pack_num);
+		} else if (compare_symbol(name, &syms_vesc.stat_v_cell_min)) {
+			res = lbm_enc_float(stats.v_cell_min);
+		} else if (compare_symbol(name, &syms_vesc.stat_v_cell_max)) {
+			res = lbm_enc_float(stats.v_cell_max);
+		} else if (compare_symbol(name, &syms_vesc.stat_v_cell_imbalance)) {
+			res = lbm_enc_float(stats.v_cell_imbalance);
+		} else if (compare_symbol(name, &syms_vesc.stat_temp_cell_max)) {
+			res = lbm_enc_float(stats.t_cell_max);
+		} else if (compare_symbol(name, &syms_vesc.stat_soc_min)) {
+			res = lbm_enc_float(stats.soc_min);
+		} else if (compare_symbol(name, &syms_vesc.stat_soc_max)) {
+			res = lbm_enc_float(stats.soc_max);
+		}
 	}
 
 	if (res != ENC_SYM_EERROR && set) {
@@ -649,6 +692,16 @@ static lbm_value ext_send_bms_can(lbm_value *args, lbm_uint argn) {
 	return ENC_SYM_TRUE;
 }
 
+static lbm_value ext_set_bms_fwd_rate(lbm_value *args, lbm_uint argn) {
+	LBM_CHECK_ARGN_NUMBER(1);
+	int rate = lbm_dec_as_i32(args[0]);
+	if (rate < 0) {
+		return ENC_SYM_EERROR;
+	}
+	bms_set_fwd_rate(rate);
+	return ENC_SYM_TRUE;
+}
+
 static lbm_value ext_get_adc(lbm_value *args, lbm_uint argn) {
 	LBM_CHECK_NUMBER_ALL();
 
@@ -831,6 +884,27 @@ static lbm_value ext_get_imu_gyro_derot(lbm_value *args, lbm_uint argn) {
 }
 
 static lbm_value ext_send_data(lbm_value *args, lbm_uint argn) {
+	// Column of a ring buffer, sent as it is stored
+	if (argn == 2 && lbm_is_ringbuf(args[0]) && lbm_is_number(args[1])) {
+		lbm_ringbuf_type_t type;
+		lbm_uint num;
+		void *data = lbm_ringbuf_column(args[0], lbm_dec_as_u32(args[1]), &type, &num);
+		if (!data) {
+			return ENC_SYM_EERROR;
+		}
+
+		// Send the newest rows that fit in one packet after the command byte
+		lbm_uint size = lbm_ringbuf_type_size(type);
+		lbm_uint fit = (PACKET_MAX_PL_LEN - 1) / size;
+		if (num > fit) {
+			data = (uint8_t*)data + (num - fit) * size;
+			num = fit;
+		}
+
+		commands_send_app_data((unsigned char*)data, num * size);
+		return ENC_SYM_TRUE;
+	}
+
 	if (argn != 1 || (!lbm_is_cons(args[0]) && !lbm_is_array_r(args[0]))) {
 		return ENC_SYM_EERROR;
 	}
@@ -1487,6 +1561,43 @@ static lbm_value ext_get_temp_mot(lbm_value *args, lbm_uint argn) {
 	return lbm_enc_float(mc_interface_temp_motor_filtered());
 }
 
+static lbm_value ext_get_temp_mot_model(lbm_value *args, lbm_uint argn) {
+	LBM_CHECK_NUMBER_ALL();
+
+	int node = 0;
+	if (argn == 1) {
+		node = lbm_dec_as_i32(args[0]);
+		if (node < 0 || node > 2) {
+			return ENC_SYM_EERROR;
+		}
+	} else if (argn != 0) {
+		return ENC_SYM_EERROR;
+	}
+
+	return lbm_enc_float(mc_interface_temp_motor_model(node));
+}
+
+static lbm_value ext_get_temp_mot_ttl(lbm_value *args, lbm_uint argn) {
+	(void)args; (void)argn;
+	return lbm_enc_float(mc_interface_temp_motor_time_to_limit());
+}
+
+static lbm_value ext_set_thermal_model(lbm_value *args, lbm_uint argn) {
+	LBM_CHECK_NUMBER_ALL();
+
+	if (argn != 1 && argn != 3) {
+		return ENC_SYM_EERROR;
+	}
+
+	mc_interface_set_thermal_derate(lbm_dec_as_i32(args[0]));
+
+	if (argn == 3) {
+		mc_interface_set_thermal_scales(lbm_dec_as_float(args[1]), lbm_dec_as_float(args[2]));
+	}
+
+	return ENC_SYM_TRUE;
+}
+
 static lbm_value ext_get_speed(lbm_value *args, lbm_uint argn) {
 	(void)args; (void)argn;
 	return lbm_enc_float(mc_interface_get_speed());
@@ -2736,6 +2847,8 @@ static lbm_value ext_conf_set(lbm_value *args, lbm_uint argn) {
 		commands_apply_mcconf_hw_limits(mcconf);
 		if (changed_mc == 2) {
 			mc_interface_set_configuration(mcconf);
+		} else {
+			mc_interface_update_derived();
 		}
 		res = ENC_SYM_TRUE;
 	} else if (changed_app > 0) {
@@ -3649,6 +3762,23 @@ static lbm_value log_send_fxx(bool is_64, lbm_value *args, lbm_uint argn) {
 				mempools_free_packet_buffer(buffer);
 				return ENC_SYM_EERROR;
 			}
+		} else if (lbm_is_ringbuf(args[arg_now])) {
+			// Newest row of the ring buffer, one field per column
+			lbm_uint ncols;
+			lbm_uint len = lbm_ringbuf_len(args[arg_now], &ncols);
+			if (len == 0 || append_cnt + (int)ncols >= append_max) {
+				mempools_free_packet_buffer(buffer);
+				return ENC_SYM_EERROR;
+			}
+			for (lbm_uint col = 0; col < ncols; col++) {
+				float val = lbm_ringbuf_get(args[arg_now], col, len - 1);
+				if (is_64) {
+					buffer_append_float64_auto(buffer, val, &ind);
+				} else {
+					buffer_append_float32_auto(buffer, val, &ind);
+				}
+				append_cnt++;
+			}
 		} else if (lbm_is_cons(args[arg_now])) {
 			lbm_value curr = args[arg_now];
 			while (lbm_is_cons(curr)) {
@@ -3759,6 +3889,9 @@ static lbm_value ext_empty(lbm_value *args, lbm_uint argn) {
 // Declare native lib extension
 lbm_value ext_load_native_lib(lbm_value *args, lbm_uint argn);
 lbm_value ext_unload_native_lib(lbm_value *args, lbm_uint argn);
+lbm_value ext_shm_view(lbm_value *args, lbm_uint argn);
+lbm_value ext_shm_seq(lbm_value *args, lbm_uint argn);
+lbm_value ext_shm_read(lbm_value *args, lbm_uint argn);
 
 static thread_t *event_tp = NULL;
 static THD_WORKING_AREA(event_thread_wa, 256);
@@ -3924,6 +4057,7 @@ void lispif_load_vesc_extensions(void) {
 	lbm_add_extension("get-bms-val", ext_get_bms_val);
 	lbm_add_extension("set-bms-val", ext_set_bms_val);
 	lbm_add_extension("send-bms-can", ext_send_bms_can);
+	lbm_add_extension("set-bms-fwd-rate", ext_set_bms_fwd_rate);
 	lbm_add_extension("get-adc", ext_get_adc);
 	lbm_add_extension("override-temp-motor", ext_override_temp_motor);
 	lbm_add_extension("get-adc-decoded", ext_get_adc_decoded);
@@ -3992,6 +4126,9 @@ void lispif_load_vesc_extensions(void) {
 	lbm_add_extension("get-pos", ext_get_pos);
 	lbm_add_extension("get-temp-fet", ext_get_temp_fet);
 	lbm_add_extension("get-temp-mot", ext_get_temp_mot);
+	lbm_add_extension("get-temp-mot-model", ext_get_temp_mot_model);
+	lbm_add_extension("get-temp-mot-ttl", ext_get_temp_mot_ttl);
+	lbm_add_extension("set-thermal-model", ext_set_thermal_model);
 	lbm_add_extension("get-speed", ext_get_speed);
 	lbm_add_extension("get-dist", ext_get_dist);
 	lbm_add_extension("get-dist-abs", ext_get_dist_abs);
@@ -4104,6 +4241,9 @@ void lispif_load_vesc_extensions(void) {
 	// Native libraries
 	lbm_add_extension("load-native-lib", ext_load_native_lib);
 	lbm_add_extension("unload-native-lib", ext_unload_native_lib);
+	lbm_add_extension("shm-view", ext_shm_view);
+	lbm_add_extension("shm-seq", ext_shm_seq);
+	lbm_add_extension("shm-read", ext_shm_read);
 
 	// UAVCAN
 	lbm_add_extension("uavcan-last-rawcmd", ext_uavcan_last_rawcmd);
@@ -4139,16 +4279,24 @@ void lispif_load_vesc_extensions(void) {
 	lbm_add_extension("gnss-date-time", ext_gnss_date_time);
 	lbm_add_extension("gnss-age", ext_gnss_age);
 
+	// DSP
+	lispif_load_dsp_extensions();
+
 	// Extra extensions
 	lbm_array_extensions_init();
 	lbm_math_extensions_init();
 	lbm_string_extensions_init();
+	lbm_ringbuf_extensions_init();
 
 	if (ext_callback) {
 		ext_callback();
 	}
 }
 
+bool lispif_can_event_enabled(bool is_ext) {
+	return is_ext ? event_can_eid_en : event_can_sid_en;
+}
+
 void lispif_process_can(uint32_t can_id, uint8_t *data8, int len, bool is_ext) {
 	if (!event_can_sid_en && !is_ext) {
 		return;
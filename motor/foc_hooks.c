@@ -0,0 +1,250 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "foc_hooks.h"
+#include "ch.h"
+#include "timer.h"
+#include "utils_math.h"
+#include <string.h>
+
+/*
+ * Hooks that run from the FOC interrupt, before and after the current
+ * controller. Each hook gets a snapshot of the motor state and, before the
+ * current controller, can override the d and q current references. The
+ * execution time of every call is measured and a hook that exceeds its
+ * budget FOC_HOOKS_OVERRUN_LIMIT times in a row is disabled. Overrides from
+ * a call that exceeded the budget are discarded.
+ *
+ * Registration and removal happen from threads. The function pointer is
+ * written last on registration and cleared first on removal, and as the
+ * interrupt cannot be preempted by the thread, a hook is never running once
+ * foc_hooks_unregister has returned.
+ */
+
+typedef struct {
+	volatile foc_hook_fun fun;
+	volatile bool enabled;
+	float budget;
+	uint32_t calls;
+	uint32_t overruns;
+	uint32_t overruns_seq;
+	float time_last;
+	float time_max;
+} foc_hook_t;
+
+// Private variables
+static foc_hook_t m_hooks[FOC_HOOK_POINT_NUM][FOC_HOOKS_PER_POINT];
+
+static foc_hook_t *get_hook(int handle) {
+	if (handle < 0 || handle >= FOC_HOOK_POINT_NUM * FOC_HOOKS_PER_POINT) {
+		return 0;
+	}
+
+	foc_hook_t *h = &m_hooks[handle / FOC_HOOKS_PER_POINT][handle % FOC_HOOKS_PER_POINT];
+	return h->fun ? h : 0;
+}
+
+/**
+ * Register a function to be called from the FOC interrupt.
+ *
+ * @param point
+ * Where to run the hook. FOC_HOOK_PRE_CURRENT hooks run after the current
+ * references are calculated and before the current limits are applied, and
+ * can override the references. FOC_HOOK_POST_CURRENT hooks run after the
+ * current controller and get a NULL override.
+ *
+ * @param fun
+ * The function to call.
+ *
+ * @param budget
+ * Maximum execution time per call in seconds.
+ *
+ * @return
+ * Handle of the hook, or -1 if the arguments are invalid or all slots
+ * for the point are in use.
+ */
+int foc_hooks_register(foc_hook_point point, foc_hook_fun fun, float budget) {
+	if ((unsigned int)point >= FOC_HOOK_POINT_NUM || !fun || budget <= 0.0) {
+		return -1;
+	}
+
+	for (int i = 0;i < FOC_HOOKS_PER_POINT;i++) {
+		foc_hook_t *h = &m_hooks[point][i];
+		if (h->fun == 0) {
+			h->enabled = true;
+			h->budget = budget;
+			h->calls = 0;
+			h->overruns = 0;
+			h->overruns_seq = 0;
+			h->time_last = 0.0;
+			h->time_max = 0.0;
+			__DSB();
+			h->fun = fun;
+			return point * FOC_HOOKS_PER_POINT + i;
+		}
+	}
+
+	return -1;
+}
+
+bool foc_hooks_unregister(int handle) {
+	foc_hook_t *h = get_hook(handle);
+	if (!h) {
+		return false;
+	}
+
+	h->fun = 0;
+	__DSB();
+	return true;
+}
+
+bool foc_hooks_get_stats(int handle, foc_hook_stats *stats) {
+	foc_hook_t *h = get_hook(handle);
+	if (!h) {
+		return false;
+	}
+
+	stats->calls = h->calls;
+	stats->overruns = h->overruns;
+	stats->time_last = h->time_last;
+	stats->time_max = h->time_max;
+	stats->budget = h->budget;
+	stats->enabled = h->enabled;
+	return true;
+}
+
+/**
+ * Remove all hooks. Used when native libraries are stopped.
+ */
+void foc_hooks_clear(void) {
+	for (int p = 0;p < FOC_HOOK_POINT_NUM;p++) {
+		for (int i = 0;i < FOC_HOOKS_PER_POINT;i++) {
+			m_hooks[p][i].fun = 0;
+		}
+	}
+	__DSB();
+}
+
+/**
+ * Remove the hooks whose function lies in an address range. Used when a
+ * native library is unloaded, as its code goes away with it even if its
+ * stop function did not unregister its hooks.
+ *
+ * @param start
+ * First address of the range.
+ *
+ * @param end
+ * Address after the range.
+ *
+ * @return
+ * The number of hooks that were removed.
+ */
+int foc_hooks_remove_range(uint32_t start, uint32_t end) {
+	int removed = 0;
+
+	for (int p = 0;p < FOC_HOOK_POINT_NUM;p++) {
+		for (int i = 0;i < FOC_HOOKS_PER_POINT;i++) {
+			// Clear the thumb bit to get the address of the code
+			uint32_t addr = (uint32_t)m_hooks[p][i].fun & ~1u;
+			if (m_hooks[p][i].fun && addr >= start && addr < end) {
+				m_hooks[p][i].fun = 0;
+				removed++;
+			}
+		}
+	}
+	__DSB();
+
+	return removed;
+}
+
+/**
+ * Run the hooks of a point. Called from the FOC interrupt.
+ *
+ * @param id_ref
+ * Pointer to the d axis current reference, or NULL if it cannot be
+ * overridden at this point. Same for iq_ref.
+ */
+void foc_hooks_run(foc_hook_point point, int motor, volatile motor_state_t *motor_state,
+		float dt, float *id_ref, float *iq_ref) {
+	foc_hook_state state;
+	bool state_ok = false;
+
+	for (int i = 0;i < FOC_HOOKS_PER_POINT;i++) {
+		foc_hook_t *h = &m_hooks[point][i];
+		foc_hook_fun fun = h->fun;
+
+		if (!fun || !h->enabled) {
+			continue;
+		}
+
+		if (!state_ok) {
+			state.motor = motor;
+			state.dt = dt;
+			state.phase = motor_state->phase;
+			state.speed_rad_s = motor_state->speed_rad_s;
+			state.id = motor_state->id;
+			state.iq = motor_state->iq;
+			state.id_filter = motor_state->id_filter;
+			state.iq_filter = motor_state->iq_filter;
+			state.id_target = id_ref ? *id_ref : motor_state->id_target;
+			state.iq_target = iq_ref ? *iq_ref : motor_state->iq_target;
+			state.vd = motor_state->vd;
+			state.vq = motor_state->vq;
+			state.mod_d = motor_state->mod_d;
+			state.mod_q = motor_state->mod_q;
+			state.v_bus = motor_state->v_bus;
+			state.duty_now = motor_state->duty_now;
+			state_ok = true;
+		}
+
+		foc_hook_override override;
+		memset(&override, 0, sizeof(override));
+
+		uint32_t t_start = timer_time_now();
+		fun(&state, (id_ref && iq_ref) ? &override : 0);
+		float time = timer_seconds_elapsed_since(t_start);
+
+		h->calls++;
+		h->time_last = time;
+		if (time > h->time_max) {
+			h->time_max = time;
+		}
+
+		if (time > h->budget) {
+			h->overruns++;
+			h->overruns_seq++;
+			if (h->overruns_seq >= FOC_HOOKS_OVERRUN_LIMIT) {
+				h->enabled = false;
+			}
+			continue;
+		}
+
+		h->overruns_seq = 0;
+
+		if (id_ref && override.id_set && !UTILS_IS_NAN(override.id) && !UTILS_IS_INF(override.id)) {
+			*id_ref = override.id;
+			state.id_target = override.id;
+		}
+
+		if (iq_ref && override.iq_set && !UTILS_IS_NAN(override.iq) && !UTILS_IS_INF(override.iq)) {
+			*iq_ref = override.iq;
+			state.iq_target = override.iq;
+		}
+	}
+}
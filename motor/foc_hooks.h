@@ -0,0 +1,84 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef FOC_HOOKS_H_
+#define FOC_HOOKS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "foc_math.h"
+
+// Settings
+#define FOC_HOOKS_PER_POINT			4
+#define FOC_HOOKS_OVERRUN_LIMIT		3 // Consecutive overruns before a hook is disabled
+
+// Types. These are duplicated in c_libs/vesc_c_if.h, keep them in sync.
+typedef enum {
+	FOC_HOOK_PRE_CURRENT = 0,
+	FOC_HOOK_POST_CURRENT,
+	FOC_HOOK_POINT_NUM
+} foc_hook_point;
+
+typedef struct {
+	int motor;
+	float dt;
+	float phase;
+	float speed_rad_s;
+	float id;
+	float iq;
+	float id_filter;
+	float iq_filter;
+	float id_target;
+	float iq_target;
+	float vd;
+	float vq;
+	float mod_d;
+	float mod_q;
+	float v_bus;
+	float duty_now;
+} foc_hook_state;
+
+typedef struct {
+	bool id_set;
+	bool iq_set;
+	float id;
+	float iq;
+} foc_hook_override;
+
+typedef void (*foc_hook_fun)(const foc_hook_state *state, foc_hook_override *override);
+
+typedef struct {
+	uint32_t calls;
+	uint32_t overruns;
+	float time_last;
+	float time_max;
+	float budget;
+	bool enabled;
+} foc_hook_stats;
+
+// Functions
+int foc_hooks_register(foc_hook_point point, foc_hook_fun fun, float budget);
+bool foc_hooks_unregister(int handle);
+bool foc_hooks_get_stats(int handle, foc_hook_stats *stats);
+void foc_hooks_clear(void);
+int foc_hooks_remove_range(uint32_t start, uint32_t end);
+void foc_hooks_run(foc_hook_point point, int motor, volatile motor_state_t *motor_state,
+		float dt, float *id_ref, float *iq_ref);
+
+#endif /* FOC_HOOKS_H_ */
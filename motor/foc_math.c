@@ -19,6 +19,7 @@
 
 #include "foc_math.h"
 #include "utils_math.h"
+#include "hw.h"
 #include <math.h>
 
 // See http://cas.ensmp.fr/~praly/Telechargement/Journaux/2010-IEEE_TPEL-Lee-Hong-Nam-Ortega-Praly-Astolfi.pdf
@@ -375,7 +376,7 @@ void foc_run_pid_control_pos(bool index_found, float dt, motor_all_state_t *moto
 	float kd_proc = conf_now->p_pid_kd_proc;
 
 	if (conf_now->p_pid_gain_dec_angle > 0.1) {
-		float min_error = conf_now->p_pid_gain_dec_angle / conf_now->p_pid_ang_div;
+		float min_error = motor->p_pid_min_error;
 		float error_abs = fabs(error);
 
 		if (error_abs < min_error) {
@@ -699,5 +700,18 @@ void foc_precalc_values(motor_all_state_t *motor) {
 	motor->p_ld = conf_now->foc_motor_l - conf_now->foc_motor_ld_lq_diff * 0.5;
 	motor->p_inv_ld_lq = (1.0 / motor->p_lq - 1.0 / motor->p_ld);
 	motor->p_v2_v3_inv_avg_half = (0.5 / motor->p_lq + 0.5 / motor->p_ld) * 0.9; // With the 0.9 we undo the adjustment from the detection
+
+#ifdef HW_HAS_PHASE_SHUNTS
+	if (conf_now->foc_sample_v0_v7) {
+		motor->p_dt = 1.0 / conf_now->foc_f_zv;
+	} else {
+		motor->p_dt = 1.0 / (conf_now->foc_f_zv / 2.0);
+	}
+#else
+	motor->p_dt = 1.0 / (conf_now->foc_f_zv / 2.0);
+#endif
+
+	motor->p_pid_ang_div_inv = 1.0 / conf_now->p_pid_ang_div;
+	motor->p_pid_min_error = conf_now->p_pid_gain_dec_angle * motor->p_pid_ang_div_inv;
 	motor->m_observer_state.lambda_est = conf_now->foc_motor_flux_linkage;
 }
@@ -202,6 +202,9 @@ typedef struct {
 	float p_ld;
 	float p_inv_ld_lq; // (1.0/lq - 1.0/ld)
 	float p_v2_v3_inv_avg_half; // (0.5/ld + 0.5/lq)
+	float p_dt; // Control loop period
+	float p_pid_ang_div_inv; // (1.0/p_pid_ang_div)
+	float p_pid_min_error; // (p_pid_gain_dec_angle/p_pid_ang_div)
 } motor_all_state_t;
 
 // Functions
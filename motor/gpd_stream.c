@@ -0,0 +1,171 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/*
+ * Flow controlled sample streaming for the general purpose drive. The
+ * samples are played at the switching frequency divided by the upsampling
+ * factor and interpolated in between. This does not touch the hardware, so
+ * gpdrive.c calls it from the ADC interrupt.
+ */
+
+#include "gpd_stream.h"
+#include <string.h>
+
+int gpd_sample_buffer_fill(const gpd_sample_buffer *b) {
+	return (b->write - b->read + GPD_SAMPLE_BUFFER_SIZE) % GPD_SAMPLE_BUFFER_SIZE;
+}
+
+/**
+ * Add a sample to the buffer unless it is full. Overwriting unread samples
+ * would also make the buffer look empty.
+ *
+ * @return
+ * false if the sample was dropped.
+ */
+bool gpd_sample_buffer_push(gpd_sample_buffer *b, float sample) {
+	int next = (b->write + 1) % GPD_SAMPLE_BUFFER_SIZE;
+
+	if (next == b->read) {
+		return false;
+	}
+
+	b->buffer[b->write] = sample;
+	b->write = next;
+	return true;
+}
+
+/**
+ * Reset the stream and make it active.
+ *
+ * @param upsample
+ * Number of switching periods per sample.
+ *
+ * @param interpol
+ * Interpolation between samples.
+ *
+ * @param scale
+ * Scale for int16 samples.
+ *
+ * @param credit_block
+ * Send a credit report after this many samples have been played. 0 for
+ * a quarter of the buffer.
+ */
+void gpd_stream_start(gpd_stream *s, int upsample, gpd_interpol interpol, float scale, int credit_block) {
+	if (upsample < 1) {
+		upsample = 1;
+	}
+
+	if (credit_block <= 0 || credit_block >= GPD_SAMPLE_BUFFER_SIZE) {
+		credit_block = GPD_SAMPLE_BUFFER_SIZE / 4;
+	}
+
+	memset(s, 0, sizeof(gpd_stream));
+	s->upsample = upsample;
+	s->interpol = interpol;
+	s->scale = scale;
+	s->credit_block = credit_block;
+	s->report_now = true;
+	s->active = true;
+}
+
+/**
+ * Interpolate between hist[1] at t = 0 and hist[2] at t = 1. hist[0] and
+ * hist[3] are only used by the cubic interpolation.
+ */
+float gpd_stream_interpolate(gpd_interpol interpol, const float *hist, float t) {
+	float p0 = hist[0];
+	float p1 = hist[1];
+	float p2 = hist[2];
+	float p3 = hist[3];
+
+	switch (interpol) {
+	case GPD_INTERPOL_LINEAR:
+		return p1 + (p2 - p1) * t;
+
+	case GPD_INTERPOL_CUBIC:
+		// Catmull-Rom
+		return p1 + 0.5 * t * (p2 - p0 + t * (2.0 * p0 - 5.0 * p1 + 4.0 * p2 - p3 +
+				t * (3.0 * (p1 - p2) + p3 - p0)));
+
+	default:
+		return p1;
+	}
+}
+
+/**
+ * Advance the stream by one switching period. A new sample is taken from
+ * the buffer every upsample periods. When the buffer is empty the last
+ * sample is held and counted as an underrun.
+ *
+ * @param max_hold_periods
+ * Stop after the buffer has been empty for this many periods.
+ *
+ * @param output
+ * The output for this period, only set for GPD_STREAM_OUTPUT.
+ */
+gpd_stream_res gpd_stream_update(gpd_stream *s, gpd_sample_buffer *b, float max_hold_periods, float *output) {
+	if (s->phase == 0) {
+		float next;
+
+		if (b->read != b->write) {
+			next = b->buffer[b->read];
+			b->read = (b->read + 1) % GPD_SAMPLE_BUFFER_SIZE;
+			s->played++;
+			s->hold_periods = 0;
+
+			if (!s->started) {
+				s->hist[0] = next;
+				s->hist[1] = next;
+				s->hist[2] = next;
+				s->hist[3] = next;
+				s->started = true;
+			}
+		} else if (s->draining) {
+			return GPD_STREAM_STOP;
+		} else if (!s->started) {
+			// Wait for the first sample
+			return GPD_STREAM_WAIT;
+		} else {
+			// Underrun, hold the last sample
+			next = s->hist[3];
+			s->underruns++;
+		}
+
+		s->hist[0] = s->hist[1];
+		s->hist[1] = s->hist[2];
+		s->hist[2] = s->hist[3];
+		s->hist[3] = next;
+	}
+
+	if (b->read == b->write && !s->draining) {
+		s->hold_periods++;
+		if ((float)s->hold_periods > max_hold_periods) {
+			return GPD_STREAM_STOP;
+		}
+	}
+
+	*output = gpd_stream_interpolate(s->interpol, s->hist, (float)s->phase / (float)s->upsample);
+
+	s->phase++;
+	if (s->phase >= s->upsample) {
+		s->phase = 0;
+	}
+
+	return GPD_STREAM_OUTPUT;
+}
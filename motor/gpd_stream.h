@@ -0,0 +1,68 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef GPD_STREAM_H_
+#define GPD_STREAM_H_
+
+#include "datatypes.h"
+
+#define GPD_SAMPLE_BUFFER_SIZE		1024
+
+typedef struct {
+	float buffer[GPD_SAMPLE_BUFFER_SIZE];
+	int read;
+	int write;
+} gpd_sample_buffer;
+
+/*
+ * Playback of streamed samples. hist holds the samples around the segment
+ * that is played, which goes from hist[1] to hist[2].
+ */
+typedef struct {
+	bool active;
+	bool started;
+	bool draining;
+	int upsample;
+	gpd_interpol interpol;
+	float scale;
+	int credit_block;
+	float hist[4];
+	int phase;
+	int hold_periods;
+	uint32_t received;
+	uint32_t played;
+	uint32_t underruns;
+	uint32_t overruns;
+	bool report_now;
+} gpd_stream;
+
+typedef enum {
+	GPD_STREAM_WAIT = 0, // No sample yet, leave the output as it is
+	GPD_STREAM_OUTPUT,
+	GPD_STREAM_STOP // Drained or held for too long
+} gpd_stream_res;
+
+// Functions
+int gpd_sample_buffer_fill(const gpd_sample_buffer *b);
+bool gpd_sample_buffer_push(gpd_sample_buffer *b, float sample);
+void gpd_stream_start(gpd_stream *s, int upsample, gpd_interpol interpol, float scale, int credit_block);
+float gpd_stream_interpolate(gpd_interpol interpol, const float *hist, float t);
+gpd_stream_res gpd_stream_update(gpd_stream *s, gpd_sample_buffer *b, float max_hold_periods, float *output);
+
+#endif /* GPD_STREAM_H_ */
@@ -18,6 +18,7 @@
     */
 
 #include "gpdrive.h"
+#include "gpd_stream.h"
 #include "ch.h"
 #include "hal.h"
 #include "stm32f4xx_conf.h"
@@ -30,12 +31,13 @@
 #include "timeout.h"
 #include "mc_interface.h"
 #include "timer.h"
+#include "buffer.h"
 #include <math.h>
 #include <string.h>
 #include <stdlib.h>
 
 // Settings
-#define SAMPLE_BUFFER_SIZE			1024
+#define STREAM_MAX_HOLD_TIME		0.1 // Stop when no samples arrive for this long (s)
 
 // Private types
 typedef struct {
@@ -44,12 +46,6 @@ typedef struct {
 	float voltage_int;
 } cc_state;
 
-typedef struct {
-	float buffer[SAMPLE_BUFFER_SIZE];
-	int read;
-	int write;
-} sample_buffer;
-
 // Private variables
 static volatile mc_configuration *m_conf;
 static volatile float m_fsw_now;
@@ -58,8 +54,9 @@ static volatile float m_current_now;
 static volatile float m_current_now_filtered;
 static volatile bool m_init_done = false;
 static volatile gpd_output_mode m_output_mode;
-static volatile sample_buffer m_sample_buffer;
+static volatile gpd_sample_buffer m_sample_buffer;
 static volatile float m_buffer_int_scale;
+static volatile gpd_stream m_stream;
 static volatile bool m_is_running;
 static volatile float m_output_now;
 static volatile bool m_dccal_done = false;
@@ -80,6 +77,8 @@ static void stop_pwm_hw(void);
 static void adc_int_handler(void *p, uint32_t flags);
 static void set_modulation(float mod);
 static void do_dc_cal(void);
+static void buffer_push(float sample);
+static void stream_update(void);
 
 // Threads
 static THD_WORKING_AREA(timer_thread_wa, 512);
@@ -109,6 +108,7 @@ void gpdrive_init(volatile mc_configuration *configuration) {
 	m_output_mode = GPD_OUTPUT_MODE_NONE;
 	memset((void*)&m_sample_buffer, 0, sizeof(m_sample_buffer));
 	m_buffer_int_scale = 1.0 / 128.0;
+	memset((void*)&m_stream, 0, sizeof(m_stream));
 	m_is_running = false;
 	m_output_now = 0.0;
 	m_curr0_sum = 0;
@@ -343,19 +343,16 @@ void gpdrive_output_sample(float sample) {
 
 void gpdrive_fill_buffer(float *samples, int sample_num) {
 	for (int i = 0;i < sample_num;i++) {
-		m_sample_buffer.buffer[m_sample_buffer.write++] = samples[i];
-		m_sample_buffer.write %= SAMPLE_BUFFER_SIZE;
+		buffer_push(samples[i]);
 	}
 }
 
 void gpdrive_add_buffer_sample(float sample) {
-	m_sample_buffer.buffer[m_sample_buffer.write++] = sample;
-	m_sample_buffer.write %= SAMPLE_BUFFER_SIZE;
+	buffer_push(sample);
 }
 
 void gpdrive_add_buffer_sample_int(int sample) {
-	m_sample_buffer.buffer[m_sample_buffer.write++] = (float)sample * m_buffer_int_scale;
-	m_sample_buffer.write %= SAMPLE_BUFFER_SIZE;
+	buffer_push((float)sample * m_buffer_int_scale);
 }
 
 void gpdrive_set_buffer_int_scale(float scale) {
@@ -371,7 +368,64 @@ void gpdrive_set_switching_frequency(float freq) {
 int gpdrive_buffer_size_left(void) {
 	return (m_sample_buffer.write > m_sample_buffer.read)
                 ? m_sample_buffer.write - m_sample_buffer.read
-                : SAMPLE_BUFFER_SIZE - m_sample_buffer.read +m_sample_buffer.write;
+                : GPD_SAMPLE_BUFFER_SIZE - m_sample_buffer.read +m_sample_buffer.write;
+}
+
+/**
+ * Start streaming samples from the buffer. Streamed samples are played
+ * at the switching frequency divided by upsample and interpolated in
+ * between. The buffer is flow controlled with COMM_GPD_STREAM_CREDIT
+ * reports instead of overwriting unread samples, and the last sample is
+ * held if the buffer runs empty.
+ *
+ * @param upsample
+ * Number of switching periods per sample.
+ *
+ * @param interpol
+ * Interpolation between samples.
+ *
+ * @param scale
+ * Scale for the int16 samples in gpdrive_stream_add_samples.
+ *
+ * @param credit_block
+ * Send a credit report after this many samples have been played. 0 for
+ * a quarter of the buffer.
+ */
+void gpdrive_stream_start(int upsample, gpd_interpol interpol, float scale, int credit_block) {
+	utils_sys_lock_cnt();
+	m_sample_buffer.read = 0;
+	m_sample_buffer.write = 0;
+	gpd_stream_start((gpd_stream*)&m_stream, upsample, interpol, scale, credit_block);
+	utils_sys_unlock_cnt();
+}
+
+/**
+ * Add int16 samples to the stream. Samples that do not fit in the buffer
+ * are dropped and counted as overruns.
+ *
+ * @param data
+ * Big endian int16 samples.
+ *
+ * @param len
+ * Length of data in bytes.
+ */
+void gpdrive_stream_add_samples(const uint8_t *data, int len) {
+	if (!m_stream.active) {
+		return;
+	}
+
+	int32_t ind = 0;
+	while ((ind + 2) <= len) {
+		buffer_push((float)buffer_get_int16(data, &ind) * m_stream.scale);
+		m_stream.received++;
+	}
+}
+
+/**
+ * Stop the stream after the buffered samples have been played.
+ */
+void gpdrive_stream_stop(void) {
+	m_stream.draining = true;
 }
 
 void gpdrive_set_mode(gpd_output_mode mode) {
@@ -457,6 +511,7 @@ static void set_modulation(float mod) {
 
 static void stop_pwm_hw(void) {
 	m_is_running = false;
+	m_stream.active = false;
 	m_sample_buffer.write = 0;
 	m_sample_buffer.read = 0;
 
@@ -582,12 +637,15 @@ static void adc_int_handler(void *p, uint32_t flags) {
 
 	interpol++;
 
-	if (interpol > m_conf->gpd_buffer_interpol) {
+	if (m_stream.active) {
+		stream_update();
+		buffer_was_empty = true;
+	} else if (interpol > m_conf->gpd_buffer_interpol) {
 		interpol = 0;
 		if (m_sample_buffer.read != m_sample_buffer.write) {
 			buffer_last = buffer_next;
 			buffer_next = m_sample_buffer.buffer[m_sample_buffer.read++];
-			m_sample_buffer.read %= SAMPLE_BUFFER_SIZE;
+			m_sample_buffer.read %= GPD_SAMPLE_BUFFER_SIZE;
 
 			m_output_now = buffer_last;
 			m_is_running = true;
@@ -625,6 +683,30 @@ static void adc_int_handler(void *p, uint32_t flags) {
 	m_last_adc_isr_duration = timer_seconds_elapsed_since(t_start);
 }
 
+static void buffer_push(float sample) {
+	if (!gpd_sample_buffer_push((gpd_sample_buffer*)&m_sample_buffer, sample)) {
+		m_stream.overruns++;
+	}
+}
+
+static void stream_update(void) {
+	float output;
+	switch (gpd_stream_update((gpd_stream*)&m_stream, (gpd_sample_buffer*)&m_sample_buffer,
+			m_fsw_now * STREAM_MAX_HOLD_TIME, &output)) {
+	case GPD_STREAM_OUTPUT:
+		m_output_now = output;
+		m_is_running = true;
+		break;
+
+	case GPD_STREAM_STOP:
+		stop_pwm_hw();
+		break;
+
+	default:
+		break;
+	}
+}
+
 static THD_FUNCTION(timer_thread, arg) {
 	(void)arg;
 
@@ -636,8 +718,38 @@ static THD_FUNCTION(timer_thread, arg) {
 			return;
 		}
 
+		// Stream credits. Also sent once after the stream has ended so
+		// that the host sees the final counters.
+		static uint32_t played_last = 0;
+		static uint32_t underruns_last = 0;
+		static uint32_t overruns_last = 0;
+		static bool stream_active_last = false;
+
+		bool stream_active = m_stream.active;
+		if (stream_active || stream_active_last) {
+			uint32_t played = m_stream.played;
+			uint32_t underruns = m_stream.underruns;
+			uint32_t overruns = m_stream.overruns;
+
+			if (m_stream.report_now || !stream_active ||
+					(played - played_last) >= (uint32_t)m_stream.credit_block ||
+					underruns != underruns_last || overruns != overruns_last) {
+				m_stream.report_now = false;
+				int fill = gpd_sample_buffer_fill((gpd_sample_buffer*)&m_sample_buffer);
+				commands_send_gpd_stream_credit(GPD_SAMPLE_BUFFER_SIZE - 1 - fill,
+						m_stream.received, played, underruns, overruns);
+				played_last = played;
+				underruns_last = underruns;
+				overruns_last = overruns;
+			}
+		}
+		stream_active_last = stream_active;
+
 		static bool buffer_empty_before = true;
-		if (gpdrive_buffer_size_left() > 0 &&
+		if (stream_active) {
+			// Flow control is done with the credits
+			buffer_empty_before = true;
+		} else if (gpdrive_buffer_size_left() > 0 &&
 				gpdrive_buffer_size_left() < m_conf->gpd_buffer_notify_left) {
 			if (!buffer_empty_before) {
 				commands_send_gpd_buffer_notify();
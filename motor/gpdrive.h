@@ -36,6 +36,9 @@ void gpdrive_add_buffer_sample_int(int sample);
 void gpdrive_set_buffer_int_scale(float scale);
 void gpdrive_set_switching_frequency(float freq);
 int gpdrive_buffer_size_left(void);
+void gpdrive_stream_start(int upsample, gpd_interpol interpol, float scale, int credit_block);
+void gpdrive_stream_add_samples(const uint8_t *data, int len);
+void gpdrive_stream_stop(void);
 void gpdrive_set_mode(gpd_output_mode mode);
 float gpdrive_get_current(void);
 float gpdrive_get_current_filtered(void);
@@ -39,6 +39,11 @@
 #include "crc.h"
 #include "bms.h"
 #include "events.h"
+#include "mc_latency.h"
+#include "mc_limits.h"
+#include "ntc_table.h"
+#include "mc_thermal.h"
+#include "timer.h"
 
 #include <math.h>
 #include <stdlib.h>
@@ -51,6 +56,11 @@
 volatile uint16_t ADC_Value[HW_ADC_CHANNELS + HW_ADC_CHANNELS_EXTRA];
 volatile float ADC_curr_norm_value[6];
 
+typedef struct {
+	ntc_table table;
+	int adc_ind;
+} temp_motor_table;
+
 typedef struct {
 	mc_configuration m_conf;
 	mc_fault_code m_fault_now;
@@ -87,16 +97,44 @@ typedef struct {
 	float m_input_voltage_filtered_slower;
 	float m_temp_override;
 
+	// Latency of the last setpoint, see mc_latency.c
+	bool m_latency_pending;
+	mc_latency_src m_latency_src;
+	uint32_t m_latency_time;
+
+	// Derived from m_conf, see mc_limits.c
+	mc_limits_derived m_limits;
+
+	// Motor temperature sensor conversion, see update_temp_tables. The timer
+	// thread reads the table m_temp_motor_table points to, null for the macros.
+	temp_motor_table m_temp_motor_tables[2];
+	temp_motor_table *m_temp_motor_table;
+
+	// Motor thermal model, see mc_thermal.c
+	mc_thermal m_thermal;
+	bool m_thermal_started;
+	bool m_thermal_derate;
+	uint32_t m_thermal_last_time;
+	int m_thermal_predict_cnt;
+	float m_thermal_time_to_limit;
+
 	// Backup data counters
 	uint64_t m_odometer_last;
 	uint64_t m_runtime_last;
 } motor_if_state_t;
 
+typedef struct {
+	const volatile mc_configuration *conf;
+	bool is_motor_1;
+	int adc_ind;
+} temp_table_arg;
+
 // Private variables
 static volatile motor_if_state_t m_motor_1;
 #ifdef HW_HAS_DUAL_MOTORS
 static volatile motor_if_state_t m_motor_2;
 #endif
+static ntc_table m_temp_fet_table;
 
 // Sampling variables
 #define ADC_SAMPLE_MAX_LEN		2000
@@ -134,8 +172,13 @@ static volatile fault_data_local m_fault_data = {0, FAULT_CODE_NONE, 0, 0, {0, 0
 
 // Private functions
 static void update_override_limits(volatile motor_if_state_t *motor, volatile mc_configuration *conf);
+static void update_temp_tables(volatile motor_if_state_t *motor);
+static void update_thermal_model(volatile motor_if_state_t *motor);
+static float temp_fet_from_adc(uint16_t adc, const void *arg);
+static float temp_motor_from_adc(uint16_t adc, const void *arg);
 static void run_timer_tasks(volatile motor_if_state_t *motor);
 static void update_stats(volatile motor_if_state_t *motor);
+static void latency_tag(void);
 static volatile motor_if_state_t *motor_now(void);
 
 // Function pointers
@@ -143,7 +186,7 @@ static void(*pwn_done_func)(void) = 0;
 static void(* volatile send_func_sample)(unsigned char *data, unsigned int len) = 0;
 
 // Threads
-static THD_WORKING_AREA(timer_thread_wa, 512);
+static THD_WORKING_AREA(timer_thread_wa, 1024);
 static THD_FUNCTION(timer_thread, arg);
 static THD_WORKING_AREA(sample_send_thread_wa, 512);
 static THD_FUNCTION(sample_send_thread, arg);
@@ -170,6 +213,16 @@ void mc_interface_init(void) {
 	m_motor_2.m_conf.motor_type = MOTOR_TYPE_FOC;
 #endif
 
+	mc_limits_update_derived((mc_limits_derived*)&m_motor_1.m_limits, &m_motor_1.m_conf);
+	update_temp_tables(&m_motor_1);
+#ifdef HW_HAS_DUAL_MOTORS
+	mc_limits_update_derived((mc_limits_derived*)&m_motor_2.m_limits, &m_motor_2.m_conf);
+	update_temp_tables(&m_motor_2);
+#endif
+
+	temp_table_arg fet_arg = {0, true, ADC_IND_TEMP_MOS};
+	ntc_table_build(&m_temp_fet_table, temp_fet_from_adc, &fet_arg);
+
 	m_last_adc_duration_sample = 0.0;
 	m_sample_len = 1000;
 	m_sample_int = 1;
@@ -299,6 +352,17 @@ const volatile mc_configuration* mc_interface_get_configuration(void) {
 	return &motor_now()->m_conf;
 }
 
+/**
+ * Rebuild the values derived from the configuration. Call this after changing
+ * fields of the configuration returned by mc_interface_get_configuration
+ * directly instead of using mc_interface_set_configuration.
+ */
+void mc_interface_update_derived(void) {
+	volatile motor_if_state_t *motor = motor_now();
+	mc_limits_update_derived((mc_limits_derived*)&motor->m_limits, &motor->m_conf);
+	update_temp_tables(motor);
+}
+
 void mc_interface_set_configuration(mc_configuration *configuration) {
 	volatile motor_if_state_t *motor = motor_now();
 
@@ -371,6 +435,8 @@ void mc_interface_set_configuration(mc_configuration *configuration) {
 		motor->m_conf = *configuration;
 	}
 
+	mc_limits_update_derived((mc_limits_derived*)&motor->m_limits, &motor->m_conf);
+	update_temp_tables(motor);
 	update_override_limits(motor, &motor->m_conf);
 
 	switch (motor->m_conf.motor_type) {
@@ -553,6 +619,7 @@ void mc_interface_set_duty(float dutyCycle) {
 		break;
 	}
 
+	latency_tag();
 	events_add("set_duty", dutyCycle);
 }
 
@@ -579,6 +646,7 @@ void mc_interface_set_duty_noramp(float dutyCycle) {
 		break;
 	}
 
+	latency_tag();
 	events_add("set_duty_noramp", dutyCycle);
 }
 
@@ -605,6 +673,7 @@ void mc_interface_set_pid_speed(float rpm) {
 		break;
 	}
 
+	latency_tag();
 	events_add("set_pid_speed", rpm);
 }
 
@@ -644,6 +713,7 @@ void mc_interface_set_pid_pos(float pos) {
 		break;
 	}
 
+	latency_tag();
 	events_add("set_pid_pos", pos);
 }
 
@@ -670,6 +740,7 @@ void mc_interface_set_current(float current) {
 		break;
 	}
 
+	latency_tag();
 	events_add("set_current", current);
 }
 
@@ -701,6 +772,7 @@ void mc_interface_set_brake_current(float current) {
 		break;
 	}
 
+	latency_tag();
 	events_add("set_current_brake", current);
 }
 
@@ -762,6 +834,7 @@ void mc_interface_set_handbrake(float current) {
 		break;
 	}
 
+	latency_tag();
 	events_add("set_handbrake", current);
 }
 
@@ -1768,6 +1841,69 @@ void mc_interface_override_temp_motor(float temp) {
 	motor_now()->m_temp_override = temp;
 }
 
+/**
+ * Get a temperature from the motor thermal model.
+ *
+ * @param node
+ * 0: Winding, 1: Stator, 2: Housing
+ *
+ * @return
+ * The temperature in degC.
+ */
+float mc_interface_temp_motor_model(int node) {
+	volatile mc_thermal *m = &motor_now()->m_thermal;
+
+	switch (node) {
+	case 1: return m->temp_s;
+	case 2: return m->temp_h;
+	default: return m->temp_w;
+	}
+}
+
+/**
+ * Seconds until the winding reaches the start of the motor temperature
+ * derating if the present losses continue, up to 600.
+ */
+float mc_interface_temp_motor_time_to_limit(void) {
+	return motor_now()->m_thermal_time_to_limit;
+}
+
+void mc_interface_get_thermal_model(mc_thermal *m) {
+	utils_sys_lock_cnt();
+	*m = *((mc_thermal*)&motor_now()->m_thermal);
+	utils_sys_unlock_cnt();
+}
+
+/**
+ * Also derate on the winding temperature of the thermal model. Without a
+ * motor temperature sensor this is the only motor temperature protection.
+ */
+void mc_interface_set_thermal_derate(bool derate) {
+	motor_now()->m_thermal_derate = derate;
+}
+
+bool mc_interface_get_thermal_derate(void) {
+	return motor_now()->m_thermal_derate;
+}
+
+/**
+ * Set the scales of the thermal model, e.g. to fit a motor without sensor
+ * to measurements made earlier. With a sensor they keep adapting.
+ *
+ * @param scale_res
+ * Scale of the thermal resistance to ambient.
+ *
+ * @param scale_cap
+ * Scale of the heat capacities.
+ */
+void mc_interface_set_thermal_scales(float scale_res, float scale_cap) {
+	volatile mc_thermal *m = &motor_now()->m_thermal;
+	utils_truncate_number(&scale_res, MC_THERMAL_SCALE_MIN, MC_THERMAL_SCALE_MAX);
+	utils_truncate_number(&scale_cap, MC_THERMAL_SCALE_MIN, MC_THERMAL_SCALE_MAX);
+	m->scale_res = scale_res;
+	m->scale_cap = scale_cap;
+}
+
 // MC implementation functions
 
 /**
@@ -1850,6 +1986,12 @@ void mc_interface_mc_timer_isr(bool is_second_motor) {
 	const float input_voltage = GET_INPUT_VOLTAGE();
 	UTILS_LP_FAST(motor->m_input_voltage_filtered, input_voltage, 0.02);
 
+	// The control loop has now run with the latest setpoint
+	if (motor->m_latency_pending) {
+		motor->m_latency_pending = false;
+		mc_latency_add(motor->m_latency_src, motor->m_latency_time);
+	}
+
 	// Check for faults that should stop the motor
 
 	static float wrong_voltage_integrator = 0.0;
@@ -2182,266 +2324,264 @@ void mc_interface_adc_inj_int_handler(void) {
  * @param conf
  * The configaration to update.
  */
-static void update_override_limits(volatile motor_if_state_t *motor, volatile mc_configuration *conf) {
-	bool is_motor_1 = motor == &m_motor_1;
-
-	const float v_in = motor->m_input_voltage_filtered;
-	float rpm_now = 0.0;
+/*
+ * The temperature macros of the hwconf read ADC_Value directly. Evaluated
+ * with a local array of the same name they convert any raw value, so the
+ * tables follow the formula of every hardware without repeating it here.
+ * Conversions that do not depend on the value, e.g. functions that combine
+ * several sensors, give invalid tables and keep using the macros.
+ */
+static float temp_fet_from_adc(uint16_t adc, const void *arg) {
+	const temp_table_arg *a = arg;
 
-	if (motor->m_conf.motor_type == MOTOR_TYPE_FOC) {
-		// Low latency is important for avoiding oscillations
-		rpm_now = DIR_MULT * mcpwm_foc_get_rpm_fast();
-	} else {
-		rpm_now = mc_interface_get_rpm();
+	uint16_t ADC_Value[HW_ADC_CHANNELS + HW_ADC_CHANNELS_EXTRA];
+	for (int i = 0;i < HW_ADC_CHANNELS + HW_ADC_CHANNELS_EXTRA;i++) {
+		ADC_Value[i] = 2048;
 	}
+	ADC_Value[a->adc_ind] = adc;
 
-	float rpm_abs = fabsf(rpm_now);
+	return NTC_TEMP(a->adc_ind);
+}
 
-	const float duty_now_abs = fabsf(mc_interface_get_duty_cycle_now());
+static float temp_motor_from_adc(uint16_t adc, const void *arg) {
+	const temp_table_arg *a = arg;
+	const volatile mc_configuration *conf = a->conf;
 
-#ifdef HW_HAS_DUAL_PARALLEL
-	UTILS_LP_FAST(motor->m_temp_fet, fmaxf(NTC_TEMP(ADC_IND_TEMP_MOS), NTC_TEMP(ADC_IND_TEMP_MOS_M2)), 0.1);
-#else
-	UTILS_LP_FAST(motor->m_temp_fet, NTC_TEMP(is_motor_1 ? ADC_IND_TEMP_MOS : ADC_IND_TEMP_MOS_M2), 0.1);
-#endif
-
-	float temp_motor = 0.0;
+	uint16_t ADC_Value[HW_ADC_CHANNELS + HW_ADC_CHANNELS_EXTRA];
+	for (int i = 0;i < HW_ADC_CHANNELS + HW_ADC_CHANNELS_EXTRA;i++) {
+		ADC_Value[i] = 2048;
+	}
+	ADC_Value[a->adc_ind] = adc;
 
+	// Only the sensors that need logf, the others are cheap enough
 	switch(conf->m_motor_temp_sens_type) {
 	case TEMP_SENSOR_NTC_10K_25C:
-		temp_motor = is_motor_1 ? NTC_TEMP_MOTOR(conf->m_ntc_motor_beta) : NTC_TEMP_MOTOR_2(conf->m_ntc_motor_beta);
-		break;
+		return a->is_motor_1 ? NTC_TEMP_MOTOR(conf->m_ntc_motor_beta) : NTC_TEMP_MOTOR_2(conf->m_ntc_motor_beta);
 
 	case TEMP_SENSOR_NTC_100K_25C:
-		temp_motor = is_motor_1 ? NTC100K_TEMP_MOTOR(conf->m_ntc_motor_beta) : NTC100K_TEMP_MOTOR_2(conf->m_ntc_motor_beta);
-		break;
-
-	case TEMP_SENSOR_PTC_1K_100C:
-		temp_motor = is_motor_1 ? PTC_TEMP_MOTOR(1000.0, conf->m_ptc_motor_coeff, 100) : PTC_TEMP_MOTOR_2(1000.0, conf->m_ptc_motor_coeff, 100);
-		break;
-
-	case TEMP_SENSOR_KTY83_122: {
-		// KTY83_122 datasheet used to approximate resistance at given temperature to cubic polynom
-		// https://docs.google.com/spreadsheets/d/1iJA66biczfaXRNClSsrVF9RJuSAKoDG-bnRZFMOcuwU/edit?usp=sharing
-		// Thanks to: https://vasilisks.wordpress.com/2017/12/14/getting-temperature-from-ntc-kty83-kty84-on-mcu/#more-645
-		// You can change pull up resistor and update NTC_RES_MOTOR for your hardware without changing polynom
-		float res = NTC_RES_MOTOR(ADC_Value[is_motor_1 ? ADC_IND_TEMP_MOTOR : ADC_IND_TEMP_MOTOR_2]);
-		float pow2 = res * res;
-		temp_motor = 0.0000000102114874947423 * pow2 * res - 0.000069967997703501 * pow2 +
-				0.243402040973194 * res - 160.145048329356;
-	} break;
-
-	case TEMP_SENSOR_KTY84_130: {
-		float res = NTC_RES_MOTOR(ADC_Value[is_motor_1 ? ADC_IND_TEMP_MOTOR : ADC_IND_TEMP_MOTOR_2]);
-		temp_motor = -7.82531699e-12 * res * res * res * res + 6.34445902e-8 * res * res * res -
-				0.00020119157  * res * res + 0.407683016 * res - 161.357536;
-	} break;
+		return a->is_motor_1 ? NTC100K_TEMP_MOTOR(conf->m_ntc_motor_beta) : NTC100K_TEMP_MOTOR_2(conf->m_ntc_motor_beta);
 
 	case TEMP_SENSOR_NTCX:
-		temp_motor = is_motor_1 ? NTCX_TEMP_MOTOR(conf->m_ntcx_ptcx_res, conf->m_ntc_motor_beta, conf->m_ntcx_ptcx_temp_base) :
+		return a->is_motor_1 ? NTCX_TEMP_MOTOR(conf->m_ntcx_ptcx_res, conf->m_ntc_motor_beta, conf->m_ntcx_ptcx_temp_base) :
 				NTCX_TEMP_MOTOR_2(conf->m_ntcx_ptcx_res, conf->m_ntc_motor_beta, conf->m_ntcx_ptcx_temp_base);
-		break;
 
-	case TEMP_SENSOR_PTCX:
-		temp_motor = is_motor_1 ? PTC_TEMP_MOTOR(conf->m_ntcx_ptcx_res, conf->m_ptc_motor_coeff, conf->m_ntcx_ptcx_temp_base) :
-				PTC_TEMP_MOTOR_2(conf->m_ntcx_ptcx_res, conf->m_ptc_motor_coeff, conf->m_ntcx_ptcx_temp_base);
-		break;
+	default:
+		return 0.0;
+	}
+}
 
-	case TEMP_SENSOR_PT1000: {
-		float res = NTC_RES_MOTOR(ADC_Value[is_motor_1 ? ADC_IND_TEMP_MOTOR : ADC_IND_TEMP_MOTOR_2]);
-		temp_motor = -(sqrtf(-0.00232 * res + 17.59246) - 3.908) / 0.00116;
-	} break;
+/**
+ * Rebuild the motor temperature table after the sensor configuration has
+ * changed. The second motor macros may read the input of the first motor,
+ * so the input is found by trying both.
+ *
+ * The timer thread can read the table at any time, so the new table is
+ * built in the slot it does not use and published with a single pointer
+ * store when it is complete.
+ */
+static void update_temp_tables(volatile motor_if_state_t *motor) {
+	temp_table_arg arg;
+	arg.conf = &motor->m_conf;
+	arg.is_motor_1 = motor == &m_motor_1;
+	arg.adc_ind = arg.is_motor_1 ? ADC_IND_TEMP_MOTOR : ADC_IND_TEMP_MOTOR_2;
 
-	case TEMP_SENSOR_DISABLED:
-		temp_motor = motor->m_temp_override;
-		break;
-	}
+	temp_motor_table *tables = (temp_motor_table*)motor->m_temp_motor_tables;
+	temp_motor_table *next = motor->m_temp_motor_table == &tables[0] ? &tables[1] : &tables[0];
 
-	// If the reading is messed up (by e.g. reading 0 on the ADC and dividing by 0) we avoid putting an
-	// invalid value in the filter, as it will never recover. It is probably safest to keep running the
-	// motor even if the temperature reading fails. A config option to reduce power on invalid temperature
-	// readings might be useful.
-	if (UTILS_IS_NAN(temp_motor) || UTILS_IS_INF(temp_motor) || temp_motor > 600.0 || temp_motor < -200.0) {
-		temp_motor = -100.0;
+	next->adc_ind = arg.adc_ind;
+	if (!ntc_table_build(&next->table, temp_motor_from_adc, &arg) && !arg.is_motor_1) {
+		arg.adc_ind = ADC_IND_TEMP_MOTOR;
+		next->adc_ind = arg.adc_ind;
+		ntc_table_build(&next->table, temp_motor_from_adc, &arg);
 	}
 
-	UTILS_LP_FAST(motor->m_temp_motor, temp_motor, MOTOR_TEMP_LPF);
-
-#ifdef HW_HAS_GATE_DRIVER_SUPPLY_MONITOR
-	UTILS_LP_FAST(motor->m_gate_driver_voltage, GET_GATE_DRIVER_SUPPLY_VOLTAGE(), 0.01);
-#endif
+	// Invalid tables fall back to the macros
+	motor->m_temp_motor_table = next->table.valid ? next : 0;
+}
 
-	const float l_current_min_tmp = conf->l_current_min * conf->l_current_min_scale;
-	const float l_current_max_tmp = conf->l_current_max * conf->l_current_max_scale;
-
-	// Temperature MOSFET
-	float lo_min_mos = l_current_min_tmp;
-	float lo_max_mos = l_current_max_tmp;
-	if (motor->m_temp_fet < (conf->l_temp_fet_start + 0.1)) {
-		// Keep values
-	} else if (motor->m_temp_fet > (conf->l_temp_fet_end - 0.1)) {
-		lo_min_mos = 0.0;
-		lo_max_mos = 0.0;
-		mc_interface_fault_stop(FAULT_CODE_OVER_TEMP_FET, !is_motor_1, false);
-	} else {
-		float maxc = fabsf(l_current_max_tmp);
-		if (fabsf(l_current_min_tmp) > maxc) {
-			maxc = fabsf(l_current_min_tmp);
+/**
+ * Run the thermal model on the copper losses from the FOC currents and adapt
+ * it to the motor temperature sensor when there is one.
+ */
+static void update_thermal_model(volatile motor_if_state_t *motor) {
+	mc_thermal *m = (mc_thermal*)&motor->m_thermal;
+	const volatile mc_configuration *conf = &motor->m_conf;
+	const bool has_sensor = conf->m_motor_temp_sens_type != TEMP_SENSOR_DISABLED;
+
+	// Start from the filtered temperatures once they have settled
+	if (!motor->m_thermal_started) {
+		if (UTILS_AGE_S(0) < 3.0) {
+			return;
 		}
 
-		maxc = utils_map(motor->m_temp_fet, conf->l_temp_fet_start, conf->l_temp_fet_end, maxc, 0.0);
+		mc_thermal_init(m, conf->foc_motor_r, conf->foc_temp_comp_base_temp,
+				has_sensor ? motor->m_temp_motor : motor->m_temp_fet);
+		motor->m_thermal_last_time = timer_time_now();
+		motor->m_thermal_started = true;
+		return;
+	}
 
-		if (fabsf(l_current_min_tmp) > maxc) {
-			lo_min_mos = SIGN(l_current_min_tmp) * maxc;
-		}
+	float dt = timer_seconds_elapsed_since(motor->m_thermal_last_time);
+	motor->m_thermal_last_time = timer_time_now();
 
-		if (fabsf(l_current_max_tmp) > maxc) {
-			lo_max_mos = SIGN(l_current_max_tmp) * maxc;
-		}
-	}
+	m->res_base = conf->foc_motor_r;
+	m->temp_base = conf->foc_temp_comp_base_temp;
 
-	// Temperature MOTOR
-	float lo_min_mot = l_current_min_tmp;
-	float lo_max_mot = l_current_max_tmp;
-	if (motor->m_temp_motor < (conf->l_temp_motor_start + 0.1)) {
-		// Keep values
-	} else if (motor->m_temp_motor > (conf->l_temp_motor_end - 0.1)) {
-		lo_min_mot = 0.0;
-		lo_max_mot = 0.0;
-		mc_interface_fault_stop(FAULT_CODE_OVER_TEMP_MOTOR, !is_motor_1, false);
+	float i_sq = 0.0;
+	float res_est = 0.0;
+	if (conf->motor_type == MOTOR_TYPE_FOC) {
+		float id = mcpwm_foc_get_id_filter();
+		float iq = mcpwm_foc_get_iq_filter();
+		i_sq = SQ(id) + SQ(iq);
+		res_est = mcpwm_foc_get_est_res();
 	} else {
-		float maxc = fabsf(l_current_max_tmp);
-		if (fabsf(l_current_min_tmp) > maxc) {
-			maxc = fabsf(l_current_min_tmp);
-		}
+		i_sq = SQ(mc_interface_get_tot_current_filtered());
+	}
 
-		maxc = utils_map(motor->m_temp_motor, conf->l_temp_motor_start, conf->l_temp_motor_end, maxc, 0.0);
+	float power = mc_thermal_losses(m, i_sq, res_est);
+	mc_thermal_update(m, power, dt);
 
-		if (fabsf(l_current_min_tmp) > maxc) {
-			lo_min_mot = SIGN(l_current_min_tmp) * maxc;
-		}
+	// Readings outside of this range are from broken or missing sensors
+	if (has_sensor && motor->m_temp_motor > -50.0 && motor->m_temp_motor < 250.0) {
+		mc_thermal_adapt(m, motor->m_temp_motor, dt);
+	}
 
-		if (fabsf(l_current_max_tmp) > maxc) {
-			lo_max_mot = SIGN(l_current_max_tmp) * maxc;
-		}
+	// The prediction simulates ahead, so it runs at a lower rate
+	motor->m_thermal_predict_cnt++;
+	if (motor->m_thermal_predict_cnt >= 100) {
+		motor->m_thermal_predict_cnt = 0;
+		motor->m_thermal_time_to_limit = mc_thermal_time_to_limit(m, power, conf->l_temp_motor_start, 600.0);
 	}
+}
+
+static void update_override_limits(volatile motor_if_state_t *motor, volatile mc_configuration *conf) {
+	bool is_motor_1 = motor == &m_motor_1;
 
-	// Decreased temperatures during acceleration
-	// in order to still have braking torque available
-	const float temp_fet_accel_start = utils_map(conf->l_temp_accel_dec, 0.0, 1.0, conf->l_temp_fet_start, 25.0);
-	const float temp_fet_accel_end = utils_map(conf->l_temp_accel_dec, 0.0, 1.0, conf->l_temp_fet_end, 25.0);
-	const float temp_motor_accel_start = utils_map(conf->l_temp_accel_dec, 0.0, 1.0, conf->l_temp_motor_start, 25.0);
-	const float temp_motor_accel_end = utils_map(conf->l_temp_accel_dec, 0.0, 1.0, conf->l_temp_motor_end, 25.0);
+	const float v_in = motor->m_input_voltage_filtered;
+	float rpm_now = 0.0;
 
-	float lo_fet_temp_accel = 0.0;
-	if (motor->m_temp_fet < (temp_fet_accel_start + 0.1)) {
-		lo_fet_temp_accel = l_current_max_tmp;
-	} else if (motor->m_temp_fet > (temp_fet_accel_end - 0.1)) {
-		lo_fet_temp_accel = 0.0;
+	if (motor->m_conf.motor_type == MOTOR_TYPE_FOC) {
+		// Low latency is important for avoiding oscillations
+		rpm_now = DIR_MULT * mcpwm_foc_get_rpm_fast();
 	} else {
-		lo_fet_temp_accel = utils_map(motor->m_temp_fet, temp_fet_accel_start,
-				temp_fet_accel_end, l_current_max_tmp, 0.0);
+		rpm_now = mc_interface_get_rpm();
 	}
 
-	float lo_motor_temp_accel = 0.0;
-	if (motor->m_temp_motor < (temp_motor_accel_start + 0.1)) {
-		lo_motor_temp_accel = l_current_max_tmp;
-	} else if (motor->m_temp_motor > (temp_motor_accel_end - 0.1)) {
-		lo_motor_temp_accel = 0.0;
-	} else {
-		lo_motor_temp_accel = utils_map(motor->m_temp_motor, temp_motor_accel_start,
-				temp_motor_accel_end, l_current_max_tmp, 0.0);
-	}
-
-	// RPM max
-	float lo_max_rpm = 0.0;
-	const float rpm_pos_cut_start = conf->l_max_erpm * conf->l_erpm_start;
-	const float rpm_pos_cut_end = conf->l_max_erpm;
-	if (rpm_now < (rpm_pos_cut_start + 0.1)) {
-		lo_max_rpm = l_current_max_tmp;
-	} else if (rpm_now > (rpm_pos_cut_end - 0.1)) {
-		lo_max_rpm = 0.0;
+	const float duty_now_abs = fabsf(mc_interface_get_duty_cycle_now());
+
+	float temp_fet = 0.0;
+#ifdef HW_HAS_DUAL_PARALLEL
+	if (m_temp_fet_table.valid) {
+		temp_fet = fmaxf(ntc_table_lookup(&m_temp_fet_table, ADC_Value[ADC_IND_TEMP_MOS]),
+				ntc_table_lookup(&m_temp_fet_table, ADC_Value[ADC_IND_TEMP_MOS_M2]));
 	} else {
-		lo_max_rpm = utils_map(rpm_now, rpm_pos_cut_start, rpm_pos_cut_end, l_current_max_tmp, 0.0);
+		temp_fet = fmaxf(NTC_TEMP(ADC_IND_TEMP_MOS), NTC_TEMP(ADC_IND_TEMP_MOS_M2));
 	}
-
-	// RPM min
-	float lo_min_rpm = 0.0;
-	const float rpm_neg_cut_start = conf->l_min_erpm * conf->l_erpm_start;
-	const float rpm_neg_cut_end = conf->l_min_erpm;
-	if (rpm_now > (rpm_neg_cut_start - 0.1)) {
-		lo_min_rpm = l_current_max_tmp;
-	} else if (rpm_now < (rpm_neg_cut_end + 0.1)) {
-		lo_min_rpm = 0.0;
+#else
+	if (m_temp_fet_table.valid) {
+		temp_fet = ntc_table_lookup(&m_temp_fet_table, ADC_Value[is_motor_1 ? ADC_IND_TEMP_MOS : ADC_IND_TEMP_MOS_M2]);
 	} else {
-		lo_min_rpm = utils_map(rpm_now, rpm_neg_cut_start, rpm_neg_cut_end, l_current_max_tmp, 0.0);
+		temp_fet = NTC_TEMP(is_motor_1 ? ADC_IND_TEMP_MOS : ADC_IND_TEMP_MOS_M2);
 	}
+#endif
+	UTILS_LP_FAST(motor->m_temp_fet, temp_fet, 0.1);
 
-	// Start Current Decrease
-	float lo_max_curr_dec = l_current_max_tmp;
-	if (rpm_abs < conf->foc_start_curr_dec_rpm) {
-		lo_max_curr_dec = utils_map(rpm_abs, 0, conf->foc_start_curr_dec_rpm,
-				conf->foc_start_curr_dec * l_current_max_tmp, l_current_max_tmp);
-	}
+	float temp_motor = 0.0;
 
-	// Duty max
-	float lo_max_duty = 0.0;
-	if (duty_now_abs < (conf->l_duty_start * conf->l_max_duty) || conf->l_duty_start > 0.99) {
-		lo_max_duty = l_current_max_tmp;
+	// Read the pointer once, update_temp_tables can replace it at any time
+	const temp_motor_table *temp_table = motor->m_temp_motor_table;
+	if (temp_table) {
+		temp_motor = ntc_table_lookup(&temp_table->table, ADC_Value[temp_table->adc_ind]);
 	} else {
-		lo_max_duty = utils_map(duty_now_abs, (conf->l_duty_start * conf->l_max_duty),
-				conf->l_max_duty, l_current_max_tmp, conf->cc_min_current * 5.0);
-	}
+		switch(conf->m_motor_temp_sens_type) {
+		case TEMP_SENSOR_NTC_10K_25C:
+			temp_motor = is_motor_1 ? NTC_TEMP_MOTOR(conf->m_ntc_motor_beta) : NTC_TEMP_MOTOR_2(conf->m_ntc_motor_beta);
+			break;
 
-	float lo_max = utils_min_abs(lo_max_mos, lo_max_mot);
-	float lo_min = utils_min_abs(lo_min_mos, lo_min_mot);
+		case TEMP_SENSOR_NTC_100K_25C:
+			temp_motor = is_motor_1 ? NTC100K_TEMP_MOTOR(conf->m_ntc_motor_beta) : NTC100K_TEMP_MOTOR_2(conf->m_ntc_motor_beta);
+			break;
 
-	lo_max = utils_min_abs(lo_max, lo_max_rpm);
-	lo_max = utils_min_abs(lo_max, lo_min_rpm);
-	lo_max = utils_min_abs(lo_max, lo_max_curr_dec);
-	lo_max = utils_min_abs(lo_max, lo_fet_temp_accel);
-	lo_max = utils_min_abs(lo_max, lo_motor_temp_accel);
-	lo_max = utils_min_abs(lo_max, lo_max_duty);
+		case TEMP_SENSOR_PTC_1K_100C:
+			temp_motor = is_motor_1 ? PTC_TEMP_MOTOR(1000.0, conf->m_ptc_motor_coeff, 100) : PTC_TEMP_MOTOR_2(1000.0, conf->m_ptc_motor_coeff, 100);
+			break;
 
-	if (lo_max < conf->cc_min_current) {
-		lo_max = conf->cc_min_current;
+		case TEMP_SENSOR_KTY83_122: {
+			// KTY83_122 datasheet used to approximate resistance at given temperature to cubic polynom
+			// https://docs.google.com/spreadsheets/d/1iJA66biczfaXRNClSsrVF9RJuSAKoDG-bnRZFMOcuwU/edit?usp=sharing
+			// Thanks to: https://vasilisks.wordpress.com/2017/12/14/getting-temperature-from-ntc-kty83-kty84-on-mcu/#more-645
+			// You can change pull up resistor and update NTC_RES_MOTOR for your hardware without changing polynom
+			float res = NTC_RES_MOTOR(ADC_Value[is_motor_1 ? ADC_IND_TEMP_MOTOR : ADC_IND_TEMP_MOTOR_2]);
+			float pow2 = res * res;
+			temp_motor = 0.0000000102114874947423 * pow2 * res - 0.000069967997703501 * pow2 +
+					0.243402040973194 * res - 160.145048329356;
+		} break;
+
+		case TEMP_SENSOR_KTY84_130: {
+			float res = NTC_RES_MOTOR(ADC_Value[is_motor_1 ? ADC_IND_TEMP_MOTOR : ADC_IND_TEMP_MOTOR_2]);
+			temp_motor = -7.82531699e-12 * res * res * res * res + 6.34445902e-8 * res * res * res -
+					0.00020119157  * res * res + 0.407683016 * res - 161.357536;
+		} break;
+
+		case TEMP_SENSOR_NTCX:
+			temp_motor = is_motor_1 ? NTCX_TEMP_MOTOR(conf->m_ntcx_ptcx_res, conf->m_ntc_motor_beta, conf->m_ntcx_ptcx_temp_base) :
+					NTCX_TEMP_MOTOR_2(conf->m_ntcx_ptcx_res, conf->m_ntc_motor_beta, conf->m_ntcx_ptcx_temp_base);
+			break;
+
+		case TEMP_SENSOR_PTCX:
+			temp_motor = is_motor_1 ? PTC_TEMP_MOTOR(conf->m_ntcx_ptcx_res, conf->m_ptc_motor_coeff, conf->m_ntcx_ptcx_temp_base) :
+					PTC_TEMP_MOTOR_2(conf->m_ntcx_ptcx_res, conf->m_ptc_motor_coeff, conf->m_ntcx_ptcx_temp_base);
+			break;
+
+		case TEMP_SENSOR_PT1000: {
+			float res = NTC_RES_MOTOR(ADC_Value[is_motor_1 ? ADC_IND_TEMP_MOTOR : ADC_IND_TEMP_MOTOR_2]);
+			temp_motor = -(sqrtf(-0.00232 * res + 17.59246) - 3.908) / 0.00116;
+		} break;
+
+		case TEMP_SENSOR_DISABLED:
+			temp_motor = motor->m_temp_override;
+			break;
+		}
 	}
 
-	if (lo_min > -conf->cc_min_current) {
-		lo_min = -conf->cc_min_current;
+	// If the reading is messed up (by e.g. reading 0 on the ADC and dividing by 0) we avoid putting an
+	// invalid value in the filter, as it will never recover. It is probably safest to keep running the
+	// motor even if the temperature reading fails. A config option to reduce power on invalid temperature
+	// readings might be useful.
+	if (UTILS_IS_NAN(temp_motor) || UTILS_IS_INF(temp_motor) || temp_motor > 600.0 || temp_motor < -200.0) {
+		temp_motor = -100.0;
 	}
 
-	conf->lo_current_max = lo_max;
-	conf->lo_current_min = lo_min;
+	UTILS_LP_FAST(motor->m_temp_motor, temp_motor, MOTOR_TEMP_LPF);
 
-	// Battery cutoff
-	float lo_in_max_batt = 0.0;
-	if (v_in > (conf->l_battery_cut_start - 0.1)) {
-		lo_in_max_batt = conf->l_in_current_max;
-	} else if (v_in < (conf->l_battery_cut_end + 0.1)) {
-		lo_in_max_batt = 0.0;
-	} else {
-		lo_in_max_batt = utils_map(v_in, conf->l_battery_cut_start,
-				conf->l_battery_cut_end, conf->l_in_current_max, 0.0);
+#ifdef HW_HAS_GATE_DRIVER_SUPPLY_MONITOR
+	UTILS_LP_FAST(motor->m_gate_driver_voltage, GET_GATE_DRIVER_SUPPLY_VOLTAGE(), 0.01);
+#endif
+
+	// Derate on the winding estimate as well when enabled, which also
+	// protects motors without sensor
+	float temp_motor_lim = motor->m_temp_motor;
+	if (motor->m_thermal_derate && motor->m_thermal_started) {
+		temp_motor_lim = fmaxf(temp_motor_lim, motor->m_thermal.temp_w);
 	}
 
-	// Regen overvoltage cutoff
-	float lo_in_min_batt = 0.0;
-	if (v_in < (conf->l_battery_regen_cut_start + 0.1)) {
-		lo_in_min_batt = conf->l_in_current_min;
-	} else if (v_in > (conf->l_battery_regen_cut_end - 0.1)) {
-		lo_in_min_batt = 0.0;
-	} else {
-		lo_in_min_batt = utils_map(v_in, conf->l_battery_regen_cut_start,
-				conf->l_battery_regen_cut_end, conf->l_in_current_min, 0.0);
+	mc_limits_result lim;
+	mc_limits_calc((const mc_limits_derived*)&motor->m_limits, motor->m_temp_fet, temp_motor_lim,
+			rpm_now, duty_now_abs, v_in, &lim);
+
+	if (lim.fet_over_temp) {
+		mc_interface_fault_stop(FAULT_CODE_OVER_TEMP_FET, !is_motor_1, false);
+	}
+
+	if (lim.motor_over_temp) {
+		mc_interface_fault_stop(FAULT_CODE_OVER_TEMP_MOTOR, !is_motor_1, false);
 	}
 
-	// Wattage limits
-	const float lo_in_max_watt = conf->l_watt_max / v_in;
-	const float lo_in_min_watt = conf->l_watt_min / v_in;
+	conf->lo_current_max = lim.current_max;
+	conf->lo_current_min = lim.current_min;
 
-	float lo_in_max = utils_min_abs(lo_in_max_watt, lo_in_max_batt);
-	float lo_in_min = utils_min_abs(lo_in_min_watt, lo_in_min_batt);
+	float lo_in_max = lim.in_current_max;
+	float lo_in_min = lim.in_current_min;
 
 	// BMS limits
 	bms_update_limits(&lo_in_min,  &lo_in_max, conf->l_in_current_min, conf->l_in_current_max);
@@ -2479,6 +2619,21 @@ static volatile motor_if_state_t *motor_now(void) {
 #endif
 }
 
+static void latency_tag(void) {
+	mc_latency_src src;
+	uint32_t time;
+
+	if (mc_latency_get_tag(&src, &time)) {
+		volatile motor_if_state_t *motor = motor_now();
+
+		// The control interrupt must not see a half-written tag
+		motor->m_latency_pending = false;
+		motor->m_latency_src = src;
+		motor->m_latency_time = time;
+		motor->m_latency_pending = true;
+	}
+}
+
 static void run_timer_tasks(volatile motor_if_state_t *motor) {
 	bool is_motor_1 = motor == &m_motor_1;
 	mc_interface_select_motor_thread(is_motor_1 ? 1 : 2);
@@ -2528,6 +2683,7 @@ static void run_timer_tasks(volatile motor_if_state_t *motor) {
 		motor->m_drv_fault_iterations = 0;
 	}
 
+	update_thermal_model(motor);
 	update_override_limits(motor, &motor->m_conf);
 
 	// Update auxiliary output
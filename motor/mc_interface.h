@@ -23,6 +23,7 @@
 #include "conf_general.h"
 #include "hw.h"
 #include "datatypes.h"
+#include "mc_thermal.h"
 
 // Functions
 void mc_interface_init(void);
@@ -31,6 +32,7 @@ void mc_interface_select_motor_thread(int motor);
 int mc_interface_get_motor_thread(void);
 const volatile mc_configuration* mc_interface_get_configuration(void);
 void mc_interface_set_configuration(mc_configuration *configuration);
+void mc_interface_update_derived(void);
 unsigned mc_interface_calc_crc(mc_configuration* conf, bool is_motor_2);
 bool mc_interface_dccal_done(void);
 void mc_interface_set_pwm_callback(void (*p_func)(void));
@@ -109,6 +111,12 @@ void mc_interface_ignore_input(int time_ms);
 void mc_interface_set_current_off_delay(float delay_sec);
 
 void mc_interface_override_temp_motor(float temp);
+float mc_interface_temp_motor_model(int node);
+float mc_interface_temp_motor_time_to_limit(void);
+void mc_interface_get_thermal_model(mc_thermal *m);
+void mc_interface_set_thermal_derate(bool derate);
+bool mc_interface_get_thermal_derate(void);
+void mc_interface_set_thermal_scales(float scale_res, float scale_cap);
 
 void mc_interface_ignore_input_both(int time_ms);
 void mc_interface_release_motor_override_both(void);
@@ -0,0 +1,228 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/*
+ * Latency tracing for motor commands. The thread that receives a command
+ * tags it with the source and the time it arrived using mc_latency_begin
+ * and mc_latency_end around the processing. mc_interface copies the tag of
+ * the calling thread into the motor state together with the setpoint, and
+ * the control interrupt adds the time since arrival to the histogram of
+ * the source the first time it runs with the new setpoint.
+ */
+
+#include "mc_latency.h"
+#include "ch.h"
+#include "timer.h"
+#include <string.h>
+
+typedef struct {
+	thread_t *thread;
+	mc_latency_src src;
+	bool persistent;
+	bool has_time;
+	uint32_t time;
+} thread_ctx;
+
+// Private variables
+static thread_ctx m_threads[MC_LATENCY_THREADS];
+static volatile mc_latency_hist m_hist[MC_LATENCY_SRC_NUM];
+
+static thread_ctx *get_ctx(bool create) {
+	thread_t *self = chThdGetSelfX();
+	thread_ctx *free_ctx = 0;
+
+	for (int i = 0;i < MC_LATENCY_THREADS;i++) {
+		if (m_threads[i].thread == self) {
+			return &m_threads[i];
+		}
+
+		if (!free_ctx && !m_threads[i].thread) {
+			free_ctx = &m_threads[i];
+		}
+	}
+
+	if (!create || !free_ctx) {
+		return 0;
+	}
+
+	chSysLock();
+	if (free_ctx->thread) {
+		// Taken by another thread in the meantime
+		chSysUnlock();
+		return get_ctx(create);
+	}
+	free_ctx->thread = self;
+	free_ctx->persistent = false;
+	free_ctx->has_time = false;
+	chSysUnlock();
+
+	return free_ctx;
+}
+
+/**
+ * Tag the setpoints that the calling thread sets until mc_latency_end
+ * with a source and an arrival time.
+ *
+ * @param src
+ * Where the command came from.
+ *
+ * @param rx_time
+ * When the command arrived, from timer_time_now.
+ */
+void mc_latency_begin(mc_latency_src src, uint32_t rx_time) {
+	thread_ctx *ctx = get_ctx(true);
+
+	if (ctx) {
+		ctx->src = src;
+		ctx->time = rx_time;
+		ctx->has_time = true;
+	}
+}
+
+void mc_latency_end(void) {
+	thread_ctx *ctx = get_ctx(false);
+
+	if (ctx) {
+		ctx->has_time = false;
+
+		if (!ctx->persistent) {
+			ctx->thread = 0;
+		}
+	}
+}
+
+/**
+ * Tag all setpoints from the calling thread outside of mc_latency_begin
+ * and mc_latency_end with a source and the time they are set. For threads
+ * that decide on the setpoint themselves, such as the lisp evaluator.
+ * The entry is kept when the thread exits, so this is meant for threads
+ * with a static working area that are started again at the same address.
+ */
+void mc_latency_set_thread_source(mc_latency_src src) {
+	thread_ctx *ctx = get_ctx(true);
+
+	if (ctx) {
+		ctx->src = src;
+		ctx->persistent = true;
+	}
+}
+
+/**
+ * Get the tag of the calling thread.
+ *
+ * @return
+ * true if the thread has a tag, false otherwise.
+ */
+bool mc_latency_get_tag(mc_latency_src *src, uint32_t *time) {
+	thread_ctx *ctx = get_ctx(false);
+
+	if (!ctx) {
+		return false;
+	}
+
+	*src = ctx->src;
+	*time = ctx->has_time ? ctx->time : timer_time_now();
+	return true;
+}
+
+/**
+ * Add the time since a tagged setpoint arrived. Called from the control
+ * interrupt.
+ */
+void mc_latency_add(mc_latency_src src, uint32_t time) {
+	mc_latency_add_us(src, (uint32_t)(timer_seconds_elapsed_since(time) * 1e6 + 0.5));
+}
+
+void mc_latency_add_us(mc_latency_src src, uint32_t us) {
+	if (src >= MC_LATENCY_SRC_NUM) {
+		return;
+	}
+
+	volatile mc_latency_hist *h = &m_hist[src];
+
+	int bin = us > 0 ? 31 - __builtin_clz(us) : 0;
+	if (bin >= MC_LATENCY_BINS) {
+		bin = MC_LATENCY_BINS - 1;
+	}
+
+	h->bins[bin]++;
+	h->count++;
+	h->sum_us += us;
+
+	if (us > h->max_us) {
+		h->max_us = us;
+	}
+}
+
+void mc_latency_get_hist(mc_latency_src src, mc_latency_hist *hist) {
+	if (src >= MC_LATENCY_SRC_NUM) {
+		memset(hist, 0, sizeof(mc_latency_hist));
+		return;
+	}
+
+	chSysLock();
+	*hist = *((mc_latency_hist*)&m_hist[src]);
+	chSysUnlock();
+}
+
+/**
+ * Estimate a percentile from a histogram.
+ *
+ * @param percentile
+ * Percentile, 0.0 to 1.0.
+ *
+ * @return
+ * The upper edge of the bin that contains the percentile, but at most the
+ * maximum latency. 0 if the histogram is empty.
+ */
+uint32_t mc_latency_percentile_us(const mc_latency_hist *hist, float percentile) {
+	if (hist->count == 0) {
+		return 0;
+	}
+
+	uint32_t target = (uint32_t)((float)hist->count * percentile);
+	uint32_t sum = 0;
+
+	for (int i = 0;i < MC_LATENCY_BINS;i++) {
+		sum += hist->bins[i];
+		if (sum > target || sum == hist->count) {
+			uint32_t edge = i < (MC_LATENCY_BINS - 1) ? (2u << i) : hist->max_us;
+			return edge < hist->max_us ? edge : hist->max_us;
+		}
+	}
+
+	return hist->max_us;
+}
+
+void mc_latency_reset(void) {
+	chSysLock();
+	memset((void*)m_hist, 0, sizeof(m_hist));
+	chSysUnlock();
+}
+
+const char *mc_latency_src_name(mc_latency_src src) {
+	switch (src) {
+	case MC_LATENCY_SRC_USB: return "USB";
+	case MC_LATENCY_SRC_UART: return "UART";
+	case MC_LATENCY_SRC_CAN: return "CAN";
+	case MC_LATENCY_SRC_LISP: return "Lisp";
+	case MC_LATENCY_SRC_APP: return "App";
+	default: return "Unknown";
+	}
+}
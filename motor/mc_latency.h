@@ -0,0 +1,58 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef MC_LATENCY_H_
+#define MC_LATENCY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Settings
+#define MC_LATENCY_BINS				16 // Bin n counts latencies from 2^n to 2^(n + 1) us
+#define MC_LATENCY_THREADS			8
+
+typedef enum {
+	MC_LATENCY_SRC_USB = 0,
+	MC_LATENCY_SRC_UART,
+	MC_LATENCY_SRC_CAN,
+	MC_LATENCY_SRC_LISP,
+	MC_LATENCY_SRC_APP,
+	MC_LATENCY_SRC_NUM
+} mc_latency_src;
+
+typedef struct {
+	uint32_t count;
+	uint32_t max_us;
+	uint64_t sum_us;
+	uint32_t bins[MC_LATENCY_BINS];
+} mc_latency_hist;
+
+// Functions
+void mc_latency_begin(mc_latency_src src, uint32_t rx_time);
+void mc_latency_end(void);
+void mc_latency_set_thread_source(mc_latency_src src);
+bool mc_latency_get_tag(mc_latency_src *src, uint32_t *time);
+void mc_latency_add(mc_latency_src src, uint32_t time);
+void mc_latency_add_us(mc_latency_src src, uint32_t us);
+void mc_latency_get_hist(mc_latency_src src, mc_latency_hist *hist);
+uint32_t mc_latency_percentile_us(const mc_latency_hist *hist, float percentile);
+void mc_latency_reset(void);
+const char *mc_latency_src_name(mc_latency_src src);
+
+#endif /* MC_LATENCY_H_ */
@@ -0,0 +1,261 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/*
+ * Override limits from temperature, speed, duty cycle and input voltage.
+ * Everything that only depends on the configuration is calculated once in
+ * mc_limits_update_derived, so that mc_limits_calc only has to evaluate the
+ * ramps it is inside of.
+ */
+
+#include "mc_limits.h"
+#include "utils_math.h"
+#include <math.h>
+
+static void ramp_init(mc_limits_ramp *r, float start, float end, float out_start, float out_end) {
+	r->start = start;
+	r->end = end;
+	r->out_start = out_start;
+	r->slope = end != start ? (out_end - out_start) / (end - start) : 0.0;
+}
+
+static inline float ramp_eval(const mc_limits_ramp *r, float x) {
+	return (x - r->start) * r->slope + r->out_start;
+}
+
+void mc_limits_update_derived(mc_limits_derived *d, const volatile mc_configuration *conf) {
+	d->current_min_tmp = conf->l_current_min * conf->l_current_min_scale;
+	d->current_max_tmp = conf->l_current_max * conf->l_current_max_scale;
+	d->cc_min_current = conf->cc_min_current;
+	d->in_current_min = conf->l_in_current_min;
+	d->in_current_max = conf->l_in_current_max;
+	d->watt_min = conf->l_watt_min;
+	d->watt_max = conf->l_watt_max;
+
+	float maxc = fabsf(d->current_max_tmp);
+	if (fabsf(d->current_min_tmp) > maxc) {
+		maxc = fabsf(d->current_min_tmp);
+	}
+
+	ramp_init(&d->temp_fet, conf->l_temp_fet_start, conf->l_temp_fet_end, maxc, 0.0);
+	ramp_init(&d->temp_motor, conf->l_temp_motor_start, conf->l_temp_motor_end, maxc, 0.0);
+
+	// Decreased temperatures during acceleration in order to still have braking torque available
+	ramp_init(&d->temp_fet_accel,
+			utils_map(conf->l_temp_accel_dec, 0.0, 1.0, conf->l_temp_fet_start, 25.0),
+			utils_map(conf->l_temp_accel_dec, 0.0, 1.0, conf->l_temp_fet_end, 25.0),
+			d->current_max_tmp, 0.0);
+	ramp_init(&d->temp_motor_accel,
+			utils_map(conf->l_temp_accel_dec, 0.0, 1.0, conf->l_temp_motor_start, 25.0),
+			utils_map(conf->l_temp_accel_dec, 0.0, 1.0, conf->l_temp_motor_end, 25.0),
+			d->current_max_tmp, 0.0);
+
+	ramp_init(&d->rpm_pos, conf->l_max_erpm * conf->l_erpm_start, conf->l_max_erpm, d->current_max_tmp, 0.0);
+	ramp_init(&d->rpm_neg, conf->l_min_erpm * conf->l_erpm_start, conf->l_min_erpm, d->current_max_tmp, 0.0);
+
+	ramp_init(&d->curr_dec, 0.0, conf->foc_start_curr_dec_rpm,
+			conf->foc_start_curr_dec * d->current_max_tmp, d->current_max_tmp);
+
+	d->duty_enabled = conf->l_duty_start <= 0.99;
+	ramp_init(&d->duty, conf->l_duty_start * conf->l_max_duty, conf->l_max_duty,
+			d->current_max_tmp, conf->cc_min_current * 5.0);
+
+	ramp_init(&d->batt, conf->l_battery_cut_start, conf->l_battery_cut_end, conf->l_in_current_max, 0.0);
+	ramp_init(&d->batt_regen, conf->l_battery_regen_cut_start, conf->l_battery_regen_cut_end,
+			conf->l_in_current_min, 0.0);
+}
+
+/**
+ * Calculate the override limits.
+ *
+ * @param d
+ * Values derived from the configuration.
+ *
+ * @param temp_fet
+ * Filtered MOSFET temperature.
+ *
+ * @param temp_motor
+ * Filtered motor temperature.
+ *
+ * @param rpm
+ * Signed electrical speed.
+ *
+ * @param duty_abs
+ * Magnitude of the duty cycle.
+ *
+ * @param v_in
+ * Filtered input voltage.
+ *
+ * @param res
+ * The limits. The input current limits still have to be combined with the
+ * BMS limits by the caller.
+ */
+void mc_limits_calc(const mc_limits_derived *d, float temp_fet, float temp_motor,
+		float rpm, float duty_abs, float v_in, mc_limits_result *res) {
+	const float l_current_min_tmp = d->current_min_tmp;
+	const float l_current_max_tmp = d->current_max_tmp;
+
+	res->fet_over_temp = false;
+	res->motor_over_temp = false;
+
+	// Temperature MOSFET
+	float lo_min_mos = l_current_min_tmp;
+	float lo_max_mos = l_current_max_tmp;
+	if (temp_fet < (d->temp_fet.start + 0.1)) {
+		// Keep values
+	} else if (temp_fet > (d->temp_fet.end - 0.1)) {
+		lo_min_mos = 0.0;
+		lo_max_mos = 0.0;
+		res->fet_over_temp = true;
+	} else {
+		float maxc = ramp_eval(&d->temp_fet, temp_fet);
+
+		if (fabsf(l_current_min_tmp) > maxc) {
+			lo_min_mos = SIGN(l_current_min_tmp) * maxc;
+		}
+
+		if (fabsf(l_current_max_tmp) > maxc) {
+			lo_max_mos = SIGN(l_current_max_tmp) * maxc;
+		}
+	}
+
+	// Temperature MOTOR
+	float lo_min_mot = l_current_min_tmp;
+	float lo_max_mot = l_current_max_tmp;
+	if (temp_motor < (d->temp_motor.start + 0.1)) {
+		// Keep values
+	} else if (temp_motor > (d->temp_motor.end - 0.1)) {
+		lo_min_mot = 0.0;
+		lo_max_mot = 0.0;
+		res->motor_over_temp = true;
+	} else {
+		float maxc = ramp_eval(&d->temp_motor, temp_motor);
+
+		if (fabsf(l_current_min_tmp) > maxc) {
+			lo_min_mot = SIGN(l_current_min_tmp) * maxc;
+		}
+
+		if (fabsf(l_current_max_tmp) > maxc) {
+			lo_max_mot = SIGN(l_current_max_tmp) * maxc;
+		}
+	}
+
+	// Decreased temperatures during acceleration
+	float lo_fet_temp_accel = 0.0;
+	if (temp_fet < (d->temp_fet_accel.start + 0.1)) {
+		lo_fet_temp_accel = l_current_max_tmp;
+	} else if (temp_fet > (d->temp_fet_accel.end - 0.1)) {
+		lo_fet_temp_accel = 0.0;
+	} else {
+		lo_fet_temp_accel = ramp_eval(&d->temp_fet_accel, temp_fet);
+	}
+
+	float lo_motor_temp_accel = 0.0;
+	if (temp_motor < (d->temp_motor_accel.start + 0.1)) {
+		lo_motor_temp_accel = l_current_max_tmp;
+	} else if (temp_motor > (d->temp_motor_accel.end - 0.1)) {
+		lo_motor_temp_accel = 0.0;
+	} else {
+		lo_motor_temp_accel = ramp_eval(&d->temp_motor_accel, temp_motor);
+	}
+
+	// RPM max
+	float lo_max_rpm = 0.0;
+	if (rpm < (d->rpm_pos.start + 0.1)) {
+		lo_max_rpm = l_current_max_tmp;
+	} else if (rpm > (d->rpm_pos.end - 0.1)) {
+		lo_max_rpm = 0.0;
+	} else {
+		lo_max_rpm = ramp_eval(&d->rpm_pos, rpm);
+	}
+
+	// RPM min
+	float lo_min_rpm = 0.0;
+	if (rpm > (d->rpm_neg.start - 0.1)) {
+		lo_min_rpm = l_current_max_tmp;
+	} else if (rpm < (d->rpm_neg.end + 0.1)) {
+		lo_min_rpm = 0.0;
+	} else {
+		lo_min_rpm = ramp_eval(&d->rpm_neg, rpm);
+	}
+
+	// Start Current Decrease
+	float lo_max_curr_dec = l_current_max_tmp;
+	const float rpm_abs = fabsf(rpm);
+	if (rpm_abs < d->curr_dec.end) {
+		lo_max_curr_dec = ramp_eval(&d->curr_dec, rpm_abs);
+	}
+
+	// Duty max
+	float lo_max_duty = 0.0;
+	if (duty_abs < d->duty.start || !d->duty_enabled) {
+		lo_max_duty = l_current_max_tmp;
+	} else {
+		lo_max_duty = ramp_eval(&d->duty, duty_abs);
+	}
+
+	float lo_max = utils_min_abs(lo_max_mos, lo_max_mot);
+	float lo_min = utils_min_abs(lo_min_mos, lo_min_mot);
+
+	lo_max = utils_min_abs(lo_max, lo_max_rpm);
+	lo_max = utils_min_abs(lo_max, lo_min_rpm);
+	lo_max = utils_min_abs(lo_max, lo_max_curr_dec);
+	lo_max = utils_min_abs(lo_max, lo_fet_temp_accel);
+	lo_max = utils_min_abs(lo_max, lo_motor_temp_accel);
+	lo_max = utils_min_abs(lo_max, lo_max_duty);
+
+	if (lo_max < d->cc_min_current) {
+		lo_max = d->cc_min_current;
+	}
+
+	if (lo_min > -d->cc_min_current) {
+		lo_min = -d->cc_min_current;
+	}
+
+	res->current_max = lo_max;
+	res->current_min = lo_min;
+
+	// Battery cutoff
+	float lo_in_max_batt = 0.0;
+	if (v_in > (d->batt.start - 0.1)) {
+		lo_in_max_batt = d->in_current_max;
+	} else if (v_in < (d->batt.end + 0.1)) {
+		lo_in_max_batt = 0.0;
+	} else {
+		lo_in_max_batt = ramp_eval(&d->batt, v_in);
+	}
+
+	// Regen overvoltage cutoff
+	float lo_in_min_batt = 0.0;
+	if (v_in < (d->batt_regen.start + 0.1)) {
+		lo_in_min_batt = d->in_current_min;
+	} else if (v_in > (d->batt_regen.end - 0.1)) {
+		lo_in_min_batt = 0.0;
+	} else {
+		lo_in_min_batt = ramp_eval(&d->batt_regen, v_in);
+	}
+
+	// Wattage limits
+	const float v_in_inv = 1.0 / v_in;
+	const float lo_in_max_watt = d->watt_max * v_in_inv;
+	const float lo_in_min_watt = d->watt_min * v_in_inv;
+
+	res->in_current_max = utils_min_abs(lo_in_max_watt, lo_in_max_batt);
+	res->in_current_min = utils_min_abs(lo_in_min_watt, lo_in_min_batt);
+}
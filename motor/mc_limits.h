@@ -0,0 +1,76 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef MC_LIMITS_H_
+#define MC_LIMITS_H_
+
+#include "datatypes.h"
+
+/*
+ * Linear ramp from out_start at start to the end value at end. The slope is
+ * precomputed so that evaluating it does not need a division.
+ */
+typedef struct {
+	float start;
+	float end;
+	float out_start;
+	float slope;
+} mc_limits_ramp;
+
+/*
+ * Values derived from the motor configuration that are used every time the
+ * override limits are updated. Rebuild with mc_limits_update_derived whenever
+ * the configuration changes.
+ */
+typedef struct {
+	float current_min_tmp;
+	float current_max_tmp;
+	float cc_min_current;
+	float in_current_min;
+	float in_current_max;
+	float watt_min;
+	float watt_max;
+	bool duty_enabled;
+	mc_limits_ramp temp_fet;
+	mc_limits_ramp temp_motor;
+	mc_limits_ramp temp_fet_accel;
+	mc_limits_ramp temp_motor_accel;
+	mc_limits_ramp rpm_pos;
+	mc_limits_ramp rpm_neg;
+	mc_limits_ramp curr_dec;
+	mc_limits_ramp duty;
+	mc_limits_ramp batt;
+	mc_limits_ramp batt_regen;
+} mc_limits_derived;
+
+typedef struct {
+	float current_min;
+	float current_max;
+	float in_current_min; // Before applying BMS limits
+	float in_current_max; // Before applying BMS limits
+	bool fet_over_temp;
+	bool motor_over_temp;
+} mc_limits_result;
+
+// Functions
+void mc_limits_update_derived(mc_limits_derived *d, const volatile mc_configuration *conf);
+void mc_limits_calc(const mc_limits_derived *d, float temp_fet, float temp_motor,
+		float rpm, float duty_abs, float v_in, mc_limits_result *res);
+
+#endif /* MC_LIMITS_H_ */
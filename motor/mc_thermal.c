@@ -0,0 +1,261 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "mc_thermal.h"
+#include <string.h>
+#include <math.h>
+
+// Defaults for a motor of around 1 kg. With a sensor the scales are adapted,
+// without one they can be set to fit the motor.
+#define DEFAULT_CAP_W			150.0
+#define DEFAULT_CAP_S			300.0
+#define DEFAULT_CAP_H			400.0
+#define DEFAULT_RES_WS			0.1
+#define DEFAULT_RES_SH			0.3
+#define DEFAULT_RES_HA			0.8
+
+// Largest change of the logarithm of a scale in one adaptation step
+#define ADAPT_STEP_MAX			0.02
+
+void mc_thermal_init(mc_thermal *m, float res_base, float temp_base, float temp_start) {
+	memset(m, 0, sizeof(mc_thermal));
+
+	m->cap_w = DEFAULT_CAP_W;
+	m->cap_s = DEFAULT_CAP_S;
+	m->cap_h = DEFAULT_CAP_H;
+	m->res_ws = DEFAULT_RES_WS;
+	m->res_sh = DEFAULT_RES_SH;
+	m->res_ha = DEFAULT_RES_HA;
+	m->res_base = res_base;
+	m->temp_base = temp_base;
+
+	m->scale_res = 1.0;
+	m->scale_cap = 1.0;
+	m->cov[0] = MC_THERMAL_ADAPT_COV_MAX;
+	m->cov[3] = MC_THERMAL_ADAPT_COV_MAX;
+
+	m->temp_w = temp_start;
+	m->temp_s = temp_start;
+	m->temp_h = temp_start;
+	m->temp_amb = temp_start;
+}
+
+/**
+ * Copper losses of the motor.
+ *
+ * @param i_sq
+ * id^2 + iq^2
+ *
+ * @param res_est
+ * Estimated phase resistance, or 0 to derive it from the winding
+ * temperature of the model.
+ *
+ * @return
+ * The losses in W.
+ */
+float mc_thermal_losses(const mc_thermal *m, float i_sq, float res_est) {
+	float res = res_est;
+	if (res <= 0.0) {
+		res = m->res_base * (1.0 + MC_THERMAL_TEMP_COEFF * (m->temp_w - m->temp_base));
+	}
+
+	return 1.5 * i_sq * res;
+}
+
+static float limit_step(float x) {
+	if (x > ADAPT_STEP_MAX) {
+		return ADAPT_STEP_MAX;
+	} else if (x < -ADAPT_STEP_MAX) {
+		return -ADAPT_STEP_MAX;
+	}
+	return x;
+}
+
+static void truncate_scale(float *scale) {
+	if (*scale < MC_THERMAL_SCALE_MIN) {
+		*scale = MC_THERMAL_SCALE_MIN;
+	} else if (*scale > MC_THERMAL_SCALE_MAX) {
+		*scale = MC_THERMAL_SCALE_MAX;
+	}
+}
+
+static void step(mc_thermal *m, float power, float dt, bool update_sens) {
+	const float cw = 1.0 / (m->cap_w * m->scale_cap);
+	const float cs = 1.0 / (m->cap_s * m->scale_cap);
+	const float ch = 1.0 / (m->cap_h * m->scale_cap);
+	const float g_ws = 1.0 / m->res_ws;
+	const float g_sh = 1.0 / m->res_sh;
+	const float g_ha = 1.0 / (m->res_ha * m->scale_res);
+
+	const float q_ws = (m->temp_w - m->temp_s) * g_ws;
+	const float q_sh = (m->temp_s - m->temp_h) * g_sh;
+	const float q_ha = (m->temp_h - m->temp_amb) * g_ha;
+
+	const float dw = (power - q_ws) * cw;
+	const float ds = (q_ws - q_sh) * cs;
+	const float dh = (q_sh - q_ha) * ch;
+
+	if (update_sens) {
+		// Sensitivity equations, obtained by differentiating the node
+		// equations with respect to the logarithm of each scale
+		float *r = m->sens_r;
+		float *c = m->sens_c;
+
+		const float r_w = -(r[0] - r[1]) * g_ws * cw;
+		const float r_s = ((r[0] - r[1]) * g_ws - (r[1] - r[2]) * g_sh) * cs;
+		const float r_h = ((r[1] - r[2]) * g_sh - r[2] * g_ha + q_ha) * ch;
+
+		const float c_w = -(c[0] - c[1]) * g_ws * cw - dw;
+		const float c_s = ((c[0] - c[1]) * g_ws - (c[1] - c[2]) * g_sh) * cs - ds;
+		const float c_h = ((c[1] - c[2]) * g_sh - c[2] * g_ha) * ch - dh;
+
+		r[0] += r_w * dt;
+		r[1] += r_s * dt;
+		r[2] += r_h * dt;
+		c[0] += c_w * dt;
+		c[1] += c_s * dt;
+		c[2] += c_h * dt;
+	}
+
+	m->temp_w += dw * dt;
+	m->temp_s += ds * dt;
+	m->temp_h += dh * dt;
+}
+
+/**
+ * Advance the model.
+ *
+ * @param power
+ * Losses in the winding, see mc_thermal_losses.
+ *
+ * @param dt
+ * Time step in seconds, must be well below the winding time constant.
+ */
+void mc_thermal_update(mc_thermal *m, float power, float dt) {
+	m->power = power;
+	step(m, power, dt, true);
+}
+
+/**
+ * Scale the parameters towards a better match with a measured winding
+ * temperature. This is recursive least squares on the sensitivities of the
+ * winding temperature to the logarithm of the scales, run every
+ * MC_THERMAL_ADAPT_PERIOD and forgetting over MC_THERMAL_ADAPT_MEMORY. Call
+ * after mc_thermal_update.
+ */
+void mc_thermal_adapt(mc_thermal *m, float temp_meas, float dt) {
+	m->adapt_time += dt;
+	if (m->adapt_time < MC_THERMAL_ADAPT_PERIOD) {
+		return;
+	}
+	m->adapt_time = 0.0;
+
+	const float err = temp_meas - m->temp_w;
+	const float f0 = m->sens_r[0];
+	const float f1 = m->sens_c[0];
+
+	// P * phi
+	const float pf0 = m->cov[0] * f0 + m->cov[1] * f1;
+	const float pf1 = m->cov[2] * f0 + m->cov[3] * f1;
+	const float den = MC_THERMAL_ADAPT_NOISE + f0 * pf0 + f1 * pf1;
+	const float k0 = pf0 / den;
+	const float k1 = pf1 / den;
+
+	m->scale_res *= expf(limit_step(k0 * err));
+	m->scale_cap *= expf(limit_step(k1 * err));
+	truncate_scale(&m->scale_res);
+	truncate_scale(&m->scale_cap);
+
+	// P = (P - K * phi' * P) / lambda, with phi' * P = (P * phi)' as P is symmetric
+	const float lambda = 1.0 - MC_THERMAL_ADAPT_PERIOD / MC_THERMAL_ADAPT_MEMORY;
+	float c0 = (m->cov[0] - k0 * pf0) / lambda;
+	float c1 = (m->cov[1] - k0 * pf1) / lambda;
+	float c3 = (m->cov[3] - k1 * pf1) / lambda;
+
+	// Without excitation the covariance grows, which would make the next
+	// update jump
+	if (c0 > MC_THERMAL_ADAPT_COV_MAX) {
+		c1 *= MC_THERMAL_ADAPT_COV_MAX / c0;
+		c0 = MC_THERMAL_ADAPT_COV_MAX;
+	}
+	if (c3 > MC_THERMAL_ADAPT_COV_MAX) {
+		c1 *= MC_THERMAL_ADAPT_COV_MAX / c3;
+		c3 = MC_THERMAL_ADAPT_COV_MAX;
+	}
+
+	m->cov[0] = c0;
+	m->cov[1] = c1;
+	m->cov[2] = c1;
+	m->cov[3] = c3;
+}
+
+/**
+ * Predict how long the winding can take the given losses.
+ *
+ * @param temp_limit
+ * Winding temperature limit.
+ *
+ * @param horizon
+ * Longest time to simulate.
+ *
+ * @return
+ * Seconds until the winding reaches temp_limit, 0 if it is above it already
+ * and horizon if it does not reach it within the horizon.
+ */
+float mc_thermal_time_to_limit(const mc_thermal *m, float power, float temp_limit, float horizon) {
+	if (m->temp_w >= temp_limit) {
+		return 0.0;
+	}
+
+	mc_thermal tmp = *m;
+	float prev = tmp.temp_w;
+
+	// Keep the step well inside the stability limit of the fastest node
+	const float cw = 1.0 / (m->cap_w * m->scale_cap);
+	const float cs = 1.0 / (m->cap_s * m->scale_cap);
+	const float ch = 1.0 / (m->cap_h * m->scale_cap);
+	float rate = 2.0 * cw / m->res_ws;
+	float rate_s = 2.0 * cs * (1.0 / m->res_ws + 1.0 / m->res_sh);
+	float rate_h = ch * (2.0 / m->res_sh + 1.0 / (m->res_ha * m->scale_res));
+	if (rate_s > rate) {
+		rate = rate_s;
+	}
+	if (rate_h > rate) {
+		rate = rate_h;
+	}
+
+	float dt = MC_THERMAL_PREDICT_STEP;
+	if (dt * rate > 1.0) {
+		dt = 1.0 / rate;
+	}
+
+	for (float t = 0.0;t < horizon;t += dt) {
+		step(&tmp, power, dt, false);
+
+		if (tmp.temp_w >= temp_limit) {
+			// Interpolate within the step
+			float frac = (temp_limit - prev) / (tmp.temp_w - prev);
+			return t + frac * dt;
+		}
+
+		prev = tmp.temp_w;
+	}
+
+	return horizon;
+}
@@ -0,0 +1,80 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef MC_THERMAL_H_
+#define MC_THERMAL_H_
+
+#include <stdbool.h>
+
+// Settings
+#define MC_THERMAL_TEMP_COEFF		0.00386 // Copper resistance change per °C
+#define MC_THERMAL_SCALE_MIN		0.25
+#define MC_THERMAL_SCALE_MAX		4.0
+#define MC_THERMAL_PREDICT_STEP		1.0 // Time step for the time to limit prediction
+#define MC_THERMAL_ADAPT_PERIOD		0.1 // Time between parameter updates
+#define MC_THERMAL_ADAPT_MEMORY		1800.0 // Time constant for forgetting old measurements
+#define MC_THERMAL_ADAPT_NOISE		1.0 // Variance of the sensor in K^2
+#define MC_THERMAL_ADAPT_COV_MAX	0.05
+
+/*
+ * Lumped thermal model of the motor with three nodes: the winding is heated
+ * by the copper losses and conducts to the stator, the stator to the housing
+ * and the housing to the ambient. When a sensor is available the resistance
+ * to ambient and the heat capacities are scaled online until the winding
+ * temperature matches the measurement.
+ */
+typedef struct {
+	// Parameters
+	float cap_w; // Heat capacity in J/K
+	float cap_s;
+	float cap_h;
+	float res_ws; // Thermal resistance in K/W
+	float res_sh;
+	float res_ha;
+	float res_base; // Phase resistance in ohm at temp_base
+	float temp_base;
+
+	// Adapted parameters
+	float scale_res; // Scales res_ha
+	float scale_cap; // Scales all heat capacities
+
+	// State
+	float temp_w;
+	float temp_s;
+	float temp_h;
+	float temp_amb;
+	float power;
+
+	// Sensitivity of the node temperatures to log(scale_res) and log(scale_cap)
+	float sens_r[3];
+	float sens_c[3];
+
+	// Adaptation
+	float cov[4]; // 2x2 covariance of log(scale_res) and log(scale_cap)
+	float adapt_time;
+} mc_thermal;
+
+// Functions
+void mc_thermal_init(mc_thermal *m, float res_base, float temp_base, float temp_start);
+float mc_thermal_losses(const mc_thermal *m, float i_sq, float res_est);
+void mc_thermal_update(mc_thermal *m, float power, float dt);
+void mc_thermal_adapt(mc_thermal *m, float temp_meas, float dt);
+float mc_thermal_time_to_limit(const mc_thermal *m, float power, float temp_limit, float horizon);
+
+#endif /* MC_THERMAL_H_ */
@@ -41,6 +41,7 @@
 #include <stdio.h>
 #include "virtual_motor.h"
 #include "foc_math.h"
+#include "foc_hooks.h"
 
 // Private variables
 static volatile bool m_dccal_done = false;
@@ -629,6 +630,10 @@ void mcpwm_foc_set_configuration(mc_configuration *configuration) {
 		m_motor_2.m_state = MC_STATE_OFF;
 		stop_pwm_hw((motor_all_state_t*)&m_motor_2);
 
+		// The switching frequency is shared, so the control loop period of the other motor changed too
+		foc_precalc_values((motor_all_state_t*)&m_motor_1);
+		foc_precalc_values((motor_all_state_t*)&m_motor_2);
+
 		timer_reinit((int)configuration->foc_f_zv);
 #else
 		get_motor_now()->m_control_mode = CONTROL_MODE_NONE;
@@ -2751,16 +2756,7 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 	float ib = ADC_curr_norm_value[1 + norm_curr_ofs] * FAC_CURRENT;
 //	float ic = -(ia + ib);
 
-#ifdef HW_HAS_PHASE_SHUNTS
-	float dt;
-	if (conf_now->foc_sample_v0_v7) {
-		dt = 1.0 / conf_now->foc_f_zv;
-	} else {
-		dt = 1.0 / (conf_now->foc_f_zv / 2.0);
-	}
-#else
-	float dt = 1.0 / (conf_now->foc_f_zv / 2.0);
-#endif
+	const float dt = motor_now->p_dt;
 
 	// This has to be done for the skip function to have any chance at working with the
 	// observer and control loops.
@@ -3083,6 +3079,10 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 		id_set_tmp -= motor_now->m_i_fw_set;
 		iq_set_tmp -= SIGN(mod_q) * motor_now->m_i_fw_set * conf_now->foc_fw_q_current_factor;
 
+		// Hooks from native libraries can override the references, the limits below still apply
+		foc_hooks_run(FOC_HOOK_PRE_CURRENT, m_isr_motor, &motor_now->m_motor_state,
+				dt, &id_set_tmp, &iq_set_tmp);
+
 		// Apply current limits
 		// TODO: Consider D axis current for the input current as well.
 		if (mod_q > 0.001) {
@@ -3105,6 +3105,8 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 		motor_now->m_motor_state.iq_target = iq_set_tmp;
 
 		control_current(motor_now, dt);
+
+		foc_hooks_run(FOC_HOOK_POST_CURRENT, m_isr_motor, &motor_now->m_motor_state, dt, 0, 0);
 	} else {
 		// Motor is not running
 
@@ -3304,16 +3306,16 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 		motor_now->m_pos_pid_now = angle_now;
 	} else {
 		if (angle_now < 90.0 && motor_now->m_pid_div_angle_last > 270.0) {
-			motor_now->m_pid_div_angle_accumulator += 360.0 / conf_now->p_pid_ang_div;
+			motor_now->m_pid_div_angle_accumulator += 360.0 * motor_now->p_pid_ang_div_inv;
 			utils_norm_angle((float*)&motor_now->m_pid_div_angle_accumulator);
 		} else if (angle_now > 270.0 && motor_now->m_pid_div_angle_last < 90.0) {
-			motor_now->m_pid_div_angle_accumulator -= 360.0 / conf_now->p_pid_ang_div;
+			motor_now->m_pid_div_angle_accumulator -= 360.0 * motor_now->p_pid_ang_div_inv;
 			utils_norm_angle((float*)&motor_now->m_pid_div_angle_accumulator);
 		}
 
 		motor_now->m_pid_div_angle_last = angle_now;
 
-		motor_now->m_pos_pid_now = motor_now->m_pid_div_angle_accumulator + angle_now / conf_now->p_pid_ang_div;
+		motor_now->m_pos_pid_now = motor_now->m_pid_div_angle_accumulator + angle_now * motor_now->p_pid_ang_div_inv;
 		utils_norm_angle((float*)&motor_now->m_pos_pid_now);
 	}
 
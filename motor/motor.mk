@@ -1,7 +1,12 @@
 CSRC += \
+	motor/foc_hooks.c \
 	motor/foc_math.c \
+	motor/gpd_stream.c \
 	motor/gpdrive.c \
 	motor/mc_interface.c \
+	motor/mc_latency.c \
+	motor/mc_limits.c \
+	motor/mc_thermal.c \
 	motor/mcpwm.c \
 	motor/mcpwm_foc.c \
 	motor/virtual_motor.c
@@ -36,6 +36,7 @@
 #include "mempools.h"
 #include "crc.h"
 #include "firmware_metadata.h"
+#include "mc_latency.h"
 
 #include <string.h>
 #include <ctype.h>
@@ -1130,6 +1131,44 @@ void terminal_process_string(char *str) {
 	} else if (strcmp(argv[0], "rebootwdt") == 0) {
 		chSysLock();
 		for (;;) {__NOP();}
+	} else if (strcmp(argv[0], "latency") == 0) {
+		for (int i = 0;i < MC_LATENCY_SRC_NUM;i++) {
+			mc_latency_hist h;
+			mc_latency_get_hist(i, &h);
+
+			if (h.count == 0) {
+				continue;
+			}
+
+			commands_printf("%-5s n: %u, avg: %u us, p50: %u us, p99: %u us, max: %u us",
+					mc_latency_src_name(i), (unsigned int)h.count,
+					(unsigned int)(h.sum_us / h.count),
+					(unsigned int)mc_latency_percentile_us(&h, 0.5),
+					(unsigned int)mc_latency_percentile_us(&h, 0.99),
+					(unsigned int)h.max_us);
+		}
+
+		if (argc == 2 && strcmp(argv[1], "reset") == 0) {
+			mc_latency_reset();
+			commands_printf("Latency histograms reset");
+		}
+
+		commands_printf(" ");
+	} else if (strcmp(argv[0], "can_rx") == 0) {
+		for (int i = 1;i <= 2;i++) {
+			can_rx_stats stats;
+			comm_can_get_rx_stats(i, &stats);
+
+			if (stats.received == 0 && stats.hw_overruns == 0) {
+				continue;
+			}
+
+			commands_printf("CAN%d received: %u, dropped: %u, FIFO overruns: %u, filter banks: %d",
+					i, (unsigned int)stats.received, (unsigned int)stats.dropped,
+					(unsigned int)stats.hw_overruns, stats.filters);
+		}
+
+		commands_printf(" ");
 	}
 
 	// The help command
@@ -1248,6 +1287,12 @@ void terminal_process_string(char *str) {
 		commands_printf("rebootwdt");
 		commands_printf("  Reboot using the watchdog timer.");
 
+		commands_printf("latency [reset]");
+		commands_printf("  Print the time from command arrival until the control loop uses it, per source.");
+
+		commands_printf("can_rx");
+		commands_printf("  Print CAN receive counters and the number of hardware filter banks in use.");
+
 		for (int i = 0;i < callback_write;i++) {
 			if (callbacks[i].cbf == 0) {
 				continue;
@@ -0,0 +1,92 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/*
+ * The parts of the ChibiOS API that bm_pipe.c uses, implemented with
+ * pthreads so that it can run on the host.
+ */
+
+#ifndef CH_H_
+#define CH_H_
+
+#include <pthread.h>
+#include <stddef.h>
+
+typedef struct {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int cnt;
+} semaphore_t;
+
+#define NORMALPRIO							64
+#define THD_WORKING_AREA(name, size)		char name[size]
+#define THD_FUNCTION(name, arg)				void name(void *arg)
+
+static inline void chSemObjectInit(semaphore_t *sp, int n) {
+	pthread_mutex_init(&sp->mutex, NULL);
+	pthread_cond_init(&sp->cond, NULL);
+	sp->cnt = n;
+}
+
+static inline void chSemWait(semaphore_t *sp) {
+	pthread_mutex_lock(&sp->mutex);
+	while (sp->cnt <= 0) {
+		pthread_cond_wait(&sp->cond, &sp->mutex);
+	}
+	sp->cnt--;
+	pthread_mutex_unlock(&sp->mutex);
+}
+
+static inline void chSemSignal(semaphore_t *sp) {
+	pthread_mutex_lock(&sp->mutex);
+	sp->cnt++;
+	pthread_cond_signal(&sp->cond);
+	pthread_mutex_unlock(&sp->mutex);
+}
+
+typedef struct {
+	void (*func)(void *arg);
+	void *arg;
+} ch_thd_start_t;
+
+static inline void *ch_thd_start(void *p) {
+	ch_thd_start_t *s = (ch_thd_start_t*)p;
+	s->func(s->arg);
+	return NULL;
+}
+
+static inline void *chThdCreateStatic(void *wsp, size_t size, int prio,
+		void (*func)(void *arg), void *arg) {
+	(void)size; (void)prio;
+	// The working area is not used as stack on the host, keep the start
+	// arguments in it instead.
+	ch_thd_start_t *s = (ch_thd_start_t*)wsp;
+	s->func = func;
+	s->arg = arg;
+	pthread_t thd;
+	pthread_create(&thd, NULL, ch_thd_start, s);
+	pthread_detach(thd);
+	return wsp;
+}
+
+static inline void chRegSetThreadName(const char *name) {
+	(void)name;
+}
+
+#endif /* CH_H_ */
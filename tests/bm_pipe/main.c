@@ -0,0 +1,200 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/*
+ * Programs a simulated target through the SWD write pipeline the way
+ * COMM_BM_WRITE_FLASH_LZO does, checks the result and the error handling,
+ * and compares the throughput with writing every chunk before receiving
+ * the next one.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "bm_pipe.h"
+#include "minilzo.h"
+#include "test_check.h"
+
+#define FLASH_SIZE			(64 * 1024)
+#define CHUNK_SIZE			384		// Uncompressed data per packet, as sent by VESC Tool
+#define SWD_NS_PER_BYTE		4000	// Around 250 kB/s over bit-banged SWD including flash time
+#define RX_NS_PER_CHUNK		1000000	// Time until the next packet arrives after the reply
+
+typedef struct {
+	uint32_t addr;
+	uint32_t len;
+	uint32_t decompressed_len;
+	uint8_t data[CHUNK_SIZE + CHUNK_SIZE / 16 + 64 + 3];
+} packet_t;
+
+static uint8_t m_image[FLASH_SIZE];
+static uint8_t m_flash[FLASH_SIZE];
+static packet_t m_packets[FLASH_SIZE / CHUNK_SIZE + 1];
+static int m_packet_num = 0;
+static uint32_t m_fail_addr = 0xFFFFFFFF;
+
+static void sleep_ns(long ns) {
+	struct timespec ts = {ns / 1000000000L, ns % 1000000000L};
+	nanosleep(&ts, NULL);
+}
+
+static double now_s(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static int target_write(uint32_t addr, const void *data, uint32_t len) {
+	sleep_ns((long)len * SWD_NS_PER_BYTE);
+
+	if (addr + len > FLASH_SIZE || (m_fail_addr >= addr && m_fail_addr < addr + len)) {
+		return -1;
+	}
+
+	memcpy(m_flash + addr, data, len);
+	return 0;
+}
+
+static void make_image(void) {
+	// Something that compresses like firmware: repeated instruction patterns
+	// with varying constants
+	uint32_t seed = 1234;
+	for (int i = 0;i < FLASH_SIZE;i += 4) {
+		seed = seed * 1103515245 + 12345;
+		uint32_t word = (seed >> 16) % 4 == 0 ? seed : 0x4770BF00u + (uint32_t)((i / 64) & 0xFF);
+		memcpy(m_image + i, &word, 4);
+	}
+
+	static lzo_align_t wrkmem[(LZO1X_1_MEM_COMPRESS + sizeof(lzo_align_t) - 1) / sizeof(lzo_align_t)];
+	size_t compressed = 0;
+
+	for (uint32_t addr = 0;addr < FLASH_SIZE;addr += CHUNK_SIZE) {
+		packet_t *p = &m_packets[m_packet_num++];
+		p->addr = addr;
+		p->decompressed_len = FLASH_SIZE - addr < CHUNK_SIZE ? FLASH_SIZE - addr : CHUNK_SIZE;
+		lzo_uint len = 0;
+		lzo1x_1_compress(m_image + addr, p->decompressed_len, p->data, &len, wrkmem);
+		p->len = len;
+		compressed += len;
+	}
+
+	printf("Image: %d bytes in %d packets, %zu bytes compressed\n",
+			FLASH_SIZE, m_packet_num, compressed);
+}
+
+// Receive and write every chunk before the next one, like before the pipeline
+static double program_sequential(void) {
+	memset(m_flash, 0xFF, sizeof(m_flash));
+	double start = now_s();
+
+	for (int i = 0;i < m_packet_num;i++) {
+		packet_t *p = &m_packets[i];
+		uint8_t buffer[BM_PIPE_CHUNK_SIZE];
+		lzo_uint len = sizeof(buffer);
+
+		sleep_ns(RX_NS_PER_CHUNK);
+		lzo1x_decompress_safe(p->data, p->len, buffer, &len, NULL);
+		target_write(p->addr, buffer, len);
+	}
+
+	return now_s() - start;
+}
+
+static double program_pipelined(int *res_out) {
+	memset(m_flash, 0xFF, sizeof(m_flash));
+	double start = now_s();
+	int res = 1;
+
+	bm_pipe_reset();
+
+	for (int i = 0;i < m_packet_num && res > 0;i++) {
+		packet_t *p = &m_packets[i];
+		sleep_ns(RX_NS_PER_CHUNK);
+		res = bm_pipe_write_lzo(p->addr, p->data, p->len, p->decompressed_len);
+	}
+
+	if (res > 0) {
+		res = bm_pipe_flush();
+	}
+
+	*res_out = res;
+	return now_s() - start;
+}
+
+static void test_errors(void) {
+	uint8_t data[BM_PIPE_CHUNK_SIZE + 1];
+	memset(data, 0xAA, sizeof(data));
+
+	bm_pipe_reset();
+	CHECK(bm_pipe_write(0, data, sizeof(data)) == -3, "too large chunk accepted");
+	CHECK(bm_pipe_write_lzo(0, data, 16, BM_PIPE_CHUNK_SIZE + 1) == -3, "too large lzo chunk accepted");
+	CHECK(bm_pipe_write_lzo(0, data, 16, 16) == -3, "corrupt lzo data accepted");
+
+	// The pipeline must still work after rejecting chunks
+	CHECK(bm_pipe_write(0, data, 16) == 1, "write after rejected chunk failed");
+	CHECK(bm_pipe_flush() == 1, "flush after rejected chunk failed");
+
+	// A failed write is reported by a later call and stays until reset
+	m_fail_addr = 1000;
+	CHECK(bm_pipe_write(1000, data, 16) == 1, "the failing write should only be queued");
+	CHECK(bm_pipe_flush() == -2, "failed write not reported by flush");
+	CHECK(bm_pipe_write(2000, data, 16) == -2, "write accepted after failure");
+	CHECK(bm_pipe_flush() == -2, "failure forgotten");
+	m_fail_addr = 0xFFFFFFFF;
+	bm_pipe_reset();
+	CHECK(bm_pipe_write(2000, data, 16) == 1, "reset did not clear failure");
+	CHECK(bm_pipe_flush() == 1, "flush after reset failed");
+
+	// Failure in the middle of an image
+	m_fail_addr = FLASH_SIZE / 2;
+	int res;
+	program_pipelined(&res);
+	CHECK(res == -2, "failure in image not reported (%d)", res);
+	m_fail_addr = 0xFFFFFFFF;
+}
+
+int main(void) {
+	if (lzo_init() != LZO_E_OK) {
+		printf("LZO init failed\n");
+		return 1;
+	}
+
+	bm_pipe_init(target_write);
+	make_image();
+
+	test_errors();
+
+	double t_seq = program_sequential();
+	CHECK(memcmp(m_flash, m_image, FLASH_SIZE) == 0, "sequential image mismatch");
+
+	int res;
+	double t_pipe = program_pipelined(&res);
+	CHECK(res == 1, "pipelined programming failed (%d)", res);
+	CHECK(memcmp(m_flash, m_image, FLASH_SIZE) == 0, "pipelined image mismatch");
+	CHECK(t_pipe < t_seq, "pipeline is not faster");
+
+	printf("Sequential: %.2f s, %.1f kB/s\n", t_seq, FLASH_SIZE / t_seq / 1024.0);
+	printf("Pipelined : %.2f s, %.1f kB/s (%.2fx)\n", t_pipe, FLASH_SIZE / t_pipe / 1024.0, t_seq / t_pipe);
+
+	return test_check_result();
+}
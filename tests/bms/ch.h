@@ -0,0 +1,58 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/*
+ * The parts of ChibiOS that bms.c uses. The system time is set by the test.
+ */
+
+#ifndef CH_H_
+#define CH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CH_CFG_ST_FREQUENCY		10000
+#define LOWPRIO					2
+
+typedef uint32_t systime_t;
+typedef struct { int dummy; } thread_t;
+typedef struct { int locked; } mutex_t;
+typedef void (*tfunc_t)(void *arg);
+
+#define THD_WORKING_AREA(s, n)	uint8_t s[n]
+#define THD_FUNCTION(tname, arg)	void tname(void *arg)
+
+extern systime_t test_time_now;
+
+static inline systime_t chVTGetSystemTimeX(void) {
+	return test_time_now;
+}
+
+static inline systime_t chVTTimeElapsedSinceX(systime_t start) {
+	return test_time_now - start;
+}
+
+void chMtxObjectInit(mutex_t *mp);
+void chMtxLock(mutex_t *mp);
+void chMtxUnlock(mutex_t *mp);
+void chRegSetThreadName(const char *name);
+void chThdSleepMilliseconds(uint32_t ms);
+thread_t *chThdCreateStatic(void *wsp, uint32_t size, int prio, tfunc_t pf, void *arg);
+
+#endif /* CH_H_ */
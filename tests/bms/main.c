@@ -0,0 +1,173 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/*
+ * Feeds status frames from more BMSs than the pack table holds into bms.c
+ * and checks that the limits still follow the hottest and the emptiest pack.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "bms.h"
+#include "buffer.h"
+#include "test_check.h"
+
+systime_t test_time_now = 1;
+
+static int m_mtx_errors = 0;
+
+void chMtxObjectInit(mutex_t *mp) {
+	mp->locked = 0;
+}
+
+void chMtxLock(mutex_t *mp) {
+	if (mp->locked) {
+		m_mtx_errors++;
+	}
+	mp->locked = 1;
+}
+
+void chMtxUnlock(mutex_t *mp) {
+	if (!mp->locked) {
+		m_mtx_errors++;
+	}
+	mp->locked = 0;
+}
+
+void chRegSetThreadName(const char *name) {
+	(void)name;
+}
+
+void chThdSleepMilliseconds(uint32_t ms) {
+	(void)ms;
+}
+
+thread_t *chThdCreateStatic(void *wsp, uint32_t size, int prio, tfunc_t pf, void *arg) {
+	(void)wsp; (void)size; (void)prio; (void)pf; (void)arg;
+	return 0;
+}
+
+void comm_can_transmit_eid(uint32_t id, const uint8_t *data, uint8_t len) {
+	(void)id; (void)data; (void)len;
+}
+
+void comm_can_send_buffer(uint8_t controller_id, uint8_t *data, unsigned int len, uint8_t send) {
+	(void)controller_id; (void)data; (void)len; (void)send;
+}
+
+void comm_usb_send_packet(unsigned char *data, unsigned int len) {
+	(void)data; (void)len;
+}
+
+void commands_send_packet(unsigned char *data, unsigned int len) {
+	(void)data; (void)len;
+}
+
+const app_configuration* app_get_configuration(void) {
+	static app_configuration conf;
+	return &conf;
+}
+
+static void advance_s(float s) {
+	test_time_now += (systime_t)(s * (float)CH_CFG_ST_FREQUENCY);
+}
+
+// CAN_PACKET_BMS_SOC_SOH_TEMP_STAT as the VESC BMS sends it
+static void send_stat(uint8_t id, float soc, int8_t temp) {
+	uint8_t data[8];
+	int32_t ind = 0;
+	buffer_append_float16(data, 3.6, 1e3, &ind);
+	buffer_append_float16(data, 3.7, 1e3, &ind);
+	data[ind++] = (uint8_t)(soc * 255.0);
+	data[ind++] = 255;
+	data[ind++] = (uint8_t)temp;
+	data[ind++] = 0;
+
+	uint32_t eid = id | ((uint32_t)CAN_PACKET_BMS_SOC_SOH_TEMP_STAT << 8);
+	CHECK(bms_process_can_frame(eid, data, ind, true), "frame from %d not used", id);
+}
+
+static bool close_to(float a, float b) {
+	return a > b - 0.01 && a < b + 0.01;
+}
+
+int main(void) {
+	bms_config conf;
+	memset(&conf, 0, sizeof(conf));
+	conf.type = BMS_TYPE_VESC;
+	conf.limit_mode = 3;
+	conf.t_limit_start = 45.0;
+	conf.t_limit_end = 65.0;
+	conf.soc_limit_start = 0.2;
+	conf.soc_limit_end = 0.1;
+	conf.fwd_can_mode = BMS_FWD_CAN_MODE_DISABLED;
+	bms_init(&conf);
+
+	// Six BMSs, the last ones to report are the hottest and the emptiest
+	for (int rep = 0;rep < 3;rep++) {
+		for (int id = 10;id < 16;id++) {
+			send_stat(id, id == 14 ? 0.05 : 0.8, id == 15 ? 70 : 25);
+		}
+		advance_s(0.1);
+	}
+
+	bms_stats stats;
+	bms_get_stats(&stats);
+	CHECK(stats.pack_num == 4, "%d packs", stats.pack_num);
+	CHECK(close_to(stats.t_cell_max, 70.0), "t_cell_max %g", (double)stats.t_cell_max);
+	CHECK(close_to(stats.soc_min, 0.05), "soc_min %g", (double)stats.soc_min);
+	CHECK(close_to(stats.soc_max, 0.8), "soc_max %g", (double)stats.soc_max);
+
+	float i_min = -50.0, i_max = 50.0;
+	bms_update_limits(&i_min, &i_max, -50.0, 50.0);
+	CHECK(i_min == 0.0 && i_max == 0.0, "limits %g %g", (double)i_min, (double)i_max);
+
+	// Once the hot BMS cools down the others limit again
+	send_stat(15, 0.8, 50);
+	bms_get_stats(&stats);
+	CHECK(close_to(stats.t_cell_max, 50.0), "t_cell_max %g after cooling", (double)stats.t_cell_max);
+
+	i_min = -50.0;
+	i_max = 50.0;
+	send_stat(14, 0.8, 25);
+	bms_update_limits(&i_min, &i_max, -50.0, 50.0);
+	CHECK(close_to(i_max, 37.5) && close_to(i_min, -37.5), "limits %g %g", (double)i_min, (double)i_max);
+
+	// Everything times out
+	advance_s(3.0);
+	bms_get_stats(&stats);
+	CHECK(stats.pack_num == 0, "%d packs after timeout", stats.pack_num);
+
+	i_min = -50.0;
+	i_max = 50.0;
+	bms_update_limits(&i_min, &i_max, -50.0, 50.0);
+	CHECK(i_min == -50.0 && i_max == 50.0, "limits %g %g after timeout", (double)i_min, (double)i_max);
+
+	// A new BMS takes over a slot of the timed out ones
+	send_stat(20, 0.5, 30);
+	bms_get_stats(&stats);
+	CHECK(stats.pack_num == 1, "%d packs after new BMS", stats.pack_num);
+	CHECK(close_to(stats.t_cell_max, 30.0), "t_cell_max %g", (double)stats.t_cell_max);
+	CHECK(close_to(stats.soc_min, 0.5), "soc_min %g", (double)stats.soc_min);
+
+	CHECK(m_mtx_errors == 0, "%d unbalanced mutex operations", m_mtx_errors);
+
+	return test_check_result();
+}
@@ -0,0 +1,190 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/*
+ * Packs a simulated bus burst into bridge batches the way the CAN process
+ * thread does, unpacks it again the way COMM_CAN_FWD_FRAMES does and compares
+ * the result and the link overhead with forwarding every frame in its own
+ * COMM_CAN_FWD_FRAME packet.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "comm_can_bridge.h"
+#include "test_check.h"
+
+#define FRAME_NUM			2000
+#define PACKET_OVERHEAD		5 // Start, length, CRC and stop bytes of a short packet
+
+typedef struct {
+	uint32_t id;
+	bool is_ext;
+	uint8_t data[8];
+	int len;
+	uint32_t dt_us;
+} frame_t;
+
+static frame_t m_frames[FRAME_NUM];
+static frame_t m_decoded[FRAME_NUM];
+static int m_decoded_num = 0;
+
+static void frame_func(uint32_t id, bool is_ext, const uint8_t *data, int len, uint32_t dt_us, void *arg) {
+	(void)arg;
+
+	if (m_decoded_num >= FRAME_NUM) {
+		m_decoded_num++;
+		return;
+	}
+
+	frame_t *f = &m_decoded[m_decoded_num++];
+	f->id = id;
+	f->is_ext = is_ext;
+	memcpy(f->data, data, len);
+	f->len = len;
+	f->dt_us = dt_us;
+}
+
+static void make_frames(void) {
+	srand(1234);
+
+	for (int i = 0;i < FRAME_NUM;i++) {
+		frame_t *f = &m_frames[i];
+		f->is_ext = rand() % 4 != 0;
+		f->id = f->is_ext ? (uint32_t)rand() & 0x1FFFFFFF : (uint32_t)rand() & 0x7FF;
+		f->len = rand() % 9;
+		for (int j = 0;j < f->len;j++) {
+			f->data[j] = rand();
+		}
+		// Mostly back to back at 1 Mbit/s, with a few idle gaps
+		f->dt_us = rand() % 50 == 0 ? 100000 : 50 + rand() % 100;
+	}
+}
+
+static bool frame_equal(const frame_t *a, const frame_t *b) {
+	uint32_t dt = a->dt_us > CAN_BRIDGE_DT_MAX ? CAN_BRIDGE_DT_MAX : a->dt_us;
+	return a->id == b->id && a->is_ext == b->is_ext && a->len == b->len &&
+			memcmp(a->data, b->data, a->len) == 0 && dt == b->dt_us;
+}
+
+static void test_round_trip(void) {
+	static can_bridge_batch b;
+	comm_can_bridge_reset(&b);
+	m_decoded_num = 0;
+
+	int packets = 0;
+	long bytes_batched = 0;
+	long bytes_single = 0;
+
+	for (int i = 0;i < FRAME_NUM;i++) {
+		frame_t *f = &m_frames[i];
+		bytes_single += 6 + f->len + PACKET_OVERHEAD;
+
+		if (!comm_can_bridge_add(&b, f->id, f->is_ext, f->data, f->len, f->dt_us)) {
+			CHECK(b.frames > 0, "empty batch rejected a frame");
+			int res = comm_can_bridge_decode(b.data, b.len, frame_func, 0);
+			CHECK(res == b.frames, "decoded %d of %d frames", res, b.frames);
+			bytes_batched += 1 + b.len + PACKET_OVERHEAD;
+			packets++;
+
+			comm_can_bridge_reset(&b);
+			CHECK(comm_can_bridge_add(&b, f->id, f->is_ext, f->data, f->len, f->dt_us),
+					"frame rejected by empty batch");
+		}
+	}
+
+	if (b.frames > 0) {
+		comm_can_bridge_decode(b.data, b.len, frame_func, 0);
+		bytes_batched += 1 + b.len + PACKET_OVERHEAD;
+		packets++;
+	}
+
+	CHECK(m_decoded_num == FRAME_NUM, "decoded %d frames, expected %d", m_decoded_num, FRAME_NUM);
+	for (int i = 0;i < FRAME_NUM && i < m_decoded_num;i++) {
+		if (!frame_equal(&m_frames[i], &m_decoded[i])) {
+			CHECK(false, "frame %d differs", i);
+			break;
+		}
+	}
+
+	CHECK(bytes_batched < bytes_single, "batching does not save bytes");
+
+	printf("Single   : %d packets, %ld bytes\n", FRAME_NUM, bytes_single);
+	printf("Batched  : %d packets, %ld bytes (%.1f frames per packet, %.2fx less data)\n",
+			packets, bytes_batched, (double)FRAME_NUM / packets, (double)bytes_single / bytes_batched);
+}
+
+static void test_malformed(void) {
+	can_bridge_batch b;
+	uint8_t data[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+
+	comm_can_bridge_reset(&b);
+	comm_can_bridge_add(&b, 0x123, false, data, 8, 10);
+	comm_can_bridge_add(&b, 0x1ABCDEF, true, data, 3, 20);
+
+	m_decoded_num = 0;
+	CHECK(comm_can_bridge_decode(b.data, b.len, frame_func, 0) == 2, "valid batch rejected");
+	CHECK(comm_can_bridge_decode(b.data, 0, frame_func, 0) == 0, "empty batch not empty");
+
+	// Truncated batches must not send anything
+	for (int len = 1;len < b.len;len++) {
+		if (len == 13) {
+			continue; // Boundary between the frames
+		}
+
+		m_decoded_num = 0;
+		CHECK(comm_can_bridge_decode(b.data, len, frame_func, 0) == -1,
+				"truncated batch of %d bytes accepted", len);
+		CHECK(m_decoded_num == 0, "truncated batch sent frames");
+	}
+
+	b.data[0] = 9;
+	m_decoded_num = 0;
+	CHECK(comm_can_bridge_decode(b.data, b.len, frame_func, 0) == -1, "dlc above 8 accepted");
+	CHECK(m_decoded_num == 0, "corrupt batch sent frames");
+
+	// Clamping and saturation
+	comm_can_bridge_reset(&b);
+	uint8_t long_data[12] = {0};
+	comm_can_bridge_add(&b, 0xFFFFFFFF, true, long_data, 12, 1000000);
+	m_decoded_num = 0;
+	comm_can_bridge_decode(b.data, b.len, frame_func, 0);
+	CHECK(m_decoded[0].len == 8, "length not clamped");
+	CHECK(m_decoded[0].id == 0x1FFFFFFF, "EID not masked");
+	CHECK(m_decoded[0].dt_us == CAN_BRIDGE_DT_MAX, "time not saturated");
+
+	// Filling a batch
+	comm_can_bridge_reset(&b);
+	int added = 0;
+	while (comm_can_bridge_add(&b, 1, true, data, 8, 0)) {
+		added++;
+	}
+	CHECK(added == CAN_BRIDGE_BATCH_SIZE / 15, "%d frames fit in a batch", added);
+	CHECK(b.len <= CAN_BRIDGE_BATCH_SIZE, "batch overflow");
+}
+
+int main(void) {
+	make_frames();
+	test_malformed();
+	test_round_trip();
+
+	return test_check_result();
+}
@@ -0,0 +1,58 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/*
+ * The CAN frame type and constants from the ChibiOS HAL that comm_can_rx.c
+ * uses.
+ */
+
+#ifndef HAL_H_
+#define HAL_H_
+
+#include <stdint.h>
+
+#define CAN_IDE_STD		0
+#define CAN_IDE_EXT		1
+
+typedef struct {
+	struct {
+		uint8_t FMI;
+		uint16_t TIME;
+	};
+	struct {
+		uint8_t DLC:4;
+		uint8_t RTR:1;
+		uint8_t IDE:1;
+	};
+	union {
+		struct {
+			uint32_t SID:11;
+		};
+		struct {
+			uint32_t EID:29;
+		};
+	};
+	union {
+		uint8_t data8[8];
+		uint16_t data16[4];
+		uint32_t data32[2];
+	};
+} CANRxFrame;
+
+#endif /* HAL_H_ */
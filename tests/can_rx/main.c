@@ -0,0 +1,266 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/*
+ * Tests the CAN receive ring with a simulated controller thread that
+ * produces bursts of frames through the acceptance filters while a consumer
+ * thread takes them, and checks that the merged filters accept every frame
+ * the node consumes.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "comm_can_rx.h"
+#include "test_check.h"
+
+#define SIM_FRAMES		200000
+#define OWN_ID			5
+
+static uint32_t m_seed = 1;
+
+static uint32_t rand_u32(void) {
+	m_seed = m_seed * 1103515245 + 12345;
+	return m_seed >> 8;
+}
+
+static void make_eid(CANRxFrame *f, uint32_t eid) {
+	memset(f, 0, sizeof(*f));
+	f->IDE = CAN_IDE_EXT;
+	f->EID = eid;
+	f->DLC = 8;
+}
+
+static void make_sid(CANRxFrame *f, uint32_t sid) {
+	memset(f, 0, sizeof(*f));
+	f->IDE = CAN_IDE_STD;
+	f->SID = sid;
+	f->DLC = 8;
+}
+
+static void test_ring(void) {
+	static can_rx_ring r;
+	comm_can_rx_ring_init(&r);
+
+	CANRxFrame f, out;
+	uint32_t time;
+
+	CHECK(!comm_can_rx_ring_pop(&r, &out, &time), "pop from empty ring");
+
+	for (int i = 0;i < CAN_RX_RING_SIZE + 10;i++) {
+		make_eid(&f, i);
+		bool ok = comm_can_rx_ring_push(&r, &f, 1000 + i);
+		CHECK(ok == (i < CAN_RX_RING_SIZE), "push %d returned %d", i, ok);
+	}
+
+	CHECK(comm_can_rx_ring_count(&r) == CAN_RX_RING_SIZE, "count %d", comm_can_rx_ring_count(&r));
+	CHECK(r.received == CAN_RX_RING_SIZE + 10 && r.dropped == 10,
+			"received %u dropped %u", r.received, r.dropped);
+
+	for (int i = 0;i < CAN_RX_RING_SIZE;i++) {
+		CHECK(comm_can_rx_ring_pop(&r, &out, &time), "pop %d failed", i);
+		CHECK(out.EID == (uint32_t)i && time == (uint32_t)(1000 + i),
+				"pop %d got frame %u time %u", i, out.EID, time);
+	}
+
+	CHECK(!comm_can_rx_ring_pop(&r, &out, 0), "ring not empty");
+
+	// Wrapping of the indexes
+	r.head = r.tail = 0xFFFFFFF0;
+	for (int i = 0;i < 40;i++) {
+		make_eid(&f, i);
+		comm_can_rx_ring_push(&r, &f, 0);
+		CHECK(comm_can_rx_ring_pop(&r, &out, 0) && out.EID == (uint32_t)i, "wrap %d", i);
+	}
+}
+
+static bool consumed_by_node(const can_rx_filter_key *key, uint32_t eid) {
+	uint8_t id = eid & 0xFF;
+	CAN_PACKET_ID cmd = eid >> 8;
+
+	return id == key->id1 || id == key->id2 || id == 255 ||
+			comm_can_rx_is_status_packet(cmd) ||
+			(key->bms && comm_can_rx_is_bms_packet(cmd));
+}
+
+static void test_filters(void) {
+	// The totals were once missing from the filters while the BMS decoded them
+	CHECK(comm_can_rx_is_bms_packet(CAN_PACKET_BMS_AH_WH_CHG_TOTAL), "charge totals not in BMS packets");
+	CHECK(comm_can_rx_is_bms_packet(CAN_PACKET_BMS_AH_WH_DIS_TOTAL), "discharge totals not in BMS packets");
+
+	for (int bms = 0;bms < 2;bms++) {
+		for (int sid = 0;sid < 2;sid++) {
+			can_rx_filter_key key = {false, sid, bms, OWN_ID, OWN_ID + 1};
+			can_rx_filter filters[CAN_RX_FILTER_MAX];
+			int num = comm_can_rx_filter_build(filters, &key);
+
+			CHECK(num > 0 && num <= CAN_RX_FILTER_MAX, "%d filters", num);
+
+			int consumed = 0;
+			int irrelevant = 0;
+			int irrelevant_rejected = 0;
+			CANRxFrame f;
+
+			// Every packet type the node decodes, from every sender
+			for (uint32_t cmd = 0;cmd < 256;cmd++) {
+				for (uint32_t id = 0;id < 256;id++) {
+					make_eid(&f, (cmd << 8) | id);
+					bool want = consumed_by_node(&key, f.EID);
+					bool pass = comm_can_rx_filter_match(filters, num, &f);
+
+					CHECK(!want || pass, "bms %d sid %d: consumed frame 0x%X rejected", bms, sid, f.EID);
+					consumed += want;
+
+					if (!want) {
+						irrelevant++;
+						irrelevant_rejected += !pass;
+					}
+				}
+			}
+
+			// Other protocols on the bus use the upper identifier bits
+			make_eid(&f, (1 << 20) | (9 << 8) | 3);
+			CHECK(!comm_can_rx_filter_match(filters, num, &f), "foreign extended frame accepted");
+
+			make_sid(&f, 0x123);
+			CHECK(comm_can_rx_filter_match(filters, num, &f) == (sid != 0), "standard frame filtering");
+
+			CHECK(irrelevant_rejected > irrelevant * 7 / 10, "only %d of %d irrelevant frames rejected",
+					irrelevant_rejected, irrelevant);
+
+			printf("Filters (bms %d, sid %d): %d banks, %d consumed, %d of %d irrelevant rejected\n",
+					bms, sid, num, consumed, irrelevant_rejected, irrelevant);
+		}
+	}
+
+	can_rx_filter_key key_all = {true, true, false, OWN_ID, OWN_ID};
+	can_rx_filter filters[CAN_RX_FILTER_MAX];
+	CHECK(comm_can_rx_filter_build(filters, &key_all) == 0, "accept all built filters");
+	CHECK(comm_can_rx_filter_match(filters, 0, &(CANRxFrame){0}), "empty filter list must accept all");
+}
+
+/*
+ * Simulated controller. Frames arrive in bursts, pass the acceptance filters
+ * and are put in the ring by the read thread, with a sequence number in the
+ * data so that the consumer can check the order.
+ */
+static can_rx_ring m_ring;
+static can_rx_filter m_filters[CAN_RX_FILTER_MAX];
+static int m_filter_num;
+static volatile bool m_producer_done = false;
+static volatile int m_consumer_delay_ns = 0;
+static uint32_t m_accepted = 0;
+
+static void sleep_ns(long ns) {
+	struct timespec ts = {ns / 1000000000L, ns % 1000000000L};
+	nanosleep(&ts, NULL);
+}
+
+static void *producer(void *arg) {
+	(void)arg;
+	uint32_t seq = 0;
+
+	for (int i = 0;i < SIM_FRAMES;) {
+		int burst = 1 + rand_u32() % 40;
+
+		for (int j = 0;j < burst && i < SIM_FRAMES;j++, i++) {
+			CANRxFrame f;
+			make_eid(&f, ((rand_u32() % 70) << 8) | (rand_u32() % 256));
+
+			if (!comm_can_rx_filter_match(m_filters, m_filter_num, &f)) {
+				continue;
+			}
+
+			m_accepted++;
+			f.data32[0] = seq++;
+			comm_can_rx_ring_push(&m_ring, &f, i);
+		}
+
+		// Starve the consumer in the middle to get overflows
+		m_consumer_delay_ns = (i > SIM_FRAMES / 2 && i < SIM_FRAMES * 3 / 4) ? 5000000 : 0;
+		sleep_ns(20000);
+	}
+
+	m_producer_done = true;
+	return NULL;
+}
+
+static void test_threads(void) {
+	can_rx_filter_key key = {false, false, false, OWN_ID, OWN_ID};
+	m_filter_num = comm_can_rx_filter_build(m_filters, &key);
+	comm_can_rx_ring_init(&m_ring);
+
+	pthread_t thd;
+	pthread_create(&thd, NULL, producer, NULL);
+
+	uint32_t consumed = 0;
+	uint32_t last_seq = 0;
+	bool first = true;
+	bool order_ok = true;
+	int wakeups = 0;
+
+	for (;;) {
+		bool done = m_producer_done;
+		CANRxFrame f;
+		int batch = 0;
+
+		while (comm_can_rx_ring_pop(&m_ring, &f, 0)) {
+			if (!first && f.data32[0] <= last_seq) {
+				order_ok = false;
+			}
+
+			first = false;
+			last_seq = f.data32[0];
+			consumed++;
+			batch++;
+		}
+
+		if (batch > 0) {
+			wakeups++;
+		}
+
+		if (done && comm_can_rx_ring_count(&m_ring) == 0) {
+			break;
+		}
+
+		sleep_ns(10000 + m_consumer_delay_ns);
+	}
+
+	pthread_join(thd, NULL);
+
+	CHECK(order_ok, "frames out of order");
+	CHECK(m_ring.received == m_accepted, "received %u, accepted %u", m_ring.received, m_accepted);
+	CHECK(consumed + m_ring.dropped == m_accepted, "consumed %u + dropped %u != accepted %u",
+			consumed, m_ring.dropped, m_accepted);
+	CHECK(m_ring.dropped > 0, "the slow consumer phase did not overflow the ring");
+
+	printf("Simulation: %d frames on the bus, %u accepted, %u consumed in %d batches, %u dropped\n",
+			SIM_FRAMES, m_accepted, consumed, wakeups, m_ring.dropped);
+}
+
+int main(void) {
+	test_ring();
+	test_filters();
+	test_threads();
+
+	return test_check_result();
+}
@@ -0,0 +1,231 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/*
+ * Runs the flux linkage averaging against a simulated motor in open loop
+ * with measurement noise and cogging ripple, and checks that stopping at
+ * convergence gives the same estimate as the full fixed-length average in
+ * a fraction of the time. Then commissions a simulated bus of VESCs whose
+ * results arrive out of order.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "detect.h"
+#include "test_check.h"
+
+#define SAMPLES_MAX		10000	// The fixed-length average in conf_general
+#define SAMPLE_RATE		10000.0	// chThdSleep(1) at CH_CFG_ST_FREQUENCY
+
+static uint32_t m_seed = 1;
+
+static float rand_normal(void) {
+	// Sum of uniform numbers, close enough to normal here
+	float sum = 0.0;
+	for (int i = 0;i < 12;i++) {
+		m_seed = m_seed * 1103515245 + 12345;
+		sum += (float)((m_seed >> 8) & 0xFFFF) / 65536.0;
+	}
+	return sum - 6.0;
+}
+
+typedef struct {
+	float r;
+	float l;
+	float lambda;
+	float erpm;
+	float current;
+	float v_noise;
+	float i_noise;
+	float ripple;
+} motor_t;
+
+static float motor_sample(const motor_t *m, int n, float *v_mag, float *i_mag) {
+	float rad_s = m->erpm / 60.0 * 2.0 * M_PI;
+	float t = (float)n / SAMPLE_RATE;
+
+	// Cogging gives a ripple on the back-EMF at six times the electrical frequency. The
+	// inductive drop is lumped in the same way as in the linkage formula.
+	float emf = (m->lambda * (1.0 + m->ripple * sinf(6.0 * rad_s * t)) + m->l * m->current) * rad_s;
+
+	*i_mag = m->current + m->i_noise * rand_normal();
+	*v_mag = emf + m->r * m->current + m->v_noise * rand_normal();
+
+	return rad_s;
+}
+
+static int measure_linkage(const motor_t *m, bool early_stop, float *linkage) {
+	detect_avg avg;
+	detect_avg_init(&avg, 2000, 0.002);
+
+	double v_sum = 0.0, i_sum = 0.0;
+	float rad_s = 0.0;
+	int n = 0;
+
+	for (n = 0;n < SAMPLES_MAX;n++) {
+		float v_mag, i_mag;
+		rad_s = motor_sample(m, n, &v_mag, &i_mag);
+		v_sum += v_mag;
+		i_sum += i_mag;
+
+		detect_avg_add(&avg, (v_mag - m->r * i_mag) / rad_s - i_mag * m->l);
+		if (early_stop && detect_avg_converged(&avg)) {
+			n++;
+			break;
+		}
+	}
+
+	float v_avg = v_sum / n;
+	float i_avg = i_sum / n;
+	*linkage = (v_avg - m->r * i_avg) / rad_s - i_avg * m->l;
+
+	float diff = fabsf(detect_avg_mean(&avg) - *linkage);
+	CHECK(diff < 1e-3 * m->lambda, "running mean differs from the sums by %g", diff);
+
+	return n;
+}
+
+static void test_avg(void) {
+	detect_avg a;
+	detect_avg_init(&a, 10, 0.01);
+	CHECK(!detect_avg_converged(&a), "empty average converged");
+	CHECK(isinf(detect_avg_std_err(&a)), "std err of empty average");
+
+	for (int i = 0;i < 9;i++) {
+		detect_avg_add(&a, 5.0);
+	}
+	CHECK(!detect_avg_converged(&a), "converged before min_samples");
+	detect_avg_add(&a, 5.0);
+	CHECK(detect_avg_converged(&a), "constant input not converged");
+	CHECK(fabsf(detect_avg_mean(&a) - 5.0f) < 1e-6, "mean of constant");
+
+	// Large offset with small spread, where the naive sum of squares fails in floats
+	detect_avg_init(&a, 2, 0.0);
+	double sum = 0.0, sum_sq = 0.0;
+	int n = 20000;
+	for (int i = 0;i < n;i++) {
+		float x = 1000.0 + 0.01 * rand_normal();
+		detect_avg_add(&a, x);
+		sum += x;
+		sum_sq += (double)x * x;
+	}
+	double mean = sum / n;
+	double std_err = sqrt((sum_sq / n - mean * mean) * n / (n - 1) / n);
+	CHECK(fabs(detect_avg_mean(&a) - mean) < 1e-3, "mean %g vs %g", detect_avg_mean(&a), mean);
+	CHECK(fabs(detect_avg_std_err(&a) - std_err) < 0.05 * std_err,
+			"std err %g vs %g", detect_avg_std_err(&a), std_err);
+}
+
+static void test_linkage(void) {
+	const motor_t motors[] = {
+		// Small outrunner
+		{0.05, 30e-6, 5e-3, 18000, 8.0, 0.3, 0.3, 0.02},
+		// Hub motor at low speed
+		{0.12, 250e-6, 25e-3, 3000, 12.0, 0.4, 0.5, 0.05},
+		// Noisy measurement
+		{0.02, 15e-6, 3e-3, 12000, 20.0, 1.0, 1.0, 0.02},
+	};
+
+	for (unsigned int i = 0;i < sizeof(motors) / sizeof(motors[0]);i++) {
+		const motor_t *m = &motors[i];
+		float l_full, l_early;
+		int n_full = measure_linkage(m, false, &l_full);
+		int n_early = measure_linkage(m, true, &l_early);
+
+		float err_full = fabsf(l_full - m->lambda) / m->lambda;
+		float err_early = fabsf(l_early - m->lambda) / m->lambda;
+
+		printf("Motor %d: full %d samples %.3f %% error, early stop %d samples %.3f %% error\n",
+				i, n_full, err_full * 100.0, n_early, err_early * 100.0);
+
+		CHECK(n_full == SAMPLES_MAX, "full average stopped early");
+		CHECK(err_early < 0.01, "motor %d: early stop error %.3f %%", i, err_early * 100.0);
+		CHECK(fabsf(l_early - l_full) / m->lambda < 0.01, "motor %d: early and full differ", i);
+	}
+
+	// A quiet motor must stop at the minimum and a very noisy one must not stop at all
+	motor_t quiet = {0.05, 30e-6, 5e-3, 18000, 8.0, 0.01, 0.01, 0.0};
+	motor_t noisy = {0.05, 30e-6, 5e-3, 6000, 8.0, 5.0, 5.0, 0.0};
+	float l;
+	CHECK(measure_linkage(&quiet, true, &l) == 2000, "quiet motor did not stop at min_samples");
+	CHECK(measure_linkage(&noisy, true, &l) == SAMPLES_MAX, "noisy motor stopped early");
+}
+
+static void test_nodes(void) {
+	detect_nodes d;
+	detect_nodes_init(&d);
+	CHECK(detect_nodes_finished(&d), "no nodes is finished");
+
+	const uint8_t ids[] = {12, 13, 40, 41};
+	for (int i = 0;i < 4;i++) {
+		CHECK(detect_nodes_add(&d, ids[i]), "add failed");
+	}
+	CHECK(!detect_nodes_finished(&d), "finished before any result");
+
+	// Results arrive in the order the detections finish
+	CHECK(detect_nodes_report(&d, 40, 1) == 2, "wrong node for id 40");
+	CHECK(detect_nodes_report(&d, 40, 1) == -1, "second result for id 40 accepted");
+	CHECK(detect_nodes_report(&d, 99, 1) == -1, "result for unknown id accepted");
+	CHECK(detect_nodes_report(&d, 12, 0) == 0, "wrong node for id 12");
+
+	// Older firmware without the sender ID takes the first pending node
+	CHECK(detect_nodes_report(&d, -1, 2) == 1, "result without id not matched");
+	CHECK(!detect_nodes_finished(&d), "finished with a node pending");
+	CHECK(detect_nodes_report(&d, 41, 1) == 3, "wrong node for id 41");
+	CHECK(detect_nodes_finished(&d), "not finished after all results");
+	CHECK(d.done_num == 4 && d.failed_num == 0, "wrong counts");
+
+	// A dual controller gets the command on both of its IDs and answers each one
+	// with the ID it was addressed to
+	detect_nodes_init(&d);
+	detect_nodes_add(&d, 20);
+	detect_nodes_add(&d, 21);
+	detect_nodes_add(&d, 30);
+	CHECK(detect_nodes_report(&d, 21, 1) == 1, "second motor of dual controller not matched");
+	CHECK(detect_nodes_report(&d, 30, 1) == 2, "single controller not matched");
+	CHECK(!detect_nodes_finished(&d), "finished with the first dual motor pending");
+	CHECK(detect_nodes_report(&d, 20, 1) == 0, "first motor of dual controller not matched");
+	CHECK(detect_nodes_finished(&d) && d.failed_num == 0, "dual controller not finished");
+
+	// A failure finishes at once
+	detect_nodes_init(&d);
+	for (int i = 0;i < 4;i++) {
+		detect_nodes_add(&d, ids[i]);
+	}
+	detect_nodes_report(&d, 13, -10);
+	CHECK(detect_nodes_finished(&d), "not finished after a failure");
+	CHECK(d.failed_num == 1 && d.nodes[1].res == -10, "failure not recorded");
+
+	// Full table
+	detect_nodes_init(&d);
+	for (int i = 0;i < DETECT_NODES_MAX;i++) {
+		detect_nodes_add(&d, i);
+	}
+	CHECK(!detect_nodes_add(&d, 200), "added to full table");
+}
+
+int main(void) {
+	test_avg();
+	test_linkage();
+	test_nodes();
+
+	return test_check_result();
+}
@@ -0,0 +1,198 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/*
+ * Plays streamed samples through gpd_stream.c the way the general purpose
+ * drive does from its ADC interrupt, and checks the interpolation, the
+ * underrun handling and the flow control of the sample buffer.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "gpd_stream.h"
+#include "test_check.h"
+
+static gpd_stream m_stream;
+static gpd_sample_buffer m_buffer;
+
+static void start(int upsample, gpd_interpol interpol) {
+	memset(&m_buffer, 0, sizeof(m_buffer));
+	gpd_stream_start(&m_stream, upsample, interpol, 1.0, 0);
+}
+
+static void push(float sample) {
+	CHECK(gpd_sample_buffer_push(&m_buffer, sample), "sample %g dropped", (double)sample);
+}
+
+static gpd_stream_res update(float *out) {
+	return gpd_stream_update(&m_stream, &m_buffer, 1000.0, out);
+}
+
+static void test_interpolate(void) {
+	const float hist[4] = {1.0, -2.0, 3.0, 0.5};
+	const gpd_interpol modes[] = {GPD_INTERPOL_HOLD, GPD_INTERPOL_LINEAR, GPD_INTERPOL_CUBIC};
+
+	// Every interpolation starts the segment at hist[1]
+	for (int i = 0;i < 3;i++) {
+		CHECK(gpd_stream_interpolate(modes[i], hist, 0.0) == hist[1], "mode %d at t = 0", i);
+	}
+
+	// Linear and cubic end it at hist[2], so that consecutive segments join
+	CHECK(gpd_stream_interpolate(GPD_INTERPOL_LINEAR, hist, 1.0) == hist[2], "linear at t = 1");
+	CHECK(fabsf(gpd_stream_interpolate(GPD_INTERPOL_CUBIC, hist, 1.0) - hist[2]) < 1e-6, "cubic at t = 1");
+	CHECK(gpd_stream_interpolate(GPD_INTERPOL_HOLD, hist, 0.99) == hist[1], "hold at t = 0.99");
+	CHECK(gpd_stream_interpolate(GPD_INTERPOL_LINEAR, hist, 0.5) == 0.5, "linear at t = 0.5");
+
+	// Catmull-Rom reproduces straight lines
+	const float line[4] = {0.0, 1.0, 2.0, 3.0};
+	for (int k = 0;k <= 8;k++) {
+		float t = (float)k / 8.0;
+		float y = gpd_stream_interpolate(GPD_INTERPOL_CUBIC, line, t);
+		float expected = 1.0 + t;
+		CHECK(fabsf(y - expected) < 1e-6, "cubic line at t = %g: %g", (double)t, (double)y);
+	}
+
+	// Unknown modes hold
+	CHECK(gpd_stream_interpolate((gpd_interpol)7, hist, 0.5) == hist[1], "unknown mode");
+}
+
+static void test_ramp(gpd_interpol interpol) {
+	const int upsample = 4;
+	start(upsample, interpol);
+
+	float out = -1.0;
+	CHECK(update(&out) == GPD_STREAM_WAIT && out == -1.0, "output before the first sample");
+	CHECK(m_stream.underruns == 0, "underrun before the first sample");
+
+	for (int i = 0;i < 10;i++) {
+		push((float)i);
+	}
+
+	// The played segment lags the newest sample by two samples, after that
+	// the ramp is followed exactly. The cubic interpolation needs two more
+	// samples of the ramp before it is a straight line.
+	for (int n = 0;n < 8 * upsample;n++) {
+		CHECK(update(&out) == GPD_STREAM_OUTPUT, "period %d", n);
+		if (interpol == GPD_INTERPOL_CUBIC && n >= upsample && n < 3 * upsample) {
+			continue;
+		}
+
+		float expected = n < 2 * upsample ? 0.0 : (float)(n - 2 * upsample) / (float)upsample;
+		if (interpol == GPD_INTERPOL_HOLD) {
+			expected = floorf(expected);
+		}
+		CHECK(fabsf(out - expected) < 1e-5, "mode %d period %d: %g, expected %g",
+				interpol, n, (double)out, (double)expected);
+	}
+
+	CHECK(m_stream.played == 8, "%u played", (unsigned)m_stream.played);
+	CHECK(m_stream.underruns == 0, "%u underruns", (unsigned)m_stream.underruns);
+}
+
+static void test_underrun(void) {
+	start(2, GPD_INTERPOL_LINEAR);
+	push(1.0);
+	push(2.0);
+
+	float out;
+	int n = 0;
+	while (m_stream.underruns == 0 && n < 100) {
+		CHECK(update(&out) == GPD_STREAM_OUTPUT, "period %d", n);
+		n++;
+	}
+	CHECK(m_stream.played == 2, "%u played", (unsigned)m_stream.played);
+
+	// The output settles on the last sample while the buffer is empty
+	for (int i = 0;i < 8;i++) {
+		CHECK(update(&out) == GPD_STREAM_OUTPUT, "hold period %d", i);
+	}
+	CHECK(out == 2.0, "held %g", (double)out);
+	CHECK(m_stream.underruns == 5, "%u underruns", (unsigned)m_stream.underruns);
+
+	// New samples continue the stream
+	push(3.0);
+	for (int i = 0;i < 6;i++) {
+		update(&out);
+	}
+	CHECK(out == 3.0, "after refill %g", (double)out);
+	CHECK(m_stream.played == 3, "%u played after refill", (unsigned)m_stream.played);
+
+	// It stops when the buffer stays empty for too long after the last sample
+	start(2, GPD_INTERPOL_LINEAR);
+	push(1.0);
+	int hold = 0;
+	while (gpd_stream_update(&m_stream, &m_buffer, 20.0, &out) == GPD_STREAM_OUTPUT && hold < 100) {
+		hold++;
+	}
+	CHECK(hold == 20, "stopped after %d empty periods", hold);
+}
+
+static void test_drain(void) {
+	start(2, GPD_INTERPOL_HOLD);
+	push(1.0);
+	push(2.0);
+	m_stream.draining = true;
+
+	float out;
+	int n = 0;
+	while (update(&out) == GPD_STREAM_OUTPUT && n < 100) {
+		n++;
+	}
+	CHECK(n == 4, "drained after %d periods", n);
+	CHECK(m_stream.underruns == 0, "%u underruns while draining", (unsigned)m_stream.underruns);
+}
+
+static void test_buffer(void) {
+	start(1, GPD_INTERPOL_HOLD);
+	for (int i = 0;i < GPD_SAMPLE_BUFFER_SIZE - 1;i++) {
+		push((float)i);
+	}
+
+	CHECK(gpd_sample_buffer_fill(&m_buffer) == GPD_SAMPLE_BUFFER_SIZE - 1, "fill");
+	CHECK(!gpd_sample_buffer_push(&m_buffer, 0.0), "full buffer accepted a sample");
+	CHECK(gpd_sample_buffer_fill(&m_buffer) == GPD_SAMPLE_BUFFER_SIZE - 1, "fill after overrun");
+
+	// The unread samples are not overwritten
+	float out;
+	for (int i = 0;i < GPD_SAMPLE_BUFFER_SIZE - 1;i++) {
+		update(&out);
+	}
+	CHECK(m_stream.played == GPD_SAMPLE_BUFFER_SIZE - 1, "%u played", (unsigned)m_stream.played);
+	CHECK(gpd_sample_buffer_fill(&m_buffer) == 0, "fill after playing");
+
+	// Defaults for out of range arguments
+	gpd_stream_start(&m_stream, 0, GPD_INTERPOL_LINEAR, 1.0, GPD_SAMPLE_BUFFER_SIZE);
+	CHECK(m_stream.upsample == 1, "upsample %d", m_stream.upsample);
+	CHECK(m_stream.credit_block == GPD_SAMPLE_BUFFER_SIZE / 4, "credit block %d", m_stream.credit_block);
+	CHECK(m_stream.active && m_stream.report_now, "not active after start");
+}
+
+int main(void) {
+	test_interpolate();
+	test_ramp(GPD_INTERPOL_HOLD);
+	test_ramp(GPD_INTERPOL_LINEAR);
+	test_ramp(GPD_INTERPOL_CUBIC);
+	test_underrun();
+	test_drain();
+	test_buffer();
+
+	return test_check_result();
+}
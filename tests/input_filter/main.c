@@ -0,0 +1,124 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/*
+ * Checks the shared throttle input stages used by the PPM, ADC and PAS
+ * apps against the processing they did before.
+ */
+
+#include <stdio.h>
+#include <math.h>
+
+#include "input_filter.h"
+#include "utils_math.h"
+#include "test_check.h"
+
+#define NEAR(a, b) (fabs((double)(a) - (double)(b)) < 1e-5)
+
+static void test_curve(void) {
+	input_filter f = {0};
+	input_filter_configure(&f, 0.15, 0.5, -0.3, 0, 0.0, 0.0);
+
+	for (float v = -1.2;v <= 1.2;v += 0.01) {
+		float ref = v;
+		utils_deadband(&ref, 0.15, 1.0);
+		ref = utils_throttle_curve(ref, 0.5, -0.3, 0);
+		CHECK(NEAR(input_filter_curve(&f, v), ref), "curve mismatch at %.2f", (double)v);
+	}
+
+	CHECK(input_filter_curve(&f, 0.1) == 0.0, "deadband not applied");
+	CHECK(NEAR(input_filter_curve(&f, 1.0), 1.0), "full throttle not reached");
+	CHECK(NEAR(input_filter_curve(&f, -1.0), -1.0), "full brake not reached");
+}
+
+static void test_ramp(void) {
+	input_filter f = {0};
+	input_filter_configure(&f, 0.0, 0.0, 0.0, 0, 0.5, 0.1);
+	input_filter_reset(&f, 0.0);
+
+	// 0.5 s to full throttle in 10 ms steps
+	float out = 0.0;
+	int steps = 0;
+	while (out < 1.0 && steps < 1000) {
+		out = input_filter_ramp(&f, 1.0, 0.01);
+		steps++;
+	}
+	CHECK(steps >= 50 && steps <= 51, "positive ramp took %d steps", steps);
+
+	// 0.1 s back to zero
+	steps = 0;
+	while (out > 0.0 && steps < 1000) {
+		out = input_filter_ramp(&f, 0.0, 0.01);
+		steps++;
+	}
+	CHECK(steps >= 10 && steps <= 11, "negative ramp took %d steps", steps);
+
+	// Ramp only when accelerating. Releasing passes through, and pressing
+	// again must ramp from there instead of comparing with the value from
+	// before releasing.
+	input_filter_configure(&f, 0.0, 0.0, 0.0, 0, 0.5, 0.0);
+	input_filter_reset(&f, 1.0);
+	CHECK(input_filter_ramp(&f, 0.0, 0.01) == 0.0, "no pass through without ramp");
+	out = input_filter_ramp(&f, 0.5, 0.01);
+	CHECK(NEAR(out, 0.02), "pressing again gave %.3f", (double)out);
+
+	// A long gap, e.g. the first call, goes straight to the target
+	input_filter_configure(&f, 0.0, 0.0, 0.0, 0, 0.5, 0.5);
+	input_filter_reset(&f, 0.0);
+	CHECK(input_filter_ramp(&f, -1.0, 100.0) == -1.0, "long gap did not reach target");
+}
+
+static void test_run(void) {
+	input_filter f = {0};
+	input_filter_configure(&f, 0.1, 0.3, 0.3, 1, 0.2, 0.2);
+	input_filter_reset(&f, 0.0);
+
+	float out = 0.0;
+	for (int i = 0;i < 100;i++) {
+		out = input_filter_run(&f, 0.6, 0.01);
+	}
+
+	CHECK(NEAR(out, input_filter_curve(&f, 0.6)), "run did not settle at the curve output");
+}
+
+static void test_latency(void) {
+	input_latency l;
+	input_latency_reset(&l);
+
+	input_latency_add(&l, 200e-6);
+	CHECK(NEAR(l.avg, 200e-6), "first sample not used as average");
+
+	for (int i = 0;i < 1000;i++) {
+		input_latency_add(&l, i == 500 ? 2e-3 : 100e-6);
+	}
+
+	CHECK(l.samples == 1001, "wrong sample count %u", (unsigned int)l.samples);
+	CHECK(NEAR(l.last, 100e-6), "wrong last sample");
+	CHECK(NEAR(l.max, 2e-3), "wrong max");
+	CHECK(fabs((double)l.avg - 100e-6) < 5e-6, "average did not converge: %g", (double)l.avg);
+}
+
+int main(void) {
+	test_curve();
+	test_ramp();
+	test_run();
+	test_latency();
+
+	return test_check_result();
+}
@@ -0,0 +1,306 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/*
+ * Calls the dsp-* extensions from lispif_dsp_extensions.c the way the
+ * evaluator does and compares their output with direct reference
+ * implementations.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "lispbm.h"
+#include "lispif.h"
+#include "test_check.h"
+
+#define HEAP_SIZE				2048
+#define GC_STACK_SIZE			256
+#define PRINT_STACK_SIZE		256
+#define EXTENSION_STORAGE_SIZE	64
+
+static lbm_cons_t heap[HEAP_SIZE] __attribute__ ((aligned (8)));
+static lbm_uint gc_stack[GC_STACK_SIZE];
+static lbm_uint print_stack[PRINT_STACK_SIZE];
+static extension_fptr extension_storage[EXTENSION_STORAGE_SIZE];
+static lbm_uint memory[LBM_MEMORY_SIZE_16K];
+static lbm_uint bitmap[LBM_MEMORY_BITMAP_SIZE_16K];
+
+static uint32_t m_seed = 1;
+
+static float rand_range(float min, float max) {
+	m_seed = m_seed * 1103515245 + 12345;
+	return min + (max - min) * (float)((m_seed >> 8) & 0xFFFF) / 65535.0;
+}
+
+static lbm_value call(const char *name, lbm_value *args, lbm_uint argn) {
+	lbm_uint sym;
+	if (!lbm_get_symbol_by_name((char*)name, &sym)) {
+		return ENC_SYM_EERROR;
+	}
+
+	extension_fptr f = lbm_get_extension(sym);
+	if (!f) {
+		return ENC_SYM_EERROR;
+	}
+
+	return f(args, argn);
+}
+
+static float *f32_data(lbm_value v) {
+	return (float*)((lbm_array_header_t*)lbm_car(v))->data;
+}
+
+static lbm_value f32_array(const float *data, int len) {
+	lbm_value res;
+	if (!lbm_create_array(&res, len * sizeof(float))) {
+		return ENC_SYM_MERROR;
+	}
+
+	memcpy(f32_data(res), data, len * sizeof(float));
+	return res;
+}
+
+static bool f32_equal(const float *a, const float *b, int len, float tol) {
+	for (int i = 0;i < len;i++) {
+		if (fabsf(a[i] - b[i]) > tol) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void test_moving_avg(void) {
+	const float in[] = {1.0, 2.0, 3.0, 4.0, 5.0};
+	const int len = sizeof(in) / sizeof(in[0]);
+
+	// Window larger than the data averages everything seen so far
+	const float avg_all[] = {1.0, 1.5, 2.0, 2.5, 3.0};
+	lbm_value args[2] = {f32_array(in, len), lbm_enc_i(10)};
+	CHECK(call("dsp-moving-avg", args, 2) == ENC_SYM_TRUE, "");
+	CHECK(f32_equal(f32_data(args[0]), avg_all, len, 1e-6), "window > len");
+
+	// Window of 1 leaves the data unchanged
+	args[0] = f32_array(in, len);
+	args[1] = lbm_enc_i(1);
+	CHECK(call("dsp-moving-avg", args, 2) == ENC_SYM_TRUE, "");
+	CHECK(f32_equal(f32_data(args[0]), in, len, 0.0), "window 1");
+
+	// Window equal to the data length
+	args[0] = f32_array(in, len);
+	args[1] = lbm_enc_i(len);
+	CHECK(call("dsp-moving-avg", args, 2) == ENC_SYM_TRUE, "");
+	CHECK(f32_equal(f32_data(args[0]), avg_all, len, 1e-6), "window == len");
+
+	const float avg_2[] = {1.0, 1.5, 2.5, 3.5, 4.5};
+	args[0] = f32_array(in, len);
+	args[1] = lbm_enc_i(2);
+	CHECK(call("dsp-moving-avg", args, 2) == ENC_SYM_TRUE, "");
+	CHECK(f32_equal(f32_data(args[0]), avg_2, len, 1e-6), "window 2");
+
+	args[0] = f32_array(in, len);
+	args[1] = lbm_enc_i(0);
+	CHECK(call("dsp-moving-avg", args, 2) == ENC_SYM_EERROR, "window 0");
+
+	// Too short to hold a single sample
+	CHECK(lbm_create_array(&args[0], 2), "");
+	args[1] = lbm_enc_i(3);
+	CHECK(call("dsp-moving-avg", args, 2) == ENC_SYM_TRUE, "no samples");
+}
+
+static float ref_median(const float *data, int i, int n) {
+	float win[32];
+	int cnt = i + 1 < n ? i + 1 : n;
+	for (int k = 0;k < cnt;k++) {
+		win[k] = data[i - k];
+	}
+
+	for (int a = 0;a < cnt;a++) {
+		for (int b = a + 1;b < cnt;b++) {
+			if (win[b] < win[a]) {
+				float t = win[a];
+				win[a] = win[b];
+				win[b] = t;
+			}
+		}
+	}
+
+	return win[cnt / 2];
+}
+
+static void test_median(void) {
+	// A single spike is removed by a window of 3
+	const float spike[] = {1.0, 1.0, 9.0, 1.0, 1.0};
+	lbm_value args[2] = {f32_array(spike, 5), lbm_enc_i(3)};
+	CHECK(call("dsp-median", args, 2) == ENC_SYM_TRUE, "");
+	CHECK(f32_data(args[0])[2] == 1.0, "spike %g", (double)f32_data(args[0])[2]);
+
+	float in[64], ref[64];
+	for (int i = 0;i < 64;i++) {
+		in[i] = rand_range(-10.0, 10.0);
+	}
+
+	for (int n = 1;n <= 31;n++) {
+		for (int i = 0;i < 64;i++) {
+			ref[i] = ref_median(in, i, n);
+		}
+
+		args[0] = f32_array(in, 64);
+		args[1] = lbm_enc_i(n);
+		CHECK(call("dsp-median", args, 2) == ENC_SYM_TRUE, "");
+		CHECK(f32_equal(f32_data(args[0]), ref, 64, 0.0), "window %d", n);
+	}
+
+	args[0] = f32_array(in, 64);
+	args[1] = lbm_enc_i(32);
+	CHECK(call("dsp-median", args, 2) == ENC_SYM_EERROR, "window 32");
+}
+
+static void test_fir(void) {
+	lbm_value args[2] = {lbm_enc_float(0.1), lbm_enc_i(4)};
+	lbm_value taps_v = call("dsp-fir-lowpass-create", args, 2);
+	CHECK(lbm_is_array_r(taps_v), "create");
+	const float *taps = f32_data(taps_v);
+
+	// The impulse response is the taps
+	float in[40] = {0};
+	in[0] = 1.0;
+	args[0] = f32_array(in, 40);
+	args[1] = taps_v;
+	CHECK(call("dsp-fir", args, 2) == ENC_SYM_TRUE, "");
+	CHECK(f32_equal(f32_data(args[0]), taps, 16, 0.0), "impulse");
+	for (int i = 16;i < 40;i++) {
+		CHECK(f32_data(args[0])[i] == 0.0, "impulse tail %d", i);
+	}
+
+	float ref[40];
+	for (int i = 0;i < 40;i++) {
+		in[i] = rand_range(-1.0, 1.0);
+	}
+
+	for (int i = 0;i < 40;i++) {
+		ref[i] = 0.0;
+		for (int k = 0;k < 16 && k <= i;k++) {
+			ref[i] += taps[k] * in[i - k];
+		}
+	}
+
+	args[0] = f32_array(in, 40);
+	CHECK(call("dsp-fir", args, 2) == ENC_SYM_TRUE, "");
+	CHECK(f32_equal(f32_data(args[0]), ref, 40, 1e-6), "random");
+
+	args[1] = lbm_enc_i(7);
+	CHECK(call("dsp-fir-lowpass-create", args, 2) == ENC_SYM_EERROR, "bits 7");
+}
+
+static void test_biquad(void) {
+	float in[64];
+	for (int i = 0;i < 64;i++) {
+		in[i] = rand_range(-1.0, 1.0);
+	}
+
+	for (int hp = 0;hp < 2;hp++) {
+		lbm_value args[2] = {lbm_enc_float(0.05), hp ? ENC_SYM_TRUE : ENC_SYM_NIL};
+		lbm_value bq_whole = call("dsp-biquad-create", args, 2);
+		lbm_value bq_split = call("dsp-biquad-create", args, 2);
+		CHECK(lbm_is_array_rw(bq_whole) && lbm_is_array_rw(bq_split), "create");
+
+		lbm_value whole = f32_array(in, 64);
+		args[0] = bq_whole;
+		args[1] = whole;
+		CHECK(call("dsp-biquad-run", args, 2) == ENC_SYM_TRUE, "");
+
+		// Running the second half in another call continues from the state
+		// the first call left behind
+		lbm_value first = f32_array(in, 25);
+		lbm_value second = f32_array(in + 25, 39);
+		args[0] = bq_split;
+		args[1] = first;
+		CHECK(call("dsp-biquad-run", args, 2) == ENC_SYM_TRUE, "");
+		args[1] = second;
+		CHECK(call("dsp-biquad-run", args, 2) == ENC_SYM_TRUE, "");
+
+		CHECK(f32_equal(f32_data(first), f32_data(whole), 25, 0.0), "hp %d first", hp);
+		CHECK(f32_equal(f32_data(second), f32_data(whole) + 25, 39, 0.0), "hp %d second", hp);
+
+		// After a reset the filter starts over
+		CHECK(call("dsp-biquad-reset", args, 1) == ENC_SYM_TRUE, "");
+		lbm_value again = f32_array(in, 64);
+		args[1] = again;
+		CHECK(call("dsp-biquad-run", args, 2) == ENC_SYM_TRUE, "");
+		CHECK(f32_equal(f32_data(again), f32_data(whole), 64, 0.0), "hp %d reset", hp);
+	}
+
+	lbm_value args[1] = {lbm_enc_float(0.5)};
+	CHECK(call("dsp-biquad-create", args, 1) == ENC_SYM_EERROR, "fc 0.5");
+}
+
+static void test_fft(void) {
+	float re_in[64], im_in[64];
+	for (int i = 0;i < 64;i++) {
+		re_in[i] = rand_range(-1.0, 1.0);
+		im_in[i] = rand_range(-1.0, 1.0);
+	}
+
+	lbm_value args[3] = {f32_array(re_in, 64), f32_array(im_in, 64), ENC_SYM_TRUE};
+	CHECK(call("dsp-fft", args, 2) == ENC_SYM_TRUE, "");
+	CHECK(!f32_equal(f32_data(args[0]), re_in, 64, 1e-3), "forward changed nothing");
+	CHECK(call("dsp-fft", args, 3) == ENC_SYM_TRUE, "");
+	CHECK(f32_equal(f32_data(args[0]), re_in, 64, 1e-5), "round trip re");
+	CHECK(f32_equal(f32_data(args[1]), im_in, 64, 1e-5), "round trip im");
+
+	// A cosine at bin 5 ends up in bins 5 and 59
+	for (int i = 0;i < 64;i++) {
+		re_in[i] = cosf(2.0 * M_PI * 5.0 * (float)i / 64.0);
+		im_in[i] = 0.0;
+	}
+
+	args[0] = f32_array(re_in, 64);
+	args[1] = f32_array(im_in, 64);
+	CHECK(call("dsp-fft", args, 2) == ENC_SYM_TRUE, "");
+	for (int i = 0;i < 64;i++) {
+		float mag = hypotf(f32_data(args[0])[i], f32_data(args[1])[i]);
+		float expected = (i == 5 || i == 59) ? 32.0 : 0.0;
+		CHECK(fabsf(mag - expected) < 1e-3, "bin %d: %g", i, (double)mag);
+	}
+
+	args[0] = f32_array(re_in, 48);
+	args[1] = f32_array(im_in, 48);
+	CHECK(call("dsp-fft", args, 2) == ENC_SYM_EERROR, "length 48");
+}
+
+int main(void) {
+	if (!lbm_init(heap, HEAP_SIZE, gc_stack, GC_STACK_SIZE,
+			memory, LBM_MEMORY_SIZE_16K, bitmap, LBM_MEMORY_BITMAP_SIZE_16K,
+			print_stack, PRINT_STACK_SIZE, extension_storage, EXTENSION_STORAGE_SIZE)) {
+		printf("lbm_init failed\n");
+		return 1;
+	}
+
+	lispif_load_dsp_extensions();
+
+	test_moving_avg();
+	test_median();
+	test_fir();
+	test_biquad();
+	test_fft();
+
+	return test_check_result();
+}
@@ -0,0 +1,41 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/*
+ * The parts of the ChibiOS API that mc_latency.c uses. The test switches
+ * between threads by setting test_thread_now.
+ */
+
+#ifndef CH_H_
+#define CH_H_
+
+typedef struct {
+	int id;
+} thread_t;
+
+extern thread_t *test_thread_now;
+
+static inline thread_t *chThdGetSelfX(void) {
+	return test_thread_now;
+}
+
+static inline void chSysLock(void) {}
+static inline void chSysUnlock(void) {}
+
+#endif /* CH_H_ */
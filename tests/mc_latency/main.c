@@ -0,0 +1,220 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/*
+ * Runs commands from several simulated receive threads through the
+ * latency tags the way mc_interface and the control interrupt use them,
+ * with a fake microsecond timer, and checks the resulting histograms.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "ch.h"
+#include "timer.h"
+#include "mc_latency.h"
+#include "test_check.h"
+
+thread_t *test_thread_now = 0;
+
+static thread_t m_usb = {1};
+static thread_t m_can = {2};
+static thread_t m_lisp = {3};
+static thread_t m_other = {4};
+
+static uint32_t m_time_us = 0;
+
+// The setpoint tag in the motor state, as in mc_interface.c
+static bool m_pending = false;
+static mc_latency_src m_pending_src;
+static uint32_t m_pending_time;
+
+uint32_t timer_time_now(void) {
+	return m_time_us;
+}
+
+float timer_seconds_elapsed_since(uint32_t time) {
+	return (float)(m_time_us - time) * 1e-6;
+}
+
+static void set_setpoint(void) {
+	mc_latency_src src;
+	uint32_t time;
+
+	if (mc_latency_get_tag(&src, &time)) {
+		m_pending = false;
+		m_pending_src = src;
+		m_pending_time = time;
+		m_pending = true;
+	}
+}
+
+static void control_isr(void) {
+	if (m_pending) {
+		m_pending = false;
+		mc_latency_add(m_pending_src, m_pending_time);
+	}
+}
+
+// A command that arrives at rx and is processed at proc. The control loop
+// runs every 50 us.
+static void command(thread_t *thd, mc_latency_src src, uint32_t rx, uint32_t proc) {
+	test_thread_now = thd;
+	m_time_us = proc;
+	mc_latency_begin(src, rx);
+	set_setpoint();
+	mc_latency_end();
+	m_time_us = (proc / 50 + 1) * 50;
+	control_isr();
+}
+
+static void test_sources(void) {
+	mc_latency_reset();
+
+	// USB: 100 us until processed, then up to 50 us until the control loop
+	for (int i = 0;i < 100;i++) {
+		command(&m_usb, MC_LATENCY_SRC_USB, i * 1000, i * 1000 + 100);
+	}
+
+	// CAN: 2 ms queueing delay
+	for (int i = 0;i < 100;i++) {
+		command(&m_can, MC_LATENCY_SRC_CAN, 200000 + i * 1000, 200000 + i * 1000 + 2000);
+	}
+
+	mc_latency_hist h;
+	mc_latency_get_hist(MC_LATENCY_SRC_USB, &h);
+	CHECK(h.count == 100, "USB count %u", (unsigned int)h.count);
+	CHECK(h.max_us == 150, "USB max %u", (unsigned int)h.max_us);
+	CHECK(h.bins[7] == 100, "USB latencies not in the 128-255 us bin");
+	CHECK(mc_latency_percentile_us(&h, 0.99) == 150, "USB p99 %u",
+			(unsigned int)mc_latency_percentile_us(&h, 0.99));
+
+	mc_latency_get_hist(MC_LATENCY_SRC_CAN, &h);
+	CHECK(h.count == 100, "CAN count %u", (unsigned int)h.count);
+	CHECK(h.sum_us / h.count == 2050, "CAN average %u", (unsigned int)(h.sum_us / h.count));
+	CHECK(h.bins[11] == 100, "CAN latencies not in the 2048-4095 us bin");
+
+	mc_latency_get_hist(MC_LATENCY_SRC_LISP, &h);
+	CHECK(h.count == 0, "lisp got samples");
+}
+
+static void test_untagged(void) {
+	mc_latency_reset();
+
+	// Threads without tag do not record anything
+	test_thread_now = &m_other;
+	m_time_us = 1000;
+	set_setpoint();
+	control_isr();
+
+	// A context is released by mc_latency_end
+	test_thread_now = &m_usb;
+	set_setpoint();
+	control_isr();
+
+	for (int i = 0;i < MC_LATENCY_SRC_NUM;i++) {
+		mc_latency_hist h;
+		mc_latency_get_hist(i, &h);
+		CHECK(h.count == 0, "untagged setpoint recorded for %s", mc_latency_src_name(i));
+	}
+}
+
+static void test_thread_source(void) {
+	mc_latency_reset();
+
+	test_thread_now = &m_lisp;
+	mc_latency_set_thread_source(MC_LATENCY_SRC_LISP);
+
+	// The setpoint time is used without mc_latency_begin
+	m_time_us = 10000;
+	set_setpoint();
+	m_time_us = 10030;
+	control_isr();
+
+	// And the arrival time with it
+	mc_latency_begin(MC_LATENCY_SRC_LISP, 11000);
+	m_time_us = 11500;
+	set_setpoint();
+	mc_latency_end();
+	m_time_us = 11520;
+	control_isr();
+
+	// The thread keeps its source after mc_latency_end
+	m_time_us = 12000;
+	set_setpoint();
+	m_time_us = 12010;
+	control_isr();
+
+	mc_latency_hist h;
+	mc_latency_get_hist(MC_LATENCY_SRC_LISP, &h);
+	CHECK(h.count == 3, "lisp count %u", (unsigned int)h.count);
+	CHECK(h.max_us == 520, "lisp max %u", (unsigned int)h.max_us);
+	CHECK(h.sum_us == 560, "lisp sum %u", (unsigned int)h.sum_us);
+}
+
+static void test_overwrite(void) {
+	mc_latency_reset();
+
+	// Only the latest of two setpoints before the control loop runs counts
+	test_thread_now = &m_usb;
+	m_time_us = 20000;
+	mc_latency_begin(MC_LATENCY_SRC_USB, 19000);
+	set_setpoint();
+	mc_latency_end();
+
+	test_thread_now = &m_can;
+	mc_latency_begin(MC_LATENCY_SRC_CAN, 19900);
+	set_setpoint();
+	mc_latency_end();
+	control_isr();
+
+	mc_latency_hist h;
+	mc_latency_get_hist(MC_LATENCY_SRC_USB, &h);
+	CHECK(h.count == 0, "overwritten setpoint recorded");
+	mc_latency_get_hist(MC_LATENCY_SRC_CAN, &h);
+	CHECK(h.count == 1 && h.max_us == 100, "latest setpoint not recorded");
+}
+
+static void test_bins(void) {
+	mc_latency_reset();
+
+	mc_latency_add_us(MC_LATENCY_SRC_APP, 0);
+	mc_latency_add_us(MC_LATENCY_SRC_APP, 1);
+	mc_latency_add_us(MC_LATENCY_SRC_APP, 2);
+	mc_latency_add_us(MC_LATENCY_SRC_APP, 1000000);
+	mc_latency_add_us(MC_LATENCY_SRC_NUM, 10);
+
+	mc_latency_hist h;
+	mc_latency_get_hist(MC_LATENCY_SRC_APP, &h);
+	CHECK(h.bins[0] == 2, "bin 0: %u", (unsigned int)h.bins[0]);
+	CHECK(h.bins[1] == 1, "bin 1: %u", (unsigned int)h.bins[1]);
+	CHECK(h.bins[MC_LATENCY_BINS - 1] == 1, "long latency not in the last bin");
+	CHECK(mc_latency_percentile_us(&h, 0.5) == 4, "p50 %u", (unsigned int)mc_latency_percentile_us(&h, 0.5));
+	CHECK(mc_latency_percentile_us(&h, 1.0) == 1000000, "p100 %u", (unsigned int)mc_latency_percentile_us(&h, 1.0));
+}
+
+int main(void) {
+	test_sources();
+	test_untagged();
+	test_thread_source();
+	test_overwrite();
+	test_bins();
+
+	return test_check_result();
+}
@@ -0,0 +1,319 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/*
+ * Compares the override limits calculated from the precomputed ramps in
+ * mc_limits.c with the original calculation that used utils_map on every
+ * update, over random configurations and operating points.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "mc_limits.h"
+#include "utils_math.h"
+#include "test_check.h"
+
+static uint32_t m_seed = 1;
+
+static float rand_range(float min, float max) {
+	m_seed = m_seed * 1103515245 + 12345;
+	return min + (max - min) * (float)((m_seed >> 8) & 0xFFFF) / 65535.0;
+}
+
+// The calculation from update_override_limits before the derived values were introduced
+static void ref_calc(const mc_configuration *conf, float temp_fet, float temp_motor,
+		float rpm_now, float duty_now_abs, float v_in, mc_limits_result *res) {
+	float rpm_abs = fabsf(rpm_now);
+
+	res->fet_over_temp = false;
+	res->motor_over_temp = false;
+
+	const float l_current_min_tmp = conf->l_current_min * conf->l_current_min_scale;
+	const float l_current_max_tmp = conf->l_current_max * conf->l_current_max_scale;
+
+	float lo_min_mos = l_current_min_tmp;
+	float lo_max_mos = l_current_max_tmp;
+	if (temp_fet < (conf->l_temp_fet_start + 0.1)) {
+	} else if (temp_fet > (conf->l_temp_fet_end - 0.1)) {
+		lo_min_mos = 0.0;
+		lo_max_mos = 0.0;
+		res->fet_over_temp = true;
+	} else {
+		float maxc = fabsf(l_current_max_tmp);
+		if (fabsf(l_current_min_tmp) > maxc) {
+			maxc = fabsf(l_current_min_tmp);
+		}
+
+		maxc = utils_map(temp_fet, conf->l_temp_fet_start, conf->l_temp_fet_end, maxc, 0.0);
+
+		if (fabsf(l_current_min_tmp) > maxc) {
+			lo_min_mos = SIGN(l_current_min_tmp) * maxc;
+		}
+
+		if (fabsf(l_current_max_tmp) > maxc) {
+			lo_max_mos = SIGN(l_current_max_tmp) * maxc;
+		}
+	}
+
+	float lo_min_mot = l_current_min_tmp;
+	float lo_max_mot = l_current_max_tmp;
+	if (temp_motor < (conf->l_temp_motor_start + 0.1)) {
+	} else if (temp_motor > (conf->l_temp_motor_end - 0.1)) {
+		lo_min_mot = 0.0;
+		lo_max_mot = 0.0;
+		res->motor_over_temp = true;
+	} else {
+		float maxc = fabsf(l_current_max_tmp);
+		if (fabsf(l_current_min_tmp) > maxc) {
+			maxc = fabsf(l_current_min_tmp);
+		}
+
+		maxc = utils_map(temp_motor, conf->l_temp_motor_start, conf->l_temp_motor_end, maxc, 0.0);
+
+		if (fabsf(l_current_min_tmp) > maxc) {
+			lo_min_mot = SIGN(l_current_min_tmp) * maxc;
+		}
+
+		if (fabsf(l_current_max_tmp) > maxc) {
+			lo_max_mot = SIGN(l_current_max_tmp) * maxc;
+		}
+	}
+
+	const float temp_fet_accel_start = utils_map(conf->l_temp_accel_dec, 0.0, 1.0, conf->l_temp_fet_start, 25.0);
+	const float temp_fet_accel_end = utils_map(conf->l_temp_accel_dec, 0.0, 1.0, conf->l_temp_fet_end, 25.0);
+	const float temp_motor_accel_start = utils_map(conf->l_temp_accel_dec, 0.0, 1.0, conf->l_temp_motor_start, 25.0);
+	const float temp_motor_accel_end = utils_map(conf->l_temp_accel_dec, 0.0, 1.0, conf->l_temp_motor_end, 25.0);
+
+	float lo_fet_temp_accel = 0.0;
+	if (temp_fet < (temp_fet_accel_start + 0.1)) {
+		lo_fet_temp_accel = l_current_max_tmp;
+	} else if (temp_fet > (temp_fet_accel_end - 0.1)) {
+		lo_fet_temp_accel = 0.0;
+	} else {
+		lo_fet_temp_accel = utils_map(temp_fet, temp_fet_accel_start,
+				temp_fet_accel_end, l_current_max_tmp, 0.0);
+	}
+
+	float lo_motor_temp_accel = 0.0;
+	if (temp_motor < (temp_motor_accel_start + 0.1)) {
+		lo_motor_temp_accel = l_current_max_tmp;
+	} else if (temp_motor > (temp_motor_accel_end - 0.1)) {
+		lo_motor_temp_accel = 0.0;
+	} else {
+		lo_motor_temp_accel = utils_map(temp_motor, temp_motor_accel_start,
+				temp_motor_accel_end, l_current_max_tmp, 0.0);
+	}
+
+	float lo_max_rpm = 0.0;
+	const float rpm_pos_cut_start = conf->l_max_erpm * conf->l_erpm_start;
+	const float rpm_pos_cut_end = conf->l_max_erpm;
+	if (rpm_now < (rpm_pos_cut_start + 0.1)) {
+		lo_max_rpm = l_current_max_tmp;
+	} else if (rpm_now > (rpm_pos_cut_end - 0.1)) {
+		lo_max_rpm = 0.0;
+	} else {
+		lo_max_rpm = utils_map(rpm_now, rpm_pos_cut_start, rpm_pos_cut_end, l_current_max_tmp, 0.0);
+	}
+
+	float lo_min_rpm = 0.0;
+	const float rpm_neg_cut_start = conf->l_min_erpm * conf->l_erpm_start;
+	const float rpm_neg_cut_end = conf->l_min_erpm;
+	if (rpm_now > (rpm_neg_cut_start - 0.1)) {
+		lo_min_rpm = l_current_max_tmp;
+	} else if (rpm_now < (rpm_neg_cut_end + 0.1)) {
+		lo_min_rpm = 0.0;
+	} else {
+		lo_min_rpm = utils_map(rpm_now, rpm_neg_cut_start, rpm_neg_cut_end, l_current_max_tmp, 0.0);
+	}
+
+	float lo_max_curr_dec = l_current_max_tmp;
+	if (rpm_abs < conf->foc_start_curr_dec_rpm) {
+		lo_max_curr_dec = utils_map(rpm_abs, 0, conf->foc_start_curr_dec_rpm,
+				conf->foc_start_curr_dec * l_current_max_tmp, l_current_max_tmp);
+	}
+
+	float lo_max_duty = 0.0;
+	if (duty_now_abs < (conf->l_duty_start * conf->l_max_duty) || conf->l_duty_start > 0.99) {
+		lo_max_duty = l_current_max_tmp;
+	} else {
+		lo_max_duty = utils_map(duty_now_abs, (conf->l_duty_start * conf->l_max_duty),
+				conf->l_max_duty, l_current_max_tmp, conf->cc_min_current * 5.0);
+	}
+
+	float lo_max = utils_min_abs(lo_max_mos, lo_max_mot);
+	float lo_min = utils_min_abs(lo_min_mos, lo_min_mot);
+
+	lo_max = utils_min_abs(lo_max, lo_max_rpm);
+	lo_max = utils_min_abs(lo_max, lo_min_rpm);
+	lo_max = utils_min_abs(lo_max, lo_max_curr_dec);
+	lo_max = utils_min_abs(lo_max, lo_fet_temp_accel);
+	lo_max = utils_min_abs(lo_max, lo_motor_temp_accel);
+	lo_max = utils_min_abs(lo_max, lo_max_duty);
+
+	if (lo_max < conf->cc_min_current) {
+		lo_max = conf->cc_min_current;
+	}
+
+	if (lo_min > -conf->cc_min_current) {
+		lo_min = -conf->cc_min_current;
+	}
+
+	res->current_max = lo_max;
+	res->current_min = lo_min;
+
+	float lo_in_max_batt = 0.0;
+	if (v_in > (conf->l_battery_cut_start - 0.1)) {
+		lo_in_max_batt = conf->l_in_current_max;
+	} else if (v_in < (conf->l_battery_cut_end + 0.1)) {
+		lo_in_max_batt = 0.0;
+	} else {
+		lo_in_max_batt = utils_map(v_in, conf->l_battery_cut_start,
+				conf->l_battery_cut_end, conf->l_in_current_max, 0.0);
+	}
+
+	float lo_in_min_batt = 0.0;
+	if (v_in < (conf->l_battery_regen_cut_start + 0.1)) {
+		lo_in_min_batt = conf->l_in_current_min;
+	} else if (v_in > (conf->l_battery_regen_cut_end - 0.1)) {
+		lo_in_min_batt = 0.0;
+	} else {
+		lo_in_min_batt = utils_map(v_in, conf->l_battery_regen_cut_start,
+				conf->l_battery_regen_cut_end, conf->l_in_current_min, 0.0);
+	}
+
+	const float lo_in_max_watt = conf->l_watt_max / v_in;
+	const float lo_in_min_watt = conf->l_watt_min / v_in;
+
+	res->in_current_max = utils_min_abs(lo_in_max_watt, lo_in_max_batt);
+	res->in_current_min = utils_min_abs(lo_in_min_watt, lo_in_min_batt);
+}
+
+static void random_conf(mc_configuration *conf) {
+	memset(conf, 0, sizeof(*conf));
+	conf->l_current_max = rand_range(5.0, 200.0);
+	conf->l_current_min = -rand_range(5.0, 200.0);
+	conf->l_current_max_scale = rand_range(0.1, 1.0);
+	conf->l_current_min_scale = rand_range(0.1, 1.0);
+	conf->l_in_current_max = rand_range(5.0, 150.0);
+	conf->l_in_current_min = -rand_range(5.0, 150.0);
+	conf->l_max_erpm = rand_range(10000.0, 100000.0);
+	conf->l_min_erpm = -rand_range(10000.0, 100000.0);
+	conf->l_erpm_start = rand_range(0.5, 1.0);
+	conf->l_temp_fet_start = rand_range(60.0, 90.0);
+	conf->l_temp_fet_end = conf->l_temp_fet_start + rand_range(1.0, 30.0);
+	conf->l_temp_motor_start = rand_range(60.0, 110.0);
+	conf->l_temp_motor_end = conf->l_temp_motor_start + rand_range(1.0, 30.0);
+	conf->l_temp_accel_dec = rand_range(0.0, 1.0);
+	conf->foc_start_curr_dec = rand_range(0.0, 1.0);
+	conf->foc_start_curr_dec_rpm = rand_range(0.0, 3000.0);
+	conf->l_max_duty = rand_range(0.8, 0.95);
+	conf->l_duty_start = rand_range(0.5, 1.0);
+	conf->cc_min_current = rand_range(0.05, 0.5);
+	conf->l_battery_cut_end = rand_range(30.0, 40.0);
+	conf->l_battery_cut_start = conf->l_battery_cut_end + rand_range(1.0, 5.0);
+	conf->l_battery_regen_cut_start = rand_range(50.0, 55.0);
+	conf->l_battery_regen_cut_end = conf->l_battery_regen_cut_start + rand_range(1.0, 5.0);
+	conf->l_watt_max = rand_range(500.0, 5000.0);
+	conf->l_watt_min = -rand_range(500.0, 5000.0);
+}
+
+static bool nearly_equal(float a, float b) {
+	return fabsf(a - b) <= 1e-4 * fmaxf(1.0, fmaxf(fabsf(a), fabsf(b)));
+}
+
+static void compare(const mc_configuration *conf, const mc_limits_derived *d,
+		float temp_fet, float temp_motor, float rpm, float duty, float v_in) {
+	mc_limits_result r1, r2;
+	ref_calc(conf, temp_fet, temp_motor, rpm, duty, v_in, &r1);
+	mc_limits_calc(d, temp_fet, temp_motor, rpm, duty, v_in, &r2);
+
+	bool ok = nearly_equal(r1.current_max, r2.current_max) &&
+			nearly_equal(r1.current_min, r2.current_min) &&
+			nearly_equal(r1.in_current_max, r2.in_current_max) &&
+			nearly_equal(r1.in_current_min, r2.in_current_min) &&
+			r1.fet_over_temp == r2.fet_over_temp &&
+			r1.motor_over_temp == r2.motor_over_temp;
+
+	CHECK(ok, "mismatch at fet %.2f mot %.2f rpm %.1f duty %.3f v_in %.2f: "
+			"max %g/%g min %g/%g in_max %g/%g in_min %g/%g",
+			(double)temp_fet, (double)temp_motor, (double)rpm, (double)duty, (double)v_in,
+			(double)r1.current_max, (double)r2.current_max,
+			(double)r1.current_min, (double)r2.current_min,
+			(double)r1.in_current_max, (double)r2.in_current_max,
+			(double)r1.in_current_min, (double)r2.in_current_min);
+}
+
+int main(void) {
+	mc_configuration conf;
+	mc_limits_derived d;
+	int points = 0;
+
+	for (int c = 0;c < 200 && test_check_errors < 10;c++) {
+		random_conf(&conf);
+		mc_limits_update_derived(&d, &conf);
+
+		for (int i = 0;i < 2000 && test_check_errors < 10;i++) {
+			compare(&conf, &d,
+					rand_range(20.0, 130.0),
+					rand_range(20.0, 150.0),
+					rand_range(-110000.0, 110000.0),
+					rand_range(0.0, 0.95),
+					rand_range(25.0, 65.0));
+			points++;
+		}
+	}
+
+	// Changing the configuration needs a rebuild of the derived values
+	random_conf(&conf);
+	mc_limits_update_derived(&d, &conf);
+	conf.l_current_max *= 0.5;
+	mc_limits_result r1, r2;
+	ref_calc(&conf, 25.0, 25.0, 0.0, 0.0, 48.0, &r1);
+	mc_limits_calc(&d, 25.0, 25.0, 0.0, 0.0, 48.0, &r2);
+	CHECK(!nearly_equal(r1.current_max, r2.current_max), "derived values did not depend on the configuration");
+	mc_limits_update_derived(&d, &conf);
+	compare(&conf, &d, 25.0, 25.0, 0.0, 0.0, 48.0);
+
+	// Assist levels change the current scale in place, which takes effect once the
+	// derived values are rebuilt
+	conf.l_erpm_start = 1.0;
+	conf.foc_start_curr_dec = 1.0;
+	conf.l_max_duty = 0.95;
+	conf.l_duty_start = 1.0;
+	for (int level = 1;level <= 9;level++) {
+		conf.l_current_max_scale = (float)level / 9.0;
+		mc_limits_update_derived(&d, &conf);
+		mc_limits_calc(&d, 25.0, 25.0, 0.0, 0.0, 48.0, &r2);
+		CHECK(nearly_equal(r2.current_max, conf.l_current_max * conf.l_current_max_scale),
+				"level %d: current max %g", level, (double)r2.current_max);
+		compare(&conf, &d, 25.0, 25.0, 0.0, 0.0, 48.0);
+	}
+
+	// The fault flags must follow the temperatures
+	mc_limits_calc(&d, conf.l_temp_fet_end, 25.0, 0.0, 0.0, 48.0, &r2);
+	CHECK(r2.fet_over_temp && !r2.motor_over_temp, "FET over temperature not flagged");
+	mc_limits_calc(&d, 25.0, conf.l_temp_motor_end, 0.0, 0.0, 48.0, &r2);
+	CHECK(!r2.fet_over_temp && r2.motor_over_temp, "motor over temperature not flagged");
+
+	printf("Compared %d operating points\n", points);
+
+	return test_check_result();
+}
@@ -0,0 +1,149 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/*
+ * Runs the thermal model next to a reference motor with other thermal
+ * parameters. The reference is fed the copper losses of a burst load
+ * profile, with the resistance following its winding temperature like the
+ * FOC resistance observer does, and its winding temperature is measured
+ * with a noisy NTC. Checks that the model adapts to the reference, tracks
+ * it without the sensor afterwards and predicts when it reaches a limit.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "mc_thermal.h"
+#include "test_check.h"
+
+#define DT					0.001
+#define RES_BASE			0.05
+#define TEMP_BASE			25.0
+#define TEMP_START			22.0
+
+// Scales of the reference motor relative to the model defaults
+#define TRUE_SCALE_RES		1.7f
+#define TRUE_SCALE_CAP		0.6f
+
+static uint32_t m_seed = 1234;
+
+static float rand_f(void) {
+	m_seed = m_seed * 1103515245 + 12345;
+	return (float)((m_seed >> 8) & 0xFFFF) / 65535.0;
+}
+
+// Resistance as seen by the resistance observer of the reference
+static float res_est(const mc_thermal *ref) {
+	return ref->res_base * (1.0 + MC_THERMAL_TEMP_COEFF * (ref->temp_w - ref->temp_base));
+}
+
+// Bursts of high current with cruising in between
+static float profile_current(float t, float period, float peak) {
+	float phase = fmodf(t, period) / period;
+	if (phase < 0.15) {
+		return peak;
+	} else if (phase < 0.8) {
+		return peak * 0.3;
+	} else {
+		return 0.0;
+	}
+}
+
+static float run(mc_thermal *ref, mc_thermal *model, float time, float period, float peak, bool adapt) {
+	float err_max = 0.0;
+
+	long steps = (long)(time / DT);
+	for (long n = 0;n < steps;n++) {
+		float i = profile_current((float)n * DT, period, peak);
+		float i_sq = i * i;
+		float power = mc_thermal_losses(ref, i_sq, res_est(ref));
+
+		mc_thermal_update(ref, power, DT);
+		mc_thermal_update(model, mc_thermal_losses(model, i_sq, res_est(ref)), DT);
+
+		if (adapt) {
+			float ntc = ref->temp_w + (rand_f() - 0.5) * 0.6;
+			mc_thermal_adapt(model, ntc, DT);
+		}
+
+		float err = fabsf(model->temp_w - ref->temp_w);
+		if (err > err_max) {
+			err_max = err;
+		}
+	}
+
+	return err_max;
+}
+
+static float time_to_reach(mc_thermal *ref, float power, float limit) {
+	mc_thermal tmp = *ref;
+	for (long n = 0;n < (long)(3600.0 / DT);n++) {
+		mc_thermal_update(&tmp, power, DT);
+		if (tmp.temp_w >= limit) {
+			return (float)n * DT;
+		}
+	}
+	return 3600.0;
+}
+
+int main(void) {
+	mc_thermal ref, model, model_static;
+	mc_thermal_init(&ref, RES_BASE, TEMP_BASE, TEMP_START);
+	mc_thermal_init(&model, RES_BASE, TEMP_BASE, TEMP_START);
+	ref.scale_res = TRUE_SCALE_RES;
+	ref.scale_cap = TRUE_SCALE_CAP;
+
+	// Adapt during two hours of riding
+	run(&ref, &model, 7200.0, 120.0, 40.0, true);
+	printf("Reference winding %.1f degC\n", (double)ref.temp_w);
+	printf("Adapted scales: res %.3f (%.3f), cap %.3f (%.3f)\n",
+			(double)model.scale_res, TRUE_SCALE_RES, (double)model.scale_cap, TRUE_SCALE_CAP);
+	CHECK(fabsf(model.scale_res - TRUE_SCALE_RES) < 0.15 * TRUE_SCALE_RES, "resistance scale not adapted");
+	CHECK(fabsf(model.scale_cap - TRUE_SCALE_CAP) < 0.15 * TRUE_SCALE_CAP, "capacity scale not adapted");
+
+	// Track a different profile without the sensor, compared to the
+	// defaults that were never adapted
+	mc_thermal_init(&model_static, RES_BASE, TEMP_BASE, TEMP_START);
+	model_static.temp_w = model.temp_w = ref.temp_w;
+	model_static.temp_s = model.temp_s = ref.temp_s;
+	model_static.temp_h = model.temp_h = ref.temp_h;
+
+	mc_thermal ref_2 = ref;
+	float err_adapted = run(&ref, &model, 1200.0, 45.0, 50.0, false);
+	float err_static = run(&ref_2, &model_static, 1200.0, 45.0, 50.0, false);
+	printf("Open loop error: adapted %.2f K, defaults %.2f K\n", (double)err_adapted, (double)err_static);
+	CHECK(err_adapted < 3.0, "adapted model does not track the motor (%.2f K)", (double)err_adapted);
+	CHECK(err_adapted < err_static, "adaptation does not help");
+
+	// Time until the winding reaches the limit with a constant overload
+	float limit = ref.temp_w + 40.0;
+	float power = mc_thermal_losses(&ref, 80.0 * 80.0, res_est(&ref));
+	float ttl_true = time_to_reach(&ref, power, limit);
+	float ttl_pred = mc_thermal_time_to_limit(&model, power, limit, 3600.0);
+	printf("Time to limit at %.0f W: predicted %.1f s, actual %.1f s\n",
+			(double)power, (double)ttl_pred, (double)ttl_true);
+	CHECK(fabsf(ttl_pred - ttl_true) < 0.1 * ttl_true, "time to limit off");
+
+	CHECK(mc_thermal_time_to_limit(&model, power, model.temp_w - 1.0, 100.0) == 0.0, "already above the limit");
+	CHECK(mc_thermal_time_to_limit(&model, 0.0, model.temp_w + 100.0, 100.0) == 100.0, "limit reached without losses");
+
+	return test_check_result();
+}
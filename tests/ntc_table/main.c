@@ -0,0 +1,176 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/*
+ * Builds conversion tables from the sensor formulas used in the hwconf
+ * headers and compares every raw ADC value in the useful range with the
+ * analytic result.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include "ntc_table.h"
+#include "test_check.h"
+
+// Largest allowed difference from the formula in the range below. Close to
+// the rails, where one ADC count is a large step, the error may be up to two
+// counts.
+#define MAX_ERROR			0.1
+#define RANGE_MIN			-30.0
+#define RANGE_MAX			150.0
+
+typedef enum {
+	SENSOR_NTC_HIGH_SIDE = 0, // MOSFET NTC with the pull-down at the ADC
+	SENSOR_NTC_LOW_SIDE, // Motor NTC with the pull-up at the ADC
+	SENSOR_LM61,
+	SENSOR_CONSTANT,
+} sensor_type;
+
+typedef struct {
+	const char *name;
+	sensor_type type;
+	float res_base;
+	float beta;
+	float temp_base;
+	float pull;
+} sensor_t;
+
+static double now_s(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// The formulas as written in the hwconf headers
+static float sensor_temp(uint16_t adc, const void *arg) {
+	const sensor_t *s = arg;
+
+	switch (s->type) {
+	case SENSOR_NTC_HIGH_SIDE: {
+		float res = (4095.0 * s->pull) / adc - s->pull;
+		return (1.0 / ((logf(res / s->res_base) / s->beta) + (1.0 / (273.15 + s->temp_base))) - 273.15);
+	}
+
+	case SENSOR_NTC_LOW_SIDE: {
+		float res = s->pull / ((4095.0 / (float)adc) - 1.0);
+		return (1.0 / ((logf(res / s->res_base) / s->beta) + (1.0 / (273.15 + s->temp_base))) - 273.15);
+	}
+
+	case SENSOR_LM61:
+		return (((3.3 / 4095.0) * (float)adc) - 0.6) / 0.01;
+
+	case SENSOR_CONSTANT:
+		return 25.0;
+	}
+
+	return 0.0;
+}
+
+static void test_sensor(const sensor_t *s) {
+	ntc_table t;
+	bool valid = ntc_table_build(&t, sensor_temp, s);
+	CHECK(valid, "%s: table not valid", s->name);
+
+	float err_max = 0.0;
+	int checked = 0;
+
+	for (int adc = 0;adc <= 4095;adc++) {
+		float ref = sensor_temp(adc, s);
+		if (!isfinite(ref) || ref < RANGE_MIN || ref > RANGE_MAX) {
+			continue;
+		}
+
+		float step = fabsf(sensor_temp(adc < 4095 ? adc + 1 : adc - 1, s) - ref);
+		float err = fabsf(ntc_table_lookup(&t, adc) - ref);
+		CHECK(err <= fmaxf(MAX_ERROR, 2.0 * step), "%s: error %.3f °C at %d (%.3f °C per count)",
+				s->name, err, adc, step);
+
+		if (err > err_max) {
+			err_max = err;
+		}
+		checked++;
+	}
+
+	CHECK(checked > 100, "%s: only %d values in range", s->name, checked);
+	printf("%-24s %4d values, max error %.4f °C\n", s->name, checked, err_max);
+
+	// Out of range raw values must still give finite and ordered results
+	CHECK(isfinite(ntc_table_lookup(&t, 0)) && isfinite(ntc_table_lookup(&t, 4095)) &&
+			isfinite(ntc_table_lookup(&t, 5000)), "%s: not finite at the rails", s->name);
+}
+
+static void test_invalid(void) {
+	ntc_table t;
+	sensor_t constant = {"constant", SENSOR_CONSTANT, 0, 0, 0, 0};
+	CHECK(!ntc_table_build(&t, sensor_temp, &constant), "constant conversion accepted");
+	CHECK(!t.valid, "invalid table marked valid");
+
+	// Negative resistance on one end gives NaN
+	sensor_t broken = {"broken", SENSOR_NTC_LOW_SIDE, 10000, 3380, 25, -10000};
+	CHECK(!ntc_table_build(&t, sensor_temp, &broken), "NaN accepted");
+}
+
+static void bench(const sensor_t *s) {
+	ntc_table t;
+	ntc_table_build(&t, sensor_temp, s);
+
+	const int iterations = 2000000;
+	volatile float sink = 0.0;
+
+	double start = now_s();
+	for (int i = 0;i < iterations;i++) {
+		sink += sensor_temp(1000 + (i & 1023), s);
+	}
+	double t_formula = now_s() - start;
+
+	start = now_s();
+	for (int i = 0;i < iterations;i++) {
+		sink += ntc_table_lookup(&t, 1000 + (i & 1023));
+	}
+	double t_table = now_s() - start;
+
+	(void)sink;
+	printf("Formula: %.1f ns, table: %.1f ns per conversion\n",
+			t_formula / iterations * 1e9, t_table / iterations * 1e9);
+}
+
+int main(void) {
+	const sensor_t sensors[] = {
+			{"MOSFET 10k beta 3380", SENSOR_NTC_HIGH_SIDE, 10000, 3380, 25, 10000},
+			{"MOSFET 10k beta 3434", SENSOR_NTC_HIGH_SIDE, 10000, 3434, 25, 10000},
+			{"Motor 10k beta 3380", SENSOR_NTC_LOW_SIDE, 10000, 3380, 25, 10000},
+			{"Motor 10k beta 4500", SENSOR_NTC_LOW_SIDE, 10000, 4500, 25, 10000},
+			{"Motor 100k beta 4250", SENSOR_NTC_LOW_SIDE, 100000, 4250, 25, 10000},
+			{"Motor NTCX 47k at 20", SENSOR_NTC_LOW_SIDE, 47000, 3950, 20, 10000},
+			{"LM61", SENSOR_LM61, 0, 0, 0, 0},
+	};
+
+	for (unsigned int i = 0;i < sizeof(sensors) / sizeof(sensors[0]);i++) {
+		test_sensor(&sensors[i]);
+	}
+
+	test_invalid();
+	bench(&sensors[2]);
+
+	return test_check_result();
+}
@@ -0,0 +1,52 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef TESTS_TEST_CHECK_H_
+#define TESTS_TEST_CHECK_H_
+
+#include <stdio.h>
+
+/*
+ * Checks for the plain C host tests. A failed check prints where it failed
+ * and an optional printf style message, and the test continues so that all
+ * failures are shown. main ends with return test_check_result();
+ */
+
+static int test_check_errors = 0;
+
+#define CHECK(cond, ...) do { \
+	if (!(cond)) { \
+		printf("FAIL %s:%d: %s", __FILE__, __LINE__, #cond); \
+		printf(" " __VA_ARGS__); \
+		printf("\n"); \
+		test_check_errors++; \
+	} \
+} while (0)
+
+static inline int test_check_result(void) {
+	if (test_check_errors) {
+		printf("%d check(s) failed\n", test_check_errors);
+		return 1;
+	}
+
+	printf("All checks passed\n");
+	return 0;
+}
+
+#endif /* TESTS_TEST_CHECK_H_ */
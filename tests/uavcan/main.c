@@ -0,0 +1,411 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/*
+ * Runs libcanard nodes against a virtual CAN bus to check the lookup tables,
+ * the publish scheduler and the pool sizing used by canard_driver.c, and
+ * measures how many frames per second the stack handles for an ESC status
+ * and command load like the one of a drone with 8 ESCs.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "canard.h"
+#include "canard_hash.h"
+#include "canard_sched.h"
+#include "uavcan/equipment/esc/Status.h"
+#include "uavcan/equipment/esc/RawCommand.h"
+#include "uavcan/protocol/GetNodeInfo.h"
+#include "uavcan/protocol/param/GetSet.h"
+#include "uavcan/protocol/file/Read.h"
+#include "vesc/RTData.h"
+#include "test_check.h"
+
+#define BUS_SIZE			4096
+#define NODES				8
+#define BENCH_ROUNDS		20000
+#define STATUS_MSGS_TO_STORE	10
+#define CAN_APP_NODE_NAME	"org.vesc.60_MK6_MAX"
+
+// Same sizing as in canard_driver.c
+#define TX_FRAMES(size)		(((size) + 2 + 6) / 7)
+#define RX_BLOCKS(size)		(1 + ((size) + CANARD_BUFFER_BLOCK_DATA_SIZE - 1) / CANARD_BUFFER_BLOCK_DATA_SIZE)
+#define NODE_INFO_SIZE		(UAVCAN_PROTOCOL_GETNODEINFO_RESPONSE_MAX_SIZE - \
+							UAVCAN_PROTOCOL_HARDWAREVERSION_CERTIFICATE_OF_AUTHENTICITY_MAX_LENGTH - \
+							UAVCAN_PROTOCOL_GETNODEINFO_RESPONSE_NAME_MAX_LENGTH + \
+							sizeof(CAN_APP_NODE_NAME))
+
+#define POOL_BLOCKS_TX		(TX_FRAMES(NODE_INFO_SIZE) + \
+							TX_FRAMES(UAVCAN_PROTOCOL_NODESTATUS_MAX_SIZE) + \
+							TX_FRAMES(UAVCAN_EQUIPMENT_ESC_STATUS_MAX_SIZE) + \
+							TX_FRAMES(VESC_RTDATA_MAX_SIZE))
+#define POOL_BLOCKS_RX		(STATUS_MSGS_TO_STORE * RX_BLOCKS(UAVCAN_EQUIPMENT_ESC_STATUS_MAX_SIZE) + \
+							RX_BLOCKS(UAVCAN_EQUIPMENT_ESC_RAWCOMMAND_MAX_SIZE) + \
+							RX_BLOCKS(UAVCAN_PROTOCOL_PARAM_GETSET_REQUEST_MAX_SIZE) + \
+							RX_BLOCKS(UAVCAN_PROTOCOL_FILE_READ_RESPONSE_MAX_SIZE))
+#define POOL_BLOCKS			(POOL_BLOCKS_TX + POOL_BLOCKS_RX)
+
+typedef struct {
+	CanardInstance ins;
+	CanardPoolAllocatorBlock pool[POOL_BLOCKS];
+	uint8_t transfer_id;
+	int status_rx;
+	int cmd_rx;
+	uint16_t last_payload_len;
+	uavcan_equipment_esc_Status last_status;
+} node_t;
+
+static CanardCANFrame bus[BUS_SIZE];
+static int bus_len = 0;
+static uint64_t bus_frames = 0;
+static node_t nodes[NODES];
+
+static double time_s(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
+
+static bool should_accept(const CanardInstance* ins, uint64_t* out_data_type_signature,
+		uint16_t data_type_id, CanardTransferType transfer_type, uint8_t source_node_id) {
+	(void)ins; (void)source_node_id;
+
+	if (transfer_type != CanardTransferTypeBroadcast) {
+		if (data_type_id == UAVCAN_PROTOCOL_GETNODEINFO_ID) {
+			*out_data_type_signature = UAVCAN_PROTOCOL_GETNODEINFO_SIGNATURE;
+			return true;
+		}
+		return false;
+	}
+
+	switch (data_type_id) {
+	case UAVCAN_EQUIPMENT_ESC_STATUS_ID:
+		*out_data_type_signature = UAVCAN_EQUIPMENT_ESC_STATUS_SIGNATURE;
+		return true;
+	case UAVCAN_EQUIPMENT_ESC_RAWCOMMAND_ID:
+		*out_data_type_signature = UAVCAN_EQUIPMENT_ESC_RAWCOMMAND_SIGNATURE;
+		return true;
+	default:
+		return false;
+	}
+}
+
+static void on_transfer(CanardInstance* ins, CanardRxTransfer* transfer) {
+	node_t *n = (node_t*)canardGetUserReference(ins);
+	n->last_payload_len = transfer->payload_len;
+
+	if (transfer->data_type_id == UAVCAN_EQUIPMENT_ESC_STATUS_ID) {
+		uavcan_equipment_esc_Status_decode_internal(transfer, transfer->payload_len, &n->last_status, 0, 0);
+		n->status_rx++;
+	} else if (transfer->data_type_id == UAVCAN_EQUIPMENT_ESC_RAWCOMMAND_ID) {
+		n->cmd_rx++;
+	}
+}
+
+static void nodes_init(int pool_blocks) {
+	memset(nodes, 0, sizeof(nodes));
+	for (int i = 0;i < NODES;i++) {
+		canardInit(&nodes[i].ins, nodes[i].pool, pool_blocks * sizeof(CanardPoolAllocatorBlock),
+				on_transfer, should_accept, &nodes[i]);
+		canardSetLocalNodeID(&nodes[i].ins, i + 1);
+	}
+	bus_len = 0;
+}
+
+// Move the TX queue of a node to the bus
+static void node_flush(node_t *n) {
+	for (const CanardCANFrame* txf = NULL; (txf = canardPeekTxQueue(&n->ins)) != NULL;) {
+		if (bus_len < BUS_SIZE) {
+			bus[bus_len++] = *txf;
+		}
+		canardPopTxQueue(&n->ins);
+	}
+}
+
+static int frame_source(const CanardCANFrame *frame) {
+	return (int)(frame->id & 0x7F);
+}
+
+// Deliver the frames on the bus to every node except the sender
+static void bus_deliver(uint64_t timestamp) {
+	for (int f = 0;f < bus_len;f++) {
+		for (int i = 0;i < NODES;i++) {
+			if (frame_source(&bus[f]) != i + 1) {
+				canardHandleRxFrame(&nodes[i].ins, &bus[f], timestamp);
+			}
+		}
+	}
+	bus_frames += bus_len;
+	bus_len = 0;
+}
+
+static void broadcast_status(node_t *n, int index) {
+	uavcan_equipment_esc_Status status;
+	memset(&status, 0, sizeof(status));
+	status.voltage = 48.0;
+	status.current = 12.5;
+	status.temperature = 300.0;
+	status.rpm = 1000 * (index + 1);
+	status.esc_index = index;
+
+	uint8_t buf[UAVCAN_EQUIPMENT_ESC_STATUS_MAX_SIZE];
+	uavcan_equipment_esc_Status_encode(&status, buf);
+	canardBroadcast(&n->ins, UAVCAN_EQUIPMENT_ESC_STATUS_SIGNATURE, UAVCAN_EQUIPMENT_ESC_STATUS_ID,
+			&n->transfer_id, CANARD_TRANSFER_PRIORITY_LOW, buf, UAVCAN_EQUIPMENT_ESC_STATUS_MAX_SIZE);
+}
+
+static void broadcast_cmd(node_t *n) {
+	uavcan_equipment_esc_RawCommand cmd;
+	int16_t data[NODES];
+	for (int i = 0;i < NODES;i++) {
+		data[i] = 1000 * i;
+	}
+	cmd.cmd.len = NODES;
+	cmd.cmd.data = data;
+
+	uint8_t buf[UAVCAN_EQUIPMENT_ESC_RAWCOMMAND_MAX_SIZE];
+	uint32_t len = uavcan_equipment_esc_RawCommand_encode(&cmd, buf);
+	canardBroadcast(&n->ins, UAVCAN_EQUIPMENT_ESC_RAWCOMMAND_SIGNATURE, UAVCAN_EQUIPMENT_ESC_RAWCOMMAND_ID,
+			&n->transfer_id, CANARD_TRANSFER_PRIORITY_HIGH, buf, len);
+}
+
+static void test_hash(void) {
+	canard_hash_t h;
+	canard_hash_init(&h);
+
+	// Same keys as the transfer handler table in canard_driver.c
+	const uint32_t keys[] = {
+			UAVCAN_PROTOCOL_GETNODEINFO_ID | 0x10000,
+			UAVCAN_EQUIPMENT_ESC_RAWCOMMAND_ID,
+			1031, 1034, 5 | 0x10000, 11 | 0x10000, 40 | 0x10000, 48 | 0x10000
+	};
+	const int num = sizeof(keys) / sizeof(keys[0]);
+
+	for (int i = 0;i < num;i++) {
+		CHECK(canard_hash_insert(&h, keys[i], i));
+	}
+	for (int i = 0;i < num;i++) {
+		CHECK(canard_hash_find(&h, keys[i]) == i);
+	}
+
+	CHECK(canard_hash_find(&h, UAVCAN_PROTOCOL_GETNODEINFO_ID) == -1);
+	CHECK(canard_hash_find(&h, 1033) == -1);
+	CHECK(!canard_hash_insert(&h, keys[0], 9));
+
+	// Fill the table completely, lookups of missing keys must still terminate
+	for (int i = num;i < CANARD_HASH_SLOTS;i++) {
+		CHECK(canard_hash_insert(&h, 0x20000 + i, i));
+	}
+	CHECK(!canard_hash_insert(&h, 0x30000, 1));
+	CHECK(canard_hash_find(&h, 0x30000) == -1);
+	CHECK(canard_hash_find(&h, 0x20000 + CANARD_HASH_SLOTS - 1) == CANARD_HASH_SLOTS - 1);
+
+	// Parameter names from canard_driver.c
+	const char *names[] = {"can_baud_rate", "can_status_rate_1", "can_status_rate_2", "can_status_msgs_r1",
+			"can_status_msgs_r2", "can_esc_index", "controller_id", "ctl_dir"};
+	canard_hash_init(&h);
+	for (int i = 0;i < 8;i++) {
+		CHECK(canard_hash_insert(&h, canard_hash_str(names[i]), i));
+	}
+	for (int i = 0;i < 8;i++) {
+		CHECK(canard_hash_find(&h, canard_hash_str(names[i])) == i);
+	}
+	CHECK(canard_hash_find(&h, canard_hash_str("ctl_dirx")) == -1);
+}
+
+static void test_sched(void) {
+	canard_sched_slot_t slots[3];
+	memset(slots, 0, sizeof(slots));
+
+	// Start close to the wrap-around of the tick counter. Slot 0 is due 3
+	// ticks after every second publish of slot 1.
+	uint32_t now = 0xFFFFFF00;
+	canard_sched_set_period(&slots[0], 100, now + 3);
+	canard_sched_set_period(&slots[1], 50, now);
+	canard_sched_set_period(&slots[2], 0, now);
+
+	int count[3] = {0, 0, 0};
+	int together = 0;
+	for (int i = 0;i < 3000;i++) {
+		uint32_t mask = canard_sched_poll(slots, 3, now, 5);
+		for (int j = 0;j < 3;j++) {
+			if (mask & (1u << j)) {
+				count[j]++;
+			}
+		}
+		if (mask == 3) {
+			together++;
+		}
+		now++;
+	}
+
+	// No drift and the disabled slot never runs
+	CHECK(count[0] == 29);
+	CHECK(count[1] == 59);
+	CHECK(count[2] == 0);
+
+	// Slot 0 is always taken together with slot 1 as it is due within the slack
+	CHECK(together == 29);
+
+	// Setting the same period again does not restart the slot
+	uint32_t next = slots[1].next;
+	canard_sched_set_period(&slots[1], 50, now);
+	CHECK(slots[1].next == next);
+
+	// A long stall gives one publish, not a burst of catch-up publishes
+	now += 1000;
+	CHECK(canard_sched_poll(slots, 3, now, 0) & 2);
+	CHECK(!(canard_sched_poll(slots, 3, now + 1, 0) & 2));
+}
+
+static void test_bus(void) {
+	nodes_init(POOL_BLOCKS);
+
+	for (int i = 0;i < NODES;i++) {
+		broadcast_status(&nodes[i], i);
+		node_flush(&nodes[i]);
+	}
+	bus_deliver(1000);
+
+	for (int i = 0;i < NODES;i++) {
+		// Every node receives the status of all other nodes
+		CHECK(nodes[i].status_rx == NODES - 1);
+
+		// The RX state of every source is kept until it has been unused for a while
+		CHECK(canardGetPoolAllocatorStatistics(&nodes[i].ins).current_usage_blocks == NODES - 1);
+		canardCleanupStaleTransfers(&nodes[i].ins, 1000 + 3 * CANARD_RECOMMENDED_STALE_TRANSFER_CLEANUP_INTERVAL_USEC);
+		CHECK(canardGetPoolAllocatorStatistics(&nodes[i].ins).current_usage_blocks == 0);
+	}
+	CHECK(nodes[0].last_status.esc_index == NODES - 1);
+	CHECK(nodes[0].last_status.rpm == 1000 * NODES);
+}
+
+/*
+ * Fill the pool of node 1 as it would be under full load: a status transfer
+ * from every other ESC and a command are received up to their last frame,
+ * and then a GetNodeInfo response and a publish burst are queued.
+ */
+static void test_pool(void) {
+	nodes_init(POOL_BLOCKS);
+
+	broadcast_cmd(&nodes[1]);
+	node_flush(&nodes[1]);
+	for (int i = 2;i < NODES;i++) {
+		broadcast_status(&nodes[i], i);
+		node_flush(&nodes[i]);
+	}
+
+	for (int f = 0;f < bus_len;f++) {
+		bool last = f == bus_len - 1 || frame_source(&bus[f + 1]) != frame_source(&bus[f]);
+		if (!last) {
+			canardHandleRxFrame(&nodes[0].ins, &bus[f], 1000);
+		}
+	}
+	bus_len = 0;
+
+	static uint8_t buf[512];
+	memset(buf, 0, sizeof(buf));
+	uint8_t tid = 0;
+	bool ok = true;
+
+	ok = ok && canardRequestOrRespond(&nodes[0].ins, 2, UAVCAN_PROTOCOL_GETNODEINFO_SIGNATURE,
+			UAVCAN_PROTOCOL_GETNODEINFO_ID, &tid, CANARD_TRANSFER_PRIORITY_LOW, CanardResponse,
+			buf, NODE_INFO_SIZE) > 0;
+	ok = ok && canardBroadcast(&nodes[0].ins, UAVCAN_PROTOCOL_NODESTATUS_SIGNATURE, UAVCAN_PROTOCOL_NODESTATUS_ID,
+			&tid, CANARD_TRANSFER_PRIORITY_LOW, buf, UAVCAN_PROTOCOL_NODESTATUS_MAX_SIZE) > 0;
+	ok = ok && canardBroadcast(&nodes[0].ins, UAVCAN_EQUIPMENT_ESC_STATUS_SIGNATURE, UAVCAN_EQUIPMENT_ESC_STATUS_ID,
+			&tid, CANARD_TRANSFER_PRIORITY_LOW, buf, UAVCAN_EQUIPMENT_ESC_STATUS_MAX_SIZE) > 0;
+	ok = ok && canardBroadcast(&nodes[0].ins, VESC_RTDATA_SIGNATURE, VESC_RTDATA_ID,
+			&tid, CANARD_TRANSFER_PRIORITY_LOW, buf, VESC_RTDATA_MAX_SIZE) > 0;
+
+	CHECK(ok);
+	printf("Pool of %d blocks of %d bytes: peak usage %d blocks under full load\n", (int)POOL_BLOCKS,
+			(int)CANARD_MEM_BLOCK_SIZE, canardGetPoolAllocatorStatistics(&nodes[0].ins).peak_usage_blocks);
+}
+
+/*
+ * Node 1 is the flight controller that sends raw commands, nodes 2 to 8 are
+ * ESCs that publish their status. Only the RX side of node 2 is timed, as that
+ * is the load one ESC sees on the bus.
+ */
+static void bench(void) {
+	nodes_init(POOL_BLOCKS);
+	bus_frames = 0;
+
+	double t_rx = 0.0;
+	uint64_t rx_frames = 0;
+	uint64_t handled = 0;
+	double t_start = time_s();
+
+	for (int r = 0;r < BENCH_ROUNDS;r++) {
+		broadcast_cmd(&nodes[0]);
+		node_flush(&nodes[0]);
+		for (int i = 1;i < NODES;i++) {
+			broadcast_status(&nodes[i], i);
+			node_flush(&nodes[i]);
+		}
+
+		uint64_t timestamp = (uint64_t)(r + 1) * 2500;
+		double t0 = time_s();
+		for (int f = 0;f < bus_len;f++) {
+			if (frame_source(&bus[f]) != 2) {
+				canardHandleRxFrame(&nodes[1].ins, &bus[f], timestamp);
+				rx_frames++;
+			}
+		}
+		t_rx += time_s() - t0;
+
+		for (int f = 0;f < bus_len;f++) {
+			for (int i = 0;i < NODES;i++) {
+				if (i != 1 && frame_source(&bus[f]) != i + 1) {
+					canardHandleRxFrame(&nodes[i].ins, &bus[f], timestamp);
+					handled++;
+				}
+			}
+		}
+		bus_frames += bus_len;
+		bus_len = 0;
+	}
+
+	double t_total = time_s() - t_start;
+
+	CHECK(nodes[1].cmd_rx == BENCH_ROUNDS);
+	CHECK(nodes[1].status_rx == BENCH_ROUNDS * (NODES - 2));
+
+	handled += rx_frames;
+	printf("Bus: %llu frames, %.0f frames/s received over all %d nodes including encoding\n",
+			(unsigned long long)bus_frames, (double)handled / t_total, NODES);
+	printf("RX of one ESC: %.0f frames/s, %.3f us per frame, peak pool usage %d blocks\n",
+			(double)rx_frames / t_rx, t_rx / (double)rx_frames * 1e6,
+			canardGetPoolAllocatorStatistics(&nodes[1].ins).peak_usage_blocks);
+}
+
+int main(void) {
+	test_hash();
+	test_sched();
+	test_bus();
+	test_pool();
+	bench();
+
+	return test_check_result();
+}
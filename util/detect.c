@@ -0,0 +1,148 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "detect.h"
+#include <math.h>
+
+/**
+ * Reset a running average.
+ *
+ * @param min_samples
+ * Never report convergence before this many samples, so that slow
+ * disturbances such as cogging over a revolution are averaged out.
+ *
+ * @param rel_tol
+ * Converged when the standard error of the mean is below this fraction
+ * of the mean.
+ */
+void detect_avg_init(detect_avg *a, int min_samples, float rel_tol) {
+	a->n = 0;
+	a->min_samples = min_samples;
+	a->rel_tol = rel_tol;
+	a->mean = 0.0;
+	a->m2 = 0.0;
+}
+
+/**
+ * Add a sample. Uses Welford's method, which stays accurate in single
+ * precision over tens of thousands of samples.
+ */
+void detect_avg_add(detect_avg *a, float x) {
+	a->n++;
+	float delta = x - a->mean;
+	a->mean += delta / (float)a->n;
+	a->m2 += delta * (x - a->mean);
+}
+
+float detect_avg_mean(const detect_avg *a) {
+	return a->mean;
+}
+
+/**
+ * Standard error of the mean, assuming independent samples.
+ */
+float detect_avg_std_err(const detect_avg *a) {
+	if (a->n < 2) {
+		return INFINITY;
+	}
+
+	float var = a->m2 / (float)(a->n - 1);
+	return sqrtf(var / (float)a->n);
+}
+
+bool detect_avg_converged(const detect_avg *a) {
+	if (a->n < a->min_samples || a->n < 2) {
+		return false;
+	}
+
+	return detect_avg_std_err(a) <= a->rel_tol * fabsf(a->mean);
+}
+
+void detect_nodes_init(detect_nodes *d) {
+	d->num = 0;
+	d->done_num = 0;
+	d->failed_num = 0;
+}
+
+/**
+ * Add a node that detection was started on.
+ *
+ * @return
+ * false if the table is full.
+ */
+bool detect_nodes_add(detect_nodes *d, uint8_t id) {
+	if (d->num >= DETECT_NODES_MAX) {
+		return false;
+	}
+
+	detect_node *n = &d->nodes[d->num++];
+	n->id = id;
+	n->done = false;
+	n->res = 0;
+
+	return true;
+}
+
+/**
+ * Record the result from a node.
+ *
+ * @param id
+ * ID of the node that sent the result, or -1 if it is unknown, as older
+ * firmwares do not include it. Then the first pending node is used, which
+ * gives the right count but not necessarily the right ID.
+ *
+ * @param res
+ * Detection result from the node, negative values are failures.
+ *
+ * @return
+ * Index of the node, or -1 if no pending node matches.
+ */
+int detect_nodes_report(detect_nodes *d, int id, int res) {
+	int ind = -1;
+
+	for (int i = 0;i < d->num;i++) {
+		if (!d->nodes[i].done && (id < 0 || d->nodes[i].id == id)) {
+			ind = i;
+			break;
+		}
+	}
+
+	if (ind < 0) {
+		return -1;
+	}
+
+	d->nodes[ind].done = true;
+	d->nodes[ind].res = res;
+	d->done_num++;
+
+	if (res < 0) {
+		d->failed_num++;
+	}
+
+	return ind;
+}
+
+/**
+ * @return
+ * true when all nodes have reported or when one has failed, as the
+ * outcome is known then.
+ */
+bool detect_nodes_finished(const detect_nodes *d) {
+	return d->done_num >= d->num || d->failed_num > 0;
+}
@@ -0,0 +1,71 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef DETECT_H_
+#define DETECT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Settings
+#define DETECT_NODES_MAX		64
+
+/*
+ * Running average that tells when more samples no longer improve it, so
+ * that fixed-length measurement loops can stop once the estimate has
+ * settled instead of always running to the end.
+ */
+typedef struct {
+	int n;
+	int min_samples;
+	float rel_tol;
+	float mean;
+	float m2;
+} detect_avg;
+
+/*
+ * Detection state of the controllers on the CAN-bus that detection was
+ * started on.
+ */
+typedef struct {
+	uint8_t id;
+	bool done;
+	int res;
+} detect_node;
+
+typedef struct {
+	detect_node nodes[DETECT_NODES_MAX];
+	int num;
+	int done_num;
+	int failed_num;
+} detect_nodes;
+
+// Functions
+void detect_avg_init(detect_avg *a, int min_samples, float rel_tol);
+void detect_avg_add(detect_avg *a, float x);
+float detect_avg_mean(const detect_avg *a);
+float detect_avg_std_err(const detect_avg *a);
+bool detect_avg_converged(const detect_avg *a);
+
+void detect_nodes_init(detect_nodes *d);
+bool detect_nodes_add(detect_nodes *d, uint8_t id);
+int detect_nodes_report(detect_nodes *d, int id, int res);
+bool detect_nodes_finished(const detect_nodes *d);
+
+#endif /* DETECT_H_ */
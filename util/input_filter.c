@@ -0,0 +1,117 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/*
+ * Shared processing stages for throttle inputs (PPM, ADC, PAS). Every
+ * stage only depends on the input and the time since the previous call,
+ * so the apps can run them as soon as a new input is available.
+ */
+
+#include "input_filter.h"
+#include "utils_math.h"
+#include <math.h>
+
+void input_filter_configure(input_filter *f, float hyst,
+		float throttle_exp, float throttle_exp_brake, int throttle_exp_mode,
+		float ramp_time_pos, float ramp_time_neg) {
+	f->hyst = hyst;
+	f->throttle_exp = throttle_exp;
+	f->throttle_exp_brake = throttle_exp_brake;
+	f->throttle_exp_mode = throttle_exp_mode;
+	f->ramp_time_pos = ramp_time_pos;
+	f->ramp_time_neg = ramp_time_neg;
+}
+
+void input_filter_reset(input_filter *f, float val) {
+	f->ramp = val;
+}
+
+/**
+ * Apply the deadband and the throttle curve.
+ *
+ * @param val
+ * Input in the range -1.0 to 1.0.
+ *
+ * @return
+ * The shaped input.
+ */
+float input_filter_curve(const input_filter *f, float val) {
+	utils_deadband(&val, f->hyst, 1.0);
+	return utils_throttle_curve(val, f->throttle_exp, f->throttle_exp_brake, f->throttle_exp_mode);
+}
+
+/**
+ * Move towards val with the ramp time for increasing or decreasing
+ * magnitude. A ramp time below 10 ms passes val through, and the ramp
+ * continues from there so that enabling the ramp in only one direction
+ * does not jump back to an old value.
+ *
+ * @param val
+ * Target value.
+ *
+ * @param dt
+ * Time since the previous call in seconds.
+ *
+ * @return
+ * The ramped value.
+ */
+float input_filter_ramp(input_filter *f, float val, float dt) {
+	float ramp_time = fabsf(val) > fabsf(f->ramp) ? f->ramp_time_pos : f->ramp_time_neg;
+
+	if (ramp_time > 0.01) {
+		utils_step_towards(&f->ramp, val, dt / ramp_time);
+	} else {
+		f->ramp = val;
+	}
+
+	return f->ramp;
+}
+
+/**
+ * Run all stages.
+ */
+float input_filter_run(input_filter *f, float val, float dt) {
+	return input_filter_ramp(f, input_filter_curve(f, val), dt);
+}
+
+void input_latency_reset(input_latency *l) {
+	l->last = 0.0;
+	l->avg = 0.0;
+	l->max = 0.0;
+	l->samples = 0;
+}
+
+/**
+ * Add the time from capturing an input until the output was updated.
+ */
+void input_latency_add(input_latency *l, float seconds) {
+	l->last = seconds;
+
+	if (l->samples == 0) {
+		l->avg = seconds;
+	} else {
+		UTILS_LP_FAST(l->avg, seconds, 0.01);
+	}
+
+	if (seconds > l->max) {
+		l->max = seconds;
+	}
+
+	l->samples++;
+}
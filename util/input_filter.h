@@ -0,0 +1,56 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef INPUT_FILTER_H_
+#define INPUT_FILTER_H_
+
+#include <stdint.h>
+
+typedef struct {
+	// Settings
+	float hyst;
+	float throttle_exp;
+	float throttle_exp_brake;
+	int throttle_exp_mode;
+	float ramp_time_pos;
+	float ramp_time_neg;
+
+	// State
+	float ramp;
+} input_filter;
+
+typedef struct {
+	float last;
+	float avg;
+	float max;
+	uint32_t samples;
+} input_latency;
+
+// Functions
+void input_filter_configure(input_filter *f, float hyst,
+		float throttle_exp, float throttle_exp_brake, int throttle_exp_mode,
+		float ramp_time_pos, float ramp_time_neg);
+void input_filter_reset(input_filter *f, float val);
+float input_filter_curve(const input_filter *f, float val);
+float input_filter_ramp(input_filter *f, float val, float dt);
+float input_filter_run(input_filter *f, float val, float dt);
+void input_latency_reset(input_latency *l);
+void input_latency_add(input_latency *l, float seconds);
+
+#endif /* INPUT_FILTER_H_ */
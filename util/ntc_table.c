@@ -0,0 +1,80 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "ntc_table.h"
+#include <math.h>
+
+/**
+ * Fill a table by evaluating a conversion function at every table point.
+ * The ends are evaluated one count inside the ADC range, as most formulas
+ * divide by zero on the rails.
+ *
+ * @param func
+ * Conversion from raw ADC value to temperature.
+ *
+ * @param arg
+ * Passed to func.
+ *
+ * @return
+ * true if the result is finite and strictly monotonic, so that it can
+ * replace the function. Otherwise the table is marked invalid, which
+ * happens e.g. when the conversion does not depend on the given value.
+ */
+bool ntc_table_build(ntc_table *t, ntc_table_func func, const void *arg) {
+	bool valid = true;
+	int dir = 0;
+
+	for (int i = 0;i < NTC_TABLE_POINTS;i++) {
+		int adc = i << NTC_TABLE_SHIFT;
+		if (adc < 1) {
+			adc = 1;
+		} else if (adc > NTC_TABLE_ADC_MAX - 1) {
+			adc = NTC_TABLE_ADC_MAX - 1;
+		}
+
+		t->temp[i] = func(adc, arg);
+
+		if (!isfinite(t->temp[i])) {
+			valid = false;
+		} else if (i > 0 && valid) {
+			float diff = t->temp[i] - t->temp[i - 1];
+			int dir_now = diff > 0.0 ? 1 : (diff < 0.0 ? -1 : 0);
+
+			if (dir_now == 0 || (dir != 0 && dir_now != dir)) {
+				valid = false;
+			}
+
+			dir = dir_now;
+		}
+	}
+
+	t->valid = valid;
+	return valid;
+}
+
+float ntc_table_lookup(const ntc_table *t, uint16_t adc) {
+	if (adc > NTC_TABLE_ADC_MAX) {
+		adc = NTC_TABLE_ADC_MAX;
+	}
+
+	const int ind = adc >> NTC_TABLE_SHIFT;
+	const float frac = (float)(adc & ((1 << NTC_TABLE_SHIFT) - 1)) * (1.0 / (float)(1 << NTC_TABLE_SHIFT));
+
+	return t->temp[ind] + (t->temp[ind + 1] - t->temp[ind]) * frac;
+}
@@ -0,0 +1,48 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef NTC_TABLE_H_
+#define NTC_TABLE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Settings
+#define NTC_TABLE_ADC_MAX		4095
+#define NTC_TABLE_SHIFT			4 // Raw ADC counts between table points is 1 << NTC_TABLE_SHIFT
+#define NTC_TABLE_POINTS		((4096 >> NTC_TABLE_SHIFT) + 1)
+
+/*
+ * Temperature at evenly spaced 12-bit ADC values, interpolated linearly
+ * between the points. Built from the conversion formula when the
+ * configuration changes, so that periodic reads need no logf.
+ */
+typedef struct {
+	float temp[NTC_TABLE_POINTS];
+	bool valid;
+} ntc_table;
+
+// Converts one raw ADC value to a temperature
+typedef float (*ntc_table_func)(uint16_t adc, const void *arg);
+
+// Functions
+bool ntc_table_build(ntc_table *t, ntc_table_func func, const void *arg);
+float ntc_table_lookup(const ntc_table *t, uint16_t adc);
+
+#endif /* NTC_TABLE_H_ */
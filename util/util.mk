@@ -1,7 +1,10 @@
 CSRC += \
 	util/buffer.c \
 	util/crc.c \
+	util/detect.c \
 	util/digital_filter.c \
+	util/input_filter.c \
+	util/ntc_table.c \
 	util/mempools.c \
 	util/utils_math.c \
 	util/utils_sys.c \